@@ -0,0 +1,579 @@
+#include "mock_runtime.hpp"
+#include "screenshot.hpp"
+#include "keybind_dispatch.hpp"
+#include "keybind_display.hpp"
+#include "ini_file.hpp"
+#include "pixel_pack.hpp"
+#include "png_encode.hpp"
+#include "image_encode.hpp"
+#include "content_hash.hpp"
+#include "contact_sheet.hpp"
+#include "comparison_archive.hpp"
+#include "buffer_pool.hpp"
+#include "preset_index.hpp"
+#include "addon_log.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Every heap allocation of the benchmark is counted, for the memory figures
+// of bench_capture_memory. The size is kept in front of the block so delete
+// can subtract it.
+#define HEAP_HEADER_SIZE 16
+
+static std::atomic<size_t> g_heap_live;
+static std::atomic<size_t> g_heap_peak;
+static std::atomic<size_t> g_heap_allocated;
+
+void *operator new(size_t size)
+{
+	void *block = malloc(size + HEAP_HEADER_SIZE);
+	if (block == nullptr)
+		throw std::bad_alloc();
+	*static_cast<size_t *>(block) = size;
+	g_heap_allocated.fetch_add(size, std::memory_order_relaxed);
+	size_t live = g_heap_live.fetch_add(size, std::memory_order_relaxed) + size;
+	size_t peak = g_heap_peak.load(std::memory_order_relaxed);
+	while (live > peak && !g_heap_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+	return static_cast<char *>(block) + HEAP_HEADER_SIZE;
+}
+
+void operator delete(void *pointer) noexcept
+{
+	if (pointer == nullptr) return;
+	void *block = static_cast<char *>(pointer) - HEAP_HEADER_SIZE;
+	g_heap_live.fetch_sub(*static_cast<size_t *>(block), std::memory_order_relaxed);
+	free(block);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+	operator delete(pointer);
+}
+
+static bool g_quick;
+// Keeps results of otherwise unused computations alive
+static volatile uint64_t g_hash_sink;
+
+// Scales iteration counts down for the smoke run under ctest
+static size_t iterations(size_t full)
+{
+	return g_quick ? std::max<size_t>(1, full / 100) : full;
+}
+
+template <typename F>
+static double time_ms(F &&function)
+{
+	auto start = std::chrono::steady_clock::now();
+	function();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char *name, double ms, size_t count, const char *unit)
+{
+	printf("%-40s %12.4f ms/%s  (%zu %ss)\n", name, ms / count, unit, count, unit);
+}
+
+static void bench_stage_queue(const std::filesystem::path &directory)
+{
+	mock_runtime runtime;
+	runtime.current_preset = "original.ini";
+	runtime.screenshot_directory = directory;
+	runtime.width = 320;
+	runtime.height = 180;
+
+	addon_settings settings;
+	std::filesystem::path preset = "target.ini";
+	size_t workloads = iterations(2000);
+	size_t frames = 0;
+	double ms = time_ms([&]() {
+		for (size_t i = 0; i < workloads; ++i)
+		{
+			queue_screenshot_workload(runtime.screenshots, preset, settings);
+			while (run_addon_frame(runtime))
+				++frames;
+		}
+		shutdown_screenshot_workers(false);
+	});
+	report("stage queue: screenshot workload", ms, workloads, "workload");
+	report("stage queue: frame", ms, frames, "frame");
+
+	// Frames without a pending workload only check the queue
+	size_t idle_frames = iterations(1000000);
+	ms = time_ms([&]() {
+		for (size_t i = 0; i < idle_frames; ++i)
+			run_addon_frame(runtime);
+	});
+	report("stage queue: idle frame", ms, idle_frames, "frame");
+
+	// A waiting workload costs the same per frame however many are queued behind it
+	for (size_t queued : { size_t(1), size_t(1000) })
+	{
+		runtime.preset_switch_latency = 1000000000;
+		for (size_t i = 0; i < queued; ++i)
+			queue_screenshot_workload(runtime.screenshots, "preset_" + std::to_string(i) + ".ini", settings);
+		size_t wait_frames = iterations(1000000);
+		ms = time_ms([&]() {
+			for (size_t i = 0; i < wait_frames; ++i)
+				run_addon_frame(runtime);
+		});
+		report(("stage queue: waiting frame, " + std::to_string(queued) + " queued").c_str(), ms, wait_frames, "frame");
+
+		cancel_all_screenshot_workloads(runtime.screenshots);
+		runtime.preset_switch_latency = 0;
+		while (run_addon_frame(runtime)) {}
+	}
+}
+
+static void bench_keybind_dispatch(size_t binding_count)
+{
+	std::vector<preset_keybind> keybinds(binding_count);
+	for (size_t i = 0; i < keybinds.size(); ++i)
+	{
+		keybinds[i].preset = "preset_" + std::to_string(i) + ".ini";
+		keybinds[i].keybind[0] = 0x30 + static_cast<unsigned int>(i % 40);
+		keybinds[i].keybind[1] = (i / 40) % 2;
+		keybinds[i].keybind[2] = (i / 80) % 2;
+		keybinds[i].action = change_preset;
+	}
+	std::string suffix = " (" + std::to_string(binding_count) + " bindings)";
+
+	keybind_dispatch_index index;
+	// Building converts every path, so large sets get fewer rounds
+	size_t builds = iterations(std::max<size_t>(100, 500000 / binding_count));
+	double ms = time_ms([&]() {
+		for (size_t i = 0; i < builds; ++i)
+			build_keybind_dispatch_index(keybinds, index);
+	});
+	report(("keybinds: build index" + suffix).c_str(), ms, builds, "build");
+
+	mock_runtime runtime;
+	size_t frames = iterations(1000000);
+	size_t fired = 0;
+	ms = time_ms([&]() {
+		for (size_t i = 0; i < frames; ++i)
+		{
+			if (i % 100 == 0)
+				runtime.press_key(0x30 + static_cast<unsigned int>(i % 40));
+			runtime.begin_frame();
+			poll_keybinds(index, &runtime, [&fired](const keybind_dispatch_entry &) { ++fired; });
+		}
+	});
+	report(("keybinds: poll" + suffix).c_str(), ms, frames, "frame");
+}
+
+// Stands in for reshade_key_name, which needs Windows
+static std::string bench_key_name(const unsigned int key[4])
+{
+	return (key[1] ? "Ctrl + " : std::string()) + (key[2] ? "Shift + " : std::string()) + "Numpad " + std::to_string(key[0] % 10);
+}
+
+// Text the keybinding list needs per overlay frame, without the ImGui calls.
+// The list shows about 15 rows of the 1000 at a time.
+static void bench_overlay_rows()
+{
+	const size_t visible_rows = 15;
+	std::vector<preset_keybind> keybinds(1000);
+	for (size_t i = 0; i < keybinds.size(); ++i)
+	{
+		keybinds[i].preset = "D:/Games/Some Game/reshade-presets/collection_" + std::to_string(i / 50) + "/preset_" + std::to_string(i) + ".ini";
+		keybinds[i].keybind[0] = 0x60 + static_cast<unsigned int>(i % 10);
+		keybinds[i].keybind[1] = i % 2;
+		keybinds[i].action = change_preset;
+	}
+
+	size_t frames = iterations(2000);
+	double ms = time_ms([&]() {
+		for (size_t i = 0; i < frames; ++i)
+		{
+			for (auto& pkb : keybinds)
+				pkb.display_valid = false;
+			prepare_keybind_rows(keybinds, 0, keybinds.size(), &bench_key_name);
+		}
+	});
+	report("overlay: all 1000 rows rebuilt", ms, frames, "frame");
+
+	frames = iterations(200000);
+	ms = time_ms([&]() {
+		for (size_t i = 0; i < frames; ++i)
+		{
+			size_t first = i % (keybinds.size() - visible_rows);
+			for (size_t row = first; row < first + visible_rows; ++row)
+				keybinds[row].display_valid = false;
+			prepare_keybind_rows(keybinds, first, first + visible_rows, &bench_key_name);
+		}
+	});
+	report("overlay: 15 visible rows rebuilt", ms, frames, "frame");
+
+	ms = time_ms([&]() {
+		for (size_t i = 0; i < frames; ++i)
+		{
+			size_t first = i % (keybinds.size() - visible_rows);
+			prepare_keybind_rows(keybinds, first, first + visible_rows, &bench_key_name);
+		}
+	});
+	report("overlay: 15 visible rows cached", ms, frames, "frame");
+}
+
+static void bench_ini(const std::filesystem::path &directory)
+{
+	std::vector<preset_keybind> keybinds(200);
+	for (size_t i = 0; i < keybinds.size(); ++i)
+	{
+		keybinds[i].preset = "presets/preset_" + std::to_string(i) + ".ini";
+		keybinds[i].keybind[0] = 0x41 + static_cast<unsigned int>(i % 26);
+		keybinds[i].action = change_preset;
+	}
+	addon_settings settings;
+	std::filesystem::path config_path = directory / "preset_selector.ini";
+
+	size_t round_trips = iterations(500);
+	double ms = time_ms([&]() {
+		for (size_t i = 0; i < round_trips; ++i)
+		{
+			std::vector<preset_keybind> loaded;
+			save_config(config_path, keybinds, settings);
+			load_preset_keybinds(config_path, loaded);
+			load_addon_settings(config_path, settings);
+		}
+	});
+	report("ini: save + load (200 bindings)", ms, round_trips, "round trip");
+
+	// Configs generated by tooling, loaded once at game startup
+	std::vector<preset_keybind> many_keybinds(10000);
+	for (size_t i = 0; i < many_keybinds.size(); ++i)
+	{
+		many_keybinds[i].preset = "presets/game_" + std::to_string(i / 100) + "/preset_" + std::to_string(i) + ".ini";
+		many_keybinds[i].keybind[0] = 0x41 + static_cast<unsigned int>(i % 26);
+		many_keybinds[i].keybind[1] = (i / 26) % 2;
+		many_keybinds[i].action = change_preset;
+	}
+	save_config(config_path, many_keybinds, settings);
+	size_t loads = iterations(200);
+	size_t loaded_count = 0;
+	ms = time_ms([&]() {
+		for (size_t i = 0; i < loads; ++i)
+		{
+			std::vector<preset_keybind> loaded;
+			load_preset_keybinds(config_path, loaded);
+			loaded_count = loaded.size();
+		}
+	});
+	report("ini: load (10000 bindings)", ms, loads, "load");
+	g_hash_sink = loaded_count;
+}
+
+// A synthetic preset collection: mostly presets, some text files that are not
+// presets and other files the filter skips, 100 to a folder two levels deep
+static void bench_preset_index(const std::filesystem::path &directory)
+{
+	std::filesystem::path root = directory / "presets";
+	size_t file_count = iterations(50000);
+	for (size_t i = 0; i < file_count; ++i)
+	{
+		std::filesystem::path folder = root / ("game_" + std::to_string(i / 1000)) / ("pack_" + std::to_string(i / 100 % 10));
+		if (i % 100 == 0)
+			std::filesystem::create_directories(folder);
+		std::string name = "preset_" + std::to_string(i);
+		if (i % 10 == 8)
+			std::ofstream(folder / (name + ".txt")) << "readme\n";
+		else if (i % 10 == 9)
+			std::ofstream(folder / (name + ".png")) << "png\n";
+		else
+			std::ofstream(folder / (name + ".ini")) << "Techniques=Bloom@Bloom.fx,Tonemap@Tonemap.fx\n[Tonemap.fx]\nExposure=1.000000\n";
+	}
+	std::string suffix = " (" + std::to_string(file_count) + " files)";
+
+	preset_index index;
+	index.set_roots({ root });
+	double ms = time_ms([&]() {
+		index.update();
+		index.wait_for_scan();
+	});
+	report(("preset index: first scan" + suffix).c_str(), ms, 1, "scan");
+
+	// Unchanged files are neither parsed nor copied into a new snapshot
+	size_t rescans = iterations(10);
+	ms = time_ms([&]() {
+		for (size_t i = 0; i < rescans; ++i)
+		{
+			index.request_rescan();
+			index.update();
+			index.wait_for_scan();
+		}
+	});
+	report(("preset index: rescan" + suffix).c_str(), ms, rescans, "scan");
+	index.shutdown(false);
+}
+
+// Heap traffic of the capture path (capture buffer, pack, encode) with and
+// without the buffer pools save_screenshot keeps
+static void bench_capture_memory(uint32_t width, uint32_t height, const char *label)
+{
+	size_t pixel_count = static_cast<size_t>(width) * height;
+	std::vector<uint8_t> frame(pixel_count * 4);
+	for (size_t i = 0; i < frame.size(); ++i)
+		frame[i] = static_cast<uint8_t>((i / 4) % 251);
+
+	const size_t captures = g_quick ? 4 : 50;
+	for (bool pooled : { false, true })
+	{
+		buffer_pool capture_buffers(2);
+		buffer_pool encode_buffers(2);
+		size_t live_before = g_heap_live.load();
+		size_t allocated_before = g_heap_allocated.load();
+		g_heap_peak.store(live_before);
+
+		double ms = time_ms([&]() {
+			for (size_t i = 0; i < captures; ++i)
+			{
+				std::vector<uint8_t> pixels = pooled ? capture_buffers.acquire(frame.size()) : std::vector<uint8_t>(frame.size());
+				memcpy(pixels.data(), frame.data(), frame.size());
+				pack_rgba_to_rgb(pixels.data(), pixel_count);
+				std::vector<uint8_t> encoded = pooled ? encode_buffers.acquire_any() : std::vector<uint8_t>();
+				encode_screenshot_image(format_qoi, pixels.data(), width, height, encoded);
+				if (pooled)
+				{
+					capture_buffers.release(std::move(pixels));
+					encode_buffers.release(std::move(encoded));
+				}
+			}
+		});
+
+		std::string name = std::string("capture memory ") + (pooled ? "pooled " : "unpooled ") + label;
+		report(name.c_str(), ms, captures, "capture");
+		printf("%-40s %12.2f MB/capture allocated\n", name.c_str(), (g_heap_allocated.load() - allocated_before) / (captures * 1048576.0));
+		printf("%-40s %12.2f MB peak\n", name.c_str(), (g_heap_peak.load() - live_before) / 1048576.0);
+		// What stays allocated between captures
+		printf("%-40s %12.2f MB steady state\n", name.c_str(), (g_heap_live.load() - live_before) / 1048576.0);
+	}
+}
+
+// Every pack kernel the CPU has, in GB/s of RGBA input
+static void bench_pack_kernels()
+{
+	struct { uint32_t width, height; const char *label; } resolutions[] = {
+		{ 1920, 1080, "1080p" },
+		{ 2560, 1440, "1440p" },
+		{ 3840, 2160, "4K" },
+		{ 7680, 4320, "8K" },
+	};
+	for (auto& resolution : resolutions)
+	{
+		size_t pixel_count = static_cast<size_t>(resolution.width) * resolution.height;
+		std::vector<uint8_t> source(pixel_count * 4);
+		for (size_t i = 0; i < source.size(); ++i)
+			source[i] = static_cast<uint8_t>(i * 7 + 3);
+		std::vector<uint8_t> pixels(source.size());
+
+		for (auto kernel : pixel_pack_kernels)
+		{
+			if (!set_pixel_pack_kernel(kernel))
+				continue;
+			// Packing works in place, so every run starts from a fresh copy
+			size_t packs = iterations(100);
+			double ms = 0;
+			for (size_t i = 0; i < packs; ++i)
+			{
+				memcpy(pixels.data(), source.data(), source.size());
+				ms += time_ms([&]() { pack_rgba_to_rgb(pixels.data(), pixel_count); });
+			}
+			std::string name = std::string("pack RGBA to RGB ") + pixel_pack_kernel_name(kernel) + ' ' + resolution.label;
+			report(name.c_str(), ms, packs, "frame");
+			printf("%-40s %12.2f GB/s\n", name.c_str(), source.size() * static_cast<double>(packs) / (ms * 1e6));
+		}
+	}
+	init_pixel_pack();
+}
+
+static void bench_pack_and_encode(uint32_t width, uint32_t height, const char *label)
+{
+	size_t pixel_count = static_cast<size_t>(width) * height;
+	std::vector<uint8_t> source(pixel_count * 4);
+	// Smooth gradients with some noise, closer to a game frame than random bytes
+	uint32_t state = 1;
+	for (size_t i = 0; i < pixel_count; ++i)
+	{
+		size_t x = i % width, y = i / width;
+		state = state * 1103515245 + 12345;
+		uint8_t noise = static_cast<uint8_t>((state >> 16) & 7);
+		source[4 * i] = static_cast<uint8_t>(x * 255 / width + noise);
+		source[4 * i + 1] = static_cast<uint8_t>(y * 255 / height + noise);
+		source[4 * i + 2] = static_cast<uint8_t>((x + y) / 16);
+		source[4 * i + 3] = 255;
+	}
+	// Packing is measured per kernel in bench_pack_kernels
+	std::vector<uint8_t> pixels = source;
+	pack_rgba_to_rgb(pixels.data(), pixel_count);
+
+	// Duplicate detection runs before every encode when enabled
+	size_t hashes = iterations(200);
+	uint64_t hash = 0;
+	double ms = time_ms([&]() {
+		for (size_t i = 0; i < hashes; ++i)
+			hash ^= content_hash(pixels.data(), pixel_count * 3, i);
+	});
+	report((std::string("content hash ") + label).c_str(), ms, hashes, "frame");
+	printf("%-40s %12.2f GB/s\n", (std::string("content hash ") + label).c_str(), pixel_count * 3.0 * hashes / (ms * 1e6));
+	g_hash_sink = hash;
+
+	// Contact sheet cells at the default width
+	uint32_t cell_width = 480, cell_height = 480 * height / width;
+	std::vector<uint8_t> cell(static_cast<size_t>(cell_width) * cell_height * 3);
+	size_t downscales = iterations(100);
+	for (auto kernel : downscale_kernels)
+	{
+		if (!set_downscale_kernel(kernel))
+			continue;
+		ms = time_ms([&]() {
+			for (size_t i = 0; i < downscales; ++i)
+				downscale_rgb_box(pixels.data(), width, height, cell.data(), cell_width, cell_height, cell_width * 3);
+		});
+		std::string name = std::string("downscale to cell ") + downscale_kernel_name(kernel) + ' ' + label;
+		report(name.c_str(), ms, downscales, "frame");
+	}
+	init_downscale();
+
+	std::vector<uint8_t> encoded;
+	for (auto format : screenshot_formats)
+	{
+		std::string name = std::string("encode ") + (screenshot_format_extension(format) + 1) + ' ' + label;
+		if (!encode_screenshot_image(format, pixels.data(), width, height, encoded))
+		{
+			printf("%-40s unavailable\n", name.c_str());
+			continue;
+		}
+		size_t encodes = iterations(20);
+		ms = time_ms([&]() {
+			for (size_t i = 0; i < encodes; ++i)
+				encode_screenshot_image(format, pixels.data(), width, height, encoded);
+		});
+		report(name.c_str(), ms, encodes, "frame");
+		printf("%-40s %12zu bytes/frame\n", name.c_str(), encoded.size());
+	}
+
+	// Scaling of the strip encoder, near linear while cores are free
+	for (uint32_t threads : { 1u, 2u, 4u, 8u })
+	{
+		std::string name = "encode png strips x" + std::to_string(threads) + ' ' + label;
+		size_t encodes = iterations(20);
+		ms = time_ms([&]() {
+			for (size_t i = 0; i < encodes; ++i)
+				encode_png_rgb_strips(pixels.data(), width, height, encoded, threads);
+		});
+		report(name.c_str(), ms, encodes, "frame");
+	}
+	printf("%-40s %12zu bytes/frame\n", (std::string("encode png strips ") + label).c_str(), encoded.size());
+	printf("%-40s %12u\n", "hardware threads", std::thread::hardware_concurrency());
+}
+
+// Capture All Presets, one archive against a PNG per preset. Presets either
+// touch only part of the frame (a HUD) or change every pixel (a tone curve).
+static void bench_comparison_archive(uint32_t width, uint32_t height, bool global_change, const char *label)
+{
+	const uint32_t preset_count = 8;
+	size_t pixel_count = static_cast<size_t>(width) * height;
+	std::vector<std::vector<uint8_t>> frames(preset_count, std::vector<uint8_t>(pixel_count * 3));
+	uint32_t state = 1;
+	for (size_t i = 0; i < pixel_count; ++i)
+	{
+		size_t x = i % width, y = i / width;
+		state = state * 1103515245 + 12345;
+		uint8_t noise = static_cast<uint8_t>((state >> 16) & 7);
+		frames[0][3 * i] = static_cast<uint8_t>(x * 255 / width + noise);
+		frames[0][3 * i + 1] = static_cast<uint8_t>(y * 255 / height + noise);
+		frames[0][3 * i + 2] = static_cast<uint8_t>((x + y) / 16);
+	}
+	for (uint32_t p = 1; p < preset_count; ++p)
+	{
+		frames[p] = frames[0];
+		if (global_change)
+		{
+			// Each preset brightens the whole frame by its own amount
+			for (auto &value : frames[p])
+				value = static_cast<uint8_t>(std::min(value * (16 + p) / 16, 255u));
+			continue;
+		}
+		// Each preset changes its own eighth of the width in the top quarter
+		for (uint32_t y = 0; y < height / 4; ++y)
+			for (uint32_t x = width * p / preset_count; x < width * (p + 1) / preset_count; ++x)
+				frames[p][(static_cast<size_t>(y) * width + x) * 3] += 40;
+	}
+
+	std::vector<uint8_t> encoded;
+	size_t png_bytes = 0;
+	size_t runs = iterations(5);
+	double ms = time_ms([&]() {
+		for (size_t run = 0; run < runs; ++run)
+		{
+			png_bytes = 0;
+			for (auto& frame : frames)
+			{
+				encode_png_rgb(frame.data(), width, height, encoded);
+				png_bytes += encoded.size();
+			}
+		}
+	});
+	std::string name = std::string("comparison as pngs ") + label;
+	report(name.c_str(), ms, runs, "batch");
+	printf("%-40s %12zu bytes/batch\n", name.c_str(), png_bytes);
+
+	std::vector<std::string> labels(preset_count, "preset.ini");
+	ms = time_ms([&]() {
+		for (size_t run = 0; run < runs; ++run)
+		{
+			comparison_archive archive(labels);
+			for (uint32_t p = 0; p < preset_count; ++p)
+				archive.add_frame(p, frames[p].data(), width, height);
+			archive.serialize(encoded);
+		}
+	});
+	name = std::string("comparison as archive ") + label;
+	report(name.c_str(), ms, runs, "batch");
+	printf("%-40s %12zu bytes/batch\n", name.c_str(), encoded.size());
+}
+
+// Pass --quick for a short smoke run
+int main(int argc, char **argv)
+{
+	g_quick = argc > 1 && strcmp(argv[1], "--quick") == 0;
+
+	init_pixel_pack();
+	init_downscale();
+	init_content_hash();
+	init_png_encode();
+	// Thousands of screenshots and config saves would flood the output
+	set_addon_log_sink([](addon_log_level, const char *) {});
+
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "preset_selector_bench";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+
+	bench_stage_queue(directory);
+	for (size_t binding_count : { 10, 100, 10000 })
+		bench_keybind_dispatch(binding_count);
+	bench_overlay_rows();
+	bench_ini(directory);
+	bench_preset_index(directory);
+	bench_pack_kernels();
+	bench_capture_memory(3840, 2160, "4K");
+	bench_pack_and_encode(1920, 1080, "1080p");
+	bench_pack_and_encode(3840, 2160, "4K");
+	bench_comparison_archive(1920, 1080, false, "1080p strip");
+	bench_comparison_archive(1920, 1080, true, "1080p global");
+
+	shutdown_png_workers(false);
+
+	std::error_code ec;
+	std::filesystem::remove_all(directory, ec);
+	return 0;
+}
@@ -0,0 +1,22 @@
+#include "addon_log.hpp"
+
+#include <atomic>
+#include <cstdio>
+
+static void log_to_stderr(addon_log_level level, const char *message)
+{
+	static const char *LEVEL_NAMES[] = { "", "ERROR", "WARN", "INFO", "DEBUG" };
+	fprintf(stderr, "%s | %s\n", LEVEL_NAMES[static_cast<int>(level)], message);
+}
+
+static std::atomic<addon_log_sink> g_log_sink = &log_to_stderr;
+
+void set_addon_log_sink(addon_log_sink sink)
+{
+	g_log_sink.store(sink != nullptr ? sink : &log_to_stderr);
+}
+
+void addon_log(addon_log_level level, const char *message)
+{
+	g_log_sink.load()(level, message);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+enum class addon_log_level {
+	error = 1,
+	warning = 2,
+	info = 3,
+	debug = 4
+};
+
+typedef void (*addon_log_sink)(addon_log_level level, const char *message);
+
+// Routes log messages of the core code to the host, stderr until a sink is set.
+// Safe to call from any thread.
+void set_addon_log_sink(addon_log_sink sink);
+void addon_log(addon_log_level level, const char *message);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <filesystem>
+#include <cstdint>
+
+enum class uniform_base_type {
+	unknown,
+	float32,
+	int32,
+	uint32,
+	boolean
+};
+
+// The parts of an effect runtime the core logic uses. The addon wraps
+// reshade::api::effect_runtime (reshade_runtime.hpp), tests and benchmarks use
+// a scripted mock, so everything behind this interface builds without ReShade.
+struct addon_runtime {
+	virtual ~addon_runtime() {}
+
+	virtual void get_screenshot_width_and_height(uint32_t *width, uint32_t *height) = 0;
+	// Fills width * height RGBA pixels, returns false when the back buffer cannot be read
+	virtual bool capture_screenshot(uint8_t *pixels) = 0;
+	// Absolute directory screenshots are saved to
+	virtual std::filesystem::path get_screenshot_directory() = 0;
+
+	virtual std::filesystem::path get_current_preset_path() = 0;
+	// Takes effect once the effects of the new preset have been compiled
+	virtual void set_current_preset_path(const char *path_utf8) = 0;
+
+	// Keycodes are Windows virtual-key codes
+	virtual bool is_key_down(unsigned int keycode) = 0;
+	virtual bool is_key_pressed(unsigned int keycode) = 0;
+
+	// Returns 0 when no effect declares the uniform
+	virtual uint64_t find_uniform_variable(const char *effect_name, const char *variable_name) = 0;
+	virtual void get_uniform_variable_type(uint64_t variable, uniform_base_type *base_type, uint32_t *rows, uint32_t *columns, uint32_t *array_length) = 0;
+	virtual void set_uniform_value_float(uint64_t variable, const float *values, size_t count) = 0;
+	virtual void set_uniform_value_int(uint64_t variable, const int32_t *values, size_t count) = 0;
+	virtual void set_uniform_value_uint(uint64_t variable, const uint32_t *values, size_t count) = 0;
+	virtual void set_uniform_value_bool(uint64_t variable, const bool *values, size_t count) = 0;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+
+enum screenshot_format {
+	format_png = 0,
+	format_qoi = 1,
+	format_bmp = 2
+};
+
+const screenshot_format screenshot_formats[] = {
+	format_png,
+	format_qoi,
+	format_bmp
+};
+
+// What a burst does with a frame when every ring slot is still being encoded
+enum burst_overflow_policy {
+	// The frame is skipped, its number is missing from the written sequence
+	burst_drop_frames = 0,
+	// The render thread waits for a free slot, every frame is kept
+	burst_wait_for_encoder = 1
+};
+
+const burst_overflow_policy burst_overflow_policies[] = {
+	burst_drop_frames,
+	burst_wait_for_encoder
+};
+
+// What a capture does when its pixels match a frame already written this session
+enum duplicate_frame_policy {
+	// Every capture is encoded and written
+	duplicate_write = 0,
+	// Nothing is written, the earlier file stands for both
+	duplicate_skip = 1,
+	// The new file is a hard link to the earlier one, encoded again if linking fails
+	duplicate_hard_link = 2
+};
+
+const duplicate_frame_policy duplicate_frame_policies[] = {
+	duplicate_write,
+	duplicate_skip,
+	duplicate_hard_link
+};
+
+// Whether capturing all presets also builds one downscaled grid of the captures
+enum contact_sheet_mode {
+	contact_sheet_off = 0,
+	contact_sheet_alongside = 1,
+	// Only the sheet is written, the full-size captures are dropped
+	contact_sheet_only = 2
+};
+
+const contact_sheet_mode contact_sheet_modes[] = {
+	contact_sheet_off,
+	contact_sheet_alongside,
+	contact_sheet_only
+};
+
+// How screenshot files reach the disk
+enum screenshot_write_mode {
+	// Through the system file cache, written back whenever the OS decides
+	write_cached = 0,
+	// Bypasses the file cache in large aligned blocks, so long batches on slow
+	// or network disks write at a steady rate instead of stalling when the
+	// cache fills up
+	write_direct = 1,
+	// Direct, and every file is flushed to the disk before the next one
+	write_direct_sync = 2
+};
+
+const screenshot_write_mode screenshot_write_modes[] = {
+	write_cached,
+	write_direct,
+	write_direct_sync
+};
+
+struct addon_settings
+{
+	// Frames to wait after a preset switch before the image counts as settled
+	uint32_t settle_min_frames = 2;
+	uint32_t settle_max_frames = 30;
+	// Mean absolute change per channel (0-255) below which a frame is settled
+	float settle_threshold = 0.5f;
+	// Switch between presets sharing the same techniques by writing only the
+	// changed uniforms. ReShade keeps reporting the previously loaded preset.
+	bool fast_preset_switch = false;
+	screenshot_format capture_format = format_png;
+	// BMP captures are re-encoded to PNG on a background thread and deleted
+	bool convert_bmp_to_png = false;
+	// Consecutive frames captured by a burst and the memory they may hold
+	// while waiting to be encoded
+	uint32_t burst_frame_count = 30;
+	uint32_t burst_memory_budget_mb = 512;
+	burst_overflow_policy burst_overflow = burst_drop_frames;
+	duplicate_frame_policy duplicate_frames = duplicate_write;
+	contact_sheet_mode contact_sheet = contact_sheet_off;
+	// Width in pixels of each capture on the sheet
+	uint32_t contact_sheet_cell_width = 480;
+	// Capturing all presets writes one comparison archive in place of the
+	// full-size captures, each preset after the first as a delta against it
+	bool comparison_archive = false;
+	screenshot_write_mode write_mode = write_cached;
+	// Load every bound preset once when the game starts, so ReShade has
+	// compiled their effects before the first switch during gameplay
+	bool warm_up_on_load = false;
+};
@@ -0,0 +1,41 @@
+#include "buffer_pool.hpp"
+
+std::vector<uint8_t> buffer_pool::acquire(size_t size)
+{
+	std::vector<uint8_t> buffer;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		while (!free_buffers.empty())
+		{
+			buffer = std::move(free_buffers.back());
+			free_buffers.pop_back();
+			if (buffer.size() == size)
+				return buffer;
+		}
+	}
+
+	// Resolution changed or pool empty, drop the stale buffer before allocating
+	buffer = std::vector<uint8_t>();
+	buffer.resize(size);
+	return buffer;
+}
+
+std::vector<uint8_t> buffer_pool::acquire_any()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (free_buffers.empty())
+		return std::vector<uint8_t>();
+
+	std::vector<uint8_t> buffer = std::move(free_buffers.back());
+	free_buffers.pop_back();
+	return buffer;
+}
+
+void buffer_pool::release(std::vector<uint8_t> buffer)
+{
+	if (buffer.capacity() == 0) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (free_buffers.size() < max_buffers)
+		free_buffers.push_back(std::move(buffer));
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+// Keeps released byte buffers around so repeated captures at the same
+// resolution do not go back to the heap. Thread-safe.
+struct buffer_pool {
+	buffer_pool(size_t max_buffers) : max_buffers(max_buffers) {};
+
+	// Returns a buffer of exactly size bytes. Pooled buffers of another size are
+	// freed, so the pool follows the current swapchain resolution.
+	std::vector<uint8_t> acquire(size_t size);
+	// Returns a buffer that only needs its capacity kept (e.g. encoder output)
+	std::vector<uint8_t> acquire_any();
+	void release(std::vector<uint8_t> buffer);
+
+private:
+	size_t max_buffers;
+	std::vector<std::vector<uint8_t>> free_buffers;
+	std::mutex mutex;
+};
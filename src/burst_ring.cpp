@@ -0,0 +1,55 @@
+#include "burst_ring.hpp"
+#include "addon_log.hpp"
+
+#include <algorithm>
+#include <new>
+#include <string>
+
+burst_ring::burst_ring(size_t frame_size, uint32_t frame_count, size_t budget_bytes, uint32_t max_slots) :
+	frame_size(frame_size)
+{
+	slots = std::min<size_t>(frame_count, max_slots);
+	if (frame_size > 0)
+		slots = std::min(slots, budget_bytes / frame_size);
+	slots = std::max<size_t>(slots, 1);
+
+	// Runs on the render thread, a large budget in a 32-bit game easily fails
+	// to allocate, so it takes fewer slots instead of throwing
+	size_t requested = slots;
+	while (slots > 0)
+	{
+		memory.reset(new (std::nothrow) uint8_t[slots * frame_size]);
+		if (memory) break;
+		slots /= 2;
+	}
+	if (slots < requested)
+	{
+		std::string message = "Could not allocate " + std::to_string(requested) + " burst frames, reserved " + std::to_string(slots);
+		addon_log(addon_log_level::warning, message.c_str());
+	}
+	// Handed out from the back, so slot 0 goes first
+	for (size_t i = slots; i-- > 0;)
+		free_slots.push_back(static_cast<int>(i));
+}
+
+int burst_ring::acquire(bool wait)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (wait)
+		slot_available.wait(lock, [this]() { return !free_slots.empty(); });
+	if (free_slots.empty())
+		return -1;
+
+	int slot = free_slots.back();
+	free_slots.pop_back();
+	return slot;
+}
+
+void burst_ring::release(int slot)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		free_slots.push_back(slot);
+	}
+	slot_available.notify_one();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Fixed set of frame slots reserved up front within a memory budget. The
+// render thread copies frames into free slots and the encoders hand them back
+// once the frame is written. Thread-safe.
+struct burst_ring {
+	// Reserves min(frame_count, budget_bytes / frame_size, max_slots) slots, at
+	// least one. Fewer when the memory cannot be allocated, none when not even
+	// one frame fits, the caller then has to give up on the burst.
+	burst_ring(size_t frame_size, uint32_t frame_count, size_t budget_bytes, uint32_t max_slots);
+
+	// Returns a free slot, or -1 when every slot is in use. With wait set the
+	// caller is blocked until a slot is released instead.
+	int acquire(bool wait);
+	void release(int slot);
+	uint8_t *data(int slot) { return memory.get() + static_cast<size_t>(slot) * frame_size; }
+	size_t slot_count() const { return slots; }
+
+private:
+	size_t frame_size;
+	size_t slots;
+	// Left uninitialized, pages are only committed when a frame is first copied in
+	std::unique_ptr<uint8_t[]> memory;
+	std::vector<int> free_slots;
+	std::mutex mutex;
+	std::condition_variable slot_available;
+};
@@ -0,0 +1,413 @@
+#include "comparison_archive.hpp"
+#include "png_encode.hpp"
+#include "deflate.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#define COMPARISON_ARCHIVE_MAGIC 0x41435350 // "PSCA"
+#define COMPARISON_ARCHIVE_VERSION 2
+
+#define IMAGE_MISSING 0
+// The PNG every delta applies to
+#define IMAGE_BASE 1
+// A PNG of its own, for frames of another size or that changed almost everywhere
+#define IMAGE_PNG 2
+// A bit per tile, set for tiles that differ, then the deflated differences of
+// those tiles in order, row by row within each tile. The differences are
+// filtered like PNG rows: the first row of a tile by Sub, the others by Up.
+#define IMAGE_DELTA 3
+
+// Above this share of changed tiles a PNG may be smaller than the delta, both
+// are encoded and the smaller one is kept
+#define DELTA_MAX_CHANGED_NUMERATOR 3
+#define DELTA_MAX_CHANGED_DENOMINATOR 4
+
+// Entries follow the header, then the labels and the image data. Everything
+// is little endian and 8-byte aligned, so the index is used in place.
+struct archive_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t tile_size;
+	uint32_t image_count;
+	uint32_t base_index;
+	uint32_t reserved;
+};
+
+struct archive_entry {
+	uint64_t offset;
+	uint64_t size;
+	uint32_t kind;
+	uint32_t width;
+	uint32_t height;
+	uint32_t changed_tiles;
+	uint32_t label_offset;
+	uint32_t label_size;
+};
+
+static_assert(sizeof(archive_header) == 32, "archive header layout");
+static_assert(sizeof(archive_entry) == 40, "archive entry layout");
+
+static const archive_header *get_header(const mapped_file &file)
+{
+	return reinterpret_cast<const archive_header *>(file.data());
+}
+
+static const archive_entry *get_entry(const mapped_file &file, uint32_t index)
+{
+	return reinterpret_cast<const archive_entry *>(file.data() + sizeof(archive_header)) + index;
+}
+
+static uint32_t tile_count(uint32_t size)
+{
+	return (size + COMPARISON_ARCHIVE_TILE_SIZE - 1) / COMPARISON_ARCHIVE_TILE_SIZE;
+}
+
+// Calls f(x, y, width, height) for every tile in order
+template <typename F>
+static void for_each_tile(uint32_t width, uint32_t height, F &&f)
+{
+	for (uint32_t y = 0; y < height; y += COMPARISON_ARCHIVE_TILE_SIZE)
+		for (uint32_t x = 0; x < width; x += COMPARISON_ARCHIVE_TILE_SIZE)
+			f(x, y, std::min<uint32_t>(COMPARISON_ARCHIVE_TILE_SIZE, width - x), std::min<uint32_t>(COMPARISON_ARCHIVE_TILE_SIZE, height - y));
+}
+
+// Tone and color presets change every pixel by a smoothly varying amount,
+// filtering leaves small values that deflate well
+static void encode_delta(const uint8_t *base, const uint8_t *frame, uint32_t width, uint32_t height, std::vector<uint8_t> &out, uint32_t &changed_tiles)
+{
+	size_t stride = static_cast<size_t>(width) * 3;
+	uint32_t tiles = tile_count(width) * tile_count(height);
+	out.assign((tiles + 7) / 8, 0);
+	std::vector<uint8_t> differences;
+	// Unfiltered differences of the current and previous row of a tile
+	std::vector<uint8_t> row_difference(COMPARISON_ARCHIVE_TILE_SIZE * 3), above(COMPARISON_ARCHIVE_TILE_SIZE * 3);
+	changed_tiles = 0;
+
+	uint32_t tile = 0;
+	for_each_tile(width, height, [&](uint32_t x, uint32_t y, uint32_t tile_width, uint32_t tile_height) {
+		size_t row_size = static_cast<size_t>(tile_width) * 3;
+		bool differs = false;
+		for (uint32_t row = 0; row < tile_height && !differs; ++row)
+		{
+			size_t offset = (y + row) * stride + static_cast<size_t>(x) * 3;
+			differs = memcmp(base + offset, frame + offset, row_size) != 0;
+		}
+
+		if (differs)
+		{
+			out[tile / 8] |= static_cast<uint8_t>(1 << (tile % 8));
+			++changed_tiles;
+			size_t start = differences.size();
+			differences.resize(start + row_size * tile_height);
+			uint8_t *p = differences.data() + start;
+			for (uint32_t row = 0; row < tile_height; ++row)
+			{
+				size_t offset = (y + row) * stride + static_cast<size_t>(x) * 3;
+				for (size_t i = 0; i < row_size; ++i)
+					row_difference[i] = static_cast<uint8_t>(frame[offset + i] - base[offset + i]);
+				if (row == 0)
+				{
+					for (size_t i = 0; i < row_size; ++i)
+						*p++ = static_cast<uint8_t>(row_difference[i] - (i >= 3 ? row_difference[i - 3] : 0));
+				}
+				else
+				{
+					for (size_t i = 0; i < row_size; ++i)
+						*p++ = static_cast<uint8_t>(row_difference[i] - above[i]);
+				}
+				row_difference.swap(above);
+			}
+		}
+		++tile;
+	});
+
+	deflate_chunk(differences.data(), differences.size(), true, out);
+}
+
+static bool delta_may_exceed_png(uint32_t width, uint32_t height, uint32_t changed_tiles)
+{
+	uint32_t tiles = tile_count(width) * tile_count(height);
+	return static_cast<uint64_t>(changed_tiles) * DELTA_MAX_CHANGED_DENOMINATOR > static_cast<uint64_t>(tiles) * DELTA_MAX_CHANGED_NUMERATOR;
+}
+
+static bool decode_delta(const uint8_t *data, size_t size, uint32_t width, uint32_t height, std::vector<uint8_t> &pixels)
+{
+	size_t stride = static_cast<size_t>(width) * 3;
+	uint32_t tiles = tile_count(width) * tile_count(height);
+	size_t mask_size = (tiles + 7) / 8;
+	if (size < mask_size) return false;
+
+	size_t expected = 0;
+	uint32_t tile = 0;
+	for_each_tile(width, height, [&](uint32_t, uint32_t, uint32_t tile_width, uint32_t tile_height) {
+		if (data[tile / 8] & (1 << (tile % 8)))
+			expected += static_cast<size_t>(tile_width) * tile_height * 3;
+		++tile;
+	});
+
+	std::vector<uint8_t> differences;
+	differences.reserve(expected);
+	if (!inflate_raw(data + mask_size, size - mask_size, differences, expected) || differences.size() != expected)
+		return false;
+
+	// Undoes the filters in place, each row then holds its plain differences
+	const uint8_t *above = nullptr;
+	uint8_t *p = differences.data();
+	tile = 0;
+	for_each_tile(width, height, [&](uint32_t x, uint32_t y, uint32_t tile_width, uint32_t tile_height) {
+		if (data[tile / 8] & (1 << (tile % 8)))
+		{
+			size_t row_size = static_cast<size_t>(tile_width) * 3;
+			for (uint32_t row = 0; row < tile_height; ++row)
+			{
+				if (row == 0)
+				{
+					for (size_t i = 3; i < row_size; ++i)
+						p[i] = static_cast<uint8_t>(p[i] + p[i - 3]);
+				}
+				else
+				{
+					for (size_t i = 0; i < row_size; ++i)
+						p[i] = static_cast<uint8_t>(p[i] + above[i]);
+				}
+
+				uint8_t *dst = pixels.data() + (y + row) * stride + static_cast<size_t>(x) * 3;
+				for (size_t i = 0; i < row_size; ++i)
+					dst[i] = static_cast<uint8_t>(dst[i] + p[i]);
+				above = p;
+				p += row_size;
+			}
+		}
+		++tile;
+	});
+	return true;
+}
+
+comparison_archive::comparison_archive(std::vector<std::string> labels) :
+	labels(std::move(labels))
+{
+	images.resize(this->labels.size());
+}
+
+bool comparison_archive::resolve_image()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return ++resolved == labels.size();
+}
+
+bool comparison_archive::add_frame(uint32_t index, const uint8_t *frame, uint32_t frame_width, uint32_t frame_height)
+{
+	PROFILE_SCOPE("comparison archive: add frame");
+	if (index >= labels.size()) return false;
+
+	bool is_base = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (base_index < 0)
+		{
+			base_index = static_cast<int>(index);
+			base_width = frame_width;
+			base_height = frame_height;
+			base_pixels.assign(frame, frame + static_cast<size_t>(frame_width) * frame_height * 3);
+			is_base = true;
+		}
+	}
+
+	// Images do not overlap and the base never changes once set, so frames
+	// are encoded in parallel without the lock
+	image encoded;
+	encoded.width = frame_width;
+	encoded.height = frame_height;
+	if (is_base)
+	{
+		encoded.kind = IMAGE_BASE;
+	}
+	else if (frame_width == base_width && frame_height == base_height)
+	{
+		encoded.kind = IMAGE_DELTA;
+		encode_delta(base_pixels.data(), frame, frame_width, frame_height, encoded.data, encoded.changed_tiles);
+	}
+	else
+	{
+		encoded.kind = IMAGE_PNG;
+	}
+
+	if (encoded.kind == IMAGE_DELTA && delta_may_exceed_png(frame_width, frame_height, encoded.changed_tiles))
+	{
+		// The base PNG shows the same scene, a delta smaller than it is kept
+		// without encoding another PNG to compare against
+		size_t base_png_size = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (images[base_index].kind == IMAGE_BASE)
+				base_png_size = images[base_index].data.size();
+		}
+		std::vector<uint8_t> png;
+		if (encoded.data.size() >= base_png_size &&
+			encode_png_rgb(frame, frame_width, frame_height, png) && png.size() < encoded.data.size())
+		{
+			encoded.kind = IMAGE_PNG;
+			encoded.changed_tiles = 0;
+			encoded.data = std::move(png);
+		}
+	}
+	// Without its base the archive is not written at all
+	else if (encoded.kind != IMAGE_DELTA && !encode_png_rgb(frame, frame_width, frame_height, encoded.data))
+	{
+		encoded.kind = IMAGE_MISSING;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		images[index] = std::move(encoded);
+	}
+	return resolve_image();
+}
+
+bool comparison_archive::skip_frame(uint32_t index)
+{
+	if (index >= labels.size()) return false;
+	return resolve_image();
+}
+
+bool comparison_archive::serialize(std::vector<uint8_t> &out) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (base_index < 0 || images[base_index].kind != IMAGE_BASE) return false;
+
+	size_t count = images.size();
+	size_t labels_offset = sizeof(archive_header) + count * sizeof(archive_entry);
+	size_t data_offset = labels_offset;
+	for (auto& label : labels)
+		data_offset += label.size();
+	data_offset = (data_offset + 7) & ~static_cast<size_t>(7);
+	size_t total = data_offset;
+	for (auto& image : images)
+		total += (image.data.size() + 7) & ~static_cast<size_t>(7);
+
+	out.assign(total, 0);
+	archive_header file_header = { COMPARISON_ARCHIVE_MAGIC, COMPARISON_ARCHIVE_VERSION, base_width, base_height,
+		COMPARISON_ARCHIVE_TILE_SIZE, static_cast<uint32_t>(count), static_cast<uint32_t>(base_index), 0 };
+	memcpy(out.data(), &file_header, sizeof(file_header));
+
+	size_t label_pos = labels_offset;
+	size_t data_pos = data_offset;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const image &image = images[i];
+		archive_entry file_entry = {};
+		file_entry.kind = image.kind;
+		file_entry.width = image.width;
+		file_entry.height = image.height;
+		file_entry.changed_tiles = image.changed_tiles;
+		file_entry.label_offset = static_cast<uint32_t>(label_pos);
+		file_entry.label_size = static_cast<uint32_t>(labels[i].size());
+		memcpy(out.data() + label_pos, labels[i].data(), labels[i].size());
+		label_pos += labels[i].size();
+
+		if (image.kind != IMAGE_MISSING)
+		{
+			file_entry.offset = data_pos;
+			file_entry.size = image.data.size();
+			memcpy(out.data() + data_pos, image.data.data(), image.data.size());
+			data_pos += (image.data.size() + 7) & ~static_cast<size_t>(7);
+		}
+		memcpy(out.data() + sizeof(archive_header) + i * sizeof(archive_entry), &file_entry, sizeof(file_entry));
+	}
+	return true;
+}
+
+bool comparison_archive_reader::open(const std::filesystem::path &path)
+{
+	close();
+	if (!file.open_read_only(path)) return false;
+
+	if (file.size() < sizeof(archive_header))
+	{
+		close();
+		return false;
+	}
+	const archive_header *header = get_header(file);
+	if (header->magic != COMPARISON_ARCHIVE_MAGIC || header->version != COMPARISON_ARCHIVE_VERSION || header->tile_size != COMPARISON_ARCHIVE_TILE_SIZE ||
+		header->image_count > (file.size() - sizeof(archive_header)) / sizeof(archive_entry) || header->base_index >= header->image_count)
+	{
+		close();
+		return false;
+	}
+
+	// Every range is checked once here, extract can then trust the index
+	for (uint32_t i = 0; i < header->image_count; ++i)
+	{
+		const archive_entry *image = get_entry(file, i);
+		bool in_bounds = image->label_offset <= file.size() && image->label_size <= file.size() - image->label_offset &&
+			image->offset <= file.size() && image->size <= file.size() - image->offset;
+		if (!in_bounds || image->kind > IMAGE_DELTA)
+		{
+			close();
+			return false;
+		}
+	}
+	count = header->image_count;
+	return true;
+}
+
+void comparison_archive_reader::close()
+{
+	file.close();
+	count = 0;
+	base_pixels.clear();
+}
+
+uint32_t comparison_archive_reader::image_count() const
+{
+	return count;
+}
+
+std::string comparison_archive_reader::label(uint32_t index) const
+{
+	if (index >= count) return std::string();
+	const archive_entry *image = get_entry(file, index);
+	return std::string(reinterpret_cast<const char *>(file.data()) + image->label_offset, image->label_size);
+}
+
+bool comparison_archive_reader::has_image(uint32_t index) const
+{
+	return index < count && get_entry(file, index)->kind != IMAGE_MISSING;
+}
+
+bool comparison_archive_reader::decode_base()
+{
+	if (!base_pixels.empty()) return true;
+
+	const archive_header *header = get_header(file);
+	const archive_entry *base = get_entry(file, header->base_index);
+	uint32_t width, height;
+	return base->kind == IMAGE_BASE && decode_png_rgb(file.data() + base->offset, static_cast<size_t>(base->size), base_pixels, width, height) &&
+		width == header->width && height == header->height;
+}
+
+bool comparison_archive_reader::extract(uint32_t index, std::vector<uint8_t> &pixels, uint32_t &width, uint32_t &height)
+{
+	PROFILE_SCOPE("comparison archive: extract");
+	if (!has_image(index)) return false;
+
+	const archive_entry *image = get_entry(file, index);
+	const uint8_t *data = file.data() + image->offset;
+	if (image->kind != IMAGE_DELTA)
+		return decode_png_rgb(data, static_cast<size_t>(image->size), pixels, width, height);
+
+	const archive_header *header = get_header(file);
+	if (image->width != header->width || image->height != header->height || !decode_base())
+	{
+		base_pixels.clear();
+		return false;
+	}
+	width = image->width;
+	height = image->height;
+	pixels = base_pixels;
+	return decode_delta(data, static_cast<size_t>(image->size), width, height, pixels);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#define COMPARISON_ARCHIVE_EXTENSION ".psca"
+#define COMPARISON_ARCHIVE_TILE_SIZE 64
+
+// One comparison of a scene across presets in a single file. The first frame
+// added is the base and stored as a PNG, every other frame of the same size
+// stores only the tiles that differ from it, as filtered and deflated byte
+// differences. Filled from worker threads like contact_sheet.
+struct comparison_archive {
+	comparison_archive(std::vector<std::string> labels);
+
+	// Encodes a packed RGB frame into its image. Returns true for the call that
+	// resolves the last image, the caller then writes the archive.
+	bool add_frame(uint32_t index, const uint8_t *frame, uint32_t frame_width, uint32_t frame_height);
+	// Leaves an image out, e.g. when its capture failed. Same return as add_frame.
+	bool skip_frame(uint32_t index);
+
+	// The file contents, false when every image was skipped
+	bool serialize(std::vector<uint8_t> &out) const;
+
+private:
+	struct image {
+		uint32_t kind = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t changed_tiles = 0;
+		std::vector<uint8_t> data;
+	};
+
+	bool resolve_image();
+
+	std::vector<std::string> labels;
+	std::vector<image> images;
+	// Written once by the first frame, only read afterwards
+	std::vector<uint8_t> base_pixels;
+	uint32_t base_width = 0;
+	uint32_t base_height = 0;
+	int base_index = -1;
+	uint32_t resolved = 0;
+	mutable std::mutex mutex;
+};
+
+// Memory-maps an archive, images are decoded on request
+struct comparison_archive_reader {
+	bool open(const std::filesystem::path &path);
+	void close();
+
+	uint32_t image_count() const;
+	// Preset name the image was captured with
+	std::string label(uint32_t index) const;
+	// False for images that were skipped
+	bool has_image(uint32_t index) const;
+	// Rebuilds the packed RGB pixels of an image
+	bool extract(uint32_t index, std::vector<uint8_t> &pixels, uint32_t &width, uint32_t &height);
+
+private:
+	bool decode_base();
+
+	mapped_file file;
+	uint32_t count = 0;
+	// Decoded once, every delta image needs it
+	std::vector<uint8_t> base_pixels;
+};
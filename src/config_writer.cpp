@@ -0,0 +1,52 @@
+#include "config_writer.hpp"
+#include "ini_file.hpp"
+#include "addon_log.hpp"
+
+#include <sstream>
+
+#define CONFIG_SAVE_DEBOUNCE_MS 500
+
+static void write_config(config_snapshot &snapshot)
+{
+	bool success = save_config(snapshot.path, snapshot.preset_keybinds, snapshot.settings);
+	std::stringstream ss;
+	if (success)
+	{
+		ss << "Config saved to: " << snapshot.path.string();
+		addon_log(addon_log_level::info, ss.str().c_str());
+	} else {
+		ss << "Config failed to save: " << snapshot.path.string();
+		addon_log(addon_log_level::error, ss.str().c_str());
+	}
+}
+
+void config_writer::mark_dirty(config_snapshot snapshot)
+{
+	pending = std::move(snapshot);
+	last_change = std::chrono::steady_clock::now();
+}
+
+void config_writer::update()
+{
+	if (!pending.has_value() || writing) return;
+	if (std::chrono::steady_clock::now() - last_change < std::chrono::milliseconds(CONFIG_SAVE_DEBOUNCE_MS)) return;
+
+	writing = true;
+	worker.submit([this, snapshot = std::move(*pending)]() mutable {
+		write_config(snapshot);
+		writing = false;
+	});
+	pending.reset();
+}
+
+void config_writer::flush(bool process_terminating)
+{
+	worker.shutdown(process_terminating);
+	writing = false;
+
+	if (pending.has_value())
+	{
+		write_config(*pending);
+		pending.reset();
+	}
+}
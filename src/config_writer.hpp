@@ -0,0 +1,35 @@
+#pragma once
+
+#include "preset_keybind.hpp"
+#include "addon_settings.hpp"
+#include "worker_pool.hpp"
+
+#include <filesystem>
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <atomic>
+
+struct config_snapshot {
+	std::filesystem::path path;
+	std::vector<preset_keybind> preset_keybinds;
+	addon_settings settings;
+};
+
+// Saves the config on a background thread once changes have stopped for a
+// short while, so edits in the overlay never do file I/O on the render thread
+struct config_writer {
+	config_writer() : worker(1, 1) {};
+
+	void mark_dirty(config_snapshot snapshot);
+	// Call once per frame, starts a write when the debounce window has passed
+	void update();
+	// Waits for a running write and saves pending changes immediately
+	void flush(bool process_terminating);
+
+private:
+	worker_pool worker;
+	std::optional<config_snapshot> pending;
+	std::chrono::steady_clock::time_point last_change;
+	std::atomic<bool> writing = false;
+};
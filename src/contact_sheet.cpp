@@ -0,0 +1,429 @@
+#include "contact_sheet.hpp"
+#include "cpu_features.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define FONT_WIDTH 5
+#define FONT_HEIGHT 7
+#define FONT_FIRST_CHAR 32
+#define FONT_LAST_CHAR 126
+#define SHEET_PADDING 8
+#define SHEET_LABEL_SCALE 2
+#define SHEET_LABEL_HEIGHT (FONT_HEIGHT * SHEET_LABEL_SCALE + SHEET_PADDING)
+#define SHEET_BACKGROUND 24
+
+// One byte per row, the low 5 bits are the pixels from left to right
+static const uint8_t FONT_5X7[FONT_LAST_CHAR - FONT_FIRST_CHAR + 1][FONT_HEIGHT] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+	{ 0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00 }, // "
+	{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a }, // #
+	{ 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 }, // $
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+	{ 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d }, // &
+	{ 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 }, // '
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+	{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 }, // *
+	{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 }, // +
+	{ 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08 }, // ,
+	{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 }, // -
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c }, // .
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+	{ 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e }, // 0
+	{ 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e }, // 1
+	{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f }, // 2
+	{ 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e }, // 3
+	{ 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 }, // 4
+	{ 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e }, // 5
+	{ 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e }, // 6
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+	{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e }, // 8
+	{ 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c }, // 9
+	{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 }, // :
+	{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 }, // ;
+	{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+	{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 }, // =
+	{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+	{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+	{ 0x0e, 0x11, 0x17, 0x15, 0x17, 0x10, 0x0e }, // @
+	{ 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // A
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e }, // B
+	{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e }, // C
+	{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c }, // D
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f }, // E
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 }, // F
+	{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f }, // G
+	{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // H
+	{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e }, // I
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c }, // J
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f }, // L
+	{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+	{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // O
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 }, // P
+	{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d }, // Q
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 }, // R
+	{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e }, // S
+	{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // U
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 }, // V
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a }, // W
+	{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 }, // X
+	{ 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 }, // Y
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f }, // Z
+	{ 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e }, // [
+	{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // backslash
+	{ 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e }, // ]
+	{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 }, // ^
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f }, // _
+	{ 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 }, // `
+	{ 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // a
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e }, // b
+	{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e }, // c
+	{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c }, // d
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f }, // e
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 }, // f
+	{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f }, // g
+	{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // h
+	{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e }, // i
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c }, // j
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // k
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f }, // l
+	{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 }, // m
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // n
+	{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // o
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 }, // p
+	{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d }, // q
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 }, // r
+	{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e }, // s
+	{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // t
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // u
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 }, // v
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a }, // w
+	{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 }, // x
+	{ 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 }, // y
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f }, // z
+	{ 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02 }, // {
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // |
+	{ 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08 }, // }
+	{ 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00 }, // ~
+};
+
+// Input rows or columns covering each output one, with the fraction of the
+// first and last that falls inside
+struct box_span {
+	uint32_t first;
+	uint32_t last;
+	float first_weight;
+	float last_weight;
+};
+
+static std::vector<box_span> compute_box_spans(uint32_t src_size, uint32_t dst_size)
+{
+	std::vector<box_span> spans(dst_size);
+	double scale = static_cast<double>(src_size) / dst_size;
+	for (uint32_t i = 0; i < dst_size; ++i)
+	{
+		double start = i * scale;
+		double end = std::min((i + 1) * scale, static_cast<double>(src_size));
+		box_span &span = spans[i];
+		span.first = static_cast<uint32_t>(start);
+		span.last = std::max(span.first, static_cast<uint32_t>(std::ceil(end)) - 1);
+		if (span.first == span.last)
+		{
+			span.first_weight = span.last_weight = static_cast<float>(end - start);
+		} else {
+			span.first_weight = static_cast<float>(span.first + 1 - start);
+			span.last_weight = static_cast<float>(end - span.last);
+		}
+	}
+	return spans;
+}
+
+// Adds count source bytes times weight to the float sums of a row
+typedef void (*accumulate_row_kernel)(float *sum, const uint8_t *src, size_t count, float weight);
+// Averages the row sums under each column span into dst_width RGB pixels.
+// row_sum has one float of padding after the last pixel.
+typedef void (*resolve_columns_kernel)(const float *row_sum, const box_span *columns, uint32_t dst_width, float area, uint8_t *dst);
+
+static void accumulate_row_scalar(float *sum, const uint8_t *src, size_t count, float weight)
+{
+	for (size_t i = 0; i < count; ++i)
+		sum[i] += src[i] * weight;
+}
+
+static void resolve_columns_scalar(const float *row_sum, const box_span *columns, uint32_t dst_width, float area, uint8_t *dst)
+{
+	for (uint32_t x = 0; x < dst_width; ++x)
+	{
+		const box_span &column = columns[x];
+		float rgb[3] = {};
+		for (uint32_t sx = column.first; sx <= column.last; ++sx)
+		{
+			float weight = sx == column.first ? column.first_weight : (sx == column.last ? column.last_weight : 1.0f);
+			const float *pixel = row_sum + 3 * sx;
+			rgb[0] += pixel[0] * weight;
+			rgb[1] += pixel[1] * weight;
+			rgb[2] += pixel[2] * weight;
+		}
+		for (int c = 0; c < 3; ++c)
+			dst[3 * x + c] = static_cast<uint8_t>(std::min(rgb[c] / area + 0.5f, 255.0f));
+	}
+}
+
+// The vector kernels do the same multiplies and adds in the same order as the
+// scalar ones, so every kernel produces identical bytes
+#ifdef CPU_X86
+CPU_TARGET("sse2")
+static void accumulate_row_sse2(float *sum, const uint8_t *src, size_t count, float weight)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 w = _mm_set1_ps(weight);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		__m128i low = _mm_unpacklo_epi8(bytes, zero);
+		__m128i high = _mm_unpackhi_epi8(bytes, zero);
+		__m128 a = _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero));
+		__m128 b = _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero));
+		__m128 c = _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero));
+		__m128 d = _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero));
+		_mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), _mm_mul_ps(a, w)));
+		_mm_storeu_ps(sum + i + 4, _mm_add_ps(_mm_loadu_ps(sum + i + 4), _mm_mul_ps(b, w)));
+		_mm_storeu_ps(sum + i + 8, _mm_add_ps(_mm_loadu_ps(sum + i + 8), _mm_mul_ps(c, w)));
+		_mm_storeu_ps(sum + i + 12, _mm_add_ps(_mm_loadu_ps(sum + i + 12), _mm_mul_ps(d, w)));
+	}
+	for (; i < count; ++i)
+		sum[i] += src[i] * weight;
+}
+
+// One pixel per vector, the fourth lane reads the next pixel's red and is dropped
+CPU_TARGET("sse2")
+static void resolve_columns_sse2(const float *row_sum, const box_span *columns, uint32_t dst_width, float area, uint8_t *dst)
+{
+	const __m128 divisor = _mm_set1_ps(area);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 max = _mm_set1_ps(255.0f);
+	for (uint32_t x = 0; x < dst_width; ++x)
+	{
+		const box_span &column = columns[x];
+		__m128 rgb = _mm_setzero_ps();
+		for (uint32_t sx = column.first; sx <= column.last; ++sx)
+		{
+			float weight = sx == column.first ? column.first_weight : (sx == column.last ? column.last_weight : 1.0f);
+			rgb = _mm_add_ps(rgb, _mm_mul_ps(_mm_loadu_ps(row_sum + 3 * sx), _mm_set1_ps(weight)));
+		}
+		__m128i values = _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(_mm_div_ps(rgb, divisor), half), max));
+		// Packs to bytes, the values already fit
+		uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(values, values), values)));
+		dst[3 * x + 0] = static_cast<uint8_t>(packed);
+		dst[3 * x + 1] = static_cast<uint8_t>(packed >> 8);
+		dst[3 * x + 2] = static_cast<uint8_t>(packed >> 16);
+	}
+}
+
+CPU_TARGET("avx2")
+static void accumulate_row_avx2(float *sum, const uint8_t *src, size_t count, float weight)
+{
+	const __m256 w = _mm256_set1_ps(weight);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256 a = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i))));
+		__m256 b = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + 8))));
+		_mm256_storeu_ps(sum + i, _mm256_add_ps(_mm256_loadu_ps(sum + i), _mm256_mul_ps(a, w)));
+		_mm256_storeu_ps(sum + i + 8, _mm256_add_ps(_mm256_loadu_ps(sum + i + 8), _mm256_mul_ps(b, w)));
+	}
+	for (; i < count; ++i)
+		sum[i] += src[i] * weight;
+}
+#endif
+
+static accumulate_row_kernel g_accumulate_row = &accumulate_row_scalar;
+static resolve_columns_kernel g_resolve_columns = &resolve_columns_scalar;
+static downscale_kernel g_downscale_kernel_id = downscale_kernel_scalar;
+
+void init_downscale()
+{
+	if (!set_downscale_kernel(downscale_kernel_avx2) && !set_downscale_kernel(downscale_kernel_sse2))
+		set_downscale_kernel(downscale_kernel_scalar);
+}
+
+bool set_downscale_kernel(downscale_kernel kernel)
+{
+	accumulate_row_kernel accumulate = nullptr;
+	resolve_columns_kernel resolve = nullptr;
+	switch (kernel)
+	{
+	case downscale_kernel_scalar:
+		accumulate = &accumulate_row_scalar;
+		resolve = &resolve_columns_scalar;
+		break;
+#ifdef CPU_X86
+	case downscale_kernel_sse2:
+		if (cpu_supports_sse2())
+		{
+			accumulate = &accumulate_row_sse2;
+			resolve = &resolve_columns_sse2;
+		}
+		break;
+	case downscale_kernel_avx2:
+		// The column pass has no wider work per pixel, it stays on SSE2
+		if (cpu_supports_avx2())
+		{
+			accumulate = &accumulate_row_avx2;
+			resolve = &resolve_columns_sse2;
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+	if (accumulate == nullptr) return false;
+
+	g_accumulate_row = accumulate;
+	g_resolve_columns = resolve;
+	g_downscale_kernel_id = kernel;
+	return true;
+}
+
+downscale_kernel get_downscale_kernel()
+{
+	return g_downscale_kernel_id;
+}
+
+const char *downscale_kernel_name(downscale_kernel kernel)
+{
+	switch (kernel)
+	{
+	case downscale_kernel_sse2:
+		return "sse2";
+	case downscale_kernel_avx2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+void downscale_rgb_box(const uint8_t *src, uint32_t src_width, uint32_t src_height,
+	uint8_t *dst, uint32_t dst_width, uint32_t dst_height, size_t dst_stride)
+{
+	if (dst_width == 0 || dst_height == 0) return;
+
+	std::vector<box_span> rows = compute_box_spans(src_height, dst_height);
+	std::vector<box_span> columns = compute_box_spans(src_width, dst_width);
+	size_t src_stride = static_cast<size_t>(src_width) * 3;
+	// Padded by one float for the vector column pass
+	std::vector<float> row_sum(src_stride + 1);
+	float area = static_cast<float>(src_width) * src_height / (static_cast<float>(dst_width) * dst_height);
+
+	for (uint32_t y = 0; y < dst_height; ++y)
+	{
+		const box_span &span = rows[y];
+		std::fill(row_sum.begin(), row_sum.end(), 0.0f);
+		for (uint32_t sy = span.first; sy <= span.last; ++sy)
+		{
+			float weight = sy == span.first ? span.first_weight : (sy == span.last ? span.last_weight : 1.0f);
+			g_accumulate_row(row_sum.data(), src + sy * src_stride, src_stride, weight);
+		}
+		g_resolve_columns(row_sum.data(), columns.data(), dst_width, area, dst + y * dst_stride);
+	}
+}
+
+void draw_text_rgb(uint8_t *pixels, uint32_t width, uint32_t height, int x, int y, const char *text, uint32_t scale, const uint8_t color[3])
+{
+	for (; *text != '\0'; ++text, x += (FONT_WIDTH + 1) * scale)
+	{
+		unsigned char ch = static_cast<unsigned char>(*text);
+		if (ch < FONT_FIRST_CHAR || ch > FONT_LAST_CHAR)
+			ch = '?';
+		const uint8_t *glyph = FONT_5X7[ch - FONT_FIRST_CHAR];
+		for (int gy = 0; gy < FONT_HEIGHT * static_cast<int>(scale); ++gy)
+		{
+			int py = y + gy;
+			if (py < 0 || py >= static_cast<int>(height)) continue;
+			uint8_t bits = glyph[gy / scale];
+			for (int gx = 0; gx < FONT_WIDTH * static_cast<int>(scale); ++gx)
+			{
+				int px = x + gx;
+				if (px < 0 || px >= static_cast<int>(width) || (bits & (0x10 >> (gx / scale))) == 0) continue;
+				memcpy(pixels + (static_cast<size_t>(py) * width + px) * 3, color, 3);
+			}
+		}
+	}
+}
+
+contact_sheet::contact_sheet(std::vector<std::string> labels, uint32_t cell_width) :
+	labels(std::move(labels)), cell_width(std::max(cell_width, 16u))
+{
+	// Close to square, rounded towards more columns since frames are wide
+	uint32_t count = static_cast<uint32_t>(this->labels.size());
+	columns = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count)))));
+}
+
+void contact_sheet::allocate(uint32_t frame_width, uint32_t frame_height)
+{
+	cell_height = std::max(1u, static_cast<uint32_t>(static_cast<uint64_t>(cell_width) * frame_height / std::max(frame_width, 1u)));
+	uint32_t count = static_cast<uint32_t>(labels.size());
+	uint32_t rows = (count + columns - 1) / columns;
+	width = SHEET_PADDING + columns * (cell_width + SHEET_PADDING);
+	height = SHEET_PADDING + rows * (cell_height + SHEET_LABEL_HEIGHT + SHEET_PADDING);
+	pixels.assign(static_cast<size_t>(width) * height * 3, SHEET_BACKGROUND);
+
+	// Labels are cut to the cell, the file names keep the full preset names
+	const uint8_t white[3] = { 230, 230, 230 };
+	size_t max_chars = cell_width / ((FONT_WIDTH + 1) * SHEET_LABEL_SCALE);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		std::string label = labels[i].substr(0, max_chars);
+		int x = SHEET_PADDING + static_cast<int>((i % columns) * (cell_width + SHEET_PADDING));
+		int y = SHEET_PADDING + static_cast<int>((i / columns) * (cell_height + SHEET_LABEL_HEIGHT + SHEET_PADDING) + cell_height + SHEET_PADDING / 2);
+		draw_text_rgb(pixels.data(), width, height, x, y, label.c_str(), SHEET_LABEL_SCALE, white);
+	}
+}
+
+bool contact_sheet::resolve_cell()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return ++resolved == labels.size();
+}
+
+bool contact_sheet::add_frame(uint32_t index, const uint8_t *frame, uint32_t frame_width, uint32_t frame_height)
+{
+	PROFILE_SCOPE("contact sheet: add frame");
+	if (index >= labels.size()) return false;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (pixels.empty())
+			allocate(frame_width, frame_height);
+	}
+
+	// Cells do not overlap, so frames are scaled in parallel without the lock.
+	// A frame of another aspect ratio is fitted and centered.
+	uint32_t fit_width = cell_width, fit_height = cell_height;
+	if (static_cast<uint64_t>(frame_width) * cell_height > static_cast<uint64_t>(frame_height) * cell_width)
+		fit_height = std::max(1u, static_cast<uint32_t>(static_cast<uint64_t>(cell_width) * frame_height / frame_width));
+	else
+		fit_width = std::max(1u, static_cast<uint32_t>(static_cast<uint64_t>(cell_height) * frame_width / std::max(frame_height, 1u)));
+	fit_width = std::min(fit_width, frame_width);
+	fit_height = std::min(fit_height, frame_height);
+
+	size_t x = SHEET_PADDING + (index % columns) * (cell_width + SHEET_PADDING) + (cell_width - fit_width) / 2;
+	size_t y = SHEET_PADDING + (index / columns) * (cell_height + SHEET_LABEL_HEIGHT + SHEET_PADDING) + (cell_height - fit_height) / 2;
+	downscale_rgb_box(frame, frame_width, frame_height, pixels.data() + (y * width + x) * 3, fit_width, fit_height, static_cast<size_t>(width) * 3);
+
+	return resolve_cell();
+}
+
+bool contact_sheet::skip_cell(uint32_t index)
+{
+	if (index >= labels.size()) return false;
+	return resolve_cell();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum downscale_kernel {
+	downscale_kernel_scalar,
+	downscale_kernel_sse2,
+	downscale_kernel_avx2,
+};
+
+const downscale_kernel downscale_kernels[] = {
+	downscale_kernel_scalar,
+	downscale_kernel_sse2,
+	downscale_kernel_avx2
+};
+
+// Selects the fastest downscale kernel supported by the CPU, call once at startup
+void init_downscale();
+// Area-averaging downscale of packed RGB pixels into a dst_width x dst_height
+// region of a larger image with dst_stride bytes per row
+void downscale_rgb_box(const uint8_t *src, uint32_t src_width, uint32_t src_height,
+	uint8_t *dst, uint32_t dst_width, uint32_t dst_height, size_t dst_stride);
+// Forces a kernel so tests and benchmarks can cover each one, every kernel
+// gives the same result. Returns false when the CPU lacks it.
+bool set_downscale_kernel(downscale_kernel kernel);
+downscale_kernel get_downscale_kernel();
+const char *downscale_kernel_name(downscale_kernel kernel);
+// Draws ASCII text with the built-in 5x7 font scaled by scale, clipped to the
+// image. Lowercase is drawn as uppercase.
+void draw_text_rgb(uint8_t *pixels, uint32_t width, uint32_t height, int x, int y, const char *text, uint32_t scale, const uint8_t color[3]);
+
+// Grid of downscaled frames with a label under each, filled from worker
+// threads. Cells take the aspect ratio of the first frame added.
+struct contact_sheet {
+	contact_sheet(std::vector<std::string> labels, uint32_t cell_width);
+
+	// Downscales a packed RGB frame into its cell. Returns true for the call
+	// that resolves the last cell, the caller then writes the sheet.
+	bool add_frame(uint32_t index, const uint8_t *frame, uint32_t frame_width, uint32_t frame_height);
+	// Leaves a cell blank, e.g. when its capture failed. Same return as add_frame.
+	bool skip_cell(uint32_t index);
+
+	// Empty when every cell was skipped
+	const std::vector<uint8_t> &get_pixels() const { return pixels; }
+	uint32_t get_width() const { return width; }
+	uint32_t get_height() const { return height; }
+
+private:
+	void allocate(uint32_t frame_width, uint32_t frame_height);
+	bool resolve_cell();
+
+	std::vector<std::string> labels;
+	uint32_t cell_width;
+	uint32_t cell_height = 0;
+	uint32_t columns;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint8_t> pixels;
+	uint32_t resolved = 0;
+	std::mutex mutex;
+};
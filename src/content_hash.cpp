@@ -0,0 +1,193 @@
+#include "content_hash.hpp"
+#include "cpu_features.hpp"
+
+#include <cstring>
+
+#define HASH_LANES 8
+#define HASH_STRIPE_SIZE 64
+// Stripes accumulated between scrambles
+#define HASH_BLOCK_STRIPES 16
+#define HASH_BLOCK_SIZE (HASH_STRIPE_SIZE * HASH_BLOCK_STRIPES)
+
+#define PRIME32_1 0x9e3779b1u
+#define PRIME64_1 0x9e3779b185ebca87ull
+#define PRIME64_2 0xc2b2ae3d27d4eb4full
+#define PRIME64_3 0x165667b19e3779f9ull
+#define PRIME64_4 0x85ebca77c2b2ae63ull
+
+// Fixed random keys mixed into every stripe and every scramble
+alignas(32) static const uint64_t HASH_KEY[HASH_LANES] = {
+	0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+	0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+};
+alignas(32) static const uint64_t HASH_SCRAMBLE_KEY[HASH_LANES] = {
+	0xcb00c391bb52283cull, 0xa32e531b8b65d088ull, 0x4ef90da297486471ull, 0xd8acdea946ef1938ull,
+	0x3f349ce33f76faa8ull, 0x1d4f0bc7c7bbdcf9ull, 0x3159b4cd4be0518aull, 0x647378d9c97e9fc8ull,
+};
+
+typedef void (*hash_blocks_kernel)(uint64_t *acc, const uint8_t *data, size_t block_count);
+
+static uint64_t load64(const uint8_t *p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static void accumulate_stripe_scalar(uint64_t *acc, const uint8_t *stripe)
+{
+	for (int lane = 0; lane < HASH_LANES; ++lane)
+	{
+		uint64_t data = load64(stripe + 8 * lane);
+		uint64_t keyed = data ^ HASH_KEY[lane];
+		acc[lane ^ 1] += data;
+		acc[lane] += (keyed & 0xffffffff) * (keyed >> 32);
+	}
+}
+
+static void scramble_scalar(uint64_t *acc)
+{
+	for (int lane = 0; lane < HASH_LANES; ++lane)
+		acc[lane] = (acc[lane] ^ (acc[lane] >> 47) ^ HASH_SCRAMBLE_KEY[lane]) * PRIME32_1;
+}
+
+static void hash_blocks_scalar(uint64_t *acc, const uint8_t *data, size_t block_count)
+{
+	for (size_t block = 0; block < block_count; ++block, data += HASH_BLOCK_SIZE)
+	{
+		for (int stripe = 0; stripe < HASH_BLOCK_STRIPES; ++stripe)
+			accumulate_stripe_scalar(acc, data + stripe * HASH_STRIPE_SIZE);
+		scramble_scalar(acc);
+	}
+}
+
+#ifdef CPU_X86
+CPU_TARGET("sse2")
+static void hash_blocks_sse2(uint64_t *acc_out, const uint8_t *data, size_t block_count)
+{
+	__m128i acc[4], key[4], scramble_key[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		acc[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc_out) + i);
+		key[i] = _mm_load_si128(reinterpret_cast<const __m128i *>(HASH_KEY) + i);
+		scramble_key[i] = _mm_load_si128(reinterpret_cast<const __m128i *>(HASH_SCRAMBLE_KEY) + i);
+	}
+	const __m128i prime = _mm_set1_epi32(static_cast<int>(PRIME32_1));
+
+	for (size_t block = 0; block < block_count; ++block, data += HASH_BLOCK_SIZE)
+	{
+		for (int stripe = 0; stripe < HASH_BLOCK_STRIPES; ++stripe)
+		{
+			const __m128i *p = reinterpret_cast<const __m128i *>(data + stripe * HASH_STRIPE_SIZE);
+			for (int i = 0; i < 4; ++i)
+			{
+				__m128i value = _mm_loadu_si128(p + i);
+				__m128i keyed = _mm_xor_si128(value, key[i]);
+				// Low half of each lane times its high half
+				__m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(3, 3, 1, 1)));
+				__m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+				acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+			}
+		}
+		for (int i = 0; i < 4; ++i)
+		{
+			__m128i a = _mm_xor_si128(_mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47)), scramble_key[i]);
+			// 64 x 32-bit multiply from two 32 x 32 products
+			__m128i low = _mm_mul_epu32(a, prime);
+			__m128i high = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+			acc[i] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+		}
+	}
+
+	for (int i = 0; i < 4; ++i)
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(acc_out) + i, acc[i]);
+}
+
+CPU_TARGET("avx2")
+static void hash_blocks_avx2(uint64_t *acc_out, const uint8_t *data, size_t block_count)
+{
+	__m256i acc[2], key[2], scramble_key[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		acc[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc_out) + i);
+		key[i] = _mm256_load_si256(reinterpret_cast<const __m256i *>(HASH_KEY) + i);
+		scramble_key[i] = _mm256_load_si256(reinterpret_cast<const __m256i *>(HASH_SCRAMBLE_KEY) + i);
+	}
+	const __m256i prime = _mm256_set1_epi32(static_cast<int>(PRIME32_1));
+
+	for (size_t block = 0; block < block_count; ++block, data += HASH_BLOCK_SIZE)
+	{
+		for (int stripe = 0; stripe < HASH_BLOCK_STRIPES; ++stripe)
+		{
+			const __m256i *p = reinterpret_cast<const __m256i *>(data + stripe * HASH_STRIPE_SIZE);
+			for (int i = 0; i < 2; ++i)
+			{
+				__m256i value = _mm256_loadu_si256(p + i);
+				__m256i keyed = _mm256_xor_si256(value, key[i]);
+				__m256i product = _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(3, 3, 1, 1)));
+				__m256i swapped = _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+				acc[i] = _mm256_add_epi64(acc[i], _mm256_add_epi64(product, swapped));
+			}
+		}
+		for (int i = 0; i < 2; ++i)
+		{
+			__m256i a = _mm256_xor_si256(_mm256_xor_si256(acc[i], _mm256_srli_epi64(acc[i], 47)), scramble_key[i]);
+			__m256i low = _mm256_mul_epu32(a, prime);
+			__m256i high = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+			acc[i] = _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+		}
+	}
+
+	for (int i = 0; i < 2; ++i)
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(acc_out) + i, acc[i]);
+}
+#endif
+
+static hash_blocks_kernel g_hash_kernel = &hash_blocks_scalar;
+
+void init_content_hash()
+{
+#ifdef CPU_X86
+	if (cpu_supports_avx2())
+		g_hash_kernel = &hash_blocks_avx2;
+	else if (cpu_supports_sse2())
+		g_hash_kernel = &hash_blocks_sse2;
+#endif
+}
+
+static uint64_t avalanche(uint64_t h)
+{
+	h ^= h >> 37;
+	h *= 0x165667919e3779f9ull;
+	return h ^ (h >> 32);
+}
+
+uint64_t content_hash(const uint8_t *data, size_t size, uint64_t seed)
+{
+	uint64_t total_size = size;
+	uint64_t acc[HASH_LANES] = {
+		PRIME32_1, PRIME64_1 + seed, PRIME64_2, PRIME64_3,
+		PRIME64_4 - seed, PRIME64_2 ^ seed, PRIME64_1, PRIME32_1 ^ seed,
+	};
+
+	size_t block_count = size / HASH_BLOCK_SIZE;
+	g_hash_kernel(acc, data, block_count);
+	data += block_count * HASH_BLOCK_SIZE;
+	size -= block_count * HASH_BLOCK_SIZE;
+
+	// The tail is zero padded to whole stripes, the length below tells apart
+	// inputs that only differ in trailing zeros
+	for (; size > 0; data += HASH_STRIPE_SIZE)
+	{
+		uint8_t stripe[HASH_STRIPE_SIZE] = {};
+		size_t n = size < HASH_STRIPE_SIZE ? size : HASH_STRIPE_SIZE;
+		memcpy(stripe, data, n);
+		accumulate_stripe_scalar(acc, stripe);
+		size -= n;
+	}
+
+	uint64_t h = total_size * PRIME64_1;
+	for (int lane = 0; lane < HASH_LANES; ++lane)
+		h = ((h ^ avalanche(acc[lane] ^ HASH_KEY[lane])) * PRIME64_2) + PRIME64_4;
+	return avalanche(h);
+}
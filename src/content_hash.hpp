@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Selects the fastest hash kernel supported by the CPU, call once at startup
+void init_content_hash();
+// 64-bit XXH3-style hash of a buffer, the same on every kernel. Meant for
+// spotting identical frames, not for anything adversarial.
+uint64_t content_hash(const uint8_t *data, size_t size, uint64_t seed = 0);
@@ -0,0 +1,54 @@
+#include "cpu_features.hpp"
+
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void cpuid(int out[4], int leaf, int subleaf)
+{
+#ifdef _MSC_VER
+	__cpuidex(out, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, out[0], out[1], out[2], out[3]);
+#endif
+}
+
+bool cpu_supports_sse2()
+{
+	int regs[4];
+	cpuid(regs, 1, 0);
+	return (regs[3] & (1 << 26)) != 0;
+}
+
+bool cpu_supports_ssse3()
+{
+	int regs[4];
+	cpuid(regs, 1, 0);
+	return (regs[2] & (1 << 9)) != 0;
+}
+
+bool cpu_supports_avx2()
+{
+	int regs[4];
+	cpuid(regs, 0, 0);
+	if (regs[0] < 7) return false;
+
+	// The OS has to save the upper halves of the YMM registers too (OSXSAVE + XCR0)
+	cpuid(regs, 1, 0);
+	if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0) return false;
+#ifdef _MSC_VER
+	unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	unsigned long long xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+	if ((xcr0 & 0x6) != 0x6) return false;
+
+	cpuid(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+}
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+
+// x86 kernels are compiled per function with CPU_TARGET and picked at startup
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CPU_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define CPU_TARGET(isa)
+#else
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+bool cpu_supports_sse2();
+bool cpu_supports_ssse3();
+// Also checks that the OS saves the YMM registers
+bool cpu_supports_avx2();
+#endif
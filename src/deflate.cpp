@@ -0,0 +1,711 @@
+#include "deflate.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_MIN_MATCH 4
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_BLOCK_SYMBOLS 65536
+#define DEFLATE_LIT_CODES 286
+#define DEFLATE_DIST_CODES 30
+#define DEFLATE_CL_CODES 19
+#define DEFLATE_MAX_CODE_LENGTH 15
+#define DEFLATE_MAX_CL_CODE_LENGTH 7
+#define ADLER_MOD 65521
+// Largest n with 255n(n+1)/2 + (n+1)(ADLER_MOD-1) < 2^32
+#define ADLER_BLOCK 5552
+
+// Symbols are literals (< 256) or matches with the top bit set
+#define MATCH_FLAG 0x80000000u
+
+static const uint8_t CL_ORDER[DEFLATE_CL_CODES] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+struct code_tables {
+	// Indexed by match length - 3 and distance - 1
+	uint8_t length_code[DEFLATE_MAX_MATCH - 2];
+	uint8_t dist_code[DEFLATE_WINDOW_SIZE];
+
+	code_tables()
+	{
+		for (int code = 0; code < 29; ++code)
+			for (int len = LENGTH_BASE[code]; len < LENGTH_BASE[code] + (1 << LENGTH_EXTRA[code]) && len <= DEFLATE_MAX_MATCH; ++len)
+				length_code[len - 3] = static_cast<uint8_t>(code);
+		// 258 also fits the range of code 27, it has its own code
+		length_code[DEFLATE_MAX_MATCH - 3] = 28;
+		for (int code = 0; code < 30; ++code)
+			for (int dist = DIST_BASE[code]; dist < DIST_BASE[code] + (1 << DIST_EXTRA[code]); ++dist)
+				dist_code[dist - 1] = static_cast<uint8_t>(code);
+	}
+};
+
+static const code_tables g_code_tables;
+
+struct bit_writer {
+	std::vector<uint8_t> &out;
+	uint64_t bits = 0;
+	uint32_t count = 0;
+
+	bit_writer(std::vector<uint8_t> &out) : out(out) {};
+
+	// LSB first, count <= 32
+	void put(uint32_t value, uint32_t bit_count)
+	{
+		bits |= static_cast<uint64_t>(value) << count;
+		count += bit_count;
+		while (count >= 8)
+		{
+			out.push_back(static_cast<uint8_t>(bits));
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+
+	void align()
+	{
+		if (count > 0)
+			put(0, 8 - count);
+	}
+};
+
+struct huffman_code {
+	uint8_t lengths[DEFLATE_LIT_CODES];
+	// Bit-reversed, ready for the LSB-first writer
+	uint16_t codes[DEFLATE_LIT_CODES];
+};
+
+struct symbol_frequency {
+	uint32_t key;
+	uint16_t symbol;
+};
+
+// In-place minimum-redundancy code lengths of symbols sorted by ascending
+// frequency (Moffat and Katajainen)
+static void compute_minimum_redundancy(symbol_frequency *a, int n)
+{
+	if (n == 1)
+	{
+		a[0].key = 1;
+		return;
+	}
+
+	a[0].key += a[1].key;
+	int root = 0, leaf = 2;
+	for (int next = 1; next < n - 1; ++next)
+	{
+		if (leaf >= n || a[root].key < a[leaf].key)
+		{
+			a[next].key = a[root].key;
+			a[root++].key = next;
+		} else {
+			a[next].key = a[leaf++].key;
+		}
+		if (leaf >= n || (root < next && a[root].key < a[leaf].key))
+		{
+			a[next].key += a[root].key;
+			a[root++].key = next;
+		} else {
+			a[next].key += a[leaf++].key;
+		}
+	}
+
+	a[n - 2].key = 0;
+	for (int next = n - 3; next >= 0; --next)
+		a[next].key = a[a[next].key].key + 1;
+
+	int available = 1, used = 0, depth = 0;
+	int root_index = n - 2, next = n - 1;
+	while (available > 0)
+	{
+		while (root_index >= 0 && static_cast<int>(a[root_index].key) == depth)
+		{
+			++used;
+			--root_index;
+		}
+		while (available > used)
+		{
+			a[next--].key = depth;
+			--available;
+		}
+		available = 2 * used;
+		++depth;
+		used = 0;
+	}
+}
+
+// Every code is built with at least two used symbols, so it is always complete
+static void build_huffman_code(const uint32_t *frequencies, int symbol_count, int max_length, huffman_code &out)
+{
+	symbol_frequency sorted[DEFLATE_LIT_CODES];
+	int used = 0;
+	for (int i = 0; i < symbol_count; ++i)
+	{
+		out.lengths[i] = 0;
+		if (frequencies[i] != 0)
+			sorted[used++] = { frequencies[i], static_cast<uint16_t>(i) };
+	}
+	std::sort(sorted, sorted + used, [](const symbol_frequency &a, const symbol_frequency &b) { return a.key < b.key; });
+
+	compute_minimum_redundancy(sorted, used);
+
+	// Limit the lengths by moving leaves down until the Kraft sum fits again
+	int length_counts[33] = {};
+	for (int i = 0; i < used; ++i)
+		++length_counts[std::min<uint32_t>(sorted[i].key, 32)];
+	for (int i = max_length + 1; i <= 32; ++i)
+		length_counts[max_length] += length_counts[i];
+	uint32_t total = 0;
+	for (int i = max_length; i > 0; --i)
+		total += static_cast<uint32_t>(length_counts[i]) << (max_length - i);
+	while (total != (1u << max_length))
+	{
+		--length_counts[max_length];
+		for (int i = max_length - 1; i > 0; --i)
+		{
+			if (length_counts[i] != 0)
+			{
+				--length_counts[i];
+				length_counts[i + 1] += 2;
+				break;
+			}
+		}
+		--total;
+	}
+
+	// Shortest codes go to the most frequent symbols at the end of the list
+	for (int length = 1, j = used; length <= max_length; ++length)
+		for (int k = length_counts[length]; k > 0; --k)
+			out.lengths[sorted[--j].symbol] = static_cast<uint8_t>(length);
+
+	// Canonical codes
+	uint32_t next_code[DEFLATE_MAX_CODE_LENGTH + 2] = {};
+	int bl_count[DEFLATE_MAX_CODE_LENGTH + 1] = {};
+	for (int i = 0; i < symbol_count; ++i)
+		++bl_count[out.lengths[i]];
+	bl_count[0] = 0;
+	uint32_t code = 0;
+	for (int bits = 1; bits <= DEFLATE_MAX_CODE_LENGTH; ++bits)
+	{
+		code = (code + bl_count[bits - 1]) << 1;
+		next_code[bits] = code;
+	}
+	for (int i = 0; i < symbol_count; ++i)
+	{
+		int length = out.lengths[i];
+		if (length == 0) continue;
+		uint32_t value = next_code[length]++;
+		uint32_t reversed = 0;
+		for (int b = 0; b < length; ++b)
+			reversed |= ((value >> b) & 1) << (length - 1 - b);
+		out.codes[i] = static_cast<uint16_t>(reversed);
+	}
+}
+
+static void write_dynamic_block(bit_writer &writer, const std::vector<uint32_t> &symbols, bool final)
+{
+	uint32_t lit_freq[DEFLATE_LIT_CODES] = {};
+	uint32_t dist_freq[DEFLATE_DIST_CODES] = {};
+	for (uint32_t symbol : symbols)
+	{
+		if (symbol & MATCH_FLAG)
+		{
+			++lit_freq[257 + g_code_tables.length_code[(symbol >> 16) & 0xff]];
+			++dist_freq[g_code_tables.dist_code[symbol & 0xffff]];
+		} else {
+			++lit_freq[symbol];
+		}
+	}
+	lit_freq[256] = 1;
+	// Keep both codes complete even when a block has few distinct symbols
+	if (lit_freq[0] == 0) lit_freq[0] = 1;
+	if (dist_freq[0] == 0) dist_freq[0] = 1;
+	if (dist_freq[1] == 0) dist_freq[1] = 1;
+
+	huffman_code lit_code, dist_code;
+	build_huffman_code(lit_freq, DEFLATE_LIT_CODES, DEFLATE_MAX_CODE_LENGTH, lit_code);
+	build_huffman_code(dist_freq, DEFLATE_DIST_CODES, DEFLATE_MAX_CODE_LENGTH, dist_code);
+
+	int hlit = DEFLATE_LIT_CODES;
+	while (hlit > 257 && lit_code.lengths[hlit - 1] == 0) --hlit;
+	int hdist = DEFLATE_DIST_CODES;
+	while (hdist > 1 && dist_code.lengths[hdist - 1] == 0) --hdist;
+
+	// Run-length code the concatenated code lengths
+	uint8_t lengths[DEFLATE_LIT_CODES + DEFLATE_DIST_CODES];
+	memcpy(lengths, lit_code.lengths, hlit);
+	memcpy(lengths + hlit, dist_code.lengths, hdist);
+	int length_count = hlit + hdist;
+
+	// Symbol in the low byte, extra bits value above
+	uint32_t cl_symbols[DEFLATE_LIT_CODES + DEFLATE_DIST_CODES];
+	int cl_symbol_count = 0;
+	uint32_t cl_freq[DEFLATE_CL_CODES] = {};
+	for (int i = 0; i < length_count;)
+	{
+		uint8_t length = lengths[i];
+		int run = 1;
+		while (i + run < length_count && lengths[i + run] == length) ++run;
+		i += run;
+
+		if (length == 0)
+		{
+			while (run >= 11)
+			{
+				int n = std::min(run, 138);
+				cl_symbols[cl_symbol_count++] = 18 | ((n - 11) << 8);
+				++cl_freq[18];
+				run -= n;
+			}
+			if (run >= 3)
+			{
+				cl_symbols[cl_symbol_count++] = 17 | ((run - 3) << 8);
+				++cl_freq[17];
+				run = 0;
+			}
+		} else {
+			cl_symbols[cl_symbol_count++] = length;
+			++cl_freq[length];
+			--run;
+			while (run >= 3)
+			{
+				int n = std::min(run, 6);
+				cl_symbols[cl_symbol_count++] = 16 | ((n - 3) << 8);
+				++cl_freq[16];
+				run -= n;
+			}
+		}
+		for (; run > 0; --run)
+		{
+			cl_symbols[cl_symbol_count++] = length;
+			++cl_freq[length];
+		}
+	}
+
+	uint32_t cl_used = 0;
+	for (uint32_t freq : cl_freq)
+		cl_used += freq != 0;
+	if (cl_used < 2)
+		cl_freq[cl_freq[0] == 0 ? 0 : 1] = 1;
+	huffman_code cl_code;
+	build_huffman_code(cl_freq, DEFLATE_CL_CODES, DEFLATE_MAX_CL_CODE_LENGTH, cl_code);
+	int hclen = DEFLATE_CL_CODES;
+	while (hclen > 4 && cl_code.lengths[CL_ORDER[hclen - 1]] == 0) --hclen;
+
+	writer.put(final ? 1 : 0, 1);
+	writer.put(2, 2);
+	writer.put(hlit - 257, 5);
+	writer.put(hdist - 1, 5);
+	writer.put(hclen - 4, 4);
+	for (int i = 0; i < hclen; ++i)
+		writer.put(cl_code.lengths[CL_ORDER[i]], 3);
+	for (int i = 0; i < cl_symbol_count; ++i)
+	{
+		uint32_t symbol = cl_symbols[i] & 0xff;
+		uint32_t extra = cl_symbols[i] >> 8;
+		writer.put(cl_code.codes[symbol], cl_code.lengths[symbol]);
+		if (symbol == 16)
+			writer.put(extra, 2);
+		else if (symbol == 17)
+			writer.put(extra, 3);
+		else if (symbol == 18)
+			writer.put(extra, 7);
+	}
+
+	for (uint32_t symbol : symbols)
+	{
+		if (symbol & MATCH_FLAG)
+		{
+			uint32_t length = ((symbol >> 16) & 0xff);
+			uint32_t dist = symbol & 0xffff;
+			uint32_t length_symbol = g_code_tables.length_code[length];
+			writer.put(lit_code.codes[257 + length_symbol], lit_code.lengths[257 + length_symbol]);
+			if (LENGTH_EXTRA[length_symbol] != 0)
+				writer.put(length + 3 - LENGTH_BASE[length_symbol], LENGTH_EXTRA[length_symbol]);
+			uint32_t dist_symbol = g_code_tables.dist_code[dist];
+			writer.put(dist_code.codes[dist_symbol], dist_code.lengths[dist_symbol]);
+			if (DIST_EXTRA[dist_symbol] != 0)
+				writer.put(dist + 1 - DIST_BASE[dist_symbol], DIST_EXTRA[dist_symbol]);
+		} else {
+			writer.put(lit_code.codes[symbol], lit_code.lengths[symbol]);
+		}
+	}
+	writer.put(lit_code.codes[256], lit_code.lengths[256]);
+}
+
+static uint32_t load32(const uint8_t *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t hash4(uint32_t value)
+{
+	return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+void deflate_chunk(const uint8_t *data, size_t size, bool final, std::vector<uint8_t> &out)
+{
+	bit_writer writer(out);
+	std::vector<int32_t> head(static_cast<size_t>(1) << DEFLATE_HASH_BITS, -1);
+	std::vector<uint32_t> symbols;
+	symbols.reserve(DEFLATE_BLOCK_SYMBOLS);
+
+	// Positions are stored relative to block_start so they fit in 32 bits
+	const uint8_t *base = data;
+	size_t pos = 0;
+	while (pos < size)
+	{
+		if (pos + DEFLATE_MIN_MATCH <= size)
+		{
+			if (pos - (base - data) > INT32_MAX - DEFLATE_WINDOW_SIZE)
+			{
+				// Rebase so the stored positions stay in range
+				std::fill(head.begin(), head.end(), -1);
+				base = data + pos;
+			}
+
+			uint32_t value = load32(data + pos);
+			uint32_t hash = hash4(value);
+			int32_t relative = static_cast<int32_t>(pos - (base - data));
+			int32_t candidate = head[hash];
+			head[hash] = relative;
+
+			if (candidate >= 0 && relative - candidate <= DEFLATE_WINDOW_SIZE && load32(base + candidate) == value)
+			{
+				const uint8_t *match = base + candidate;
+				size_t max_length = std::min<size_t>(DEFLATE_MAX_MATCH, size - pos);
+				size_t length = DEFLATE_MIN_MATCH;
+				while (length < max_length && match[length] == data[pos + length])
+					++length;
+
+				uint32_t dist = static_cast<uint32_t>(relative - candidate);
+				symbols.push_back(MATCH_FLAG | static_cast<uint32_t>(length - 3) << 16 | (dist - 1));
+				pos += length;
+			} else {
+				symbols.push_back(data[pos++]);
+			}
+		} else {
+			symbols.push_back(data[pos++]);
+		}
+
+		if (symbols.size() >= DEFLATE_BLOCK_SYMBOLS)
+		{
+			write_dynamic_block(writer, symbols, final && pos == size);
+			symbols.clear();
+		}
+	}
+	if (!symbols.empty() || size == 0)
+		write_dynamic_block(writer, symbols, final);
+
+	if (!final)
+	{
+		// Empty stored block: BFINAL 0, BTYPE 00, aligned LEN 0 and NLEN 0xffff
+		writer.put(0, 3);
+		writer.align();
+		writer.put(0x0000, 16);
+		writer.put(0xffff, 16);
+	}
+	writer.align();
+}
+
+uint32_t deflate_adler32(uint32_t adler, const uint8_t *data, size_t size)
+{
+	uint32_t a = adler & 0xffff;
+	uint32_t b = adler >> 16;
+	while (size > 0)
+	{
+		size_t block = std::min<size_t>(size, ADLER_BLOCK);
+		size -= block;
+		for (size_t i = 0; i < block; ++i)
+		{
+			a += data[i];
+			b += a;
+		}
+		data += block;
+		a %= ADLER_MOD;
+		b %= ADLER_MOD;
+	}
+	return (b << 16) | a;
+}
+
+// Same arithmetic as zlib's adler32_combine
+uint32_t deflate_adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2)
+{
+	uint32_t rem = static_cast<uint32_t>(size2 % ADLER_MOD);
+	uint32_t sum1 = adler1 & 0xffff;
+	uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(rem) * sum1) % ADLER_MOD);
+	sum1 += (adler2 & 0xffff) + ADLER_MOD - 1;
+	sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_MOD - rem;
+	if (sum1 >= ADLER_MOD) sum1 -= ADLER_MOD;
+	if (sum1 >= ADLER_MOD) sum1 -= ADLER_MOD;
+	if (sum2 >= (static_cast<uint32_t>(ADLER_MOD) << 1)) sum2 -= (static_cast<uint32_t>(ADLER_MOD) << 1);
+	if (sum2 >= ADLER_MOD) sum2 -= ADLER_MOD;
+	return (sum2 << 16) | sum1;
+}
+
+#define INFLATE_FAST_BITS 10
+
+struct bit_reader {
+	const uint8_t *data;
+	size_t size;
+	size_t pos = 0;
+	uint64_t bits = 0;
+	uint32_t count = 0;
+
+	bit_reader(const uint8_t *data, size_t size) : data(data), size(size) {};
+
+	// Past the end the input reads as zeros, overrun() tells when those were used
+	void refill()
+	{
+		while (count <= 56)
+		{
+			if (pos < size)
+				bits |= static_cast<uint64_t>(data[pos]) << count;
+			++pos;
+			count += 8;
+		}
+	}
+
+	uint32_t peek(uint32_t bit_count)
+	{
+		if (count < bit_count)
+			refill();
+		return static_cast<uint32_t>(bits & ((1ull << bit_count) - 1));
+	}
+
+	void skip(uint32_t bit_count)
+	{
+		bits >>= bit_count;
+		count -= bit_count;
+	}
+
+	// LSB first, bit_count <= 32
+	uint32_t get(uint32_t bit_count)
+	{
+		uint32_t value = peek(bit_count);
+		skip(bit_count);
+		return value;
+	}
+
+	void align()
+	{
+		skip(count % 8);
+	}
+
+	bool overrun() const
+	{
+		return pos * 8 - count > size * 8;
+	}
+};
+
+// Canonical Huffman decoding, a table for the short codes and a walk over
+// the code lengths for the rest
+struct huffman_decoder {
+	uint16_t counts[DEFLATE_MAX_CODE_LENGTH + 1];
+	uint16_t symbols[DEFLATE_LIT_CODES + 2];
+	// Symbol << 4 | length, 0 when the code is longer than INFLATE_FAST_BITS
+	uint16_t fast[1 << INFLATE_FAST_BITS];
+
+	// Incomplete codes are allowed, RFC 1951 permits them for a single distance code
+	bool build(const uint8_t *lengths, int symbol_count)
+	{
+		memset(counts, 0, sizeof(counts));
+		memset(fast, 0, sizeof(fast));
+		for (int i = 0; i < symbol_count; ++i)
+			++counts[lengths[i]];
+		counts[0] = 0;
+
+		int left = 1;
+		uint16_t offsets[DEFLATE_MAX_CODE_LENGTH + 2] = {};
+		for (int len = 1; len <= DEFLATE_MAX_CODE_LENGTH; ++len)
+		{
+			left = (left << 1) - counts[len];
+			if (left < 0) return false;
+			offsets[len + 1] = offsets[len] + counts[len];
+		}
+		for (int i = 0; i < symbol_count; ++i)
+		{
+			if (lengths[i] != 0)
+				symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+		}
+
+		uint32_t code = 0;
+		int index = 0;
+		for (int len = 1; len <= INFLATE_FAST_BITS; ++len)
+		{
+			for (int i = 0; i < counts[len]; ++i, ++code, ++index)
+			{
+				uint32_t reversed = 0;
+				for (int bit = 0; bit < len; ++bit)
+					reversed |= ((code >> bit) & 1) << (len - 1 - bit);
+				for (uint32_t fill = reversed; fill < (1u << INFLATE_FAST_BITS); fill += 1u << len)
+					fast[fill] = static_cast<uint16_t>(symbols[index] << 4 | len);
+			}
+			code <<= 1;
+		}
+		return true;
+	}
+
+	// Returns -1 on an invalid code
+	int decode(bit_reader &reader) const
+	{
+		uint16_t entry = fast[reader.peek(INFLATE_FAST_BITS)];
+		if (entry != 0)
+		{
+			reader.skip(entry & 15);
+			return entry >> 4;
+		}
+
+		int code = 0, first = 0, index = 0;
+		for (int len = 1; len <= DEFLATE_MAX_CODE_LENGTH; ++len)
+		{
+			code |= static_cast<int>(reader.get(1));
+			int count = counts[len];
+			if (code - count < first)
+				return symbols[index + (code - first)];
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+		return -1;
+	}
+};
+
+struct fixed_decoders {
+	huffman_decoder literals;
+	huffman_decoder distances;
+
+	fixed_decoders()
+	{
+		uint8_t lengths[DEFLATE_LIT_CODES + 2];
+		for (int i = 0; i < 144; ++i) lengths[i] = 8;
+		for (int i = 144; i < 256; ++i) lengths[i] = 9;
+		for (int i = 256; i < 280; ++i) lengths[i] = 7;
+		for (int i = 280; i < DEFLATE_LIT_CODES + 2; ++i) lengths[i] = 8;
+		literals.build(lengths, DEFLATE_LIT_CODES + 2);
+		std::fill(lengths, lengths + DEFLATE_DIST_CODES, static_cast<uint8_t>(5));
+		distances.build(lengths, DEFLATE_DIST_CODES);
+	}
+};
+
+static const fixed_decoders g_fixed_decoders;
+
+static bool read_dynamic_decoders(bit_reader &reader, huffman_decoder &literals, huffman_decoder &distances)
+{
+	uint32_t literal_count = reader.get(5) + 257;
+	uint32_t distance_count = reader.get(5) + 1;
+	uint32_t cl_count = reader.get(4) + 4;
+	if (literal_count > DEFLATE_LIT_CODES || distance_count > DEFLATE_DIST_CODES) return false;
+
+	uint8_t cl_lengths[DEFLATE_CL_CODES] = {};
+	for (uint32_t i = 0; i < cl_count; ++i)
+		cl_lengths[CL_ORDER[i]] = static_cast<uint8_t>(reader.get(3));
+	huffman_decoder cl_decoder;
+	if (!cl_decoder.build(cl_lengths, DEFLATE_CL_CODES)) return false;
+
+	uint8_t lengths[DEFLATE_LIT_CODES + DEFLATE_DIST_CODES];
+	uint32_t index = 0;
+	while (index < literal_count + distance_count)
+	{
+		int symbol = cl_decoder.decode(reader);
+		if (symbol < 0) return false;
+		if (symbol < 16)
+		{
+			lengths[index++] = static_cast<uint8_t>(symbol);
+			continue;
+		}
+
+		uint8_t value = 0;
+		uint32_t repeat;
+		if (symbol == 16)
+		{
+			if (index == 0) return false;
+			value = lengths[index - 1];
+			repeat = 3 + reader.get(2);
+		}
+		else if (symbol == 17)
+			repeat = 3 + reader.get(3);
+		else
+			repeat = 11 + reader.get(7);
+		if (index + repeat > literal_count + distance_count) return false;
+		while (repeat-- > 0)
+			lengths[index++] = value;
+	}
+	// Without an end of block code no block could ever finish
+	if (lengths[256] == 0) return false;
+
+	return literals.build(lengths, literal_count) && distances.build(lengths + literal_count, distance_count);
+}
+
+static bool inflate_block(bit_reader &reader, const huffman_decoder &literals, const huffman_decoder &distances, std::vector<uint8_t> &out, size_t max_size)
+{
+	for (;;)
+	{
+		int symbol = literals.decode(reader);
+		if (symbol < 0 || reader.overrun()) return false;
+		if (symbol < 256)
+		{
+			if (out.size() >= max_size) return false;
+			out.push_back(static_cast<uint8_t>(symbol));
+			continue;
+		}
+		if (symbol == 256) return true;
+
+		symbol -= 257;
+		if (symbol >= 29) return false;
+		size_t length = LENGTH_BASE[symbol] + reader.get(LENGTH_EXTRA[symbol]);
+		int dist_symbol = distances.decode(reader);
+		if (dist_symbol < 0 || dist_symbol >= 30) return false;
+		size_t dist = DIST_BASE[dist_symbol] + reader.get(DIST_EXTRA[dist_symbol]);
+		if (dist > out.size() || out.size() + length > max_size) return false;
+
+		// Byte by byte, the match may overlap what it produces
+		size_t from = out.size() - dist;
+		out.resize(out.size() + length);
+		uint8_t *p = out.data();
+		for (size_t i = 0; i < length; ++i)
+			p[out.size() - length + i] = p[from + i];
+	}
+}
+
+bool inflate_raw(const uint8_t *data, size_t size, std::vector<uint8_t> &out, size_t max_size)
+{
+	bit_reader reader(data, size);
+	huffman_decoder literals, distances;
+	bool final = false;
+	while (!final)
+	{
+		final = reader.get(1) != 0;
+		uint32_t type = reader.get(2);
+		if (type == 0)
+		{
+			reader.align();
+			uint32_t length = reader.get(16);
+			uint32_t inverted = reader.get(16);
+			if ((length ^ 0xffff) != inverted || out.size() + length > max_size) return false;
+			for (uint32_t i = 0; i < length; ++i)
+				out.push_back(static_cast<uint8_t>(reader.get(8)));
+		}
+		else if (type == 1)
+		{
+			if (!inflate_block(reader, g_fixed_decoders.literals, g_fixed_decoders.distances, out, max_size)) return false;
+		}
+		else if (type == 2)
+		{
+			if (!read_dynamic_decoders(reader, literals, distances) ||
+				!inflate_block(reader, literals, distances, out, max_size)) return false;
+		}
+		else
+		{
+			return false;
+		}
+		if (reader.overrun()) return false;
+	}
+	return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Raw deflate (RFC 1951) of an independent chunk, appended to out. Greedy
+// LZ77 with one hash probe per position and dynamic Huffman blocks, tuned for
+// filtered image rows rather than ratio. Matches never reach outside the
+// chunk. With final unset the chunk ends in an empty stored block, so it is
+// byte aligned and the next chunk can be appended as is.
+void deflate_chunk(const uint8_t *data, size_t size, bool final, std::vector<uint8_t> &out);
+
+// Decodes a raw deflate stream up to its final block, appending to out.
+// Fails on malformed input or once out would grow past max_size.
+bool inflate_raw(const uint8_t *data, size_t size, std::vector<uint8_t> &out, size_t max_size = SIZE_MAX);
+
+// Adler-32 as used by the zlib trailer, start with adler = 1
+uint32_t deflate_adler32(uint32_t adler, const uint8_t *data, size_t size);
+// Adler-32 of two concatenated buffers from their checksums and the second size
+uint32_t deflate_adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2);
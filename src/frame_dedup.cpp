@@ -0,0 +1,45 @@
+#include "frame_dedup.hpp"
+
+bool frame_dedup::find_or_claim(uint64_t hash, const std::filesystem::path &path, std::filesystem::path &original)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	// The first writer may still be encoding, its file is about to exist
+	written.wait(lock, [this, hash] {
+		auto it = entries.find(hash);
+		return it == entries.end() || !it->second.pending;
+	});
+
+	auto it = entries.find(hash);
+	std::error_code ec;
+	// A file deleted since it was written no longer stands for the frame
+	if (it != entries.end() && std::filesystem::exists(it->second.path, ec))
+	{
+		original = it->second.path;
+		return true;
+	}
+
+	entries[hash] = { path, true };
+	return false;
+}
+
+void frame_dedup::complete(uint64_t hash, bool written_file)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = entries.find(hash);
+		if (it != entries.end())
+		{
+			if (written_file)
+				it->second.pending = false;
+			else
+				entries.erase(it);
+		}
+	}
+	written.notify_all();
+}
+
+void frame_dedup::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+}
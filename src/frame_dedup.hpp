@@ -0,0 +1,29 @@
+#pragma once
+
+#include <filesystem>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Files written this session keyed by the content hash of their frame, shared
+// by the encoder threads
+struct frame_dedup {
+	// Returns true with the file of an earlier identical frame, waiting while it
+	// is still being written. Otherwise claims the hash for path and the caller
+	// has to call complete once it is done with the file.
+	bool find_or_claim(uint64_t hash, const std::filesystem::path &path, std::filesystem::path &original);
+	// Publishes a claimed file, or drops the claim when it was not written
+	void complete(uint64_t hash, bool written);
+	void clear();
+
+private:
+	struct entry {
+		std::filesystem::path path;
+		bool pending;
+	};
+
+	std::unordered_map<uint64_t, entry> entries;
+	std::mutex mutex;
+	std::condition_variable written;
+};
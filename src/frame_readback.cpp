@@ -0,0 +1,191 @@
+#include "frame_readback.hpp"
+#include "frame_signature.hpp"
+#include "profiler.hpp"
+#include "addon_log.hpp"
+
+bool frame_readback::begin(readback_device *device, uint32_t frame, uint32_t width, uint32_t height, uint8_t *pixels, std::function<void(bool read)> complete)
+{
+	slot *free_slot = nullptr;
+	for (auto& s : slots)
+	{
+		if (s.fence_value != 0) continue;
+		// Prefer a staging resource that already has the right size
+		if (free_slot == nullptr || (s.width == width && s.height == height && s.staging != 0))
+			free_slot = &s;
+	}
+	if (free_slot == nullptr) return false;
+
+	slot &s = *free_slot;
+	if (s.staging != 0 && (s.width != width || s.height != height))
+	{
+		device->destroy_staging(s.staging);
+		s.staging = 0;
+	}
+	if (s.staging == 0)
+	{
+		s.staging = device->create_staging(width, height);
+		if (s.staging == 0) return false;
+		s.width = width;
+		s.height = height;
+	}
+
+	uint64_t fence_value;
+	{
+		PROFILE_SCOPE("readback: copy");
+		fence_value = device->copy_back_buffer(s.staging);
+	}
+	if (fence_value == 0) return false;
+
+	s.fence_value = fence_value;
+	s.start_frame = frame;
+	s.pixels = pixels;
+	s.complete = std::move(complete);
+	return true;
+}
+
+void frame_readback::poll(readback_device *device, uint32_t frame)
+{
+	if (pending_count() == 0) return;
+
+	uint64_t completed = device->get_completed_fence_value();
+	for (auto& s : slots)
+	{
+		if (s.fence_value == 0) continue;
+
+		if (s.fence_value <= completed)
+		{
+			bool read;
+			{
+				PROFILE_SCOPE("readback: map");
+				read = device->read_staging(s.staging, s.pixels);
+			}
+			finish(s, read);
+		}
+		else if (frame - s.start_frame >= FRAME_READBACK_TIMEOUT_FRAMES)
+		{
+			addon_log(addon_log_level::error, "Back buffer copy did not finish, dropping the capture");
+			finish(s, false);
+		}
+	}
+}
+
+size_t frame_readback::pending_count() const
+{
+	size_t count = 0;
+	for (auto& s : slots)
+	{
+		if (s.fence_value != 0)
+			++count;
+	}
+	return count;
+}
+
+void frame_readback::release(readback_device *device)
+{
+	for (auto& s : slots)
+	{
+		if (s.fence_value != 0)
+			finish(s, false);
+		if (s.staging != 0)
+			device->destroy_staging(s.staging);
+		s = slot();
+	}
+}
+
+void frame_readback::finish(slot &s, bool read)
+{
+	s.fence_value = 0;
+	s.pixels = nullptr;
+	// Cleared before the call, the callback may start the next copy
+	std::function<void(bool)> complete = std::move(s.complete);
+	s.complete = nullptr;
+	complete(read);
+}
+
+bool signature_readback::begin(readback_device *device, uint32_t frame, uint32_t width, uint32_t height, std::function<void(bool read, const uint8_t *rows)> complete)
+{
+	slot *free_slot = nullptr;
+	for (auto& s : slots)
+	{
+		if (s.fence_value != 0) continue;
+		if (free_slot == nullptr || (s.width == width && s.staging != 0))
+			free_slot = &s;
+	}
+	if (free_slot == nullptr || height == 0) return false;
+
+	slot &s = *free_slot;
+	if (s.staging != 0 && s.width != width)
+	{
+		device->destroy_staging(s.staging);
+		s.staging = 0;
+	}
+	if (s.staging == 0)
+	{
+		s.staging = device->create_row_staging(width, FRAME_SIGNATURE_ROWS);
+		if (s.staging == 0) return false;
+		s.width = width;
+		s.rows.resize(static_cast<size_t>(width) * FRAME_SIGNATURE_ROWS * 4);
+	}
+
+	uint32_t rows[FRAME_SIGNATURE_ROWS];
+	for (uint32_t r = 0; r < FRAME_SIGNATURE_ROWS; ++r)
+		rows[r] = frame_signature_row(r, height);
+	uint64_t fence_value;
+	{
+		PROFILE_SCOPE("readback: copy signature rows");
+		fence_value = device->copy_back_buffer_rows(s.staging, rows, FRAME_SIGNATURE_ROWS);
+	}
+	if (fence_value == 0) return false;
+
+	s.fence_value = fence_value;
+	s.start_frame = frame;
+	s.complete = std::move(complete);
+	return true;
+}
+
+void signature_readback::poll(readback_device *device, uint32_t frame)
+{
+	if (pending_count() == 0) return;
+
+	uint64_t completed = device->get_completed_fence_value();
+	for (auto& s : slots)
+	{
+		if (s.fence_value == 0) continue;
+
+		if (s.fence_value <= completed)
+			finish(s, device->read_staging(s.staging, s.rows.data()));
+		else if (frame - s.start_frame >= FRAME_READBACK_TIMEOUT_FRAMES)
+			finish(s, false);
+	}
+}
+
+size_t signature_readback::pending_count() const
+{
+	size_t count = 0;
+	for (auto& s : slots)
+	{
+		if (s.fence_value != 0)
+			++count;
+	}
+	return count;
+}
+
+void signature_readback::release(readback_device *device)
+{
+	for (auto& s : slots)
+	{
+		if (s.fence_value != 0)
+			finish(s, false);
+		if (s.staging != 0)
+			device->destroy_staging(s.staging);
+		s = slot();
+	}
+}
+
+void signature_readback::finish(slot &s, bool read)
+{
+	s.fence_value = 0;
+	std::function<void(bool, const uint8_t *)> complete = std::move(s.complete);
+	s.complete = nullptr;
+	complete(read, s.rows.data());
+}
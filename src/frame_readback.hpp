@@ -0,0 +1,97 @@
+#pragma once
+
+#include <functional>
+#include <cstdint>
+#include <vector>
+
+#define FRAME_READBACK_SLOTS 4
+// A copy the GPU has not finished by then is given up on, e.g. after a device loss
+#define FRAME_READBACK_TIMEOUT_FRAMES 60
+// Settle detection samples every frame and compares them a few frames late
+#define SIGNATURE_READBACK_SLOTS 4
+
+// The GPU side of an asynchronous capture. The addon implements it with the
+// ReShade device API (reshade_readback.hpp), tests with a fake device, so the
+// fence and mapping logic builds and runs without a GPU.
+struct readback_device {
+	virtual ~readback_device() {}
+
+	// Creates a CPU readable copy target for the back buffer at width * height,
+	// returns 0 when the back buffer cannot be read back asynchronously
+	virtual uint64_t create_staging(uint32_t width, uint32_t height) = 0;
+	virtual void destroy_staging(uint64_t staging) = 0;
+	// Records a copy of the current back buffer into staging and submits it.
+	// Returns the fence value signaled once the copy is done, 0 on failure.
+	virtual uint64_t copy_back_buffer(uint64_t staging) = 0;
+	virtual uint64_t get_completed_fence_value() = 0;
+	// Maps staging and writes its width * height RGBA pixels
+	virtual bool read_staging(uint64_t staging, uint8_t *pixels) = 0;
+	// Like create_staging for row_count rows of a width wide back buffer,
+	// read_staging then writes width * row_count pixels
+	virtual uint64_t create_row_staging(uint32_t width, uint32_t row_count) = 0;
+	// Records a copy of only the given back buffer rows into a row staging,
+	// same return as copy_back_buffer
+	virtual uint64_t copy_back_buffer_rows(uint64_t staging, const uint32_t *rows, uint32_t row_count) = 0;
+};
+
+// Small pool of staging resources the back buffer is copied into, so a
+// capture only records a copy and the pixels are read a frame or two later
+// once the GPU is done with it. Only used on the render thread of its runtime.
+struct frame_readback {
+	// Records a copy of the back buffer. complete is called from a later poll
+	// with the pixels written to pixels, or with false when the copy failed.
+	// Returns false without calling complete when no slot is free or the
+	// device cannot copy, the caller then captures synchronously.
+	bool begin(readback_device *device, uint32_t frame, uint32_t width, uint32_t height, uint8_t *pixels, std::function<void(bool read)> complete);
+	// Reads back every copy the GPU has finished, call once per frame
+	void poll(readback_device *device, uint32_t frame);
+	size_t pending_count() const;
+	// Fails pending copies and destroys the staging resources, e.g. before the
+	// device goes away
+	void release(readback_device *device);
+
+private:
+	struct slot {
+		uint64_t staging = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		// Zero while the slot is free
+		uint64_t fence_value = 0;
+		uint32_t start_frame = 0;
+		uint8_t *pixels = nullptr;
+		std::function<void(bool)> complete;
+	};
+
+	void finish(slot &s, bool read);
+
+	slot slots[FRAME_READBACK_SLOTS];
+};
+
+// Copies of the few back buffer rows a frame signature is taken from, for
+// settle detection. Has its own small staging resources and buffers, so
+// sampling every frame neither allocates nor takes the slots of captures.
+struct signature_readback {
+	// Records a copy of the signature rows of a width * height back buffer.
+	// complete is called from a later poll with the FRAME_SIGNATURE_ROWS rows,
+	// or with false when the copy failed. Returns false without calling
+	// complete when no slot is free or the device cannot copy rows.
+	bool begin(readback_device *device, uint32_t frame, uint32_t width, uint32_t height, std::function<void(bool read, const uint8_t *rows)> complete);
+	void poll(readback_device *device, uint32_t frame);
+	size_t pending_count() const;
+	void release(readback_device *device);
+
+private:
+	struct slot {
+		uint64_t staging = 0;
+		uint32_t width = 0;
+		// Zero while the slot is free
+		uint64_t fence_value = 0;
+		uint32_t start_frame = 0;
+		std::vector<uint8_t> rows;
+		std::function<void(bool, const uint8_t *)> complete;
+	};
+
+	void finish(slot &s, bool read);
+
+	slot slots[SIGNATURE_READBACK_SLOTS];
+};
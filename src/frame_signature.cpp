@@ -0,0 +1,84 @@
+#include "frame_signature.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define FRAME_SIGNATURE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define SIGNATURE_COLUMNS 32
+
+// Sums the color bytes of pixel_count RGBA pixels, alpha is left out
+static uint32_t sum_rgb(const uint8_t *pixels, size_t pixel_count)
+{
+	size_t i = 0;
+	uint64_t sum = 0;
+#ifdef FRAME_SIGNATURE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 4 <= pixel_count; i += 4)
+	{
+		__m128i block = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 4 * i)), rgb_mask);
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(block, zero));
+	}
+	sum = static_cast<uint64_t>(_mm_cvtsi128_si32(acc)) + static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#endif
+	for (; i < pixel_count; ++i)
+		sum += pixels[4 * i] + pixels[4 * i + 1] + pixels[4 * i + 2];
+	return static_cast<uint32_t>(sum);
+}
+
+// Frames narrower than the grid get one pixel wide cells
+static uint32_t signature_cell_width(uint32_t width)
+{
+	return std::max(width / SIGNATURE_COLUMNS, 1u);
+}
+
+uint32_t frame_signature_row(uint32_t index, uint32_t height)
+{
+	return static_cast<uint32_t>((static_cast<uint64_t>(2 * index + 1) * height) / (2 * FRAME_SIGNATURE_ROWS));
+}
+
+// Sums the cells of one sampled row into out
+static void sum_signature_row(const uint8_t *row, uint32_t width, uint32_t *out)
+{
+	const uint32_t columns = std::min(width, static_cast<uint32_t>(SIGNATURE_COLUMNS));
+	const uint32_t cell_width = signature_cell_width(width);
+	for (uint32_t c = 0; c < columns; ++c)
+		out[c] = sum_rgb(row + static_cast<size_t>(c) * cell_width * 4, cell_width);
+}
+
+void compute_frame_signature(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint32_t> &out)
+{
+	const uint32_t columns = std::min(width, static_cast<uint32_t>(SIGNATURE_COLUMNS));
+	out.assign(height != 0 ? FRAME_SIGNATURE_ROWS * columns : 0, 0);
+	if (out.empty()) return;
+
+	const size_t row_bytes = static_cast<size_t>(width) * 4;
+	for (uint32_t r = 0; r < FRAME_SIGNATURE_ROWS; ++r)
+		sum_signature_row(pixels + frame_signature_row(r, height) * row_bytes, width, &out[r * columns]);
+}
+
+void compute_frame_signature_from_rows(const uint8_t *rows, uint32_t width, std::vector<uint32_t> &out)
+{
+	const uint32_t columns = std::min(width, static_cast<uint32_t>(SIGNATURE_COLUMNS));
+	out.assign(FRAME_SIGNATURE_ROWS * columns, 0);
+	if (out.empty()) return;
+
+	const size_t row_bytes = static_cast<size_t>(width) * 4;
+	for (uint32_t r = 0; r < FRAME_SIGNATURE_ROWS; ++r)
+		sum_signature_row(rows + r * row_bytes, width, &out[r * columns]);
+}
+
+float compare_frame_signatures(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b, uint32_t width)
+{
+	if (a.size() != b.size() || a.empty()) return INFINITY;
+
+	double total = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+		total += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+	return static_cast<float>(total / (static_cast<double>(a.size()) * signature_cell_width(width) * 3));
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Rows of the frame a signature is taken from
+#define FRAME_SIGNATURE_ROWS 32
+
+// Reduces an RGBA frame to a coarse grid of color sums taken from a few
+// sampled rows. Cheap enough to run every frame.
+void compute_frame_signature(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint32_t> &out);
+// Frame row sampled for signature row index (0 to FRAME_SIGNATURE_ROWS - 1)
+uint32_t frame_signature_row(uint32_t index, uint32_t height);
+// Same signature from only the sampled rows, FRAME_SIGNATURE_ROWS packed RGBA
+// rows of width pixels, e.g. copied from the back buffer on their own
+void compute_frame_signature_from_rows(const uint8_t *rows, uint32_t width, std::vector<uint32_t> &out);
+// Mean absolute change per channel (0-255) between two signatures of frames
+// with the given width
+float compare_frame_signatures(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b, uint32_t width);
@@ -0,0 +1,228 @@
+#include "image_encode.hpp"
+#include "png_encode.hpp"
+
+#include <cstring>
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_HEADER_SIZE 14
+#define QOI_END_MARKER_SIZE 8
+#define QOI_MAX_RUN 62
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 40
+
+const char *screenshot_format_extension(screenshot_format format)
+{
+	switch (format)
+	{
+	case format_qoi:
+		return ".qoi";
+	case format_bmp:
+		return ".bmp";
+	default:
+		return ".png";
+	}
+}
+
+bool encode_screenshot_image(screenshot_format format, const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+{
+	switch (format)
+	{
+	case format_qoi:
+		return encode_qoi_rgb(pixels, width, height, out);
+	case format_bmp:
+		return encode_bmp_rgb(pixels, width, height, out);
+	default:
+		return encode_png_rgb(pixels, width, height, out);
+	}
+}
+
+static uint8_t *write_be32(uint8_t *out, uint32_t value)
+{
+	out[0] = static_cast<uint8_t>(value >> 24);
+	out[1] = static_cast<uint8_t>(value >> 16);
+	out[2] = static_cast<uint8_t>(value >> 8);
+	out[3] = static_cast<uint8_t>(value);
+	return out + 4;
+}
+
+static uint8_t *write_le16(uint8_t *out, uint16_t value)
+{
+	out[0] = static_cast<uint8_t>(value);
+	out[1] = static_cast<uint8_t>(value >> 8);
+	return out + 2;
+}
+
+static uint8_t *write_le32(uint8_t *out, uint32_t value)
+{
+	out[0] = static_cast<uint8_t>(value);
+	out[1] = static_cast<uint8_t>(value >> 8);
+	out[2] = static_cast<uint8_t>(value >> 16);
+	out[3] = static_cast<uint8_t>(value >> 24);
+	return out + 4;
+}
+
+static uint32_t read_le32(const uint8_t *data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+// https://qoiformat.org/qoi-specification.pdf, alpha is always opaque
+bool encode_qoi_rgb(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+{
+	if (width == 0 || height == 0) return false;
+
+	size_t pixel_count = static_cast<size_t>(width) * height;
+	// Every pixel costs at most a QOI_OP_RGB
+	out.resize(QOI_HEADER_SIZE + pixel_count * 4 + QOI_END_MARKER_SIZE);
+	uint8_t *p = out.data();
+	memcpy(p, "qoif", 4);
+	p = write_be32(p + 4, width);
+	p = write_be32(p, height);
+	*p++ = 3;
+	*p++ = 0;
+
+	uint32_t index[64] = {};
+	uint8_t prev_r = 0, prev_g = 0, prev_b = 0;
+	uint32_t run = 0;
+	for (size_t i = 0; i < pixel_count; ++i)
+	{
+		uint8_t r = pixels[3 * i], g = pixels[3 * i + 1], b = pixels[3 * i + 2];
+		if (r == prev_r && g == prev_g && b == prev_b)
+		{
+			if (++run == QOI_MAX_RUN)
+			{
+				*p++ = static_cast<uint8_t>(QOI_OP_RUN | (run - 1));
+				run = 0;
+			}
+			continue;
+		}
+		if (run > 0)
+		{
+			*p++ = static_cast<uint8_t>(QOI_OP_RUN | (run - 1));
+			run = 0;
+		}
+
+		uint32_t color = r | (g << 8) | (b << 16) | 0xff000000u;
+		uint32_t hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+		if (index[hash] == color)
+		{
+			*p++ = static_cast<uint8_t>(QOI_OP_INDEX | hash);
+		} else {
+			index[hash] = color;
+
+			int8_t dr = static_cast<int8_t>(r - prev_r);
+			int8_t dg = static_cast<int8_t>(g - prev_g);
+			int8_t db = static_cast<int8_t>(b - prev_b);
+			int8_t dr_dg = static_cast<int8_t>(dr - dg);
+			int8_t db_dg = static_cast<int8_t>(db - dg);
+			if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2)
+			{
+				*p++ = static_cast<uint8_t>(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+			}
+			else if (dg > -33 && dg < 32 && dr_dg > -9 && dr_dg < 8 && db_dg > -9 && db_dg < 8)
+			{
+				*p++ = static_cast<uint8_t>(QOI_OP_LUMA | (dg + 32));
+				*p++ = static_cast<uint8_t>((dr_dg + 8) << 4 | (db_dg + 8));
+			} else {
+				*p++ = QOI_OP_RGB;
+				*p++ = r;
+				*p++ = g;
+				*p++ = b;
+			}
+		}
+		prev_r = r;
+		prev_g = g;
+		prev_b = b;
+	}
+	if (run > 0)
+		*p++ = static_cast<uint8_t>(QOI_OP_RUN | (run - 1));
+
+	static const uint8_t END_MARKER[QOI_END_MARKER_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	memcpy(p, END_MARKER, sizeof(END_MARKER));
+	p += sizeof(END_MARKER);
+	out.resize(p - out.data());
+	return true;
+}
+
+bool encode_bmp_rgb(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+{
+	if (width == 0 || height == 0) return false;
+
+	size_t stride = (static_cast<size_t>(width) * 3 + 3) & ~static_cast<size_t>(3);
+	size_t image_size = stride * height;
+	size_t header_size = BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE;
+	if (header_size + image_size > UINT32_MAX) return false;
+
+	out.resize(header_size + image_size);
+	uint8_t *p = out.data();
+	*p++ = 'B';
+	*p++ = 'M';
+	p = write_le32(p, static_cast<uint32_t>(out.size()));
+	p = write_le32(p, 0);
+	p = write_le32(p, static_cast<uint32_t>(header_size));
+
+	p = write_le32(p, BMP_INFO_HEADER_SIZE);
+	p = write_le32(p, width);
+	// Negative height stores rows top-down, in capture order
+	p = write_le32(p, static_cast<uint32_t>(-static_cast<int32_t>(height)));
+	p = write_le16(p, 1);
+	p = write_le16(p, 24);
+	p = write_le32(p, 0);
+	p = write_le32(p, static_cast<uint32_t>(image_size));
+	p = write_le32(p, 2835);
+	p = write_le32(p, 2835);
+	p = write_le32(p, 0);
+	p = write_le32(p, 0);
+
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const uint8_t *src = pixels + static_cast<size_t>(y) * width * 3;
+		uint8_t *dst = p + y * stride;
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			dst[3 * x] = src[3 * x + 2];
+			dst[3 * x + 1] = src[3 * x + 1];
+			dst[3 * x + 2] = src[3 * x];
+		}
+		memset(dst + static_cast<size_t>(width) * 3, 0, stride - static_cast<size_t>(width) * 3);
+	}
+	return true;
+}
+
+bool decode_bmp_rgb(const uint8_t *data, size_t size, std::vector<uint8_t> &out, uint32_t &width, uint32_t &height)
+{
+	if (size < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE || data[0] != 'B' || data[1] != 'M') return false;
+
+	uint32_t pixel_offset = read_le32(data + 10);
+	const uint8_t *info = data + BMP_FILE_HEADER_SIZE;
+	int32_t signed_width = static_cast<int32_t>(read_le32(info + 4));
+	int32_t signed_height = static_cast<int32_t>(read_le32(info + 8));
+	uint16_t bit_count = static_cast<uint16_t>(info[14] | (info[15] << 8));
+	uint32_t compression = read_le32(info + 16);
+	if (bit_count != 24 || compression != 0 || signed_width <= 0 || signed_height == 0) return false;
+
+	bool top_down = signed_height < 0;
+	width = static_cast<uint32_t>(signed_width);
+	height = static_cast<uint32_t>(top_down ? -static_cast<int64_t>(signed_height) : signed_height);
+	size_t stride = (static_cast<size_t>(width) * 3 + 3) & ~static_cast<size_t>(3);
+	if (pixel_offset > size || size - pixel_offset < stride * height) return false;
+
+	out.resize(static_cast<size_t>(width) * height * 3);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const uint8_t *src = data + pixel_offset + (top_down ? y : height - 1 - y) * stride;
+		uint8_t *dst = out.data() + static_cast<size_t>(y) * width * 3;
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			dst[3 * x] = src[3 * x + 2];
+			dst[3 * x + 1] = src[3 * x + 1];
+			dst[3 * x + 2] = src[3 * x];
+		}
+	}
+	return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "addon_settings.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// File extension including the dot
+const char *screenshot_format_extension(screenshot_format format);
+// Encodes tightly packed RGB pixels into out, resizing it. PNG is the smallest,
+// QOI is lossless and several times faster, BMP is a plain copy.
+bool encode_screenshot_image(screenshot_format format, const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out);
+
+bool encode_qoi_rgb(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out);
+// 24-bit top-down BMP
+bool encode_bmp_rgb(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out);
+// Reads an uncompressed 24-bit BMP back into packed RGB
+bool decode_bmp_rgb(const uint8_t *data, size_t size, std::vector<uint8_t> &out, uint32_t &width, uint32_t &height);
@@ -1,15 +1,35 @@
-#define MINI_CASE_SENSITIVE
-
 #include "preset_keybind.hpp"
 #include "ini_file.hpp"
+#include "addon_log.hpp"
 
-#include <reshade.hpp>
-#include <ini.h>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string_view>
 
 static const char* SECTION_PRESET_KEYBINDS = "PresetKeybinds";
+static const char* SECTION_SETTINGS = "Settings";
 static const char* KEY_PREFIX_PRESET = "Preset_";
 static const char* KEY_PREFIX_KEYBIND = "Keybind_";
 static const char* KEY_PREFIX_ACTION = "Action_";
+static const char* KEY_SETTLE_MIN_FRAMES = "SettleMinFrames";
+static const char* KEY_SETTLE_MAX_FRAMES = "SettleMaxFrames";
+static const char* KEY_SETTLE_THRESHOLD = "SettleThreshold";
+static const char* KEY_FAST_PRESET_SWITCH = "FastPresetSwitch";
+static const char* KEY_SCREENSHOT_FORMAT = "ScreenshotFormat";
+static const char* KEY_CONVERT_BMP_TO_PNG = "ConvertBmpToPng";
+static const char* KEY_BURST_FRAME_COUNT = "BurstFrameCount";
+static const char* KEY_BURST_MEMORY_BUDGET_MB = "BurstMemoryBudgetMB";
+static const char* KEY_BURST_OVERFLOW = "BurstOverflow";
+static const char* KEY_DUPLICATE_FRAMES = "DuplicateFrames";
+static const char* KEY_CONTACT_SHEET = "ContactSheet";
+static const char* KEY_CONTACT_SHEET_CELL_WIDTH = "ContactSheetCellWidth";
+static const char* KEY_COMPARISON_ARCHIVE = "ComparisonArchive";
+static const char* KEY_SCREENSHOT_WRITE_MODE = "ScreenshotWriteMode";
+static const char* KEY_WARM_UP_ON_LOAD = "WarmUpOnLoad";
 
 static std::string to_string(unsigned int keybind[4])
 {
@@ -25,84 +45,452 @@ static std::string to_string(unsigned int keybind[4])
     return ss.str();
 }
 
-static void parse_keybind(std::string& str, unsigned int out[4])
+static void write_preset_keybinds(std::string& out, std::vector<preset_keybind>& preset_keybinds)
 {
-    std::stringstream ss(str);
-    std::string s;
+    out += '[';
+    out += SECTION_PRESET_KEYBINDS;
+    out += "]\n";
+
     int idx = 0;
-    while (std::getline(ss, s, ',') && idx < 4)
+    for (auto& pkb : preset_keybinds)
     {
-        out[idx] = std::stoi(s);
+        out += KEY_PREFIX_PRESET + std::to_string(idx) + '=' + pkb.preset.string() + '\n';
+        out += KEY_PREFIX_KEYBIND + std::to_string(idx) + '=' + to_string(pkb.keybind) + '\n';
+        out += KEY_PREFIX_ACTION + std::to_string(idx) + '=' + std::to_string(pkb.action) + '\n';
         ++idx;
     }
 }
 
-static std::string convert_key(std::string key, const char* from_prefix, const char* to_prefix)
+enum keybind_field {
+    field_preset = 0,
+    field_keybind = 1,
+    field_action = 2
+};
+
+struct keybind_line {
+    uint32_t index;
+    keybind_field field;
+    size_t line_number;
+    std::string_view value;
+};
+
+static std::string_view trim(std::string_view str)
 {
-    std::stringstream ss;
-    ss << to_prefix;
-    ss << key.substr(strlen(from_prefix), key.size()-strlen(from_prefix));
-    return ss.str();
+    size_t begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos)
+    {
+        return std::string_view();
+    }
+    size_t end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
 }
 
-bool save_preset_keybinds(std::filesystem::path& config_path, std::vector<preset_keybind>& preset_keybinds)
+static bool parse_index(std::string_view key, std::string_view prefix, uint32_t& out)
 {
-    mINI::INIFile config_file(config_path.string());
-    mINI::INIStructure ini;
+    if (key.size() <= prefix.size() || key.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+    const char* end = key.data() + key.size();
+    auto result = std::from_chars(key.data() + prefix.size(), end, out);
+    return result.ec == std::errc() && result.ptr == end;
+}
 
-    int idx = 0;
-    for (auto& pkb : preset_keybinds)
+static bool parse_keybind(std::string_view str, unsigned int out[4])
+{
+    unsigned int values[4] = {};
+    const char* it = str.data();
+    const char* end = str.data() + str.size();
+    for (int idx = 0; idx < 4; ++idx)
     {
-        std::stringstream preset_prop, keybind_prop, action_prop;
-        preset_prop << KEY_PREFIX_PRESET << idx;
-        keybind_prop << KEY_PREFIX_KEYBIND << idx;
-        action_prop << KEY_PREFIX_ACTION << idx;
-        ++idx;
+        while (it != end && *it == ' ') ++it;
+        auto result = std::from_chars(it, end, values[idx]);
+        if (result.ec != std::errc())
+        {
+            return false;
+        }
+        it = result.ptr;
+        while (it != end && *it == ' ') ++it;
+        if (idx < 3)
+        {
+            if (it == end || *it != ',')
+            {
+                return false;
+            }
+            ++it;
+        }
+    }
+    if (it != end)
+    {
+        return false;
+    }
+    std::memcpy(out, values, sizeof(values));
+    return true;
+}
 
-        ini[SECTION_PRESET_KEYBINDS][preset_prop.str()] = pkb.preset.string();
-        ini[SECTION_PRESET_KEYBINDS][keybind_prop.str()] = to_string(pkb.keybind);
-        ini[SECTION_PRESET_KEYBINDS][action_prop.str()] = std::to_string(pkb.action);
+static bool parse_action(std::string_view str, keybind_action& out)
+{
+    unsigned int value;
+    auto result = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (result.ec != std::errc() || result.ptr != str.data() + str.size())
+    {
+        return false;
+    }
+    for (auto action : keybind_actions)
+    {
+        if (static_cast<unsigned int>(action) == value)
+        {
+            out = action;
+            return true;
+        }
     }
+    return false;
+}
 
-    return config_file.generate(ini);
+static void report_malformed(std::filesystem::path& config_path, size_t line_number, const char* reason)
+{
+    std::stringstream ss;
+    ss << "Ignoring malformed entry in " << config_path.string() << " line " << line_number << ": " << reason;
+    addon_log(addon_log_level::warning, ss.str().c_str());
 }
 
-bool load_preset_keybinds(std::filesystem::path& config_path, std::vector<preset_keybind>& out)
+static bool read_config_file(std::filesystem::path& config_path, std::string& out)
 {
-    mINI::INIFile config_file(config_path.string());
-    mINI::INIStructure ini;
-    if (!config_file.read(ini))
+    std::ifstream file(config_path, std::ios::binary);
+    if (!file)
     {
         return false;
     }
+    out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
 
-    out.clear();
-    for (auto const& it : ini[SECTION_PRESET_KEYBINDS])
+static std::string_view next_line(std::string_view& data)
+{
+    size_t eol = data.find('\n');
+    std::string_view line = data.substr(0, eol);
+    data.remove_prefix(eol == std::string_view::npos ? data.size() : eol + 1);
+    return line;
+}
+
+// Stores the name of a section header line, returns false for any other line
+static bool parse_section_header(std::string_view line, std::string_view& name)
+{
+    if (line.empty() || line.front() != '[' || line.back() != ']')
+    {
+        return false;
+    }
+    name = trim(line.substr(1, line.size() - 2));
+    return true;
+}
+
+// Single pass over one section without building the whole INI structure. Calls
+// entry(key, value, line_number) for each key, lines without '=' are reported.
+template <typename F>
+static void for_each_section_entry(std::filesystem::path& config_path, std::string_view data, std::string_view section, F&& entry)
+{
+    if (data.compare(0, 3, "\xEF\xBB\xBF") == 0)
+    {
+        data.remove_prefix(3);
+    }
+
+    bool in_section = false;
+    size_t line_number = 0;
+    while (!data.empty())
     {
-        std::string key = it.first;
-        if (key.rfind(KEY_PREFIX_PRESET, 0) == 0)
+        std::string_view line = trim(next_line(data));
+        ++line_number;
+
+        if (line.empty() || line[0] == ';' || line[0] == '#')
         {
-            preset_keybind pkb = {};
+            continue;
+        }
+        std::string_view name;
+        if (line.front() == '[')
+        {
+            in_section = parse_section_header(line, name) && name == section;
+            continue;
+        }
+        if (!in_section)
+        {
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == std::string_view::npos)
+        {
+            report_malformed(config_path, line_number, "missing '='");
+            continue;
+        }
+        entry(trim(line.substr(0, eq)), trim(line.substr(eq + 1)), line_number);
+    }
+}
 
-            pkb.preset = it.second;
+// Malformed entries are reported and skipped instead of throwing
+bool load_preset_keybinds(std::filesystem::path& config_path, std::vector<preset_keybind>& out)
+{
+    std::string content;
+    if (!read_config_file(config_path, content))
+    {
+        return false;
+    }
 
-            std::string keybind_key = convert_key(key, KEY_PREFIX_PRESET, KEY_PREFIX_KEYBIND);
-            if (ini[SECTION_PRESET_KEYBINDS].has(keybind_key))
+    std::vector<keybind_line> lines;
+    for_each_section_entry(config_path, content, SECTION_PRESET_KEYBINDS,
+        [&config_path, &lines](std::string_view key, std::string_view value, size_t line_number) {
+            keybind_line entry = { 0, field_preset, line_number, value };
+            if (parse_index(key, KEY_PREFIX_PRESET, entry.index))
+            {
+                entry.field = field_preset;
+            }
+            else if (parse_index(key, KEY_PREFIX_KEYBIND, entry.index))
+            {
+                entry.field = field_keybind;
+            }
+            else if (parse_index(key, KEY_PREFIX_ACTION, entry.index))
             {
-                std::string keybind_str = ini[SECTION_PRESET_KEYBINDS][keybind_key];
-                parse_keybind(keybind_str, pkb.keybind);
+                entry.field = field_action;
             }
+            else
+            {
+                report_malformed(config_path, line_number, "unknown key");
+                return;
+            }
+            lines.push_back(entry);
+        });
+
+    // Group by index in Preset_N order, keeping file order for duplicates so the last one wins
+    std::stable_sort(lines.begin(), lines.end(), [](keybind_line const& a, keybind_line const& b) {
+        return a.index != b.index ? a.index < b.index : a.field < b.field;
+    });
 
-            std::string action_key = convert_key(key, KEY_PREFIX_PRESET, KEY_PREFIX_ACTION);
-            if (ini[SECTION_PRESET_KEYBINDS].has(action_key))
+    out.clear();
+    for (size_t i = 0; i < lines.size();)
+    {
+        uint32_t index = lines[i].index;
+        preset_keybind pkb = {};
+        bool has_preset = false;
+        for (; i < lines.size() && lines[i].index == index; ++i)
+        {
+            const keybind_line& entry = lines[i];
+            if (entry.field == field_preset)
             {
-                std::string action_str = ini[SECTION_PRESET_KEYBINDS][action_key];
-                pkb.action = static_cast<keybind_action>(stoi(action_str));
+                pkb.preset = std::string(entry.value);
+                has_preset = true;
             }
+            else if (entry.field == field_keybind && !parse_keybind(entry.value, pkb.keybind))
+            {
+                report_malformed(config_path, entry.line_number, "keybind must be four comma-separated numbers");
+            }
+            else if (entry.field == field_action && !parse_action(entry.value, pkb.action))
+            {
+                report_malformed(config_path, entry.line_number, "unknown action");
+            }
+        }
 
+        if (has_preset)
+        {
             out.push_back(std::move(pkb));
         }
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+static void read_uint(std::string_view value, uint32_t& out)
+{
+    uint32_t parsed;
+    auto result = std::from_chars(value.data(), value.data() + value.size(), parsed);
+    if (result.ec == std::errc())
+    {
+        out = parsed;
+    }
+}
+
+static void read_bool(std::string_view value, bool& out)
+{
+    uint32_t parsed = out ? 1 : 0;
+    read_uint(value, parsed);
+    out = parsed != 0;
+}
+
+static void read_float(std::string_view value, float& out)
+{
+    // from_chars for floating point is missing from older standard libraries
+    std::string str(value);
+    char* end;
+    float parsed = strtof(str.c_str(), &end);
+    if (end != str.c_str())
+    {
+        out = parsed;
+    }
+}
+
+// Only accepts values listed in options
+template <typename T, size_t N>
+static void read_enum(std::string_view value, const T (&options)[N], T& out)
+{
+    uint32_t parsed = static_cast<uint32_t>(out);
+    read_uint(value, parsed);
+    for (auto option : options)
+    {
+        if (static_cast<uint32_t>(option) == parsed)
+        {
+            out = option;
+        }
+    }
+}
+
+static void write_addon_settings(std::string& out, addon_settings& settings)
+{
+    out += '[';
+    out += SECTION_SETTINGS;
+    out += "]\n";
+    out += std::string(KEY_SETTLE_MIN_FRAMES) + '=' + std::to_string(settings.settle_min_frames) + '\n';
+    out += std::string(KEY_SETTLE_MAX_FRAMES) + '=' + std::to_string(settings.settle_max_frames) + '\n';
+    out += std::string(KEY_SETTLE_THRESHOLD) + '=' + std::to_string(settings.settle_threshold) + '\n';
+    out += std::string(KEY_FAST_PRESET_SWITCH) + '=' + (settings.fast_preset_switch ? "1" : "0") + '\n';
+    out += std::string(KEY_SCREENSHOT_FORMAT) + '=' + std::to_string(settings.capture_format) + '\n';
+    out += std::string(KEY_CONVERT_BMP_TO_PNG) + '=' + (settings.convert_bmp_to_png ? "1" : "0") + '\n';
+    out += std::string(KEY_BURST_FRAME_COUNT) + '=' + std::to_string(settings.burst_frame_count) + '\n';
+    out += std::string(KEY_BURST_MEMORY_BUDGET_MB) + '=' + std::to_string(settings.burst_memory_budget_mb) + '\n';
+    out += std::string(KEY_BURST_OVERFLOW) + '=' + std::to_string(settings.burst_overflow) + '\n';
+    out += std::string(KEY_DUPLICATE_FRAMES) + '=' + std::to_string(settings.duplicate_frames) + '\n';
+    out += std::string(KEY_CONTACT_SHEET) + '=' + std::to_string(settings.contact_sheet) + '\n';
+    out += std::string(KEY_CONTACT_SHEET_CELL_WIDTH) + '=' + std::to_string(settings.contact_sheet_cell_width) + '\n';
+    out += std::string(KEY_COMPARISON_ARCHIVE) + '=' + (settings.comparison_archive ? "1" : "0") + '\n';
+    out += std::string(KEY_SCREENSHOT_WRITE_MODE) + '=' + std::to_string(settings.write_mode) + '\n';
+    out += std::string(KEY_WARM_UP_ON_LOAD) + '=' + (settings.warm_up_on_load ? "1" : "0") + '\n';
+}
+
+bool save_config(std::filesystem::path& config_path, std::vector<preset_keybind>& preset_keybinds, addon_settings& settings)
+{
+    // Keep sections written by others line for line, only ours are rewritten
+    std::string content;
+    read_config_file(config_path, content);
+
+    std::string out;
+    out.reserve(content.size() + 64 * preset_keybinds.size() + 256);
+    std::string_view data(content);
+    bool in_own_section = false;
+    while (!data.empty())
+    {
+        std::string_view line = next_line(data);
+        std::string_view name;
+        if (parse_section_header(trim(line), name))
+        {
+            in_own_section = name == SECTION_PRESET_KEYBINDS || name == SECTION_SETTINGS;
+        }
+        if (!in_own_section)
+        {
+            out += line;
+            out += '\n';
+        }
+    }
+    if (!out.empty() && (out.size() < 2 || out.compare(out.size() - 2, 2, "\n\n") != 0))
+    {
+        out += '\n';
+    }
+
+    write_preset_keybinds(out, preset_keybinds);
+    out += '\n';
+    write_addon_settings(out, settings);
+
+    // Write next to the config and rename over it, so a crash mid-write
+    // leaves the previous config intact
+    std::filesystem::path temp_path = config_path;
+    temp_path += ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(out.data(), out.size());
+        file.close();
+        if (!file.good())
+        {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, config_path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+bool load_addon_settings(std::filesystem::path& config_path, addon_settings& out)
+{
+    std::string content;
+    if (!read_config_file(config_path, content))
+    {
+        return false;
+    }
+
+    for_each_section_entry(config_path, content, SECTION_SETTINGS,
+        [&out](std::string_view key, std::string_view value, size_t) {
+            if (key == KEY_SETTLE_MIN_FRAMES)
+            {
+                read_uint(value, out.settle_min_frames);
+            }
+            else if (key == KEY_SETTLE_MAX_FRAMES)
+            {
+                read_uint(value, out.settle_max_frames);
+            }
+            else if (key == KEY_SETTLE_THRESHOLD)
+            {
+                read_float(value, out.settle_threshold);
+            }
+            else if (key == KEY_FAST_PRESET_SWITCH)
+            {
+                read_bool(value, out.fast_preset_switch);
+            }
+            else if (key == KEY_SCREENSHOT_FORMAT)
+            {
+                read_enum(value, screenshot_formats, out.capture_format);
+            }
+            else if (key == KEY_CONVERT_BMP_TO_PNG)
+            {
+                read_bool(value, out.convert_bmp_to_png);
+            }
+            else if (key == KEY_BURST_FRAME_COUNT)
+            {
+                read_uint(value, out.burst_frame_count);
+            }
+            else if (key == KEY_BURST_MEMORY_BUDGET_MB)
+            {
+                read_uint(value, out.burst_memory_budget_mb);
+            }
+            else if (key == KEY_BURST_OVERFLOW)
+            {
+                read_enum(value, burst_overflow_policies, out.burst_overflow);
+            }
+            else if (key == KEY_DUPLICATE_FRAMES)
+            {
+                read_enum(value, duplicate_frame_policies, out.duplicate_frames);
+            }
+            else if (key == KEY_CONTACT_SHEET)
+            {
+                read_enum(value, contact_sheet_modes, out.contact_sheet);
+            }
+            else if (key == KEY_CONTACT_SHEET_CELL_WIDTH)
+            {
+                read_uint(value, out.contact_sheet_cell_width);
+            }
+            else if (key == KEY_COMPARISON_ARCHIVE)
+            {
+                read_bool(value, out.comparison_archive);
+            }
+            else if (key == KEY_SCREENSHOT_WRITE_MODE)
+            {
+                read_enum(value, screenshot_write_modes, out.write_mode);
+            }
+            else if (key == KEY_WARM_UP_ON_LOAD)
+            {
+                read_bool(value, out.warm_up_on_load);
+            }
+        });
+
+    return true;
+}
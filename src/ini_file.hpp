@@ -1,6 +1,10 @@
 #pragma once
 
 #include "preset_keybind.hpp"
+#include "addon_settings.hpp"
 
-bool save_preset_keybinds(std::filesystem::path& config_path, std::vector<preset_keybind>& preset_keybinds);
-bool load_preset_keybinds(std::filesystem::path& config_path, std::vector<preset_keybind>& out);
\ No newline at end of file
+#include <vector>
+
+bool save_config(std::filesystem::path& config_path, std::vector<preset_keybind>& preset_keybinds, addon_settings& settings);
+bool load_preset_keybinds(std::filesystem::path& config_path, std::vector<preset_keybind>& out);
+bool load_addon_settings(std::filesystem::path& config_path, addon_settings& out);
\ No newline at end of file
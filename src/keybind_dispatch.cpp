@@ -0,0 +1,50 @@
+#include "keybind_dispatch.hpp"
+
+#include <algorithm>
+
+uint32_t keybind_modifier_mask(bool ctrl, bool shift, bool alt)
+{
+	return (ctrl ? 1u : 0u) | (shift ? 2u : 0u) | (alt ? 4u : 0u);
+}
+
+void build_keybind_dispatch_index(const std::vector<preset_keybind> &preset_keybinds, keybind_dispatch_index &out)
+{
+	const uint32_t bucket_count = KEYBIND_KEYCODE_COUNT * KEYBIND_MODIFIER_COMBINATIONS;
+
+	std::vector<std::pair<uint32_t, const preset_keybind *>> bound;
+	bool key_used[KEYBIND_KEYCODE_COUNT] = {};
+	for (auto& pkb : preset_keybinds)
+	{
+		if (pkb.keybind[0] == 0 || pkb.keybind[0] >= KEYBIND_KEYCODE_COUNT || pkb.preset.empty())
+			continue;
+
+		uint32_t mask = keybind_modifier_mask(pkb.keybind[1] != 0, pkb.keybind[2] != 0, pkb.keybind[3] != 0);
+		bound.emplace_back(pkb.keybind[0] * KEYBIND_MODIFIER_COMBINATIONS + mask, &pkb);
+		key_used[pkb.keybind[0]] = true;
+	}
+	// Stable so bindings sharing a key fire in list order, as before
+	std::stable_sort(bound.begin(), bound.end(),
+		[](auto const& a, auto const& b) { return a.first < b.first; });
+
+	out.keycodes.clear();
+	for (unsigned int keycode = 0; keycode < KEYBIND_KEYCODE_COUNT; ++keycode)
+	{
+		if (key_used[keycode])
+			out.keycodes.push_back(keycode);
+	}
+
+	out.entries.clear();
+	out.entries.reserve(bound.size());
+	out.bucket_offsets.assign(bucket_count + 1, 0);
+	for (auto& it : bound)
+	{
+		keybind_dispatch_entry entry;
+		entry.action = it.second->action;
+		entry.preset = it.second->preset;
+		entry.preset_utf8 = it.second->preset.u8string();
+		out.entries.push_back(std::move(entry));
+		++out.bucket_offsets[it.first + 1];
+	}
+	for (uint32_t b = 0; b < bucket_count; ++b)
+		out.bucket_offsets[b + 1] += out.bucket_offsets[b];
+}
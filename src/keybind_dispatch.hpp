@@ -0,0 +1,55 @@
+#pragma once
+
+#include "preset_keybind.hpp"
+#include "addon_runtime.hpp"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#define KEYBIND_KEYCODE_COUNT 256
+#define KEYBIND_MODIFIER_COMBINATIONS 8
+
+struct keybind_dispatch_entry {
+	keybind_action action;
+	std::filesystem::path preset;
+	// Converted once so dispatch does not allocate
+	std::string preset_utf8;
+};
+
+// Bindings bucketed by keycode and modifier mask, rebuilt only when the
+// bindings change so per-frame polling scales with distinct keys, not bindings
+struct keybind_dispatch_index {
+	std::vector<unsigned int> keycodes;
+	std::vector<keybind_dispatch_entry> entries;
+	// Entries of bucket b are entries[bucket_offsets[b], bucket_offsets[b + 1])
+	std::vector<uint32_t> bucket_offsets;
+};
+
+uint32_t keybind_modifier_mask(bool ctrl, bool shift, bool alt);
+void build_keybind_dispatch_index(const std::vector<preset_keybind> &preset_keybinds, keybind_dispatch_index &out);
+
+template <typename F>
+void dispatch_keybind(const keybind_dispatch_index &index, unsigned int keycode, uint32_t modifier_mask, F &&callback)
+{
+	if (index.bucket_offsets.empty()) return;
+
+	uint32_t bucket = keycode * KEYBIND_MODIFIER_COMBINATIONS + modifier_mask;
+	for (uint32_t i = index.bucket_offsets[bucket]; i < index.bucket_offsets[bucket + 1]; ++i)
+		callback(index.entries[i]);
+}
+
+// Dispatches every binding whose key was pressed this frame with exactly its
+// modifiers held, polling each distinct bound key once
+template <typename F>
+void poll_keybinds(const keybind_dispatch_index &index, addon_runtime *runtime, F &&callback)
+{
+	uint32_t modifier_mask = keybind_modifier_mask(
+		runtime->is_key_down(0x11), runtime->is_key_down(0x10), runtime->is_key_down(0x12));
+
+	for (unsigned int keycode : index.keycodes)
+	{
+		if (!runtime->is_key_pressed(keycode)) continue;
+		dispatch_keybind(index, keycode, modifier_mask, callback);
+	}
+}
@@ -0,0 +1,58 @@
+#include "keybind_display.hpp"
+
+#include <algorithm>
+
+const char *keybind_action_label(keybind_action action)
+{
+	switch (action)
+	{
+	case take_screenshot:
+		return "Take Screenshot";
+	case capture_all_presets:
+		return "Capture All Presets";
+	case capture_burst:
+		return "Capture Burst";
+	default:
+		return "Change preset";
+	}
+}
+
+void update_keybind_display(preset_keybind &pkb, keybind_name_function key_name)
+{
+	if (pkb.preset.empty())
+	{
+		pkb.preset_display = "None";
+	} else {
+		std::string str = pkb.preset.u8string();
+		if (str.length() > PRESET_DISPLAY_MAX_LENGTH)
+		{
+			// Do not start in the middle of a UTF-8 sequence
+			size_t start = str.length() - PRESET_DISPLAY_MAX_LENGTH;
+			while (start < str.length() && (static_cast<unsigned char>(str[start]) & 0xC0) == 0x80)
+				++start;
+			str = "..." + str.substr(start);
+		}
+		pkb.preset_display = std::move(str);
+	}
+
+	if (pkb.keybind[0] != 0)
+	{
+		pkb.keybind_display = key_name(pkb.keybind) + " | " + keybind_action_label(pkb.action);
+	} else {
+		pkb.keybind_display.clear();
+	}
+
+	pkb.display_valid = true;
+}
+
+size_t prepare_keybind_rows(std::vector<preset_keybind> &keybinds, size_t first, size_t last, keybind_name_function key_name)
+{
+	size_t rebuilt = 0;
+	for (size_t i = first; i < std::min(last, keybinds.size()); ++i)
+	{
+		if (keybinds[i].display_valid) continue;
+		update_keybind_display(keybinds[i], key_name);
+		++rebuilt;
+	}
+	return rebuilt;
+}
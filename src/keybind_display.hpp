@@ -0,0 +1,19 @@
+#pragma once
+
+#include "preset_keybind.hpp"
+
+#include <string>
+#include <vector>
+
+#define PRESET_DISPLAY_MAX_LENGTH 30
+
+// Names a key with its modifiers, e.g. reshade_key_name
+typedef std::string (*keybind_name_function)(const unsigned int key[4]);
+
+const char *keybind_action_label(keybind_action action);
+// Rebuilds the overlay text of a binding: the tail of its preset path and its
+// key with the action
+void update_keybind_display(preset_keybind &pkb, keybind_name_function key_name);
+// Rebuilds the text of the rows in [first, last) whose display_valid was
+// cleared, called with the rows the list clipper shows. Returns the rows rebuilt.
+size_t prepare_keybind_rows(std::vector<preset_keybind> &keybinds, size_t first, size_t last, keybind_name_function key_name);
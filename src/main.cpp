@@ -2,11 +2,25 @@
 #include "key_input_box.hpp"
 #include "ini_file.hpp"
 #include "screenshot.hpp"
+#include "pixel_pack.hpp"
+#include "contact_sheet.hpp"
+#include "keybind_dispatch.hpp"
+#include "keybind_display.hpp"
+#include "preset_switch.hpp"
+#include "preset_index.hpp"
+#include "preset_picker.hpp"
+#include "config_writer.hpp"
+#include "profiler.hpp"
+#include "reshade_runtime.hpp"
+#include "png_encode.hpp"
+#include "content_hash.hpp"
+#include "thumbnail_atlas.hpp"
+#include "preset_preview.hpp"
+#include "reshade_readback.hpp"
 
 #include <imgui.h>
 #include <reshade.hpp>
 #include <imfilebrowser.h>
-#include <fpng.h>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -14,127 +28,361 @@
 #include <map>
 #include <queue>
 #include <optional>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
-#define PRESET_DISPLAY_MAX_LENGTH 30
+// Bindings and settings as the render threads see them. Replaced as a whole
+// when the overlay changes them, so every runtime reads without a lock.
+struct binding_snapshot {
+	keybind_dispatch_index keybinds;
+	// Each bound preset once, in binding order
+	std::vector<std::filesystem::path> presets;
+	addon_settings settings;
+};
+
+// Addon state of one effect runtime, e.g. one per VR eye or game window.
+// Created and destroyed with the runtime and only used on its render thread.
+struct __declspec(uuid("5d6f1c9e-8b0a-4f2e-9a57-3c1e7b4d2a60")) runtime_state {
+	screenshot_queue screenshots;
+	uint32_t frame = 0;
+	bool is_key_input_box_active = false;
+	// Set when the runtime starts with warm-up on load enabled
+	bool warm_up_pending = false;
+	preset_preview_cache previews;
+	// Lets captures copy the back buffer without stalling the frame
+	reshade_readback_device readback;
+};
 
+// Edited by the overlay only
 static std::vector<preset_keybind> g_preset_keybinds;
+static addon_settings g_settings;
+static std::shared_ptr<const binding_snapshot> g_bindings;
+// Held while an overlay edits the state above. Per-frame housekeeping only
+// tries it, so a render thread never waits on another runtime's overlay.
+static std::mutex g_overlay_mutex;
+static std::atomic<int> g_runtime_count;
 static std::filesystem::path g_config_path;
 static ImGui::FileBrowser g_file_browser;
 static std::optional<int> g_browse_idx;
-static bool g_is_key_input_box_active;
-static uint32_t g_frame;
+static std::optional<int> g_edit_idx;
+static preset_index g_preset_index;
+static preset_picker_state g_preset_picker;
+static config_writer g_config_writer;
+static std::vector<profile_stats> g_profile_stats;
+
+static std::map<screenshot_format, const char*> SCREENSHOT_FORMAT_LABELS = {
+	{ format_png, "PNG" },
+	{ format_qoi, "QOI (fast, lossless)" },
+	{ format_bmp, "BMP (uncompressed)" },
+};
+
+static std::map<burst_overflow_policy, const char*> BURST_OVERFLOW_LABELS = {
+	{ burst_drop_frames, "Drop frames" },
+	{ burst_wait_for_encoder, "Wait for encoder" },
+};
+
+static std::map<duplicate_frame_policy, const char*> DUPLICATE_FRAME_LABELS = {
+	{ duplicate_write, "Write again" },
+	{ duplicate_skip, "Skip" },
+	{ duplicate_hard_link, "Hard link" },
+};
 
-static std::map<keybind_action, const char*> KEYBIND_ACTION_LABELS = {
-	{ keybind_action::change_preset, "Change preset" },
-	{ keybind_action::take_screenshot, "Take Screenshot" },
+static std::map<contact_sheet_mode, const char*> CONTACT_SHEET_LABELS = {
+	{ contact_sheet_off, "Off" },
+	{ contact_sheet_alongside, "Alongside captures" },
+	{ contact_sheet_only, "Instead of captures" },
+};
+
+static std::map<screenshot_write_mode, const char*> WRITE_MODE_LABELS = {
+	{ write_cached, "System cache" },
+	{ write_direct, "Direct" },
+	{ write_direct_sync, "Direct, flush every file" },
 };
 
 static std::filesystem::path get_current_preset_path(reshade::api::effect_runtime *runtime)
 {
-	size_t path_size;
-	runtime->get_current_preset_path(nullptr, &path_size);
-	char* current_preset = new char[path_size];
-	runtime->get_current_preset_path(current_preset, &path_size);
-	return std::filesystem::path(current_preset);
+	return reshade_runtime(runtime).get_current_preset_path();
 }
 
-static void draw_overlay(reshade::api::effect_runtime *runtime)
+static std::shared_ptr<const binding_snapshot> get_bindings()
 {
-	bool updated = false;
-	g_is_key_input_box_active = false;
+	return std::atomic_load(&g_bindings);
+}
 
-	if (ImGui::CollapsingHeader("Preset Keybindings", ImGuiTreeNodeFlags_DefaultOpen))
+static void publish_bindings()
+{
+	auto bindings = std::make_shared<binding_snapshot>();
+	build_keybind_dispatch_index(g_preset_keybinds, bindings->keybinds);
+	std::set<std::filesystem::path> seen;
+	for (auto& pkb : g_preset_keybinds)
+	{
+		if (!pkb.preset.empty() && seen.insert(pkb.preset).second)
+			bindings->presets.push_back(pkb.preset);
+	}
+	bindings->settings = g_settings;
+	std::atomic_store(&g_bindings, std::shared_ptr<const binding_snapshot>(std::move(bindings)));
+}
+
+static void rebuild_keybind_index()
+{
+	publish_bindings();
+
+	if (g_settings.fast_preset_switch)
+		prefetch_presets(get_bindings()->presets);
+}
+
+static void update_preset_index_roots(reshade::api::effect_runtime *runtime)
+{
+	std::vector<std::filesystem::path> roots;
+	roots.push_back(get_current_preset_path(runtime).parent_path());
+	for (auto& pkb : g_preset_keybinds)
+	{
+		if (!pkb.preset.empty())
+			roots.push_back(pkb.preset.parent_path());
+	}
+	roots.erase(std::remove_if(roots.begin(), roots.end(),
+		[](std::filesystem::path const & root) { return root.empty(); }), roots.end());
+	g_preset_index.set_roots(std::move(roots));
+}
+
+static runtime_state &get_runtime_state(reshade::api::effect_runtime *runtime)
+{
+	return *runtime->get_private_data<runtime_state>();
+}
+
+static void queue_capture_all_presets(runtime_state &state, const binding_snapshot &bindings)
+{
+	if (bindings.presets.empty()) return;
+
+	queue_batch_screenshot_workload(state.screenshots, bindings.presets, bindings.settings);
+}
+
+static void queue_warm_up_presets(runtime_state &state, const binding_snapshot &bindings)
+{
+	if (bindings.presets.empty()) return;
+
+	queue_preset_warm_up_workload(state.screenshots, bindings.presets, bindings.settings);
+}
+
+static void draw_warm_up_report(runtime_state &state)
+{
+	std::shared_ptr<const preset_warm_up_report> report = get_preset_warm_up_report(state.screenshots);
+	if (report == nullptr) return;
+
+	std::string label = "Warm-up (" + std::to_string(report->entries.size()) + " of " + std::to_string(report->preset_count) + " presets)###warm_up_report";
+	if (!ImGui::TreeNode(label.c_str())) return;
+	if (ImGui::BeginTable("##warm_up", 2, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
 	{
-		for (uint8_t i = 0; i < g_preset_keybinds.size(); ++i)
+		ImGui::TableSetupColumn("Preset");
+		ImGui::TableSetupColumn("Frames to render");
+		ImGui::TableHeadersRow();
+		for (auto& entry : report->entries)
 		{
-			ImGui::PushID(i);
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(entry.preset.filename().u8string().c_str());
+			ImGui::TableNextColumn();
+			if (entry.timed_out)
+				ImGui::Text("> %u (did not render)", entry.frames);
+			else
+				ImGui::Text("%u", entry.frames);
+		}
+		ImGui::EndTable();
+	}
+	ImGui::TreePop();
+}
 
-			const char* preset_display;
-			if (g_preset_keybinds[i].preset.empty())
-			{
-				preset_display = "None";
-			} else {
-				std::string str = g_preset_keybinds[i].preset.string();
-				if (str.length()  > PRESET_DISPLAY_MAX_LENGTH)
-				{
-					std::stringstream ss;
-					ss << "..." << str.substr(str.length()-PRESET_DISPLAY_MAX_LENGTH, PRESET_DISPLAY_MAX_LENGTH);
-					str = ss.str();
-				}
-				preset_display = str.c_str();
-			}
-			ImGui::Text("%s", preset_display);
+// Every row has the same height so the list can be clipped to the visible rows
+static bool draw_keybind_row(reshade::api::effect_runtime *runtime, int i, bool &open_picker, bool &open_editor)
+{
+	bool updated = false;
+	preset_keybind &pkb = g_preset_keybinds[i];
+
+	ImGui::PushID(i);
+
+	ImGui::TextUnformatted(pkb.preset_display.c_str());
+	if (!pkb.preset.empty() && ImGui::IsItemHovered(ImGuiHoveredFlags_ForTooltip) && ImGui::BeginTooltip())
+	{
+		// Only presets the index has seen have a known hash and thumbnail
+		std::shared_ptr<const preset_index_snapshot> snapshot = g_preset_index.snapshot();
+		const preset_index_entry *entry = snapshot != nullptr ? find_preset_index_entry(*snapshot, pkb.preset) : nullptr;
+		if (entry != nullptr)
+			get_runtime_state(runtime).previews.draw(runtime, pkb.preset, entry->content_hash);
+		ImGui::TextUnformatted(pkb.preset.u8string().c_str());
+		ImGui::EndTooltip();
+	}
+	ImGui::SameLine();
+
+	if (ImGui::Button("Browse..."))
+	{
+		update_preset_index_roots(runtime);
+		g_browse_idx.emplace(i);
+		open_picker = true;
+	}
+	ImGui::SameLine();
+
+	if (!pkb.preset.empty())
+	{
+		const char* button_text;
+		if (pkb.keybind[0] != 0)
+		{
+			ImGui::TextUnformatted(pkb.keybind_display.c_str());
 			ImGui::SameLine();
+			button_text = "Edit";
+		} else {
+			button_text = "Add Keybind";
+		}
+		if (ImGui::Button(button_text))
+		{
+			g_edit_idx.emplace(i);
+			open_editor = true;
+		}
+		ImGui::SameLine();
+	}
 
-			if (ImGui::Button("Browse..."))
+	if (ImGui::Button("Remove"))
+	{
+		pkb.remove = true;
+		updated = true;
+	}
+
+	ImGui::Separator();
+	ImGui::PopID();
+
+	return updated;
+}
+
+static bool draw_keybind_editor(reshade::api::effect_runtime *runtime, preset_keybind &pkb)
+{
+	bool updated = false;
+
+	ImGui::Text("%s", "Key Shortcut");
+	ImGui::SameLine();
+	bool active;
+	if (reshade_key_input_box("", pkb.keybind, runtime, active))
+	{
+		pkb.display_valid = false;
+		updated = true;
+	}
+	get_runtime_state(runtime).is_key_input_box_active |= active;
+
+	ImGui::Text("%s", "Action");
+	ImGui::SameLine();
+	if (ImGui::BeginCombo("##action", keybind_action_label(pkb.action)))
+	{
+		for (auto action : keybind_actions)
+		{
+			if (ImGui::Selectable(keybind_action_label(action), pkb.action == action))
 			{
-				std::filesystem::path preset_path;
-				if (g_preset_keybinds[i].preset.empty())
-				{
-					preset_path = std::filesystem::path(get_current_preset_path(runtime));
-				} else {
-					preset_path = g_preset_keybinds[i].preset;
-				}
-				g_file_browser.SetPwd(preset_path.parent_path());
-				g_file_browser.Open();
-				g_browse_idx.emplace(i);
+				pkb.action = action;
+				pkb.display_valid = false;
+				updated = true;
 			}
-			ImGui::SameLine();
+		}
+		ImGui::EndCombo();
+	}
+
+	return updated;
+}
+
+static void draw_profiler()
+{
+	bool enabled = g_profiler_enabled.load(std::memory_order_relaxed);
+	if (ImGui::Checkbox("Enable profiling", &enabled))
+	{
+		g_profiler_enabled.store(enabled, std::memory_order_relaxed);
+	}
 
-			if (!g_preset_keybinds[i].preset.empty())
+	profiler_collect();
+	profiler_get_stats(g_profile_stats);
+	if (ImGui::BeginTable("##profile_stats", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+	{
+		ImGui::TableSetupColumn("Scope");
+		ImGui::TableSetupColumn("Count");
+		ImGui::TableSetupColumn("p50 ms");
+		ImGui::TableSetupColumn("p95 ms");
+		ImGui::TableSetupColumn("Max ms");
+		ImGui::TableHeadersRow();
+		for (auto& stats : g_profile_stats)
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(stats.name);
+			ImGui::TableNextColumn();
+			ImGui::Text("%u", stats.count);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", stats.p50_ms);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", stats.p95_ms);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", stats.max_ms);
+		}
+		ImGui::EndTable();
+	}
+	uint64_t dropped = profiler_dropped_events();
+	if (dropped != 0)
+	{
+		ImGui::Text("Dropped events: %llu", static_cast<unsigned long long>(dropped));
+	}
+
+	// Dumps are written next to the addon config
+	std::filesystem::path dump_path = g_config_path;
+	if (ImGui::Button("Write CSV"))
+	{
+		dump_path.replace_extension(".profile.csv");
+		if (!profiler_write_csv(dump_path))
+			reshade::log_message(reshade::log_level::error, "Failed to write profile CSV");
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Write Chrome Trace"))
+	{
+		dump_path.replace_extension(".trace.json");
+		if (!profiler_write_chrome_trace(dump_path))
+			reshade::log_message(reshade::log_level::error, "Failed to write profile trace");
+	}
+}
+
+static void draw_overlay(reshade::api::effect_runtime *runtime)
+{
+	std::lock_guard<std::mutex> lock(g_overlay_mutex);
+	runtime_state &state = get_runtime_state(runtime);
+	bool updated = false;
+	bool open_picker = false;
+	state.is_key_input_box_active = false;
+
+	g_preset_index.update();
+
+	if (ImGui::CollapsingHeader("Preset Keybindings", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		bool open_editor = false;
+		ImGuiListClipper clipper;
+		clipper.Begin(static_cast<int>(g_preset_keybinds.size()));
+		while (clipper.Step())
+		{
+			prepare_keybind_rows(g_preset_keybinds, clipper.DisplayStart, clipper.DisplayEnd, &reshade_key_name);
+			for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
 			{
-				const char* button_text;
-				if (g_preset_keybinds[i].keybind[0] != 0)
-				{
-					ImGui::Text("%s | %s",
-						reshade_key_name(g_preset_keybinds[i].keybind).c_str(),
-						KEYBIND_ACTION_LABELS[g_preset_keybinds[i].action]);
-					ImGui::SameLine();
-					button_text = "Edit";
-				} else {
-					button_text = "Add Keybind";
-				}
-				if (ImGui::Button(button_text))
-				{
-					g_preset_keybinds[i].keybind_opened = !g_preset_keybinds[i].keybind_opened;
-				}
-				ImGui::SameLine();
+				updated |= draw_keybind_row(runtime, i, open_picker, open_editor);
 			}
+		}
+		clipper.End();
 
-			if (ImGui::Button("Remove"))
+		if (open_editor)
+		{
+			ImGui::OpenPopup("##keybind_editor");
+		}
+		if (g_edit_idx.has_value())
+		{
+			if (ImGui::BeginPopup("##keybind_editor"))
 			{
-				g_preset_keybinds[i].remove = true;
-				updated = true;
+				updated |= draw_keybind_editor(runtime, g_preset_keybinds[g_edit_idx.value()]);
+				ImGui::EndPopup();
 			}
-
-			if (g_preset_keybinds[i].keybind_opened)
+			else
 			{
-				ImGui::Text("%s", "Key Shortcut");
-				ImGui::SameLine();
-				bool active;
-				if (reshade_key_input_box("", g_preset_keybinds[i].keybind, runtime, active))
-				{
-					updated = true;
-				}
-
-				ImGui::Text("%s", "Action");
-				ImGui::SameLine();
-				if (ImGui::BeginCombo("##action", KEYBIND_ACTION_LABELS[g_preset_keybinds[i].action]))
-				{
-					for (auto action : keybind_actions)
-					{
-						if (ImGui::Selectable(KEYBIND_ACTION_LABELS[action], g_preset_keybinds[i].action == action))
-						{
-							g_preset_keybinds[i].action = action;
-							updated = true;
-						}
-					}
-					ImGui::EndCombo();
-				}
-				g_is_key_input_box_active |= active;
+				g_edit_idx = {};
 			}
-			ImGui::Separator();
-			ImGui::PopID();
 		}
 
 		if (g_preset_keybinds.empty() || !g_preset_keybinds.back().preset.empty())
@@ -144,17 +392,70 @@ static void draw_overlay(reshade::api::effect_runtime *runtime)
 				preset_keybind pkb = {};
 				g_preset_keybinds.push_back(std::move(pkb));
 			}
+			ImGui::SameLine();
+		}
+
+		if (ImGui::Button("Capture All Presets"))
+		{
+			queue_capture_all_presets(state, *get_bindings());
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Warm Up Presets"))
+		{
+			queue_warm_up_presets(state, *get_bindings());
+		}
+		if (ImGui::IsItemHovered(ImGuiHoveredFlags_ForTooltip))
+		{
+			ImGui::SetTooltip("Load every bound preset once so ReShade compiles their effects now instead of on the first switch.");
+		}
+		size_t workload_count = get_screenshot_workload_count(state.screenshots);
+		if (workload_count > 0)
+		{
+			ImGui::SameLine();
+			std::string cancel_label = "Cancel Captures (" + std::to_string(workload_count) + ")";
+			if (ImGui::Button(cancel_label.c_str()))
+			{
+				cancel_all_screenshot_workloads(state.screenshots);
+			}
+		}
+
+		if (open_picker)
+		{
+			ImGui::OpenPopup("##preset_picker");
+		}
+		std::filesystem::path picked_preset;
+		bool browse_files = false;
+		auto draw_preview = [runtime, &state](const preset_index_entry &entry) { state.previews.draw(runtime, entry.path, entry.content_hash); };
+		if (preset_picker_popup("##preset_picker", g_preset_index, g_preset_picker, picked_preset, browse_files, draw_preview) && g_browse_idx.has_value())
+		{
+			g_preset_keybinds[g_browse_idx.value()].preset = picked_preset;
+			g_preset_keybinds[g_browse_idx.value()].display_valid = false;
+			g_browse_idx = {};
+			updated = true;
+		}
+		if (browse_files && g_browse_idx.has_value())
+		{
+			// Lists the directory synchronously, only used on explicit request
+			std::filesystem::path preset_path = g_preset_keybinds[g_browse_idx.value()].preset;
+			if (preset_path.empty())
+			{
+				preset_path = get_current_preset_path(runtime);
+			}
+			g_file_browser.SetPwd(preset_path.parent_path());
+			g_file_browser.Open();
 		}
 
 		g_file_browser.Display();
 		if (g_file_browser.HasSelected() && g_browse_idx.has_value())
 		{
 			g_preset_keybinds[g_browse_idx.value()].preset = g_file_browser.GetSelected();
+			g_preset_keybinds[g_browse_idx.value()].display_valid = false;
 			g_file_browser.ClearSelected();
 			g_browse_idx = {};
 			updated = true;
 		}
 
+		size_t count = g_preset_keybinds.size();
 		g_preset_keybinds.erase(
 			std::remove_if(
 				g_preset_keybinds.begin(),
@@ -163,61 +464,297 @@ static void draw_overlay(reshade::api::effect_runtime *runtime)
 			),
 			g_preset_keybinds.end()
 		);
+		if (g_preset_keybinds.size() != count)
+		{
+			// Indices moved
+			g_browse_idx = {};
+			g_edit_idx = {};
+		}
+
+		draw_warm_up_report(state);
 	}
 
-	if (updated)
+	bool settings_updated = false;
+	if (ImGui::CollapsingHeader("Settings"))
 	{
-		bool success = save_preset_keybinds(g_config_path, g_preset_keybinds);
-		std::stringstream ss;
-		if (success)
+		if (ImGui::Checkbox("Fast preset switching", &g_settings.fast_preset_switch))
 		{
-			ss << "Config saved to: " << g_config_path.string();
-			reshade::log_message(reshade::log_level::info, ss.str().c_str());
-		} else {
-			ss << "Config failed to save: " << g_config_path.string();
-			reshade::log_message(reshade::log_level::error, ss.str().c_str());
+			if (g_settings.fast_preset_switch)
+				prefetch_presets(get_bindings()->presets);
+			settings_updated = true;
+		}
+		if (ImGui::IsItemHovered(ImGuiHoveredFlags_ForTooltip))
+		{
+			ImGui::SetTooltip("Switch between presets that enable the same techniques by only changing the uniforms that differ.\nReShade keeps showing the previously loaded preset while a switched preset is active,\nand changes saved in its UI then go to that preset's file.");
 		}
-	}
-}
 
-static void handle_keypress(reshade::api::effect_runtime *runtime)
-{
-	unsigned int ctrl_down = runtime->is_key_down(0x11);
-	unsigned int shift_down = runtime->is_key_down(0x10);
-	unsigned int alt_down = runtime->is_key_down(0x12);
+		int min_frames = static_cast<int>(g_settings.settle_min_frames);
+		int max_frames = static_cast<int>(g_settings.settle_max_frames);
+		if (ImGui::SliderInt("Min settle frames", &min_frames, 1, 60))
+		{
+			g_settings.settle_min_frames = static_cast<uint32_t>(min_frames);
+			settings_updated = true;
+		}
+		if (ImGui::SliderInt("Max settle frames", &max_frames, 1, 240))
+		{
+			g_settings.settle_max_frames = static_cast<uint32_t>(max_frames);
+			settings_updated = true;
+		}
+		if (ImGui::SliderFloat("Settle threshold", &g_settings.settle_threshold, 0.0f, 10.0f, "%.2f"))
+		{
+			settings_updated = true;
+		}
+		if (ImGui::IsItemHovered(ImGuiHoveredFlags_ForTooltip))
+		{
+			ImGui::SetTooltip("Mean change per color channel between two frames below which the image counts as settled.");
+		}
 
-	for (auto& pkb : g_preset_keybinds)
-	{
-		if (!g_is_key_input_box_active &&
-			pkb.keybind[0] != 0 && runtime->is_key_pressed(pkb.keybind[0]) &&
-			(ctrl_down == pkb.keybind[1]) && (shift_down == pkb.keybind[2]) && (alt_down == pkb.keybind[3]))
+		if (ImGui::BeginCombo("Screenshot format", SCREENSHOT_FORMAT_LABELS[g_settings.capture_format]))
+		{
+			for (auto format : screenshot_formats)
+			{
+				if (ImGui::Selectable(SCREENSHOT_FORMAT_LABELS[format], g_settings.capture_format == format))
+				{
+					g_settings.capture_format = format;
+					settings_updated = true;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		if (g_settings.capture_format == format_bmp)
+		{
+			if (ImGui::Checkbox("Convert to PNG in background", &g_settings.convert_bmp_to_png))
+			{
+				settings_updated = true;
+			}
+		}
+
+		int burst_frames = static_cast<int>(g_settings.burst_frame_count);
+		if (ImGui::SliderInt("Burst frames", &burst_frames, 2, 240))
+		{
+			g_settings.burst_frame_count = static_cast<uint32_t>(burst_frames);
+			settings_updated = true;
+		}
+		int burst_budget = static_cast<int>(g_settings.burst_memory_budget_mb);
+		if (ImGui::SliderInt("Burst memory (MB)", &burst_budget, 64, 8192))
+		{
+			g_settings.burst_memory_budget_mb = static_cast<uint32_t>(burst_budget);
+			settings_updated = true;
+		}
+		if (ImGui::BeginCombo("When burst memory is full", BURST_OVERFLOW_LABELS[g_settings.burst_overflow]))
+		{
+			for (auto policy : burst_overflow_policies)
+			{
+				if (ImGui::Selectable(BURST_OVERFLOW_LABELS[policy], g_settings.burst_overflow == policy))
+				{
+					g_settings.burst_overflow = policy;
+					settings_updated = true;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		if (ImGui::IsItemHovered(ImGuiHoveredFlags_ForTooltip))
+		{
+			ImGui::SetTooltip("Dropping keeps the frame rate, missing frames leave gaps in the file numbers.\nWaiting keeps every frame but stalls the game until a frame is encoded.");
+		}
+		if (ImGui::BeginCombo("Identical captures", DUPLICATE_FRAME_LABELS[g_settings.duplicate_frames]))
+		{
+			for (auto policy : duplicate_frame_policies)
+			{
+				if (ImGui::Selectable(DUPLICATE_FRAME_LABELS[policy], g_settings.duplicate_frames == policy))
+				{
+					g_settings.duplicate_frames = policy;
+					settings_updated = true;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		if (ImGui::IsItemHovered(ImGuiHoveredFlags_ForTooltip))
 		{
-			if (pkb.action == change_preset)
+			ImGui::SetTooltip("Captures whose pixels match one already saved this session.");
+		}
+		if (ImGui::BeginCombo("Contact sheet", CONTACT_SHEET_LABELS[g_settings.contact_sheet]))
+		{
+			for (auto mode : contact_sheet_modes)
+			{
+				if (ImGui::Selectable(CONTACT_SHEET_LABELS[mode], g_settings.contact_sheet == mode))
+				{
+					g_settings.contact_sheet = mode;
+					settings_updated = true;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		if (ImGui::IsItemHovered(ImGuiHoveredFlags_ForTooltip))
+		{
+			ImGui::SetTooltip("Capture All Presets also saves one grid of downscaled, labelled captures.");
+		}
+		if (g_settings.contact_sheet != contact_sheet_off)
+		{
+			int cell_width = static_cast<int>(g_settings.contact_sheet_cell_width);
+			if (ImGui::SliderInt("Contact sheet cell width", &cell_width, 128, 1920))
+			{
+				g_settings.contact_sheet_cell_width = static_cast<uint32_t>(cell_width);
+				settings_updated = true;
+			}
+		}
+		if (g_settings.contact_sheet != contact_sheet_only)
+		{
+			if (ImGui::Checkbox("Store all preset captures in one archive", &g_settings.comparison_archive))
+			{
+				settings_updated = true;
+			}
+			if (ImGui::IsItemHovered(ImGuiHoveredFlags_ForTooltip))
 			{
-				runtime->set_current_preset_path(pkb.preset.string().c_str());
+				ImGui::SetTooltip("Each preset after the first is stored as its difference to the first capture.\nExtract single images with preset_comparison_extract.");
 			}
-			else if (pkb.action == take_screenshot)
+		}
+		if (ImGui::Checkbox("Warm up presets on game start", &g_settings.warm_up_on_load))
+		{
+			settings_updated = true;
+		}
+		if (ImGui::BeginCombo("Screenshot writes", WRITE_MODE_LABELS[g_settings.write_mode]))
+		{
+			for (auto mode : screenshot_write_modes)
 			{
-				std::filesystem::path original_preset = get_current_preset_path(runtime);
-				queue_screenshot_workload(pkb.preset, original_preset);
+				if (ImGui::Selectable(WRITE_MODE_LABELS[mode], g_settings.write_mode == mode))
+				{
+					g_settings.write_mode = mode;
+					settings_updated = true;
+				}
 			}
+			ImGui::EndCombo();
+		}
+		if (ImGui::IsItemHovered(ImGuiHoveredFlags_ForTooltip))
+		{
+			ImGui::SetTooltip("Direct writes bypass the system file cache, which keeps long batches on slow or network disks at a steady speed.\nFlushing every file waits until it is on the disk before writing the next one.");
 		}
 	}
+
+	if (ImGui::CollapsingHeader("Profiler"))
+	{
+		draw_profiler();
+	}
+
+	if (updated)
+	{
+		rebuild_keybind_index();
+	}
+	else if (settings_updated)
+	{
+		publish_bindings();
+	}
+
+	if (updated || settings_updated)
+	{
+		g_config_writer.mark_dirty({ g_config_path, g_preset_keybinds, g_settings });
+	}
+}
+
+static void handle_keypress(reshade::api::effect_runtime *runtime, runtime_state &state, const binding_snapshot &bindings)
+{
+	if (state.is_key_input_box_active) return;
+
+	PROFILE_SCOPE("handle_keypress");
+	reshade_runtime rt(runtime);
+	const addon_settings &settings = bindings.settings;
+	poll_keybinds(bindings.keybinds, &rt, [&](const keybind_dispatch_entry &entry) {
+		if (entry.action == change_preset)
+		{
+			// Switching under a running capture would end up in its screenshots
+			if (get_screenshot_workload_count(state.screenshots) > 0)
+				queue_preset_switch_workload(state.screenshots, entry.preset, settings);
+			else
+				switch_preset(&rt, state.screenshots.preset_switch, entry.preset, entry.preset_utf8, settings.fast_preset_switch);
+		}
+		else if (entry.action == take_screenshot)
+		{
+			queue_screenshot_workload(state.screenshots, entry.preset, settings);
+		}
+		else if (entry.action == capture_all_presets)
+		{
+			queue_capture_all_presets(state, bindings);
+		}
+		else if (entry.action == capture_burst)
+		{
+			queue_burst_screenshot_workload(state.screenshots, entry.preset, settings);
+		}
+	});
 }
 
 static void on_reshade_overlay(reshade::api::effect_runtime *runtime)
 {
-	++g_frame;
-	screenshot_notify_frame(g_frame);
+	runtime_state &state = get_runtime_state(runtime);
+	++state.frame;
+	screenshot_notify_frame(state.screenshots, state.frame);
+	// Whichever runtime gets here first does the shared work this frame
+	std::unique_lock<std::mutex> lock(g_overlay_mutex, std::try_to_lock);
+	if (lock.owns_lock())
+	{
+		g_config_writer.update();
+		if (g_profiler_enabled.load(std::memory_order_relaxed))
+			profiler_collect();
+		lock.unlock();
+	}
 
-	if (process_screenshot_workload(runtime)) return;
+	std::shared_ptr<const binding_snapshot> bindings = get_bindings();
+	if (state.warm_up_pending)
+	{
+		state.warm_up_pending = false;
+		queue_warm_up_presets(state, *bindings);
+	}
 
-	handle_keypress(runtime);
+	reshade_runtime rt(runtime);
+	process_screenshot_workload(state.screenshots, &rt);
+	// Keybinds stay live during captures, new requests queue behind the running one
+	handle_keypress(runtime, state, *bindings);
 }
 
 static void on_reshade_begin_effects(reshade::api::effect_runtime *runtime, reshade::api::command_list *cmd_list, reshade::api::resource_view rtv, reshade::api::resource_view rtv_srgb)
 {
-	screenshot_notify_effects_rendered(g_frame);
+	runtime_state &state = get_runtime_state(runtime);
+	screenshot_notify_effects_rendered(state.screenshots, state.frame);
+}
+
+static bool on_reshade_open_overlay(reshade::api::effect_runtime *runtime, bool open, reshade::api::input_source source)
+{
+	runtime_state &state = get_runtime_state(runtime);
+	// The screenshot path can only be changed in the ReShade settings of the overlay
+	invalidate_screenshot_directory(state.screenshots);
+	if (open)
+	{
+		std::lock_guard<std::mutex> lock(g_overlay_mutex);
+		update_preset_index_roots(runtime);
+		// Presets may have been edited outside the overlay
+		state.previews.invalidate();
+	}
+	return false;
+}
+
+static void on_init_effect_runtime(reshade::api::effect_runtime *runtime)
+{
+	runtime_state &state = runtime->create_private_data<runtime_state>();
+	state.warm_up_pending = get_bindings()->settings.warm_up_on_load;
+	if (state.readback.init(runtime))
+		set_screenshot_readback_device(state.screenshots, &state.readback);
+	++g_runtime_count;
+}
+
+static void on_destroy_effect_runtime(reshade::api::effect_runtime *runtime)
+{
+	runtime_state &state = get_runtime_state(runtime);
+	state.previews.destroy(runtime);
+	// Copies still in flight are dropped with their buffers
+	set_screenshot_readback_device(state.screenshots, nullptr);
+	state.readback.shutdown();
+	runtime->destroy_private_data<runtime_state>();
+	// The workers and the config are shared, they outlive all but the last runtime
+	if (--g_runtime_count == 0)
+	{
+		shutdown_screenshot_workers(false);
+		g_preset_index.shutdown(false);
+		g_config_writer.flush(false);
+	}
 }
 
 // https://github.com/crosire/reshade/blob/v6.0.0/source/dll_main.cpp#L115
@@ -230,7 +767,7 @@ std::filesystem::path get_module_path(HMODULE module)
 extern "C" __declspec(dllexport) const char *NAME = "Preset Selector";
 extern "C" __declspec(dllexport) const char *DESCRIPTION = "Bind specific presets to keyboard shortcuts.";
 
-BOOL APIENTRY DllMain(HMODULE hModule, DWORD fdwReason, LPVOID)
+BOOL APIENTRY DllMain(HMODULE hModule, DWORD fdwReason, LPVOID lpReserved)
 {
 	switch (fdwReason)
 	{
@@ -238,10 +775,18 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD fdwReason, LPVOID)
 		if (!reshade::register_addon(hModule))
 			return FALSE;
 
-		fpng::fpng_init();
+		set_addon_log_sink(&reshade_log_sink);
+		init_png_encode();
+		init_pixel_pack();
+		init_downscale();
+		init_content_hash();
 
 		g_config_path = get_module_path(hModule).replace_extension(".ini");
 		load_preset_keybinds(g_config_path, g_preset_keybinds);
+		load_addon_settings(g_config_path, g_settings);
+		rebuild_keybind_index();
+		// Previews are optional, captures carry on without the atlas
+		g_thumbnail_atlas.open(std::filesystem::path(g_config_path).replace_extension(".thumbnails"));
 
 		g_file_browser.SetTitle("Select preset");
 		g_file_browser.SetTypeFilters({ ".ini", ".txt" });
@@ -249,10 +794,19 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD fdwReason, LPVOID)
 		reshade::register_overlay(nullptr, &draw_overlay);
 		reshade::register_event<reshade::addon_event::reshade_overlay>(&on_reshade_overlay);
 		reshade::register_event<reshade::addon_event::reshade_begin_effects>(&on_reshade_begin_effects);
+		reshade::register_event<reshade::addon_event::reshade_open_overlay>(&on_reshade_open_overlay);
+		reshade::register_event<reshade::addon_event::init_effect_runtime>(&on_init_effect_runtime);
+		reshade::register_event<reshade::addon_event::destroy_effect_runtime>(&on_destroy_effect_runtime);
 		break;
 	case DLL_PROCESS_DETACH:
+		// lpReserved is non-null when the process is terminating
+		shutdown_screenshot_workers(lpReserved != nullptr);
+		g_preset_index.shutdown(lpReserved != nullptr);
+		g_config_writer.flush(lpReserved != nullptr);
+		g_thumbnail_atlas.close();
 		reshade::unregister_overlay(nullptr, &draw_overlay);
 		reshade::unregister_addon(hModule);
+		set_addon_log_sink(nullptr);
 		break;
 	}
 
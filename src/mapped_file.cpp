@@ -0,0 +1,185 @@
+#include "mapped_file.hpp"
+#include "addon_log.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+#ifdef _WIN32
+bool mapped_file::open(const std::filesystem::path &path, size_t size)
+{
+	close();
+
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		addon_log(addon_log_level::warning, "Failed to open mapped file");
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	file_size.QuadPart = static_cast<LONGLONG>(size);
+	if (!SetFilePointerEx(file, file_size, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+	{
+		addon_log(addon_log_level::warning, "Failed to resize mapped file");
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+	void *mapped = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : nullptr;
+	if (mapped == nullptr)
+	{
+		addon_log(addon_log_level::warning, "Failed to map file");
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	file_handle = file;
+	mapping_handle = mapping;
+	view = static_cast<uint8_t *>(mapped);
+	view_size = size;
+	return true;
+}
+
+bool mapped_file::open_read_only(const std::filesystem::path &path)
+{
+	close();
+
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void *mapped = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (mapped == nullptr)
+	{
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	file_handle = file;
+	mapping_handle = mapping;
+	view = static_cast<uint8_t *>(mapped);
+	view_size = static_cast<size_t>(file_size.QuadPart);
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (view != nullptr)
+		UnmapViewOfFile(view);
+	if (mapping_handle != nullptr)
+		CloseHandle(mapping_handle);
+	if (file_handle != nullptr)
+		CloseHandle(file_handle);
+	view = nullptr;
+	view_size = 0;
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+}
+
+void mapped_file::flush()
+{
+	if (view != nullptr)
+		FlushViewOfFile(view, view_size);
+}
+#else
+bool mapped_file::open(const std::filesystem::path &path, size_t size)
+{
+	close();
+
+	int file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (file < 0)
+	{
+		addon_log(addon_log_level::warning, "Failed to open mapped file");
+		return false;
+	}
+	if (ftruncate(file, static_cast<off_t>(size)) != 0)
+	{
+		addon_log(addon_log_level::warning, "Failed to resize mapped file");
+		::close(file);
+		return false;
+	}
+
+	void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (mapped == MAP_FAILED)
+	{
+		addon_log(addon_log_level::warning, "Failed to map file");
+		::close(file);
+		return false;
+	}
+
+	fd = file;
+	view = static_cast<uint8_t *>(mapped);
+	view_size = size;
+	return true;
+}
+
+bool mapped_file::open_read_only(const std::filesystem::path &path)
+{
+	close();
+
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size <= 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	size_t size = static_cast<size_t>(info.st_size);
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+	if (mapped == MAP_FAILED)
+	{
+		::close(file);
+		return false;
+	}
+
+	fd = file;
+	view = static_cast<uint8_t *>(mapped);
+	view_size = size;
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (view != nullptr)
+		munmap(view, view_size);
+	if (fd >= 0)
+		::close(fd);
+	view = nullptr;
+	view_size = 0;
+	fd = -1;
+}
+
+void mapped_file::flush()
+{
+	if (view != nullptr)
+		msync(view, view_size, MS_ASYNC);
+}
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <filesystem>
+#include <cstddef>
+#include <cstdint>
+
+// Read-write memory mapping of a whole file. Pages are only read from disk
+// when first touched.
+struct mapped_file {
+	mapped_file() {};
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+	~mapped_file();
+
+	// Opens or creates the file, resizing it to exactly size bytes
+	bool open(const std::filesystem::path &path, size_t size);
+	// Maps an existing, non-empty file as it is. The view must not be written.
+	bool open_read_only(const std::filesystem::path &path);
+	void close();
+	// Writes dirty pages back, without waiting for the disk
+	void flush();
+
+	uint8_t *data() const { return view; }
+	size_t size() const { return view_size; }
+	bool is_open() const { return view != nullptr; }
+
+private:
+	uint8_t *view = nullptr;
+	size_t view_size = 0;
+#ifdef _WIN32
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+#else
+	int fd = -1;
+#endif
+};
@@ -0,0 +1,138 @@
+#include "pixel_pack.hpp"
+#include "cpu_features.hpp"
+
+typedef void (*pack_kernel)(uint8_t *pixels, size_t pixel_count);
+
+// Every kernel writes its output at 3/4 of the read offset, so a block is always
+// loaded before any store can reach it and packing in place is safe.
+static void pack_rgba_to_rgb_scalar(uint8_t *pixels, size_t pixel_count)
+{
+	for (size_t i = 0; i < pixel_count; ++i)
+		*reinterpret_cast<uint32_t *>(pixels + 3 * i) = *reinterpret_cast<const uint32_t *>(pixels + 4 * i);
+}
+
+#ifdef CPU_X86
+CPU_TARGET("ssse3")
+static void pack_rgba_to_rgb_ssse3(uint8_t *pixels, size_t pixel_count)
+{
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	size_t i = 0;
+	for (; i + 16 <= pixel_count; i += 16)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 4 * i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 4 * i + 16));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 4 * i + 32));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 4 * i + 48));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + 3 * i), _mm_shuffle_epi8(a, shuffle));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + 3 * i + 12), _mm_shuffle_epi8(b, shuffle));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + 3 * i + 24), _mm_shuffle_epi8(c, shuffle));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + 3 * i + 36), _mm_shuffle_epi8(d, shuffle));
+	}
+	for (; i + 4 <= pixel_count; i += 4)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 4 * i));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + 3 * i), _mm_shuffle_epi8(a, shuffle));
+	}
+
+	for (; i < pixel_count; ++i)
+		*reinterpret_cast<uint32_t *>(pixels + 3 * i) = *reinterpret_cast<const uint32_t *>(pixels + 4 * i);
+}
+
+CPU_TARGET("avx2")
+static void pack_rgba_to_rgb_avx2(uint8_t *pixels, size_t pixel_count)
+{
+	// Packs each 128-bit lane into its low 12 bytes, then moves the two 12-byte
+	// runs next to each other
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i permute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+	size_t i = 0;
+	for (; i + 32 <= pixel_count; i += 32)
+	{
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + 4 * i));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + 4 * i + 32));
+		__m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + 4 * i + 64));
+		__m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + 4 * i + 96));
+		a = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(a, shuffle), permute);
+		b = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(b, shuffle), permute);
+		c = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(c, shuffle), permute);
+		d = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(d, shuffle), permute);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(pixels + 3 * i), a);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(pixels + 3 * i + 24), b);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(pixels + 3 * i + 48), c);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(pixels + 3 * i + 72), d);
+	}
+	for (; i + 8 <= pixel_count; i += 8)
+	{
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + 4 * i));
+		a = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(a, shuffle), permute);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(pixels + 3 * i), a);
+	}
+
+	for (; i < pixel_count; ++i)
+		*reinterpret_cast<uint32_t *>(pixels + 3 * i) = *reinterpret_cast<const uint32_t *>(pixels + 4 * i);
+}
+#endif
+
+static pack_kernel g_pack_kernel = &pack_rgba_to_rgb_scalar;
+static pixel_pack_kernel g_pack_kernel_id = pack_kernel_scalar;
+
+void init_pixel_pack()
+{
+	if (!set_pixel_pack_kernel(pack_kernel_avx2) && !set_pixel_pack_kernel(pack_kernel_ssse3))
+		set_pixel_pack_kernel(pack_kernel_scalar);
+}
+
+void pack_rgba_to_rgb(uint8_t *pixels, size_t pixel_count)
+{
+	g_pack_kernel(pixels, pixel_count);
+}
+
+bool set_pixel_pack_kernel(pixel_pack_kernel kernel)
+{
+	pack_kernel function = nullptr;
+	switch (kernel)
+	{
+	case pack_kernel_scalar:
+		function = &pack_rgba_to_rgb_scalar;
+		break;
+#ifdef CPU_X86
+	case pack_kernel_ssse3:
+		if (cpu_supports_ssse3())
+			function = &pack_rgba_to_rgb_ssse3;
+		break;
+	case pack_kernel_avx2:
+		if (cpu_supports_avx2())
+			function = &pack_rgba_to_rgb_avx2;
+		break;
+#endif
+	default:
+		break;
+	}
+	if (function == nullptr) return false;
+
+	g_pack_kernel = function;
+	g_pack_kernel_id = kernel;
+	return true;
+}
+
+pixel_pack_kernel get_pixel_pack_kernel()
+{
+	return g_pack_kernel_id;
+}
+
+const char *pixel_pack_kernel_name(pixel_pack_kernel kernel)
+{
+	switch (kernel)
+	{
+	case pack_kernel_ssse3:
+		return "ssse3";
+	case pack_kernel_avx2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
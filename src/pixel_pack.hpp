@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum pixel_pack_kernel {
+	pack_kernel_scalar,
+	pack_kernel_ssse3,
+	pack_kernel_avx2,
+};
+
+const pixel_pack_kernel pixel_pack_kernels[] = {
+	pack_kernel_scalar,
+	pack_kernel_ssse3,
+	pack_kernel_avx2
+};
+
+// Selects the fastest pack kernel supported by the CPU, call once at startup
+void init_pixel_pack();
+// Drops the alpha channel of pixel_count RGBA pixels, writing RGB in place
+void pack_rgba_to_rgb(uint8_t *pixels, size_t pixel_count);
+
+// Forces a kernel so tests and benchmarks can cover each one, init_pixel_pack
+// picks the fastest again. Returns false when the CPU lacks it.
+bool set_pixel_pack_kernel(pixel_pack_kernel kernel);
+pixel_pack_kernel get_pixel_pack_kernel();
+const char *pixel_pack_kernel_name(pixel_pack_kernel kernel);
@@ -0,0 +1,333 @@
+#include "png_encode.hpp"
+#include "deflate.hpp"
+#include "worker_pool.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Headless builds without the fpng submodule define PNG_ENCODE_NO_FPNG, every
+// image then goes through the strip encoder
+#ifndef PNG_ENCODE_NO_FPNG
+#include <fpng.h>
+#endif
+
+// The caller encodes strips too, so this is one more than the pool size
+#define PNG_MAX_THREADS 8
+// Below this a strip costs more in lost matches and thread handoff than it saves
+#define PNG_MIN_STRIP_BYTES (256 * 1024)
+// fpng is faster per core, strips only pay off for large frames on several cores
+#define PNG_STRIPS_MIN_PIXELS (2560 * 1440)
+#define PNG_STRIPS_MIN_THREADS 3
+#define PNG_DECODE_MAX_PIXELS (16384ull * 16384ull)
+
+static uint32_t png_thread_count()
+{
+	uint32_t cores = std::thread::hardware_concurrency();
+	return std::clamp<uint32_t>(cores, 1, PNG_MAX_THREADS);
+}
+
+static worker_pool g_png_workers(std::max<uint32_t>(png_thread_count() - 1, 1), PNG_MAX_THREADS);
+
+struct crc_table {
+	uint32_t entries[256];
+
+	crc_table()
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			entries[i] = c;
+		}
+	}
+};
+
+static const crc_table g_crc_table;
+
+static uint32_t png_crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+		crc = g_crc_table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void put_be32(uint8_t *p, uint32_t value)
+{
+	p[0] = static_cast<uint8_t>(value >> 24);
+	p[1] = static_cast<uint8_t>(value >> 16);
+	p[2] = static_cast<uint8_t>(value >> 8);
+	p[3] = static_cast<uint8_t>(value);
+}
+
+// Leaves room for the length and type, fill the data after it then call end_chunk
+static size_t begin_chunk(std::vector<uint8_t> &out, const char *type)
+{
+	size_t start = out.size();
+	out.resize(start + 8);
+	memcpy(out.data() + start + 4, type, 4);
+	return start;
+}
+
+static void end_chunk(std::vector<uint8_t> &out, size_t start)
+{
+	size_t data_size = out.size() - start - 8;
+	put_be32(out.data() + start, static_cast<uint32_t>(data_size));
+	uint32_t crc = png_crc32(0, out.data() + start + 4, data_size + 4);
+	out.resize(out.size() + 4);
+	put_be32(out.data() + out.size() - 4, crc);
+}
+
+struct png_strip {
+	uint32_t first_row;
+	uint32_t row_count;
+	// Complete IDAT chunk including length and CRC
+	std::vector<uint8_t> chunk;
+	uint32_t adler;
+	size_t filtered_size;
+};
+
+// Shared with the helper jobs, which may only start after the encode returned
+struct png_strip_state {
+	const uint8_t *pixels;
+	uint32_t width;
+	std::vector<png_strip> strips;
+	std::atomic<uint32_t> next_strip { 0 };
+	std::mutex mutex;
+	std::condition_variable strip_done;
+	uint32_t done_count = 0;
+};
+
+// Every row uses the Up filter except the first row of the image, strips read
+// the row above them so the filtered stream matches a single pass encode
+static void encode_strip(const png_strip_state &state, png_strip &strip, bool last)
+{
+	PROFILE_SCOPE("png: encode strip");
+
+	size_t stride = static_cast<size_t>(state.width) * 3;
+	std::vector<uint8_t> filtered((stride + 1) * strip.row_count);
+	uint8_t *dst = filtered.data();
+	for (uint32_t y = strip.first_row; y < strip.first_row + strip.row_count; ++y)
+	{
+		const uint8_t *row = state.pixels + y * stride;
+		if (y == 0)
+		{
+			*dst++ = 0;
+			memcpy(dst, row, stride);
+		} else {
+			const uint8_t *above = row - stride;
+			*dst++ = 2;
+			for (size_t i = 0; i < stride; ++i)
+				dst[i] = static_cast<uint8_t>(row[i] - above[i]);
+		}
+		dst += stride;
+	}
+
+	strip.filtered_size = filtered.size();
+	strip.adler = deflate_adler32(1, filtered.data(), filtered.size());
+
+	size_t start = begin_chunk(strip.chunk, "IDAT");
+	if (strip.first_row == 0)
+	{
+		// zlib header: deflate, 32K window, no dictionary, fastest level
+		strip.chunk.push_back(0x78);
+		strip.chunk.push_back(0x01);
+	}
+	deflate_chunk(filtered.data(), filtered.size(), last, strip.chunk);
+	end_chunk(strip.chunk, start);
+}
+
+static void encode_pending_strips(png_strip_state &state)
+{
+	uint32_t index;
+	while ((index = state.next_strip.fetch_add(1)) < state.strips.size())
+	{
+		encode_strip(state, state.strips[index], index + 1 == state.strips.size());
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (++state.done_count == state.strips.size())
+			state.strip_done.notify_all();
+	}
+}
+
+bool encode_png_rgb_strips(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out, uint32_t max_threads)
+{
+	PROFILE_SCOPE("png: encode strips");
+
+	out.clear();
+	if (width == 0 || height == 0 || width > (UINT32_MAX - 1) / 3)
+		return false;
+
+	uint32_t threads = max_threads == 0 ? png_thread_count() : std::min<uint32_t>(max_threads, PNG_MAX_THREADS);
+	size_t filtered_size = (static_cast<size_t>(width) * 3 + 1) * height;
+	size_t strip_count = std::min<size_t>({ threads, height, std::max<size_t>(filtered_size / PNG_MIN_STRIP_BYTES, 1) });
+
+	auto state = std::make_shared<png_strip_state>();
+	state->pixels = pixels;
+	state->width = width;
+	state->strips.resize(strip_count);
+	for (size_t i = 0; i < strip_count; ++i)
+	{
+		state->strips[i].first_row = static_cast<uint32_t>(height * i / strip_count);
+		state->strips[i].row_count = static_cast<uint32_t>(height * (i + 1) / strip_count) - state->strips[i].first_row;
+	}
+
+	// Helpers stuck behind another encode in the queue find no strips left and
+	// return, the caller never waits on a job that has not started
+	for (size_t i = 1; i < strip_count; ++i)
+		g_png_workers.submit([state]() { encode_pending_strips(*state); });
+	encode_pending_strips(*state);
+	{
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->strip_done.wait(lock, [&state] { return state->done_count == state->strips.size(); });
+	}
+
+	uint32_t adler = state->strips[0].adler;
+	size_t total_size = 8 + 25 + 16 + 12;
+	for (size_t i = 0; i < strip_count; ++i)
+	{
+		if (i > 0)
+			adler = deflate_adler32_combine(adler, state->strips[i].adler, state->strips[i].filtered_size);
+		total_size += state->strips[i].chunk.size();
+	}
+
+	out.reserve(total_size);
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	out.insert(out.end(), signature, signature + 8);
+
+	size_t start = begin_chunk(out, "IHDR");
+	out.resize(out.size() + 13);
+	uint8_t *ihdr = out.data() + start + 8;
+	put_be32(ihdr, width);
+	put_be32(ihdr + 4, height);
+	ihdr[8] = 8; // bit depth
+	ihdr[9] = 2; // RGB
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+	end_chunk(out, start);
+
+	for (const png_strip &strip : state->strips)
+		out.insert(out.end(), strip.chunk.begin(), strip.chunk.end());
+
+	// The zlib trailer gets its own IDAT so no strip waits on the others
+	start = begin_chunk(out, "IDAT");
+	out.resize(out.size() + 4);
+	put_be32(out.data() + out.size() - 4, adler);
+	end_chunk(out, start);
+
+	start = begin_chunk(out, "IEND");
+	end_chunk(out, start);
+	return true;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | p[3];
+}
+
+static uint8_t paeth_predictor(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+	return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+bool decode_png_rgb(const uint8_t *data, size_t size, std::vector<uint8_t> &out, uint32_t &width, uint32_t &height)
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if (size < 8 || memcmp(data, signature, 8) != 0) return false;
+
+	std::vector<uint8_t> compressed;
+	bool have_header = false;
+	size_t pos = 8;
+	while (pos + 12 <= size)
+	{
+		uint32_t length = get_be32(data + pos);
+		const uint8_t *type = data + pos + 4;
+		const uint8_t *chunk = data + pos + 8;
+		if (length > size - pos - 12) return false;
+
+		if (memcmp(type, "IHDR", 4) == 0)
+		{
+			// 8-bit RGB, default compression and filters, not interlaced
+			if (length != 13 || chunk[8] != 8 || chunk[9] != 2 || chunk[10] != 0 || chunk[11] != 0 || chunk[12] != 0) return false;
+			width = get_be32(chunk);
+			height = get_be32(chunk + 4);
+			have_header = true;
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+		{
+			compressed.insert(compressed.end(), chunk, chunk + length);
+		}
+		else if (memcmp(type, "IEND", 4) == 0)
+		{
+			break;
+		}
+		pos += 12 + static_cast<size_t>(length);
+	}
+	if (!have_header || width == 0 || height == 0 || compressed.size() < 6) return false;
+	// Far beyond any back buffer, keeps a corrupt header from allocating gigabytes
+	if (static_cast<uint64_t>(width) * height > PNG_DECODE_MAX_PIXELS) return false;
+	// zlib header: deflate without a preset dictionary
+	if ((compressed[0] & 0x0f) != 8 || (compressed[1] & 0x20) != 0 || ((compressed[0] << 8) | compressed[1]) % 31 != 0) return false;
+
+	size_t stride = static_cast<size_t>(width) * 3;
+	size_t filtered_size = (stride + 1) * height;
+	std::vector<uint8_t> filtered;
+	filtered.reserve(filtered_size);
+	if (!inflate_raw(compressed.data() + 2, compressed.size() - 6, filtered, filtered_size) || filtered.size() != filtered_size) return false;
+	if (deflate_adler32(1, filtered.data(), filtered.size()) != get_be32(compressed.data() + compressed.size() - 4)) return false;
+
+	out.resize(stride * height);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const uint8_t *src = filtered.data() + y * (stride + 1);
+		uint8_t *row = out.data() + y * stride;
+		const uint8_t *up = y > 0 ? row - stride : nullptr;
+		uint8_t filter = *src++;
+		for (size_t x = 0; x < stride; ++x)
+		{
+			int a = x >= 3 ? row[x - 3] : 0;
+			int b = up ? up[x] : 0;
+			int c = up && x >= 3 ? up[x - 3] : 0;
+			switch (filter)
+			{
+			case 0: row[x] = src[x]; break;
+			case 1: row[x] = static_cast<uint8_t>(src[x] + a); break;
+			case 2: row[x] = static_cast<uint8_t>(src[x] + b); break;
+			case 3: row[x] = static_cast<uint8_t>(src[x] + ((a + b) >> 1)); break;
+			case 4: row[x] = static_cast<uint8_t>(src[x] + paeth_predictor(a, b, c)); break;
+			default: return false;
+			}
+		}
+	}
+	return true;
+}
+
+void init_png_encode()
+{
+#ifndef PNG_ENCODE_NO_FPNG
+	fpng::fpng_init();
+#endif
+}
+
+bool encode_png_rgb(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+{
+#ifndef PNG_ENCODE_NO_FPNG
+	if (static_cast<size_t>(width) * height < PNG_STRIPS_MIN_PIXELS || png_thread_count() < PNG_STRIPS_MIN_THREADS)
+		return fpng::fpng_encode_image_to_memory(pixels, width, height, 3, out);
+#endif
+	return encode_png_rgb_strips(pixels, width, height, out);
+}
+
+void shutdown_png_workers(bool process_terminating)
+{
+	g_png_workers.shutdown(process_terminating);
+}
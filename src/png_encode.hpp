@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Call once at startup before encoding
+void init_png_encode();
+// Encodes tightly packed RGB pixels as a PNG into out, resizing it. Large
+// images go through the strip encoder when enough cores are available.
+bool encode_png_rgb(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out);
+// Splits the image into horizontal strips deflated on up to max_threads
+// threads (0 for all PNG workers plus the caller) and joins them into a single
+// PNG with one IDAT per strip. Output is larger than fpng but scales with cores.
+bool encode_png_rgb_strips(const uint8_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &out, uint32_t max_threads = 0);
+// Reads an 8-bit RGB, non-interlaced PNG (what the encoders above write) back
+// into packed RGB. Other PNG variants are rejected.
+bool decode_png_rgb(const uint8_t *data, size_t size, std::vector<uint8_t> &out, uint32_t &width, uint32_t &height);
+// Stops the strip encoder threads, see worker_pool::shutdown
+void shutdown_png_workers(bool process_terminating);
@@ -0,0 +1,71 @@
+#include "preset_file.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+static const char* KEY_TECHNIQUES = "Techniques";
+
+static std::string trim(const std::string &str)
+{
+	size_t begin = str.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos) return std::string();
+	size_t end = str.find_last_not_of(" \t\r\n");
+	return str.substr(begin, end - begin + 1);
+}
+
+static bool parse_preset_content(const std::string &content, preset_file &out)
+{
+	out.sections.clear();
+	out.techniques.clear();
+
+	std::map<std::string, std::string> *section = &out.sections[""];
+	std::stringstream ss(content);
+	std::string line;
+	while (std::getline(ss, line))
+	{
+		line = trim(line);
+		if (line.empty() || line[0] == ';' || line[0] == '#') continue;
+
+		if (line.front() == '[' && line.back() == ']')
+		{
+			section = &out.sections[trim(line.substr(1, line.size() - 2))];
+			continue;
+		}
+
+		size_t eq = line.find('=');
+		if (eq == std::string::npos) continue;
+		(*section)[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+	}
+
+	auto& global = out.sections[""];
+	auto it = global.find(KEY_TECHNIQUES);
+	if (it != global.end())
+	{
+		std::stringstream techniques(it->second);
+		std::string technique;
+		while (std::getline(techniques, technique, ','))
+		{
+			technique = trim(technique);
+			if (!technique.empty())
+				out.techniques.push_back(technique);
+		}
+		std::sort(out.techniques.begin(), out.techniques.end());
+	}
+
+	return true;
+}
+
+bool parse_preset_file(const std::filesystem::path &path, preset_file &out)
+{
+	std::error_code ec;
+	out.last_write_time = std::filesystem::last_write_time(path, ec);
+	if (ec) return false;
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	std::stringstream content;
+	content << file.rdbuf();
+	return parse_preset_content(content.str(), out);
+}
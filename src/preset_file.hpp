@@ -0,0 +1,16 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <map>
+
+// Parsed ReShade preset. Keys outside any section are stored under "".
+struct preset_file {
+	std::map<std::string, std::map<std::string, std::string>> sections;
+	// Sorted entries of the Techniques key ("Name@File.fx")
+	std::vector<std::string> techniques;
+	std::filesystem::file_time_type last_write_time;
+};
+
+bool parse_preset_file(const std::filesystem::path &path, preset_file &out);
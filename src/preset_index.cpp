@@ -0,0 +1,169 @@
+#include "preset_index.hpp"
+#include "preset_file.hpp"
+#include "thumbnail_atlas.hpp"
+
+#include <unordered_set>
+#include <algorithm>
+#include <cctype>
+
+#define PRESET_INDEX_RESCAN_SECONDS 5
+#define PRESET_INDEX_MAX_FILE_SIZE (1024 * 1024)
+
+static bool has_preset_extension(const std::filesystem::path &path)
+{
+	std::string ext = path.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return ext == ".ini" || ext == ".txt";
+}
+
+// Lowercase UTF-8 path, snapshots are sorted by it
+static std::string get_search_key(std::string display)
+{
+	std::transform(display.begin(), display.end(), display.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return display;
+}
+
+const preset_index_entry *find_preset_index_entry(const preset_index_snapshot &snapshot, const std::filesystem::path &path)
+{
+	std::string key = get_search_key(path.u8string());
+	auto it = std::lower_bound(snapshot.begin(), snapshot.end(), key,
+		[](const preset_index_entry &entry, const std::string &key) { return entry.search_key < key; });
+	// Paths differing only in case share a key
+	for (; it != snapshot.end() && it->search_key == key; ++it)
+	{
+		if (it->path == path)
+			return &*it;
+	}
+	return nullptr;
+}
+
+void preset_index::set_roots(std::vector<std::filesystem::path> new_roots)
+{
+	std::sort(new_roots.begin(), new_roots.end());
+	new_roots.erase(std::unique(new_roots.begin(), new_roots.end()), new_roots.end());
+	if (new_roots == roots) return;
+
+	roots = std::move(new_roots);
+	rescan_requested = true;
+}
+
+void preset_index::request_rescan()
+{
+	rescan_requested = true;
+}
+
+void preset_index::update()
+{
+	if (scanning || roots.empty()) return;
+
+	auto now = std::chrono::steady_clock::now();
+	if (!rescan_requested && now - last_scan < std::chrono::seconds(PRESET_INDEX_RESCAN_SECONDS)) return;
+
+	rescan_requested = false;
+	last_scan = now;
+	scanning = true;
+	worker.submit([this, roots = roots, previous = snapshot()]() {
+		scan(roots, previous);
+	});
+}
+
+void preset_index::wait_for_scan()
+{
+	worker.drain();
+}
+
+void preset_index::shutdown(bool process_terminating)
+{
+	worker.shutdown(process_terminating);
+	scanning = false;
+}
+
+std::shared_ptr<const preset_index_snapshot> preset_index::snapshot()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return current;
+}
+
+void preset_index::scan(std::vector<std::filesystem::path> scan_roots, std::shared_ptr<const preset_index_snapshot> previous)
+{
+	std::unordered_map<std::string, const preset_index_entry *> known;
+	if (previous != nullptr)
+	{
+		for (auto& entry : *previous)
+			known.emplace(entry.display, &entry);
+	}
+
+	auto next = std::make_shared<preset_index_snapshot>();
+	bool changed = previous == nullptr;
+	std::unordered_set<std::string> seen;
+
+	for (auto& root : scan_roots)
+	{
+		std::error_code ec;
+		auto it = std::filesystem::recursive_directory_iterator(root, std::filesystem::directory_options::skip_permission_denied, ec);
+		for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+		{
+			if (it.depth() >= PRESET_INDEX_MAX_DEPTH)
+				it.disable_recursion_pending();
+
+			const std::filesystem::directory_entry &file = *it;
+			std::error_code file_ec;
+			if (!file.is_regular_file(file_ec) || !has_preset_extension(file.path()))
+				continue;
+
+			std::string display = file.path().u8string();
+			if (!seen.insert(display).second)
+				continue;
+
+			uintmax_t size = file.file_size(file_ec);
+			std::filesystem::file_time_type last_write_time = file.last_write_time(file_ec);
+			if (file_ec || size > PRESET_INDEX_MAX_FILE_SIZE)
+				continue;
+
+			auto known_it = known.find(display);
+			if (known_it != known.end() && known_it->second->size == size && known_it->second->last_write_time == last_write_time)
+			{
+				next->push_back(*known_it->second);
+				continue;
+			}
+
+			auto rejected_it = rejected.find(display);
+			if (rejected_it != rejected.end() && rejected_it->second.size == size && rejected_it->second.last_write_time == last_write_time)
+				continue;
+
+			changed = true;
+			preset_file preset;
+			if (!parse_preset_file(file.path(), preset) || preset.techniques.empty())
+			{
+				rejected[display] = { size, last_write_time };
+				continue;
+			}
+			rejected.erase(display);
+
+			preset_index_entry entry;
+			entry.path = file.path();
+			entry.display = std::move(display);
+			entry.search_key = get_search_key(entry.display);
+			entry.last_write_time = last_write_time;
+			entry.size = size;
+			entry.techniques = std::move(preset.techniques);
+			// Hashed here, so the overlay never reads a preset to find its thumbnail
+			entry.content_hash = hash_preset_file(entry.path);
+			next->push_back(std::move(entry));
+		}
+	}
+
+	if (!changed && next->size() != previous->size())
+		changed = true;
+
+	if (changed)
+	{
+		std::sort(next->begin(), next->end(),
+			[](const preset_index_entry &a, const preset_index_entry &b) { return a.search_key < b.search_key; });
+
+		std::lock_guard<std::mutex> lock(mutex);
+		current = std::move(next);
+		++published_generation;
+	}
+	scanning = false;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "worker_pool.hpp"
+
+#include <filesystem>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+
+// Levels of subdirectories below a root that are scanned
+#define PRESET_INDEX_MAX_DEPTH 4
+
+struct preset_index_entry {
+	std::filesystem::path path;
+	// UTF-8 path for display and its lowercase form for searching
+	std::string display;
+	std::string search_key;
+	std::filesystem::file_time_type last_write_time;
+	uintmax_t size;
+	std::vector<std::string> techniques;
+	// hash_preset_file of the contents, which keys the preset's thumbnail
+	uint64_t content_hash;
+};
+
+typedef std::vector<preset_index_entry> preset_index_snapshot;
+
+// Entry of the preset at path, or null when the snapshot does not have it
+const preset_index_entry *find_preset_index_entry(const preset_index_snapshot &snapshot, const std::filesystem::path &path);
+
+// Scans preset directories on a background thread and publishes immutable
+// snapshots, so the overlay can list and search presets without disk access.
+// Files whose mtime and size did not change are not reparsed.
+struct preset_index {
+	preset_index() : worker(1, 1) {};
+
+	// Directories to scan (recursively). Triggers a rescan when they change.
+	void set_roots(std::vector<std::filesystem::path> roots);
+	// Call once per frame, starts a rescan when one is due
+	void update();
+	void request_rescan();
+	// Blocks until a started scan has finished, for tests and benchmarks
+	void wait_for_scan();
+	void shutdown(bool process_terminating);
+
+	std::shared_ptr<const preset_index_snapshot> snapshot();
+	// Increases every time a new snapshot is published
+	uint32_t generation() const { return published_generation; }
+
+private:
+	void scan(std::vector<std::filesystem::path> roots, std::shared_ptr<const preset_index_snapshot> previous);
+
+	struct file_stamp {
+		uintmax_t size;
+		std::filesystem::file_time_type last_write_time;
+	};
+
+	worker_pool worker;
+	// Files that matched the filter but are not presets, only used by the worker
+	std::unordered_map<std::string, file_stamp> rejected;
+	std::vector<std::filesystem::path> roots;
+	std::shared_ptr<const preset_index_snapshot> current;
+	std::mutex mutex;
+	std::atomic<bool> scanning = false;
+	std::atomic<uint32_t> published_generation = 0;
+	bool rescan_requested = false;
+	std::chrono::steady_clock::time_point last_scan;
+};
@@ -1,15 +1,20 @@
 #pragma once
 
 #include <filesystem>
+#include <string>
 
 enum keybind_action {
 	change_preset = 0,
-	take_screenshot = 1
+	take_screenshot = 1,
+	capture_all_presets = 2,
+	capture_burst = 3
 };
 
 const keybind_action keybind_actions[] = {
 	change_preset,
-	take_screenshot
+	take_screenshot,
+	capture_all_presets,
+	capture_burst
 };
 
 struct preset_keybind
@@ -17,6 +22,10 @@ struct preset_keybind
 	std::filesystem::path preset;
 	unsigned int keybind[4];
 	keybind_action action;
-	bool keybind_opened;
 	bool remove;
+
+	// Overlay text, rebuilt when display_valid is cleared
+	std::string preset_display;
+	std::string keybind_display;
+	bool display_valid;
 };
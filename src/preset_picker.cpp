@@ -0,0 +1,93 @@
+#include "preset_picker.hpp"
+
+#include <imgui.h>
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+#define PRESET_PICKER_VISIBLE_ROWS 15
+#define PRESET_PICKER_TOOLTIP_TECHNIQUES 20
+
+static void refilter(preset_index &index, preset_picker_state &state)
+{
+	std::string filter = state.filter;
+	std::transform(filter.begin(), filter.end(), filter.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	std::vector<std::string> terms;
+	std::stringstream ss(filter);
+	std::string term;
+	while (ss >> term)
+		terms.push_back(term);
+
+	state.applied_filter = state.filter;
+	state.applied_generation = index.generation();
+	state.snapshot = index.snapshot();
+	state.filtered.clear();
+	if (state.snapshot == nullptr) return;
+
+	for (uint32_t i = 0; i < state.snapshot->size(); ++i)
+	{
+		const std::string &key = (*state.snapshot)[i].search_key;
+		if (std::all_of(terms.begin(), terms.end(), [&key](const std::string &t) { return key.find(t) != std::string::npos; }))
+			state.filtered.push_back(i);
+	}
+}
+
+bool preset_picker_popup(const char *id, preset_index &index, preset_picker_state &state, std::filesystem::path &selected, bool &browse_files,
+	const std::function<void(const preset_index_entry &)> &draw_preview)
+{
+	bool picked = false;
+	browse_files = false;
+
+	if (!ImGui::BeginPopup(id)) return false;
+
+	ImGui::InputTextWithHint("##filter", "Search presets", state.filter, sizeof(state.filter));
+	if (state.applied_filter != state.filter || state.applied_generation != index.generation() || state.snapshot == nullptr)
+		refilter(index, state);
+
+	if (state.snapshot == nullptr)
+		ImGui::TextDisabled("%s", "Scanning preset folders...");
+	else
+		ImGui::TextDisabled("%u of %u presets", static_cast<unsigned int>(state.filtered.size()), static_cast<unsigned int>(state.snapshot->size()));
+
+	ImGui::BeginChild("##presets", ImVec2(600, ImGui::GetTextLineHeightWithSpacing() * PRESET_PICKER_VISIBLE_ROWS));
+	ImGuiListClipper clipper;
+	clipper.Begin(static_cast<int>(state.filtered.size()));
+	while (clipper.Step())
+	{
+		for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+		{
+			const preset_index_entry &entry = (*state.snapshot)[state.filtered[row]];
+			ImGui::PushID(row);
+			if (ImGui::Selectable(entry.display.c_str()))
+			{
+				selected = entry.path;
+				picked = true;
+				ImGui::CloseCurrentPopup();
+			}
+			if (ImGui::IsItemHovered(ImGuiHoveredFlags_ForTooltip) && ImGui::BeginTooltip())
+			{
+				if (draw_preview)
+					draw_preview(entry);
+				size_t shown = std::min<size_t>(entry.techniques.size(), PRESET_PICKER_TOOLTIP_TECHNIQUES);
+				for (size_t t = 0; t < shown; ++t)
+					ImGui::TextUnformatted(entry.techniques[t].c_str());
+				if (shown < entry.techniques.size())
+					ImGui::TextDisabled("... %u more", static_cast<unsigned int>(entry.techniques.size() - shown));
+				ImGui::EndTooltip();
+			}
+			ImGui::PopID();
+		}
+	}
+	clipper.End();
+	ImGui::EndChild();
+
+	if (ImGui::Button("Browse files..."))
+	{
+		browse_files = true;
+		ImGui::CloseCurrentPopup();
+	}
+
+	ImGui::EndPopup();
+	return picked;
+}
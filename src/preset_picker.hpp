@@ -0,0 +1,23 @@
+#pragma once
+
+#include "preset_index.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct preset_picker_state {
+	char filter[256] = {};
+	std::string applied_filter;
+	uint32_t applied_generation = 0;
+	std::shared_ptr<const preset_index_snapshot> snapshot;
+	std::vector<uint32_t> filtered;
+};
+
+// Searchable list of indexed presets, shown in the popup opened with ImGui::OpenPopup(id).
+// Returns true when a preset was picked. browse_files is set when the user asks for the file browser instead.
+// draw_preview, when set, adds to the tooltip of a hovered preset.
+bool preset_picker_popup(const char *id, preset_index &index, preset_picker_state &state, std::filesystem::path &selected, bool &browse_files,
+	const std::function<void(const preset_index_entry &)> &draw_preview = nullptr);
@@ -0,0 +1,115 @@
+#include "preset_preview.hpp"
+#include "thumbnail_atlas.hpp"
+
+#include <imgui.h>
+
+// Frames the GPU may still be drawing with a retired texture
+#define PRESET_PREVIEW_RETIRE_FRAMES 4
+
+void preset_preview_cache::retire()
+{
+	// A texture may still be referenced by the draw list of this frame
+	retired_frame = ImGui::GetFrameCount();
+	for (auto& [path, cached] : previews)
+		if (cached.texture.handle != 0)
+			retired.push_back(cached);
+	previews.clear();
+}
+
+void preset_preview_cache::destroy_retired(reshade::api::device *device)
+{
+	for (auto& cached : retired)
+	{
+		device->destroy_resource_view(cached.view);
+		device->destroy_resource(cached.texture);
+	}
+	retired.clear();
+}
+
+preset_preview_cache::preview preset_preview_cache::create(reshade::api::device *device, const std::filesystem::path &preset, uint64_t content_hash)
+{
+	preview created = {};
+	created.content_hash = content_hash;
+	std::vector<uint8_t> rgb;
+	if (!g_thumbnail_atlas.load(preset, content_hash, rgb))
+		return created;
+
+	std::vector<uint8_t> rgba(THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT * 4);
+	for (size_t i = 0; i < THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT; ++i)
+	{
+		rgba[i * 4 + 0] = rgb[i * 3 + 0];
+		rgba[i * 4 + 1] = rgb[i * 3 + 1];
+		rgba[i * 4 + 2] = rgb[i * 3 + 2];
+		rgba[i * 4 + 3] = 255;
+	}
+
+	reshade::api::subresource_data data = {};
+	data.data = rgba.data();
+	data.row_pitch = THUMBNAIL_WIDTH * 4;
+	data.slice_pitch = THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT * 4;
+	reshade::api::resource_desc desc(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, 1, 1, reshade::api::format::r8g8b8a8_unorm, 1,
+		reshade::api::memory_heap::gpu_only, reshade::api::resource_usage::shader_resource);
+	if (!device->create_resource(desc, &data, reshade::api::resource_usage::shader_resource, &created.texture))
+	{
+		created.texture = {};
+		return created;
+	}
+	if (!device->create_resource_view(created.texture, reshade::api::resource_usage::shader_resource,
+		reshade::api::resource_view_desc(reshade::api::format::r8g8b8a8_unorm), &created.view))
+	{
+		device->destroy_resource(created.texture);
+		created.texture = {};
+		created.view = {};
+	}
+	return created;
+}
+
+void preset_preview_cache::draw(reshade::api::effect_runtime *runtime, const std::filesystem::path &preset, uint64_t content_hash)
+{
+	if (preset.empty() || content_hash == 0) return;
+
+	reshade::api::device *device = runtime->get_device();
+	if (ImGui::GetFrameCount() - retired_frame > PRESET_PREVIEW_RETIRE_FRAMES)
+		destroy_retired(device);
+	if (stale || generation != g_thumbnail_atlas.generation())
+	{
+		retire();
+		stale = false;
+		generation = g_thumbnail_atlas.generation();
+	}
+
+	auto it = previews.find(preset);
+	if (it != previews.end() && it->second.content_hash != content_hash)
+	{
+		if (it->second.texture.handle != 0)
+		{
+			retired_frame = ImGui::GetFrameCount();
+			retired.push_back(it->second);
+		}
+		previews.erase(it);
+		it = previews.end();
+	}
+	if (it == previews.end())
+	{
+		it = previews.emplace(preset, create(device, preset, content_hash)).first;
+		// Loading may drop a stale entry, which is not worth a second lookup
+		generation = g_thumbnail_atlas.generation();
+	}
+	if (it->second.view.handle != 0)
+		ImGui::Image(static_cast<ImTextureID>(it->second.view.handle), ImVec2(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+}
+
+void preset_preview_cache::invalidate()
+{
+	stale = true;
+}
+
+void preset_preview_cache::destroy(reshade::api::effect_runtime *runtime)
+{
+	// Nothing is drawn anymore, everything can go right away
+	for (auto& [path, cached] : previews)
+		if (cached.texture.handle != 0)
+			retired.push_back(cached);
+	previews.clear();
+	destroy_retired(runtime->get_device());
+}
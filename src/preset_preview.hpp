@@ -0,0 +1,40 @@
+#pragma once
+
+#include <reshade.hpp>
+#include <filesystem>
+#include <map>
+#include <vector>
+
+// Thumbnails from g_thumbnail_atlas as textures of one runtime's device.
+// Textures are created on first use and kept until the atlas changes or
+// invalidate is called. Only used from that runtime's overlay.
+struct preset_preview_cache {
+	// Draws the preset's thumbnail as an ImGui image, or nothing when it has
+	// none. content_hash comes from the preset index (hash_preset_file), the
+	// file is never read during a frame. Zero draws nothing.
+	void draw(reshade::api::effect_runtime *runtime, const std::filesystem::path &preset, uint64_t content_hash);
+	// Forgets cached thumbnails, e.g. when the overlay opens after presets were edited
+	void invalidate();
+	// Frees the textures, call before the runtime's device is destroyed
+	void destroy(reshade::api::effect_runtime *runtime);
+
+private:
+	struct preview {
+		// Zero handles when the preset has no thumbnail
+		reshade::api::resource texture;
+		reshade::api::resource_view view;
+		// Contents the thumbnail was looked up for, an edit needs a new lookup
+		uint64_t content_hash;
+	};
+
+	void retire();
+	void destroy_retired(reshade::api::device *device);
+	preview create(reshade::api::device *device, const std::filesystem::path &preset, uint64_t content_hash);
+
+	std::map<std::filesystem::path, preview> previews;
+	std::vector<preview> retired;
+	int retired_frame = 0;
+	uint32_t generation = 0;
+	// Set outside of the overlay, where no ImGui frame is current
+	bool stale = false;
+};
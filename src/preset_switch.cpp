@@ -0,0 +1,214 @@
+#include "preset_switch.hpp"
+#include "preset_file.hpp"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+
+static const char* KEY_TECHNIQUE_SORTING = "TechniqueSorting";
+static const char* KEY_PREPROCESSOR_DEFINITIONS = "PreprocessorDefinitions";
+
+struct uniform_change {
+	uint64_t variable;
+	const std::string *value;
+};
+
+static std::map<std::filesystem::path, std::shared_ptr<preset_file>> g_preset_cache;
+// Only held for lookups, parsing happens outside so runtimes never wait on the disk of another
+static std::mutex g_preset_cache_mutex;
+
+static std::shared_ptr<preset_file> get_preset(const std::filesystem::path &path)
+{
+	std::error_code ec;
+	std::filesystem::file_time_type last_write_time = std::filesystem::last_write_time(path, ec);
+	if (ec) return nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(g_preset_cache_mutex);
+		auto it = g_preset_cache.find(path);
+		if (it != g_preset_cache.end() && it->second->last_write_time == last_write_time)
+			return it->second;
+	}
+
+	auto preset = std::make_shared<preset_file>();
+	if (!parse_preset_file(path, *preset))
+		return nullptr;
+	std::lock_guard<std::mutex> lock(g_preset_cache_mutex);
+	g_preset_cache[path] = preset;
+	return preset;
+}
+
+static const std::string *find_value(const preset_file &preset, const std::string &section, const char *key)
+{
+	auto section_it = preset.sections.find(section);
+	if (section_it == preset.sections.end()) return nullptr;
+	auto it = section_it->second.find(key);
+	return it != section_it->second.end() ? &it->second : nullptr;
+}
+
+static bool same_value(const preset_file &a, const preset_file &b, const std::string &section, const char *key)
+{
+	const std::string *va = find_value(a, section, key);
+	const std::string *vb = find_value(b, section, key);
+	if (va == nullptr || vb == nullptr) return va == vb;
+	return *va == *vb;
+}
+
+// Anything that changes which effects are compiled or in which order they run
+// needs a full reload
+static bool has_same_effect_setup(const preset_file &from, const preset_file &to)
+{
+	if (from.techniques != to.techniques) return false;
+	if (!same_value(from, to, "", KEY_TECHNIQUE_SORTING)) return false;
+
+	for (auto& section : from.sections)
+		if (!same_value(from, to, section.first, KEY_PREPROCESSOR_DEFINITIONS)) return false;
+	for (auto& section : to.sections)
+		if (!same_value(from, to, section.first, KEY_PREPROCESSOR_DEFINITIONS)) return false;
+
+	return true;
+}
+
+static bool collect_uniform_changes(addon_runtime *runtime, const preset_file &from, const preset_file &to, std::vector<uniform_change> &out)
+{
+	for (auto& section : from.sections)
+	{
+		if (section.first.empty()) continue;
+		for (auto& value : section.second)
+		{
+			// A uniform missing from the target would have to be reset to its
+			// default, which only a reload knows
+			if (find_value(to, section.first, value.first.c_str()) == nullptr)
+				return false;
+		}
+	}
+
+	for (auto& section : to.sections)
+	{
+		if (section.first.empty()) continue;
+		for (auto& value : section.second)
+		{
+			if (value.first == KEY_PREPROCESSOR_DEFINITIONS) continue;
+
+			const std::string *current = find_value(from, section.first, value.first.c_str());
+			if (current != nullptr && *current == value.second) continue;
+
+			uint64_t variable = runtime->find_uniform_variable(section.first.c_str(), value.first.c_str());
+			if (variable == 0)
+				return false;
+			out.push_back({ variable, &value.second });
+		}
+	}
+
+	return true;
+}
+
+static void apply_uniform_change(addon_runtime *runtime, const uniform_change &change)
+{
+	uniform_base_type base_type = uniform_base_type::unknown;
+	uint32_t rows = 0, columns = 0, array_length = 0;
+	runtime->get_uniform_variable_type(change.variable, &base_type, &rows, &columns, &array_length);
+
+	std::vector<std::string> tokens;
+	std::stringstream ss(*change.value);
+	std::string token;
+	while (std::getline(ss, token, ','))
+		tokens.push_back(token);
+
+	size_t count = std::min<size_t>(tokens.size(), static_cast<size_t>(rows) * columns * std::max(array_length, 1u));
+	if (count == 0) return;
+
+	switch (base_type)
+	{
+	case uniform_base_type::float32:
+	{
+		std::vector<float> values(count);
+		for (size_t i = 0; i < count; ++i)
+			values[i] = strtof(tokens[i].c_str(), nullptr);
+		runtime->set_uniform_value_float(change.variable, values.data(), count);
+		break;
+	}
+	case uniform_base_type::int32:
+	{
+		std::vector<int32_t> values(count);
+		for (size_t i = 0; i < count; ++i)
+			values[i] = static_cast<int32_t>(strtol(tokens[i].c_str(), nullptr, 10));
+		runtime->set_uniform_value_int(change.variable, values.data(), count);
+		break;
+	}
+	case uniform_base_type::uint32:
+	{
+		std::vector<uint32_t> values(count);
+		for (size_t i = 0; i < count; ++i)
+			values[i] = static_cast<uint32_t>(strtoul(tokens[i].c_str(), nullptr, 10));
+		runtime->set_uniform_value_uint(change.variable, values.data(), count);
+		break;
+	}
+	default:
+	{
+		std::unique_ptr<bool[]> values(new bool[count]);
+		for (size_t i = 0; i < count; ++i)
+			values[i] = strtol(tokens[i].c_str(), nullptr, 10) != 0;
+		runtime->set_uniform_value_bool(change.variable, values.get(), count);
+		break;
+	}
+	}
+}
+
+// Values applied by an earlier diff are only trusted while ReShade still
+// reports the same preset, otherwise the live state is that preset
+static const std::filesystem::path &live_preset_for(const preset_switch_state &state, const std::filesystem::path &reshade_preset)
+{
+	if (!state.applied_preset.empty() && state.applied_reshade_preset == reshade_preset)
+		return state.applied_preset;
+	return reshade_preset;
+}
+
+static bool try_switch_by_uniform_diff(addon_runtime *runtime, const preset_switch_state &state, const std::filesystem::path &preset, const std::filesystem::path &reshade_preset)
+{
+	const std::filesystem::path &live_preset = live_preset_for(state, reshade_preset);
+	if (live_preset == preset) return true;
+
+	std::shared_ptr<preset_file> from = get_preset(live_preset);
+	std::shared_ptr<preset_file> to = get_preset(preset);
+	if (from == nullptr || to == nullptr || !has_same_effect_setup(*from, *to)) return false;
+
+	std::vector<uniform_change> changes;
+	if (!collect_uniform_changes(runtime, *from, *to, changes)) return false;
+
+	for (auto& change : changes)
+		apply_uniform_change(runtime, change);
+	return true;
+}
+
+bool switch_preset(addon_runtime *runtime, preset_switch_state &state, const std::filesystem::path &preset, const std::string &preset_utf8, bool allow_uniform_diff)
+{
+	std::filesystem::path reshade_preset = runtime->get_current_preset_path();
+
+	if (allow_uniform_diff && try_switch_by_uniform_diff(runtime, state, preset, reshade_preset))
+	{
+		state.applied_preset = preset;
+		state.applied_reshade_preset = reshade_preset;
+		return true;
+	}
+
+	runtime->set_current_preset_path(preset_utf8.c_str());
+	state.applied_preset = preset;
+	state.applied_reshade_preset = preset;
+	return false;
+}
+
+std::filesystem::path get_live_preset(addon_runtime *runtime, const preset_switch_state &state)
+{
+	return live_preset_for(state, runtime->get_current_preset_path());
+}
+
+void prefetch_presets(const std::vector<std::filesystem::path> &presets)
+{
+	for (auto& preset : presets)
+		get_preset(preset);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "addon_runtime.hpp"
+
+#include <filesystem>
+#include <vector>
+#include <string>
+
+// Uniform values a runtime has live, each runtime switches presets on its own
+struct preset_switch_state {
+	// Preset whose values are live, and the path ReShade reported when they were applied
+	std::filesystem::path applied_preset;
+	std::filesystem::path applied_reshade_preset;
+};
+
+// Switches to a preset. With allow_uniform_diff set and the live preset using
+// the same techniques and preprocessor definitions, only the uniforms that
+// differ are written, which takes effect on the next frame instead of
+// triggering a full reload. Otherwise falls back to set_current_preset_path.
+// Returns true when the switch was applied as a uniform diff.
+// ReShade is not told about a diff switch, so it keeps reporting the previous
+// preset, shows that one in its UI and saves edits made there into its file.
+bool switch_preset(addon_runtime *runtime, preset_switch_state &state, const std::filesystem::path &preset, const std::string &preset_utf8, bool allow_uniform_diff);
+// Preset whose values are live. That is the preset of the last diff switch
+// while ReShade still reports the path it reported then, otherwise the preset
+// ReShade reports.
+std::filesystem::path get_live_preset(addon_runtime *runtime, const preset_switch_state &state);
+// Parses presets ahead of time so the first switch to them does not touch the
+// disk. The parsed presets are shared by every runtime.
+void prefetch_presets(const std::vector<std::filesystem::path> &presets);
@@ -0,0 +1,197 @@
+#include "profiler.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+#define PROFILER_RING_SIZE 4096
+#define PROFILER_HISTORY_SIZE 16384
+
+struct profile_event {
+	const char *name;
+	uint64_t start;
+	uint64_t end;
+	uint32_t thread_id;
+	// Index into g_names, set by profiler_collect
+	uint32_t name_id;
+};
+
+// Durations are regrouped into the same vectors every time the stats change
+struct profile_name {
+	const char *name;
+	std::vector<uint64_t> durations;
+};
+
+// Single producer (owning thread), single consumer (profiler_collect)
+struct profile_ring {
+	profile_event events[PROFILER_RING_SIZE];
+	std::atomic<uint32_t> head = 0;
+	std::atomic<uint32_t> tail = 0;
+	uint32_t thread_id = 0;
+};
+
+std::atomic<bool> g_profiler_enabled = false;
+
+static std::mutex g_rings_mutex;
+static std::vector<std::unique_ptr<profile_ring>> g_rings;
+static std::atomic<uint64_t> g_dropped_events = 0;
+static std::vector<profile_event> g_history;
+static size_t g_history_next;
+static std::vector<profile_name> g_names;
+static std::unordered_map<const char *, uint32_t> g_name_ids;
+// Stats of the current history, rebuilt only after profiler_collect moved events
+static std::vector<profile_stats> g_stats;
+static bool g_stats_stale = false;
+static const auto g_epoch = std::chrono::steady_clock::now();
+
+static profile_ring *get_thread_ring()
+{
+	// Rings outlive their threads, they are only created once per thread
+	thread_local profile_ring *ring = nullptr;
+	if (ring == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(g_rings_mutex);
+		g_rings.push_back(std::make_unique<profile_ring>());
+		ring = g_rings.back().get();
+		ring->thread_id = static_cast<uint32_t>(g_rings.size());
+	}
+	return ring;
+}
+
+uint64_t profiler_now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+void profiler_record(const char *name, uint64_t start, uint64_t end)
+{
+	profile_ring *ring = get_thread_ring();
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= PROFILER_RING_SIZE)
+	{
+		g_dropped_events.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	ring->events[head % PROFILER_RING_SIZE] = { name, start, end, ring->thread_id, 0 };
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+// Names are string literals, but the same literal may have several addresses.
+// Each address is matched by its text once.
+static uint32_t intern_name(const char *name)
+{
+	auto it = g_name_ids.find(name);
+	if (it != g_name_ids.end()) return it->second;
+
+	uint32_t id = 0;
+	while (id < g_names.size() && strcmp(g_names[id].name, name) != 0)
+		++id;
+	if (id == g_names.size())
+		g_names.push_back({ name, {} });
+	g_name_ids.emplace(name, id);
+	return id;
+}
+
+void profiler_collect()
+{
+	std::vector<profile_ring *> rings;
+	{
+		std::lock_guard<std::mutex> lock(g_rings_mutex);
+		for (auto& ring : g_rings)
+			rings.push_back(ring.get());
+	}
+
+	for (profile_ring *ring : rings)
+	{
+		uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+		uint32_t head = ring->head.load(std::memory_order_acquire);
+		for (; tail != head; ++tail)
+		{
+			profile_event event = ring->events[tail % PROFILER_RING_SIZE];
+			event.name_id = intern_name(event.name);
+			g_stats_stale = true;
+			if (g_history.size() < PROFILER_HISTORY_SIZE)
+			{
+				g_history.push_back(event);
+			} else {
+				g_history[g_history_next] = event;
+				g_history_next = (g_history_next + 1) % PROFILER_HISTORY_SIZE;
+			}
+		}
+		ring->tail.store(tail, std::memory_order_release);
+	}
+}
+
+void profiler_get_stats(std::vector<profile_stats> &out)
+{
+	if (g_stats_stale)
+	{
+		g_stats_stale = false;
+		for (auto& name : g_names)
+			name.durations.clear();
+		for (auto& event : g_history)
+			g_names[event.name_id].durations.push_back(event.end - event.start);
+
+		g_stats.clear();
+		for (auto& name : g_names)
+		{
+			std::vector<uint64_t> &values = name.durations;
+			if (values.empty()) continue;
+			// Partial sorts around the two percentiles, the maximum lies above p95
+			size_t p95 = std::min(values.size() - 1, static_cast<size_t>(0.95 * values.size()));
+			size_t p50 = std::min(values.size() - 1, static_cast<size_t>(0.5 * values.size()));
+			std::nth_element(values.begin(), values.begin() + p95, values.end());
+			std::nth_element(values.begin(), values.begin() + p50, values.begin() + p95);
+			uint64_t max = *std::max_element(values.begin() + p95, values.end());
+			g_stats.push_back({ name.name, static_cast<uint32_t>(values.size()), values[p50] / 1e6, values[p95] / 1e6, max / 1e6 });
+		}
+		std::sort(g_stats.begin(), g_stats.end(),
+			[](const profile_stats &a, const profile_stats &b) { return strcmp(a.name, b.name) < 0; });
+	}
+	out = g_stats;
+}
+
+uint64_t profiler_dropped_events()
+{
+	return g_dropped_events.load(std::memory_order_relaxed);
+}
+
+static std::vector<profile_event> sorted_history()
+{
+	std::vector<profile_event> events = g_history;
+	std::sort(events.begin(), events.end(),
+		[](const profile_event &a, const profile_event &b) { return a.start < b.start; });
+	return events;
+}
+
+bool profiler_write_csv(const std::filesystem::path &path)
+{
+	std::ofstream file(path, std::ios::trunc);
+	file << "name,thread,start_us,duration_us\n";
+	for (auto& event : sorted_history())
+		file << event.name << ',' << event.thread_id << ',' << event.start / 1000.0 << ',' << (event.end - event.start) / 1000.0 << '\n';
+	file.close();
+	return file.good();
+}
+
+bool profiler_write_chrome_trace(const std::filesystem::path &path)
+{
+	std::ofstream file(path, std::ios::trunc);
+	file << "{\"traceEvents\":[";
+	bool first = true;
+	for (auto& event : sorted_history())
+	{
+		file << (first ? "\n" : ",\n");
+		file << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread_id
+			<< ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+		first = false;
+	}
+	file << "\n]}\n";
+	file.close();
+	return file.good();
+}
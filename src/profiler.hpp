@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <vector>
+#include <cstdint>
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// Times the enclosing scope. name must be a string literal.
+#define PROFILE_SCOPE(name) profile_scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+extern std::atomic<bool> g_profiler_enabled;
+
+uint64_t profiler_now();
+// Lock-free, appends to the calling thread's ring and drops the event when it is full
+void profiler_record(const char *name, uint64_t start, uint64_t end);
+
+struct profile_scope {
+	const char *name;
+	uint64_t start;
+
+	// Costs one relaxed load when profiling is disabled
+	profile_scope(const char *name) :
+		name(g_profiler_enabled.load(std::memory_order_relaxed) ? name : nullptr),
+		start(this->name != nullptr ? profiler_now() : 0) {};
+	~profile_scope()
+	{
+		if (name != nullptr)
+			profiler_record(name, start, profiler_now());
+	}
+};
+
+struct profile_stats {
+	const char *name;
+	uint32_t count;
+	double p50_ms;
+	double p95_ms;
+	double max_ms;
+};
+
+// Moves events out of all thread rings into the recent history. Call from one thread only.
+void profiler_collect();
+// Per-scope timings of the recent history sorted by name, only recomputed after
+// profiler_collect brought new events. Call from the profiler_collect thread.
+void profiler_get_stats(std::vector<profile_stats> &out);
+uint64_t profiler_dropped_events();
+bool profiler_write_csv(const std::filesystem::path &path);
+bool profiler_write_chrome_trace(const std::filesystem::path &path);
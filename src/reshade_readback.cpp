@@ -0,0 +1,215 @@
+#include "reshade_readback.hpp"
+#include "addon_log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// D3D12 copies rows at 256 byte pitch, the other APIs accept it as well
+#define READBACK_ROW_ALIGNMENT 64
+// Each copied signature row starts a new copy, which D3D12 places at 512 bytes
+#define READBACK_ROW_PLACEMENT_ALIGNMENT 128
+
+using namespace reshade::api;
+
+static bool is_supported_format(format texture_format)
+{
+	switch (texture_format)
+	{
+	case format::r8g8b8a8_unorm:
+	case format::r8g8b8a8_unorm_srgb:
+	case format::r8g8b8x8_unorm:
+	case format::r8g8b8x8_unorm_srgb:
+	case format::b8g8r8a8_unorm:
+	case format::b8g8r8a8_unorm_srgb:
+	case format::b8g8r8x8_unorm:
+	case format::b8g8r8x8_unorm_srgb:
+	case format::r10g10b10a2_unorm:
+	case format::b10g10r10a2_unorm:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Converts one row of the back buffer format to RGBA8, like capture_screenshot does
+static void convert_row(format texture_format, const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	switch (texture_format)
+	{
+	case format::b8g8r8a8_unorm:
+	case format::b8g8r8a8_unorm_srgb:
+	case format::b8g8r8x8_unorm:
+	case format::b8g8r8x8_unorm_srgb:
+		for (uint32_t x = 0; x < width; ++x, src += 4, dst += 4)
+		{
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+			dst[3] = src[3];
+		}
+		break;
+	case format::r10g10b10a2_unorm:
+	case format::b10g10r10a2_unorm:
+		for (uint32_t x = 0; x < width; ++x, src += 4, dst += 4)
+		{
+			uint32_t value;
+			memcpy(&value, src, 4);
+			uint8_t r = static_cast<uint8_t>(((value >> 0) & 0x3FF) >> 2);
+			uint8_t b = static_cast<uint8_t>(((value >> 20) & 0x3FF) >> 2);
+			dst[0] = texture_format == format::r10g10b10a2_unorm ? r : b;
+			dst[1] = static_cast<uint8_t>(((value >> 10) & 0x3FF) >> 2);
+			dst[2] = texture_format == format::r10g10b10a2_unorm ? b : r;
+			dst[3] = static_cast<uint8_t>(((value >> 30) & 0x3) * 85);
+		}
+		break;
+	default:
+		memcpy(dst, src, static_cast<size_t>(width) * 4);
+		break;
+	}
+}
+
+bool reshade_readback_device::init(effect_runtime *runtime)
+{
+	this->runtime = runtime;
+	if (!runtime->get_device()->create_fence(0, fence_flags::none, &fence))
+	{
+		fence = { 0 };
+		addon_log(addon_log_level::info, "Device has no fences, screenshots are read back synchronously");
+		return false;
+	}
+	return true;
+}
+
+void reshade_readback_device::shutdown()
+{
+	device *device = runtime->get_device();
+	for (auto& entry : buffers)
+		device->destroy_resource(entry.second.buffer);
+	buffers.clear();
+	if (fence.handle != 0)
+		device->destroy_fence(fence);
+	fence = { 0 };
+}
+
+bool reshade_readback_device::matches_back_buffer(const staging_buffer &staging, bool rows_only)
+{
+	resource_desc desc = runtime->get_device()->get_resource_desc(runtime->get_current_back_buffer());
+	return desc.texture.samples <= 1 && desc.texture.width == staging.width && (rows_only || desc.texture.height == staging.height) &&
+		format_to_default_typed(desc.texture.format) == staging.format;
+}
+
+bool reshade_readback_device::create_buffer(staging_buffer &staging)
+{
+	uint64_t size = static_cast<uint64_t>(staging.row_length) * staging.height * 4;
+	if (!runtime->get_device()->create_resource(resource_desc(size, memory_heap::gpu_to_cpu, resource_usage::copy_dest), nullptr, resource_usage::copy_dest, &staging.buffer))
+	{
+		addon_log(addon_log_level::warning, "Failed to create a readback buffer, falling back to synchronous screenshots");
+		return false;
+	}
+	buffers[staging.buffer.handle] = staging;
+	return true;
+}
+
+uint64_t reshade_readback_device::create_staging(uint32_t width, uint32_t height)
+{
+	resource_desc back_buffer_desc = runtime->get_device()->get_resource_desc(runtime->get_current_back_buffer());
+	staging_buffer staging = {};
+	staging.format = format_to_default_typed(back_buffer_desc.texture.format);
+	staging.width = width;
+	staging.height = height;
+	staging.row_length = (width + READBACK_ROW_ALIGNMENT - 1) / READBACK_ROW_ALIGNMENT * READBACK_ROW_ALIGNMENT;
+	if (!is_supported_format(staging.format) || !matches_back_buffer(staging, false) || !create_buffer(staging))
+		return 0;
+	return staging.buffer.handle;
+}
+
+uint64_t reshade_readback_device::create_row_staging(uint32_t width, uint32_t row_count)
+{
+	resource_desc back_buffer_desc = runtime->get_device()->get_resource_desc(runtime->get_current_back_buffer());
+	staging_buffer staging = {};
+	staging.format = format_to_default_typed(back_buffer_desc.texture.format);
+	staging.width = width;
+	staging.height = row_count;
+	staging.row_length = (width + READBACK_ROW_PLACEMENT_ALIGNMENT - 1) / READBACK_ROW_PLACEMENT_ALIGNMENT * READBACK_ROW_PLACEMENT_ALIGNMENT;
+	if (!is_supported_format(staging.format) || !matches_back_buffer(staging, true) || !create_buffer(staging))
+		return 0;
+	return staging.buffer.handle;
+}
+
+void reshade_readback_device::destroy_staging(uint64_t staging)
+{
+	auto it = buffers.find(staging);
+	if (it == buffers.end()) return;
+	runtime->get_device()->destroy_resource(it->second.buffer);
+	buffers.erase(it);
+}
+
+uint64_t reshade_readback_device::copy_back_buffer(uint64_t staging)
+{
+	const staging_buffer &target = buffers.at(staging);
+	// The swapchain may have been resized or changed format since the buffer was made
+	if (!matches_back_buffer(target, false))
+		return 0;
+
+	resource back_buffer = runtime->get_current_back_buffer();
+	command_queue *queue = runtime->get_command_queue();
+	command_list *cmd_list = queue->get_immediate_command_list();
+	cmd_list->barrier(back_buffer, resource_usage::present, resource_usage::copy_source);
+	cmd_list->copy_texture_to_buffer(back_buffer, 0, nullptr, target.buffer, 0, target.row_length, target.height);
+	cmd_list->barrier(back_buffer, resource_usage::copy_source, resource_usage::present);
+	queue->flush_immediate_command_list();
+
+	if (!queue->signal(fence, fence_value + 1))
+		return 0;
+	return ++fence_value;
+}
+
+uint64_t reshade_readback_device::copy_back_buffer_rows(uint64_t staging, const uint32_t *rows, uint32_t row_count)
+{
+	const staging_buffer &target = buffers.at(staging);
+	if (row_count > target.height || !matches_back_buffer(target, true))
+		return 0;
+
+	resource back_buffer = runtime->get_current_back_buffer();
+	uint32_t back_buffer_height = runtime->get_device()->get_resource_desc(back_buffer).texture.height;
+	command_queue *queue = runtime->get_command_queue();
+	command_list *cmd_list = queue->get_immediate_command_list();
+	cmd_list->barrier(back_buffer, resource_usage::present, resource_usage::copy_source);
+	for (uint32_t i = 0; i < row_count; ++i)
+	{
+		subresource_box box = {};
+		box.left = 0;
+		box.top = std::min(rows[i], back_buffer_height - 1);
+		box.front = 0;
+		box.right = target.width;
+		box.bottom = box.top + 1;
+		box.back = 1;
+		cmd_list->copy_texture_to_buffer(back_buffer, 0, &box, target.buffer, static_cast<uint64_t>(i) * target.row_length * 4, target.row_length, 1);
+	}
+	cmd_list->barrier(back_buffer, resource_usage::copy_source, resource_usage::present);
+	queue->flush_immediate_command_list();
+
+	if (!queue->signal(fence, fence_value + 1))
+		return 0;
+	return ++fence_value;
+}
+
+uint64_t reshade_readback_device::get_completed_fence_value()
+{
+	return runtime->get_device()->get_completed_fence_value(fence);
+}
+
+bool reshade_readback_device::read_staging(uint64_t staging, uint8_t *pixels)
+{
+	const staging_buffer &source = buffers.at(staging);
+	device *device = runtime->get_device();
+	void *data = nullptr;
+	if (!device->map_buffer_region(source.buffer, 0, UINT64_MAX, map_access::read_only, &data))
+		return false;
+
+	const uint8_t *src = static_cast<const uint8_t *>(data);
+	for (uint32_t y = 0; y < source.height; ++y)
+		convert_row(source.format, src + static_cast<size_t>(y) * source.row_length * 4, pixels + static_cast<size_t>(y) * source.width * 4, source.width);
+	device->unmap_buffer_region(source.buffer);
+	return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "frame_readback.hpp"
+
+#include <reshade.hpp>
+#include <unordered_map>
+
+// Copies the back buffer of an effect runtime into host-visible buffers and
+// tracks the copies with a fence. Keeps the fence and the buffers, so there is
+// one per runtime and shutdown has to be called before the runtime goes away.
+struct reshade_readback_device : readback_device {
+	// Returns false when the device has no fences (e.g. D3D9, OpenGL), captures
+	// then stay synchronous
+	bool init(reshade::api::effect_runtime *runtime);
+	void shutdown();
+
+	uint64_t create_staging(uint32_t width, uint32_t height);
+	void destroy_staging(uint64_t staging);
+	uint64_t copy_back_buffer(uint64_t staging);
+	uint64_t get_completed_fence_value();
+	bool read_staging(uint64_t staging, uint8_t *pixels);
+	uint64_t create_row_staging(uint32_t width, uint32_t row_count);
+	uint64_t copy_back_buffer_rows(uint64_t staging, const uint32_t *rows, uint32_t row_count);
+
+private:
+	struct staging_buffer {
+		reshade::api::resource buffer;
+		reshade::api::format format;
+		uint32_t width;
+		uint32_t height;
+		// In pixels, rows are padded for D3D12
+		uint32_t row_length;
+	};
+
+	// Checks the back buffer still has the size and format staging was made for
+	bool matches_back_buffer(const staging_buffer &staging, bool rows_only);
+	bool create_buffer(staging_buffer &staging);
+
+	reshade::api::effect_runtime *runtime = nullptr;
+	reshade::api::fence fence = { 0 };
+	uint64_t fence_value = 0;
+	std::unordered_map<uint64_t, staging_buffer> buffers;
+};
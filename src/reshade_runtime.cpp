@@ -0,0 +1,115 @@
+#include "reshade_runtime.hpp"
+
+#include <string>
+#include <cstring>
+
+static std::string trim_to_terminator(std::string str)
+{
+	str.resize(strlen(str.c_str()));
+	return str;
+}
+
+void reshade_runtime::get_screenshot_width_and_height(uint32_t *width, uint32_t *height)
+{
+	runtime->get_screenshot_width_and_height(width, height);
+}
+
+bool reshade_runtime::capture_screenshot(uint8_t *pixels)
+{
+	return runtime->capture_screenshot(pixels);
+}
+
+std::filesystem::path reshade_runtime::get_screenshot_directory()
+{
+	size_t size = 0;
+	reshade::get_reshade_base_path(nullptr, &size);
+	std::string reshade_path(size, '\0');
+	reshade::get_reshade_base_path(reshade_path.data(), &size);
+
+	size = 0;
+	reshade::get_config_value(runtime, "SCREENSHOT", "SavePath", nullptr, &size);
+	std::string screenshot_path(size, '\0');
+	reshade::get_config_value(runtime, "SCREENSHOT", "SavePath", screenshot_path.data(), &size);
+
+	std::filesystem::path directory = std::filesystem::u8path(trim_to_terminator(std::move(reshade_path)));
+	directory /= std::filesystem::u8path(trim_to_terminator(std::move(screenshot_path)));
+	return directory.lexically_normal();
+}
+
+std::filesystem::path reshade_runtime::get_current_preset_path()
+{
+	size_t path_size = 0;
+	runtime->get_current_preset_path(nullptr, &path_size);
+	std::string current_preset(path_size, '\0');
+	runtime->get_current_preset_path(current_preset.data(), &path_size);
+	return std::filesystem::u8path(trim_to_terminator(std::move(current_preset)));
+}
+
+void reshade_runtime::set_current_preset_path(const char *path_utf8)
+{
+	runtime->set_current_preset_path(path_utf8);
+}
+
+bool reshade_runtime::is_key_down(unsigned int keycode)
+{
+	return runtime->is_key_down(keycode);
+}
+
+bool reshade_runtime::is_key_pressed(unsigned int keycode)
+{
+	return runtime->is_key_pressed(keycode);
+}
+
+uint64_t reshade_runtime::find_uniform_variable(const char *effect_name, const char *variable_name)
+{
+	return runtime->find_uniform_variable(effect_name, variable_name).handle;
+}
+
+void reshade_runtime::get_uniform_variable_type(uint64_t variable, uniform_base_type *base_type, uint32_t *rows, uint32_t *columns, uint32_t *array_length)
+{
+	reshade::api::format format = reshade::api::format::unknown;
+	runtime->get_uniform_variable_type({ variable }, &format, rows, columns, array_length);
+	switch (format)
+	{
+	case reshade::api::format::r32_float:
+		*base_type = uniform_base_type::float32;
+		break;
+	case reshade::api::format::r32_sint:
+		*base_type = uniform_base_type::int32;
+		break;
+	case reshade::api::format::r32_uint:
+		*base_type = uniform_base_type::uint32;
+		break;
+	case reshade::api::format::r32_typeless:
+		*base_type = uniform_base_type::boolean;
+		break;
+	default:
+		*base_type = uniform_base_type::unknown;
+		break;
+	}
+}
+
+void reshade_runtime::set_uniform_value_float(uint64_t variable, const float *values, size_t count)
+{
+	runtime->set_uniform_value_float({ variable }, values, count);
+}
+
+void reshade_runtime::set_uniform_value_int(uint64_t variable, const int32_t *values, size_t count)
+{
+	runtime->set_uniform_value_int({ variable }, values, count);
+}
+
+void reshade_runtime::set_uniform_value_uint(uint64_t variable, const uint32_t *values, size_t count)
+{
+	runtime->set_uniform_value_uint({ variable }, values, count);
+}
+
+void reshade_runtime::set_uniform_value_bool(uint64_t variable, const bool *values, size_t count)
+{
+	runtime->set_uniform_value_bool({ variable }, values, count);
+}
+
+void reshade_log_sink(addon_log_level level, const char *message)
+{
+	reshade::log_message(static_cast<reshade::log_level>(level), message);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "addon_runtime.hpp"
+#include "addon_log.hpp"
+
+#include <reshade.hpp>
+
+// Forwards to the ReShade effect runtime. Holds no state, so it is cheap to
+// construct around the runtime passed to each event.
+struct reshade_runtime : addon_runtime {
+	reshade::api::effect_runtime *runtime;
+
+	reshade_runtime(reshade::api::effect_runtime *runtime) : runtime(runtime) {};
+
+	void get_screenshot_width_and_height(uint32_t *width, uint32_t *height);
+	bool capture_screenshot(uint8_t *pixels);
+	std::filesystem::path get_screenshot_directory();
+	std::filesystem::path get_current_preset_path();
+	void set_current_preset_path(const char *path_utf8);
+	bool is_key_down(unsigned int keycode);
+	bool is_key_pressed(unsigned int keycode);
+	uint64_t find_uniform_variable(const char *effect_name, const char *variable_name);
+	void get_uniform_variable_type(uint64_t variable, uniform_base_type *base_type, uint32_t *rows, uint32_t *columns, uint32_t *array_length);
+	void set_uniform_value_float(uint64_t variable, const float *values, size_t count);
+	void set_uniform_value_int(uint64_t variable, const int32_t *values, size_t count);
+	void set_uniform_value_uint(uint64_t variable, const uint32_t *values, size_t count);
+	void set_uniform_value_bool(uint64_t variable, const bool *values, size_t count);
+};
+
+// Forwards core log messages to the ReShade log
+void reshade_log_sink(addon_log_level level, const char *message);
@@ -1,160 +1,967 @@
 #include "screenshot.hpp"
+#include "worker_pool.hpp"
+#include "pixel_pack.hpp"
+#include "buffer_pool.hpp"
+#include "frame_signature.hpp"
+#include "preset_switch.hpp"
+#include "profiler.hpp"
+#include "png_encode.hpp"
+#include "image_encode.hpp"
+#include "content_hash.hpp"
+#include "frame_dedup.hpp"
+#include "contact_sheet.hpp"
+#include "thumbnail_atlas.hpp"
+#include "comparison_archive.hpp"
+#include "screenshot_writer.hpp"
+#include "addon_log.hpp"
 
-#include <reshade.hpp>
-#include <fpng.h>
 #include <string>
-#include <queue>
+#include <map>
+#include <unordered_map>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
 #include <chrono>
 #include <time.h>
 
-static std::queue<std::unique_ptr<screenshot_stage>> g_screenshot_workloads;
-static uint32_t g_last_frame;
-static uint32_t g_last_effects_render_frame;
+#define SCREENSHOT_WORKER_COUNT 2
+#define SCREENSHOT_QUEUE_CAPACITY 4
+#define SCREENSHOT_POOLED_BUFFERS 2
+#define SCREENSHOT_CONVERSION_QUEUE_CAPACITY 256
+// Also the burst worker queue size, so queueing a frame never blocks
+#define BURST_MAX_SLOTS 256
 
-void screenshot_stage::initialize(reshade::api::effect_runtime *runtime) {
+struct contact_sheet_job {
+	contact_sheet sheet;
+	// Set by the first capture, which knows the screenshot directory
+	std::filesystem::path path;
+	screenshot_format format;
+	bool convert_to_png;
+	bool keep_frames;
+	screenshot_write_mode write_mode;
+
+	contact_sheet_job(std::vector<std::string> labels, const addon_settings &settings) :
+		sheet(std::move(labels), settings.contact_sheet_cell_width),
+		format(settings.capture_format),
+		convert_to_png(settings.convert_bmp_to_png),
+		keep_frames(settings.contact_sheet != contact_sheet_only),
+		write_mode(settings.write_mode) {};
+};
+
+struct comparison_archive_job {
+	comparison_archive archive;
+	// Set by the first capture, like the contact sheet path
+	std::filesystem::path path;
+	screenshot_write_mode write_mode;
+
+	comparison_archive_job(std::vector<std::string> labels, const addon_settings &settings) :
+		archive(std::move(labels)),
+		write_mode(settings.write_mode) {};
+};
+
+struct screenshot_output {
+	uint32_t width;
+	uint32_t height;
+	std::filesystem::path path;
+	screenshot_format format;
+	bool convert_to_png;
+	duplicate_frame_policy duplicates;
+	screenshot_write_mode write_mode;
+	std::shared_ptr<contact_sheet_job> sheet;
+	uint32_t batch_index;
+	// Preset active during the capture, its thumbnail is refreshed from the frame
+	std::filesystem::path preset;
+	std::shared_ptr<comparison_archive_job> archive;
+};
+
+struct screenshot_job {
+	std::vector<uint8_t> pixels;
+	screenshot_output output;
+};
+
+// Unique across runtimes so an id never names another runtime's workload
+static std::atomic<screenshot_workload_id> g_next_workload_id = 1;
+static worker_pool g_screenshot_workers(SCREENSHOT_WORKER_COUNT, SCREENSHOT_QUEUE_CAPACITY);
+static buffer_pool g_capture_buffers(SCREENSHOT_POOLED_BUFFERS);
+static buffer_pool g_encode_buffers(SCREENSHOT_POOLED_BUFFERS);
+// One thread, so converting BMP bursts to PNG never competes with the capture
+// encoders for more than a core
+static worker_pool g_conversion_worker(1, SCREENSHOT_CONVERSION_QUEUE_CAPACITY);
+// Every in-flight burst frame holds a ring slot, so the queue never fills
+static worker_pool g_burst_workers(SCREENSHOT_WORKER_COUNT, BURST_MAX_SLOTS);
+static frame_dedup g_written_frames;
+static screenshot_writer g_screenshot_writer;
+static std::mutex g_filename_mutex;
+
+void screenshot_stage::initialize(screenshot_queue &queue, addon_runtime *runtime) {
 	if (!this->started)
 	{
+		this->queue = &queue;
+		if (g_profiler_enabled.load(std::memory_order_relaxed))
+			this->profile_start = profiler_now();
 		this->start_work(runtime);
 		started = true;
 	}
 }
 
-void screenshot_change_preset_stage::start_work(reshade::api::effect_runtime *runtime)
+void screenshot_stage::finish()
+{
+	// Stages span several frames, so they are timed from start to completion
+	if (this->profile_start != 0)
+		profiler_record(this->profile_name(), this->profile_start, profiler_now());
+}
+
+void screenshot_change_preset_stage::start_work(addon_runtime *runtime)
+{
+	switch_preset(runtime, this->queue->preset_switch, preset, preset_utf8, allow_uniform_diff);
+	this->prev_effects_render_frame = this->queue->last_effects_render_frame;
+}
+
+void screenshot_restore_preset_stage::start_work(addon_runtime *runtime)
 {
-	runtime->set_current_preset_path(preset.string().c_str());
-	this->prev_effects_render_frame = g_last_effects_render_frame;
+	this->preset = this->original_preset;
+	this->preset_utf8 = this->preset.u8string();
+	screenshot_change_preset_stage::start_work(runtime);
 }
 
 bool screenshot_change_preset_stage::is_completed()
 {
-	return g_last_effects_render_frame > this->prev_effects_render_frame;
+	return this->queue->last_effects_render_frame > this->prev_effects_render_frame;
+}
+
+void screenshot_warm_up_stage::start_work(addon_runtime *runtime)
+{
+	// The report of a warm-up becomes visible once it actually runs
+	this->queue->warm_up_report = this->report;
+	this->start_frame = this->queue->last_frame;
+	screenshot_change_preset_stage::start_work(runtime);
 }
 
-void screenshot_wait_stage::start_work(reshade::api::effect_runtime *runtime)
+bool screenshot_warm_up_stage::is_completed()
 {
-	this->start_frame = g_last_frame;
+	return screenshot_change_preset_stage::is_completed() || this->queue->last_frame - this->start_frame >= PRESET_WARM_UP_MAX_FRAMES;
+}
+
+void screenshot_warm_up_stage::finish()
+{
+	screenshot_stage::finish();
+	bool timed_out = !screenshot_change_preset_stage::is_completed();
+	this->report->entries.push_back({ this->preset, this->queue->last_frame - this->start_frame, timed_out });
+	if (timed_out)
+		addon_log(addon_log_level::warning, ("Preset did not render while warming up: " + this->preset_utf8).c_str());
+}
+
+void screenshot_wait_stage::start_work(addon_runtime *runtime)
+{
+	this->start_frame = this->queue->last_frame;
 }
 
 bool screenshot_wait_stage::is_completed()
 {
-	return g_last_frame - this->start_frame >= this->frames_count;
+	return this->queue->last_frame - this->start_frame >= this->frames_count;
+}
+
+struct settle_signature {
+	uint32_t width;
+	std::vector<uint32_t> values;
+};
+
+struct settle_samples {
+	uint32_t min_frames;
+	float threshold;
+	bool settled = false;
+	// Set once the stage is done, later read backs are dropped
+	bool finished = false;
+	// Keyed by frames since the stage started. Read backs can complete out of
+	// order, so each sample is compared with whichever neighbor arrived.
+	std::map<uint32_t, settle_signature> signatures;
+};
+
+// Compares the sample of frame with the one of the frame before it
+static bool is_settled_at(const settle_samples &samples, uint32_t frame)
+{
+	if (frame < samples.min_frames || frame == 0) return false;
+	auto current = samples.signatures.find(frame);
+	auto previous = samples.signatures.find(frame - 1);
+	if (current == samples.signatures.end() || previous == samples.signatures.end() || current->second.width != previous->second.width)
+		return false;
+	return compare_frame_signatures(previous->second.values, current->second.values, current->second.width) < samples.threshold;
 }
 
-void screenshot_capture_stage::start_work(reshade::api::effect_runtime *runtime)
+static void add_settle_sample(settle_samples &samples, uint32_t frame, const uint8_t *rows, uint32_t width)
 {
-	save_screenshot(runtime);
+	if (samples.settled || samples.finished) return;
+	settle_signature &sample = samples.signatures[frame];
+	sample.width = width;
+	compute_frame_signature_from_rows(rows, width, sample.values);
+	samples.settled = is_settled_at(samples, frame) || is_settled_at(samples, frame + 1);
+	// At most one sample per readback slot is still waiting for its neighbor
+	while (samples.signatures.size() > SIGNATURE_READBACK_SLOTS + 1)
+		samples.signatures.erase(samples.signatures.begin());
 }
 
-void queue_screenshot_workload(std::filesystem::path &preset, std::filesystem::path &original_preset)
+void screenshot_settle_stage::start_work(addon_runtime *runtime)
 {
-	g_screenshot_workloads.push(std::make_unique<screenshot_change_preset_stage>(preset));
-	g_screenshot_workloads.push(std::make_unique<screenshot_wait_stage>(5));
-	g_screenshot_workloads.push(std::make_unique<screenshot_capture_stage>());
-	g_screenshot_workloads.push(std::make_unique<screenshot_change_preset_stage>(original_preset));
+	this->start_frame = this->queue->last_frame;
+	this->sampled_frame = this->queue->last_frame;
+	this->samples = std::make_shared<settle_samples>();
+	this->samples->min_frames = this->min_frames;
+	this->samples->threshold = this->threshold;
+	this->sampling = this->queue->device != nullptr;
 }
 
-bool process_screenshot_workload(reshade::api::effect_runtime *runtime)
+void screenshot_settle_stage::update(addon_runtime *runtime)
 {
-	if (g_screenshot_workloads.empty()) return false;
+	if (this->samples->settled || this->sampled_frame == this->queue->last_frame) return;
+	this->sampled_frame = this->queue->last_frame;
+
+	// Only the frame before the minimum is needed as a reference
+	uint32_t frames = this->queue->last_frame - this->start_frame;
+	if (frames + 1 < this->min_frames || frames >= this->max_frames) return;
+
+	if (!this->sampling) return;
+	uint32_t width, height;
+	runtime->get_screenshot_width_and_height(&width, &height);
+	bool copied = this->queue->signatures.begin(this->queue->device, this->queue->last_frame, width, height,
+		[samples = this->samples, frames, width](bool read, const uint8_t *rows) {
+			if (read)
+				add_settle_sample(*samples, frames, rows, width);
+		});
+	// Busy slots only skip a sample. A device that cannot copy rows at all
+	// would leave the stage waiting for the maximum, it waits a fixed time
+	// instead, never stalling on synchronous captures.
+	if (!copied && this->queue->signatures.pending_count() == 0)
+		this->sampling = false;
+}
 
-	do
+bool screenshot_settle_stage::is_completed()
+{
+	uint32_t frames = this->queue->last_frame - this->start_frame;
+	if (!this->sampling)
+		return frames >= std::clamp(static_cast<uint32_t>(SETTLE_FIXED_WAIT_FRAMES), this->min_frames, this->max_frames);
+	return this->samples->settled || frames >= this->max_frames;
+}
+
+void screenshot_settle_stage::finish()
+{
+	screenshot_stage::finish();
+	this->samples->finished = true;
+}
+
+static void capture_and_queue_screenshot(screenshot_queue &queue, addon_runtime *runtime, screenshot_output output);
+
+void screenshot_capture_stage::start_work(addon_runtime *runtime)
+{
+	screenshot_output output = {};
+	output.format = format;
+	output.convert_to_png = convert_to_png;
+	output.duplicates = duplicates;
+	output.write_mode = write_mode;
+	output.sheet = sheet;
+	output.archive = archive;
+	output.batch_index = batch_index;
+	capture_and_queue_screenshot(*this->queue, runtime, std::move(output));
+}
+
+static std::unique_ptr<screenshot_workload> create_workload(std::string merge_key, screenshot_workload_priority priority)
+{
+	auto workload = std::make_unique<screenshot_workload>();
+	workload->merge_key = std::move(merge_key);
+	workload->priority = priority;
+	return workload;
+}
+
+static std::string get_capture_merge_key(const char *kind, const std::filesystem::path &preset, const addon_settings &settings)
+{
+	return std::string(kind) + '|' + std::to_string(settings.capture_format) + '|' + std::to_string(settings.convert_bmp_to_png) + '|' + preset.u8string();
+}
+
+static void forget_merge_key(screenshot_queue &queue, screenshot_workload &workload)
+{
+	auto it = queue.workloads_by_key.find(workload.merge_key);
+	if (it != queue.workloads_by_key.end() && it->second == &workload)
+		queue.workloads_by_key.erase(it);
+}
+
+// Returns the id of an identical pending workload, or of the running one
+// while its captures are still ahead, raising its priority to the new
+// request's. Otherwise queues the new one.
+static screenshot_workload_id queue_workload(screenshot_queue &queue, std::unique_ptr<screenshot_workload> workload)
+{
+	auto existing = queue.workloads_by_key.find(workload->merge_key);
+	bool merge = existing != queue.workloads_by_key.end();
+	if (merge && existing->second == queue.active_workload.get())
+		merge = queue.active_workload->current_stage + 1 < queue.active_workload->stages.size();
+	if (merge)
 	{
-		g_screenshot_workloads.front()->initialize(runtime);
-		if (g_screenshot_workloads.front()->is_completed())
-			g_screenshot_workloads.pop();
-		else
-			break;
+		screenshot_workload *merged = existing->second;
+		if (merged != queue.active_workload.get() && workload->priority > merged->priority)
+		{
+			auto node = queue.pending_workloads.extract({ -merged->priority, merged->id });
+			merged->priority = workload->priority;
+			node.key() = { -merged->priority, merged->id };
+			queue.pending_workloads.insert(std::move(node));
+		}
+		return merged->id;
+	}
+
+	workload->id = g_next_workload_id.fetch_add(1, std::memory_order_relaxed);
+	screenshot_workload_id id = workload->id;
+	queue.workloads_by_key[workload->merge_key] = workload.get();
+	queue.pending_workloads[{ -workload->priority, id }] = std::move(workload);
+	return id;
+}
+
+screenshot_workload_id queue_burst_screenshot_workload(screenshot_queue &queue, const std::filesystem::path &preset, const addon_settings &settings, screenshot_workload_priority priority)
+{
+	std::string key = get_capture_merge_key("burst", preset, settings) + '|' + std::to_string(settings.burst_frame_count);
+	auto workload = create_workload(std::move(key), priority);
+	workload->stages.push_back(std::make_unique<screenshot_change_preset_stage>(preset, settings));
+	workload->stages.push_back(std::make_unique<screenshot_settle_stage>(settings));
+	workload->stages.push_back(std::make_unique<screenshot_burst_stage>(settings));
+	workload->stages.push_back(std::make_unique<screenshot_restore_preset_stage>(workload->original_preset, settings));
+	return queue_workload(queue, std::move(workload));
+}
+
+screenshot_workload_id queue_screenshot_workload(screenshot_queue &queue, const std::filesystem::path &preset, const addon_settings &settings, screenshot_workload_priority priority)
+{
+	auto workload = create_workload(get_capture_merge_key("screenshot", preset, settings), priority);
+	workload->stages.push_back(std::make_unique<screenshot_change_preset_stage>(preset, settings));
+	workload->stages.push_back(std::make_unique<screenshot_settle_stage>(settings));
+	workload->stages.push_back(std::make_unique<screenshot_capture_stage>(settings));
+	workload->stages.push_back(std::make_unique<screenshot_restore_preset_stage>(workload->original_preset, settings));
+	return queue_workload(queue, std::move(workload));
+}
+
+screenshot_workload_id queue_batch_screenshot_workload(screenshot_queue &queue, const std::vector<std::filesystem::path> &presets, const addon_settings &settings, screenshot_workload_priority priority)
+{
+	std::string key = get_capture_merge_key("batch", std::filesystem::path(), settings) + '|' +
+		std::to_string(settings.contact_sheet) + '|' + std::to_string(settings.contact_sheet_cell_width) + '|' + std::to_string(settings.comparison_archive);
+	for (auto& preset : presets)
+		key += '|' + preset.u8string();
+	auto workload = create_workload(std::move(key), priority);
+
+	std::vector<std::string> labels;
+	for (auto& preset : presets)
+		labels.push_back(preset.stem().u8string());
+	std::shared_ptr<contact_sheet_job> sheet;
+	if (settings.contact_sheet != contact_sheet_off && !presets.empty())
+		sheet = std::make_shared<contact_sheet_job>(labels, settings);
+	// A sheet only batch has no full-size captures to archive
+	std::shared_ptr<comparison_archive_job> archive;
+	if (settings.comparison_archive && settings.contact_sheet != contact_sheet_only && !presets.empty())
+		archive = std::make_shared<comparison_archive_job>(labels, settings);
+
+	// Switch straight from one preset to the next, the capture of the previous
+	// preset is encoded on the workers while the next one loads
+	for (size_t i = 0; i < presets.size(); ++i)
+	{
+		workload->stages.push_back(std::make_unique<screenshot_change_preset_stage>(presets[i], settings));
+		workload->stages.push_back(std::make_unique<screenshot_settle_stage>(settings));
+		workload->stages.push_back(std::make_unique<screenshot_capture_stage>(settings, sheet, archive, static_cast<uint32_t>(i)));
+	}
+	workload->stages.push_back(std::make_unique<screenshot_restore_preset_stage>(workload->original_preset, settings));
+	return queue_workload(queue, std::move(workload));
+}
+
+screenshot_workload_id queue_preset_warm_up_workload(screenshot_queue &queue, const std::vector<std::filesystem::path> &presets, const addon_settings &settings, screenshot_workload_priority priority)
+{
+	std::string key = "warm up";
+	for (auto& preset : presets)
+		key += '|' + preset.u8string();
+	auto workload = create_workload(std::move(key), priority);
+
+	auto report = std::make_shared<preset_warm_up_report>();
+	report->preset_count = presets.size();
+	for (auto& preset : presets)
+		workload->stages.push_back(std::make_unique<screenshot_warm_up_stage>(preset, settings, report));
+	// The warm-up reloaded ReShade's preset in full, a uniform diff back would
+	// leave ReShade on the last warmed up preset
+	auto restore = std::make_unique<screenshot_restore_preset_stage>(workload->original_preset, settings);
+	restore->allow_uniform_diff = false;
+	workload->stages.push_back(std::move(restore));
+	return queue_workload(queue, std::move(workload));
+}
+
+std::shared_ptr<const preset_warm_up_report> get_preset_warm_up_report(const screenshot_queue &queue)
+{
+	return queue.warm_up_report;
+}
+
+screenshot_workload_id queue_preset_switch_workload(screenshot_queue &queue, const std::filesystem::path &preset, const addon_settings &settings)
+{
+	auto workload = create_workload("switch|" + preset.u8string(), workload_priority_high);
+	workload->stages.push_back(std::make_unique<screenshot_change_preset_stage>(preset, settings));
+	return queue_workload(queue, std::move(workload));
+}
+
+static void skip_contact_sheet_cell(std::shared_ptr<contact_sheet_job> sheet, uint32_t index);
+static void skip_comparison_archive_image(std::shared_ptr<comparison_archive_job> archive, uint32_t index);
+
+static void cancel_workload(screenshot_queue &queue, screenshot_workload &workload)
+{
+	workload.cancelled = true;
+	// A new identical request queues a fresh workload instead of merging
+	forget_merge_key(queue, workload);
+	// Only the final restore stage still runs, and only once a stage has
+	// switched away from the original preset
+	size_t last = workload.stages.size() - 1;
+	// Batch captures that will never run leave their cells blank, so the
+	// sheet and archive are still written with the captures taken before the cancel
+	for (size_t i = workload.current_stage; i < workload.stages.size(); ++i)
+	{
+		auto capture = dynamic_cast<screenshot_capture_stage *>(workload.stages[i].get());
+		if (capture != nullptr && !capture->started)
+		{
+			skip_contact_sheet_cell(capture->sheet, capture->batch_index);
+			skip_comparison_archive_image(capture->archive, capture->batch_index);
+		}
+	}
+	if (workload.current_stage == 0 && !workload.stages[0]->started)
+		workload.current_stage = workload.stages.size();
+	else if (workload.current_stage < last && dynamic_cast<screenshot_restore_preset_stage *>(workload.stages[last].get()) != nullptr)
+		workload.current_stage = last;
+}
+
+bool cancel_screenshot_workload(screenshot_queue &queue, screenshot_workload_id id)
+{
+	if (queue.active_workload && queue.active_workload->id == id)
+	{
+		if (queue.active_workload->cancelled) return false;
+		cancel_workload(queue, *queue.active_workload);
+		return true;
+	}
+
+	// Cancelling is rare, a scan keeps the queue to a single ordered map
+	for (auto it = queue.pending_workloads.begin(); it != queue.pending_workloads.end(); ++it)
+	{
+		if (it->second->id == id)
+		{
+			forget_merge_key(queue, *it->second);
+			queue.pending_workloads.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+void cancel_all_screenshot_workloads(screenshot_queue &queue)
+{
+	queue.pending_workloads.clear();
+	queue.workloads_by_key.clear();
+	if (queue.active_workload && !queue.active_workload->cancelled)
+		cancel_workload(queue, *queue.active_workload);
+}
+
+size_t get_screenshot_workload_count(const screenshot_queue &queue)
+{
+	return queue.pending_workloads.size() + (queue.active_workload ? 1 : 0);
+}
+
+bool process_screenshot_workload(screenshot_queue &queue, addon_runtime *runtime)
+{
+	if (queue.device != nullptr)
+	{
+		queue.readback.poll(queue.device, queue.last_frame);
+		queue.signatures.poll(queue.device, queue.last_frame);
+	}
+	// The captures still in flight are part of the work
+	if (!queue.active_workload && queue.pending_workloads.empty()) return queue.readback.pending_count() > 0;
+
+	// A finished workload hands over to the next in the same frame
+	while (queue.active_workload || !queue.pending_workloads.empty())
+	{
+		if (!queue.active_workload)
+		{
+			auto next = queue.pending_workloads.begin();
+			queue.active_workload = std::move(next->second);
+			queue.pending_workloads.erase(next);
+			queue.active_workload->original_preset = get_live_preset(runtime, queue.preset_switch);
+		}
+
+		screenshot_workload &workload = *queue.active_workload;
+		while (workload.current_stage < workload.stages.size())
+		{
+			screenshot_stage &stage = *workload.stages[workload.current_stage];
+			stage.initialize(queue, runtime);
+			stage.update(runtime);
+			if (!stage.is_completed())
+				return true;
+			stage.finish();
+			++workload.current_stage;
+		}
+
+		forget_merge_key(queue, workload);
+		queue.active_workload.reset();
 	}
-	while (!g_screenshot_workloads.empty());
 
 	return true;
 }
 
-static std::string get_screenshot_filename()
+void set_screenshot_readback_device(screenshot_queue &queue, readback_device *device)
 {
+	if (queue.device != nullptr && queue.device != device)
+	{
+		queue.readback.release(queue.device);
+		queue.signatures.release(queue.device);
+	}
+	queue.device = device;
+}
+
+// Names within the same millisecond get a counter, so captures never
+// overwrite each other, also across runtimes
+static std::string get_screenshot_filename(const char *suffix)
+{
+	static long long last_ms;
+	static uint32_t repeats;
+	std::lock_guard<std::mutex> lock(g_filename_mutex);
+
 	const auto now = std::chrono::system_clock::now();
 	const auto now_seconds = std::chrono::time_point_cast<std::chrono::seconds>(now);
 	const std::time_t now_time = std::chrono::system_clock::to_time_t(now_seconds);
 	std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - now_seconds);
 
+	long long now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+	repeats = now_ms == last_ms ? repeats + 1 : 0;
+	last_ms = now_ms;
+
 	struct tm tm;
+#ifdef _WIN32
 	localtime_s(&tm, &now_time);
-	char filename[30];
-	sprintf(filename, "%.4d-%.2d-%.2d %.2d-%.2d-%.2d.%.3lld.png",
+#else
+	localtime_r(&now_time, &tm);
+#endif
+	char filename[80];
+	int length = snprintf(filename, sizeof(filename), "%.4d-%.2d-%.2d %.2d-%.2d-%.2d.%.3lld",
 		tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday,
-		tm.tm_hour, tm.tm_min, tm.tm_sec, ms.count());
+		tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<long long>(ms.count()));
+	if (repeats > 0)
+		snprintf(filename + length, sizeof(filename) - length, "_%u", repeats + 1);
 
-	return filename;
+	return filename + std::string(suffix);
 }
 
-static std::filesystem::path get_screenshot_path(reshade::api::effect_runtime *runtime)
+static const std::filesystem::path &get_screenshot_directory(screenshot_queue &queue, addon_runtime *runtime)
 {
-	size_t size;
-	reshade::get_reshade_base_path(nullptr, &size);
-	char* reshade_path_str = new char[size];
-	reshade::get_reshade_base_path(reshade_path_str, &size);
+	if (!queue.screenshot_directory_valid)
+	{
+		queue.screenshot_directory = runtime->get_screenshot_directory();
+		queue.screenshot_directory_valid = true;
+	}
+	return queue.screenshot_directory;
+}
 
-	reshade::get_config_value(runtime, "SCREENSHOT", "SavePath", nullptr, &size);
-	char* screenshot_path_str = new char[size];
-	reshade::get_config_value(runtime, "SCREENSHOT", "SavePath", screenshot_path_str, &size);
+void invalidate_screenshot_directory(screenshot_queue &queue)
+{
+	queue.screenshot_directory_valid = false;
+}
 
-	std::filesystem::path screenshot_path = std::filesystem::u8path(reshade_path_str);
-	screenshot_path /= std::filesystem::u8path(screenshot_path_str);
-	screenshot_path /= get_screenshot_filename();
+static std::filesystem::path get_screenshot_path(screenshot_queue &queue, addon_runtime *runtime, screenshot_format format)
+{
+	return get_screenshot_directory(queue, runtime) / get_screenshot_filename(screenshot_format_extension(format));
+}
 
-	return screenshot_path.lexically_normal();
+static bool write_screenshot_file(const std::filesystem::path &path, const std::vector<uint8_t> &data, screenshot_write_mode mode)
+{
+	return g_screenshot_writer.write(path, data.data(), data.size(), mode);
 }
 
-void save_screenshot(reshade::api::effect_runtime *runtime)
+// Runs on the conversion worker thread
+static void convert_screenshot_to_png(const std::filesystem::path &bmp_path, screenshot_write_mode write_mode)
 {
+	PROFILE_SCOPE("screenshot: convert to png");
+	std::ifstream file(bmp_path, std::ios::binary);
+	std::vector<uint8_t> bmp_data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	file.close();
+
+	std::vector<uint8_t> pixels;
 	uint32_t width, height;
-	runtime->get_screenshot_width_and_height(&width, &height);
-	std::vector<uint8_t> pixels(static_cast<size_t>(width) * static_cast<size_t>(height) * 4);
-	if (!runtime->capture_screenshot(pixels.data()))
+	std::vector<uint8_t> png_data;
+	if (!decode_bmp_rgb(bmp_data.data(), bmp_data.size(), pixels, width, height) ||
+		!encode_png_rgb(pixels.data(), width, height, png_data))
 	{
-		reshade::log_message(reshade::log_level::error, "Failed to capture screenshot");
+		addon_log(addon_log_level::error, "Failed to convert screenshot to png");
 		return;
 	}
 
-	for (size_t i = 0; i < static_cast<size_t>(width) * static_cast<size_t>(height); ++i)
-		*reinterpret_cast<uint32_t *>(pixels.data() + 3 * i) = *reinterpret_cast<const uint32_t *>(pixels.data() + 4 * i);
+	std::filesystem::path png_path = bmp_path;
+	png_path.replace_extension(".png");
+	if (write_screenshot_file(png_path, png_data, write_mode))
+	{
+		std::error_code ec;
+		std::filesystem::remove(bmp_path, ec);
+	}
+}
+
+static void queue_png_conversion(screenshot_output &output)
+{
+	if (output.format == format_bmp && output.convert_to_png)
+	{
+		g_conversion_worker.submit([path = std::move(output.path), write_mode = output.write_mode]() {
+			convert_screenshot_to_png(path, write_mode);
+		});
+	}
+}
+
+// Runs on the worker that resolved the last cell
+static void write_contact_sheet(contact_sheet_job &job)
+{
+	PROFILE_SCOPE("screenshot: contact sheet");
+	const contact_sheet &sheet = job.sheet;
+	if (sheet.get_pixels().empty() || job.path.empty())
+		return;
 
 	std::vector<uint8_t> encoded_data;
-	if (!fpng::fpng_encode_image_to_memory(pixels.data(), width, height, 3, encoded_data))
+	if (!encode_screenshot_image(job.format, sheet.get_pixels().data(), sheet.get_width(), sheet.get_height(), encoded_data))
 	{
-		reshade::log_message(reshade::log_level::error, "Failed to encode screenshot to png");
+		addon_log(addon_log_level::error, "Failed to encode contact sheet");
 		return;
 	}
+	if (write_screenshot_file(job.path, encoded_data, job.write_mode))
+	{
+		screenshot_output output = {};
+		output.path = job.path;
+		output.format = job.format;
+		output.convert_to_png = job.convert_to_png;
+		output.write_mode = job.write_mode;
+		queue_png_conversion(output);
+	}
+}
+
+// Leaves the cell of a capture that never happened blank, the sheet is still
+// written when this was its last cell
+static void skip_contact_sheet_cell(std::shared_ptr<contact_sheet_job> sheet, uint32_t index)
+{
+	if (sheet && sheet->sheet.skip_cell(index))
+	{
+		g_screenshot_workers.submit([sheet = std::move(sheet)]() {
+			write_contact_sheet(*sheet);
+		});
+	}
+}
 
-	std::filesystem::path path = get_screenshot_path(runtime);
+// Runs on the worker that resolved the last image
+static void write_comparison_archive(comparison_archive_job &job)
+{
+	PROFILE_SCOPE("screenshot: comparison archive");
+	if (job.path.empty())
+		return;
 
-	if (!std::filesystem::exists(path.parent_path()))
+	std::vector<uint8_t> data;
+	if (!job.archive.serialize(data))
 	{
-		if (!std::filesystem::create_directories(path.parent_path()))
+		addon_log(addon_log_level::error, "Comparison archive has no base capture, nothing written");
+		return;
+	}
+	write_screenshot_file(job.path, data, job.write_mode);
+}
+
+// Same as skip_contact_sheet_cell for the image in the archive
+static void skip_comparison_archive_image(std::shared_ptr<comparison_archive_job> archive, uint32_t index)
+{
+	if (archive && archive->archive.skip_frame(index))
+	{
+		g_screenshot_workers.submit([archive = std::move(archive)]() {
+			write_comparison_archive(*archive);
+		});
+	}
+}
+
+// Frames only count as identical when they would also produce the same file
+static uint64_t hash_packed_frame(const uint8_t *pixels, const screenshot_output &output)
+{
+	PROFILE_SCOPE("screenshot: hash");
+	uint64_t seed = (static_cast<uint64_t>(output.width) << 32 | output.height) ^
+		(static_cast<uint64_t>(output.format) << 8 | (output.convert_to_png ? 1 : 0)) * 0x9e3779b185ebca87ull;
+	return content_hash(pixels, static_cast<size_t>(output.width) * static_cast<size_t>(output.height) * 3, seed);
+}
+
+// Returns true when the duplicate needs no file of its own
+static bool handle_duplicate_frame(const std::filesystem::path &original, const screenshot_output &output)
+{
+	if (output.duplicates == duplicate_hard_link)
+	{
+		std::error_code ec;
+		std::filesystem::create_hard_link(original, output.path, ec);
+		if (ec)
 		{
-			reshade::log_message(reshade::log_level::error, "Failed to create screenshot directory");
+			// e.g. FAT volumes, the capture is written normally instead
+			addon_log(addon_log_level::warning, ("Failed to link duplicate screenshot, writing it: " + ec.message()).c_str());
+			return false;
+		}
+	}
+
+	std::string message = "Screenshot identical to " + original.filename().u8string() + (output.duplicates == duplicate_skip ? ", skipped" : ", linked");
+	addon_log(addon_log_level::info, message.c_str());
+	return true;
+}
+
+// Packs the RGBA pixels in place, encodes and writes them. release_pixels is
+// called as soon as the pixels are no longer needed. Runs on a worker thread.
+template <typename F>
+static void encode_and_write_pixels(uint8_t *pixels, screenshot_output &output, F &&release_pixels)
+{
+	{
+		PROFILE_SCOPE("screenshot: pack");
+		pack_rgba_to_rgb(pixels, static_cast<size_t>(output.width) * static_cast<size_t>(output.height));
+	}
+
+	// The preset is already loaded for the capture, so its preview comes for free
+	if (!output.preset.empty() && g_thumbnail_atlas.is_open())
+	{
+		PROFILE_SCOPE("screenshot: thumbnail");
+		g_thumbnail_atlas.store(output.preset, hash_preset_file(output.preset), pixels, output.width, output.height);
+	}
+
+	if (output.sheet)
+	{
+		if (output.sheet->sheet.add_frame(output.batch_index, pixels, output.width, output.height))
+			write_contact_sheet(*output.sheet);
+		if (!output.sheet->keep_frames)
+		{
+			release_pixels();
 			return;
 		}
 	}
 
-	std::ofstream file = std::ofstream(path, std::ios::binary | std::ios::trunc);
-	file.write((const char*)encoded_data.data(), encoded_data.size());
-	file.close();
+	if (output.archive)
+	{
+		// The archive takes the place of the capture's own file
+		if (output.archive->archive.add_frame(output.batch_index, pixels, output.width, output.height))
+			write_comparison_archive(*output.archive);
+		release_pixels();
+		return;
+	}
 
-	if (!file.good())
+	// Hashing costs a fraction of encoding, so duplicates skip the encode too
+	uint64_t hash = 0;
+	bool claimed = false;
+	if (output.duplicates != duplicate_write)
 	{
-		reshade::log_message(reshade::log_level::error, "Error while saving screenshot to file");
+		hash = hash_packed_frame(pixels, output);
+		std::filesystem::path original;
+		if (!g_written_frames.find_or_claim(hash, output.path, original))
+			claimed = true;
+		else if (handle_duplicate_frame(original, output))
+		{
+			release_pixels();
+			// A link to a BMP gets its own PNG like the file it points to
+			if (output.duplicates == duplicate_hard_link)
+				queue_png_conversion(output);
+			return;
+		}
+	}
+
+	// The encoder resizes the output vector, a recycled one keeps its capacity
+	std::vector<uint8_t> encoded_data = g_encode_buffers.acquire_any();
+	bool encoded;
+	{
+		PROFILE_SCOPE("screenshot: encode");
+		encoded = encode_screenshot_image(output.format, pixels, output.width, output.height, encoded_data);
+	}
+	release_pixels();
+	if (!encoded)
+	{
+		g_encode_buffers.release(std::move(encoded_data));
+		if (claimed)
+			g_written_frames.complete(hash, false);
+		addon_log(addon_log_level::error, "Failed to encode screenshot");
+		return;
+	}
+
+	bool written;
+	{
+		PROFILE_SCOPE("screenshot: write");
+		written = write_screenshot_file(output.path, encoded_data, output.write_mode);
+	}
+	g_encode_buffers.release(std::move(encoded_data));
+	if (claimed)
+		g_written_frames.complete(hash, written);
+
+	if (written)
+		queue_png_conversion(output);
+}
+
+// Hands the captured pixels of job to the encoders, or drops it when the
+// capture failed
+static void finish_screenshot_job(screenshot_job job, bool captured)
+{
+	if (!captured)
+	{
+		g_capture_buffers.release(std::move(job.pixels));
+		addon_log(addon_log_level::error, "Failed to capture screenshot");
+		skip_contact_sheet_cell(std::move(job.output.sheet), job.output.batch_index);
+		skip_comparison_archive_image(std::move(job.output.archive), job.output.batch_index);
+		return;
+	}
+
+	g_screenshot_workers.submit([job = std::move(job)]() mutable {
+		encode_and_write_pixels(job.pixels.data(), job.output, [&job]() {
+			g_capture_buffers.release(std::move(job.pixels));
+		});
+	});
+}
+
+static void capture_and_queue_screenshot(screenshot_queue &queue, addon_runtime *runtime, screenshot_output output)
+{
+	PROFILE_SCOPE("save_screenshot");
+	screenshot_job job;
+	job.output = std::move(output);
+	runtime->get_screenshot_width_and_height(&job.output.width, &job.output.height);
+	if (job.output.sheet && job.output.sheet->path.empty())
+		job.output.sheet->path = get_screenshot_directory(queue, runtime) / get_screenshot_filename((std::string(" contact sheet") + screenshot_format_extension(job.output.format)).c_str());
+	if (job.output.archive && job.output.archive->path.empty())
+		job.output.archive->path = get_screenshot_directory(queue, runtime) / get_screenshot_filename(" comparison" COMPARISON_ARCHIVE_EXTENSION);
+	// Taken now, a read back capture is finished after the preset may have changed
+	if (!job.output.archive)
+	{
+		PROFILE_SCOPE("screenshot: resolve path");
+		job.output.path = get_screenshot_path(queue, runtime, job.output.format);
+	}
+	// ReShade still reports the previous preset after a uniform diff switch
+	job.output.preset = get_live_preset(runtime, queue.preset_switch);
+	job.pixels = g_capture_buffers.acquire(static_cast<size_t>(job.output.width) * static_cast<size_t>(job.output.height) * 4);
+
+	if (queue.device != nullptr)
+	{
+		auto pending = std::make_shared<screenshot_job>(std::move(job));
+		if (queue.readback.begin(queue.device, queue.last_frame, pending->output.width, pending->output.height, pending->pixels.data(), [pending](bool read) {
+			finish_screenshot_job(std::move(*pending), read);
+		}))
+			return;
+		job = std::move(*pending);
+	}
+
+	bool captured;
+	{
+		PROFILE_SCOPE("screenshot: capture_screenshot");
+		captured = runtime->capture_screenshot(job.pixels.data());
+	}
+	finish_screenshot_job(std::move(job), captured);
+}
+
+void save_screenshot(screenshot_queue &queue, addon_runtime *runtime, screenshot_format format, bool convert_to_png, duplicate_frame_policy duplicates, screenshot_write_mode write_mode)
+{
+	screenshot_output output = {};
+	output.format = format;
+	output.convert_to_png = convert_to_png;
+	output.duplicates = duplicates;
+	output.write_mode = write_mode;
+	capture_and_queue_screenshot(queue, runtime, std::move(output));
+}
+
+void screenshot_burst_stage::start_work(addon_runtime *runtime)
+{
+	runtime->get_screenshot_width_and_height(&this->width, &this->height);
+	size_t frame_size = static_cast<size_t>(this->width) * static_cast<size_t>(this->height) * 4;
+	this->ring = std::make_shared<burst_ring>(frame_size, this->frame_count, this->budget_bytes, BURST_MAX_SLOTS);
+	this->directory = get_screenshot_directory(*this->queue, runtime);
+	this->name_prefix = get_screenshot_filename(" burst ");
+	// The first frame is captured right away
+	this->sampled_frame = this->queue->last_frame - 1;
+	this->frames_seen = 0;
+	this->dropped = 0;
+	if (this->ring->slot_count() == 0)
+	{
+		addon_log(addon_log_level::error, "Not enough memory for a single burst frame, burst skipped");
+		this->frames_seen = this->frame_count;
 	}
 }
 
-void screenshot_notify_frame(uint32_t frame)
+void screenshot_burst_stage::update(addon_runtime *runtime)
+{
+	if (this->frames_seen >= this->frame_count || this->sampled_frame == this->queue->last_frame) return;
+	this->sampled_frame = this->queue->last_frame;
+	PROFILE_SCOPE("screenshot: burst frame");
+
+	uint32_t index = this->frames_seen++;
+	uint32_t width, height;
+	runtime->get_screenshot_width_and_height(&width, &height);
+	// A resized back buffer no longer fits the slots
+	int slot = -1;
+	if (width == this->width && height == this->height)
+		slot = this->ring->acquire(this->overflow == burst_wait_for_encoder);
+	if (slot >= 0)
+	{
+		char number[16];
+		snprintf(number, sizeof(number), "%03u", index);
+		screenshot_output output = {};
+		output.width = width;
+		output.height = height;
+		output.path = this->directory / (this->name_prefix + number + screenshot_format_extension(this->format));
+		output.format = this->format;
+		output.convert_to_png = this->convert_to_png;
+		output.duplicates = this->duplicates;
+		output.write_mode = this->write_mode;
+		auto encode = [ring = this->ring, slot, output = std::move(output)](bool captured) mutable {
+			if (!captured)
+			{
+				ring->release(slot);
+				return;
+			}
+			g_burst_workers.submit([ring = std::move(ring), slot, output = std::move(output)]() mutable {
+				encode_and_write_pixels(ring->data(slot), output, [&ring, slot]() {
+					ring->release(slot);
+				});
+			});
+		};
+
+		// Slots waiting for the GPU are only released by this thread, so one is
+		// always left to the encoders, or waiting for a slot would never end
+		bool read_back = this->queue->device != nullptr && this->queue->readback.pending_count() + 1 < this->ring->slot_count();
+		// A failed read back only shows up frames later, it is logged then
+		if (!read_back || !this->queue->readback.begin(this->queue->device, this->queue->last_frame, width, height, this->ring->data(slot), [encode](bool read) mutable {
+			if (!read)
+				addon_log(addon_log_level::error, "Failed to read back burst frame");
+			encode(read);
+		}))
+		{
+			bool captured = runtime->capture_screenshot(this->ring->data(slot));
+			encode(captured);
+			if (!captured)
+				slot = -1;
+		}
+	}
+
+	if (slot < 0)
+		++this->dropped;
+
+	if (this->frames_seen == this->frame_count && this->dropped > 0)
+	{
+		std::string message = "Burst dropped " + std::to_string(this->dropped) + " of " + std::to_string(this->frame_count) +
+			" frames, the encoders could not keep up within the memory budget";
+		addon_log(addon_log_level::warning, message.c_str());
+	}
+}
+
+bool screenshot_burst_stage::is_completed()
+{
+	if (this->frames_seen < this->frame_count) return false;
+	// The workers keep the slots alive until the last frame is written
+	this->ring.reset();
+	return true;
+}
+
+void shutdown_screenshot_workers(bool process_terminating)
+{
+	// Conversions are queued by the screenshot workers, so those stop first
+	g_screenshot_workers.shutdown(process_terminating);
+	g_burst_workers.shutdown(process_terminating);
+	g_conversion_worker.shutdown(process_terminating);
+	// Every PNG encode runs on the workers above
+	shutdown_png_workers(process_terminating);
+	// Duplicates are only tracked within a session
+	g_written_frames.clear();
+	// The next runtime may save somewhere else
+	g_screenshot_writer.reset();
+}
+
+void screenshot_notify_frame(screenshot_queue &queue, uint32_t frame)
 {
-	g_last_frame = frame;
+	queue.last_frame = frame;
 }
 
-void screenshot_notify_effects_rendered(uint32_t frame)
+void screenshot_notify_effects_rendered(screenshot_queue &queue, uint32_t frame)
 {
-	g_last_effects_render_frame = frame;
+	queue.last_effects_render_frame = frame;
 }
@@ -1,28 +1,96 @@
 #pragma once
 
-#include <reshade.hpp>
-#include <queue>
 #include <memory>
 #include <filesystem>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "addon_settings.hpp"
+#include "addon_runtime.hpp"
+#include "burst_ring.hpp"
+#include "preset_switch.hpp"
+#include "frame_readback.hpp"
+
+struct screenshot_queue;
 
 struct screenshot_stage {
 	bool started;
+	// Zero unless profiling was enabled when the stage started
+	uint64_t profile_start;
+	// Queue of the runtime running the stage, set when it starts
+	screenshot_queue *queue;
 
-	screenshot_stage() : started(false) {}
-	void initialize(reshade::api::effect_runtime *runtime);
-	virtual void start_work(reshade::api::effect_runtime *runtime) {}
+	screenshot_stage() : started(false), profile_start(0), queue(nullptr) {}
+	virtual ~screenshot_stage() {}
+	void initialize(screenshot_queue &queue, addon_runtime *runtime);
+	virtual void finish();
+	virtual const char *profile_name() { return "stage"; }
+	virtual void start_work(addon_runtime *runtime) {}
+	virtual void update(addon_runtime *runtime) {}
 	virtual bool is_completed() { return true; }
 };
 
 struct screenshot_change_preset_stage : screenshot_stage {
 	std::filesystem::path preset;
+	std::string preset_utf8;
+	bool allow_uniform_diff;
 	uint32_t prev_effects_render_frame;
 
-	screenshot_change_preset_stage(std::filesystem::path &preset) :
-		screenshot_stage(), preset(preset) {};
+	screenshot_change_preset_stage(const std::filesystem::path &preset, const addon_settings &settings) :
+		screenshot_stage(), preset(preset), preset_utf8(preset.u8string()), allow_uniform_diff(settings.fast_preset_switch) {};
 	
-	void start_work(reshade::api::effect_runtime *runtime);
+	const char *profile_name() { return "stage: change preset"; }
+	void start_work(addon_runtime *runtime);
+	bool is_completed();
+};
+
+// Switches back to the preset that was active when the workload started,
+// which is only known once the workloads queued before it have run
+struct screenshot_restore_preset_stage : screenshot_change_preset_stage {
+	const std::filesystem::path &original_preset;
+
+	screenshot_restore_preset_stage(const std::filesystem::path &original_preset, const addon_settings &settings) :
+		screenshot_change_preset_stage(std::filesystem::path(), settings), original_preset(original_preset) {};
+
+	const char *profile_name() { return "stage: restore preset"; }
+	void start_work(addon_runtime *runtime);
+};
+
+// Frames a preset took to render after being loaded by a warm-up
+struct preset_warm_up_entry {
+	std::filesystem::path preset;
+	uint32_t frames;
+	// The effects did not render within PRESET_WARM_UP_MAX_FRAMES
+	bool timed_out;
+};
+
+struct preset_warm_up_report {
+	std::vector<preset_warm_up_entry> entries;
+	size_t preset_count;
+};
+
+#define PRESET_WARM_UP_MAX_FRAMES 600
+
+// Loads a preset in full so ReShade compiles its effects, then records how
+// many frames it took until they rendered
+struct screenshot_warm_up_stage : screenshot_change_preset_stage {
+	std::shared_ptr<preset_warm_up_report> report;
+	uint32_t start_frame;
+
+	screenshot_warm_up_stage(const std::filesystem::path &preset, const addon_settings &settings, std::shared_ptr<preset_warm_up_report> report) :
+		screenshot_change_preset_stage(preset, settings), report(std::move(report))
+	{
+		// Only a full reload makes ReShade compile what the preset needs
+		this->allow_uniform_diff = false;
+	};
+
+	const char *profile_name() { return "stage: warm up"; }
+	void start_work(addon_runtime *runtime);
 	bool is_completed();
+	void finish();
 };
 
 struct screenshot_wait_stage : screenshot_stage {
@@ -32,18 +100,189 @@ struct screenshot_wait_stage : screenshot_stage {
 	screenshot_wait_stage(uint8_t frames_count) :
 		screenshot_stage(), frames_count(frames_count) {};
 
-	void start_work(reshade::api::effect_runtime *runtime);
+	const char *profile_name() { return "stage: wait"; }
+	void start_work(addon_runtime *runtime);
+	bool is_completed();
+};
+
+// Frames a settle stage waits when it cannot compare frames, clamped to its
+// minimum and maximum
+#define SETTLE_FIXED_WAIT_FRAMES 5
+
+// Signatures of the frames a settle stage sampled, defined in screenshot.cpp.
+// Read back samples complete frames later, possibly after the stage is done.
+struct settle_samples;
+
+// Waits until successive frames stop changing, bounded by a minimum and
+// maximum frame count. Frames are compared from copies of the few rows their
+// signature samples, read back a frame or two late. Without a readback device
+// it waits a fixed SETTLE_FIXED_WAIT_FRAMES instead of capturing every frame.
+struct screenshot_settle_stage : screenshot_stage {
+	uint32_t min_frames;
+	uint32_t max_frames;
+	float threshold;
+	uint32_t start_frame;
+	uint32_t sampled_frame;
+	// False once the frames cannot be sampled, the stage then waits a fixed time
+	bool sampling;
+	std::shared_ptr<settle_samples> samples;
+
+	screenshot_settle_stage(const addon_settings &settings) :
+		screenshot_stage(),
+		min_frames(settings.settle_min_frames),
+		max_frames(std::max(settings.settle_min_frames, settings.settle_max_frames)),
+		threshold(settings.settle_threshold) {};
+
+	const char *profile_name() { return "stage: settle"; }
+	void start_work(addon_runtime *runtime);
+	void update(addon_runtime *runtime);
 	bool is_completed();
+	void finish();
 };
 
+// A batch's contact sheet and comparison archive with the files they are
+// written to, defined in screenshot.cpp
+struct contact_sheet_job;
+struct comparison_archive_job;
+
 struct screenshot_capture_stage : screenshot_stage {
-	screenshot_capture_stage() : screenshot_stage() {};
+	screenshot_format format;
+	bool convert_to_png;
+	duplicate_frame_policy duplicates;
+	screenshot_write_mode write_mode;
+	// Set when the capture also goes into a contact sheet cell
+	std::shared_ptr<contact_sheet_job> sheet;
+	// Set when the capture is stored in an archive instead of its own file
+	std::shared_ptr<comparison_archive_job> archive;
+	// Position within the batch, the sheet cell and archive image it fills
+	uint32_t batch_index;
+
+	screenshot_capture_stage(const addon_settings &settings, std::shared_ptr<contact_sheet_job> sheet = nullptr, std::shared_ptr<comparison_archive_job> archive = nullptr, uint32_t batch_index = 0) :
+		screenshot_stage(), format(settings.capture_format), convert_to_png(settings.convert_bmp_to_png), duplicates(settings.duplicate_frames),
+		write_mode(settings.write_mode), sheet(std::move(sheet)), archive(std::move(archive)), batch_index(batch_index) {};
+
+	const char *profile_name() { return "stage: capture"; }
+	void start_work(addon_runtime *runtime);
+};
+
+// Captures frame_count consecutive frames into a burst_ring at frame rate,
+// they are encoded and written on the burst workers
+struct screenshot_burst_stage : screenshot_stage {
+	uint32_t frame_count;
+	size_t budget_bytes;
+	burst_overflow_policy overflow;
+	screenshot_format format;
+	bool convert_to_png;
+	duplicate_frame_policy duplicates;
+	screenshot_write_mode write_mode;
+	std::shared_ptr<burst_ring> ring;
+	std::filesystem::path directory;
+	std::string name_prefix;
+	uint32_t width;
+	uint32_t height;
+	uint32_t sampled_frame;
+	uint32_t frames_seen;
+	uint32_t dropped;
+
+	screenshot_burst_stage(const addon_settings &settings) :
+		screenshot_stage(),
+		frame_count(std::max(settings.burst_frame_count, 1u)),
+		// Shifted in 64 bits, budgets of 4 GB and more overflow a 32-bit size_t
+		budget_bytes(static_cast<size_t>(std::min<uint64_t>(static_cast<uint64_t>(settings.burst_memory_budget_mb) << 20, SIZE_MAX))),
+		overflow(settings.burst_overflow),
+		format(settings.capture_format),
+		convert_to_png(settings.convert_bmp_to_png),
+		duplicates(settings.duplicate_frames),
+		write_mode(settings.write_mode) {};
+
+	const char *profile_name() { return "stage: burst"; }
+	void start_work(addon_runtime *runtime);
+	void update(addon_runtime *runtime);
+	bool is_completed();
+};
+
+typedef uint64_t screenshot_workload_id;
+
+// Pending workloads run highest priority first, then in queue order
+enum screenshot_workload_priority {
+	workload_priority_low = 0,
+	workload_priority_normal = 1,
+	workload_priority_high = 2,
+};
+
+// A sequence of stages run one at a time, one workload at a time. Stages only
+// compare frame counters, so a frame costs the same however many are queued.
+struct screenshot_workload {
+	screenshot_workload_id id;
+	screenshot_workload_priority priority;
+	// Identical requests share a key and are merged while pending or running
+	std::string merge_key;
+	std::vector<std::unique_ptr<screenshot_stage>> stages;
+	size_t current_stage;
+	// Preset active when the workload started, restored by its last stage
+	std::filesystem::path original_preset;
+	bool cancelled;
+
+	screenshot_workload() : id(0), priority(workload_priority_normal), current_stage(0), cancelled(false) {};
+};
 
-	void start_work(reshade::api::effect_runtime *runtime);
+// Workloads, frame counters and preset switching state of one effect runtime.
+// ReShade creates a runtime per swapchain (e.g. one per VR eye or window),
+// each on its own render thread, so a queue is only touched by its runtime.
+// The encoder workers behind it are shared and thread-safe.
+struct screenshot_queue {
+	std::unique_ptr<screenshot_workload> active_workload;
+	// Keyed by negated priority then id, so begin() is the next workload to run
+	std::map<std::pair<int, screenshot_workload_id>, std::unique_ptr<screenshot_workload>> pending_workloads;
+	std::unordered_map<std::string, screenshot_workload *> workloads_by_key;
+	uint32_t last_frame = 0;
+	uint32_t last_effects_render_frame = 0;
+	// Resolving the directory goes through the ReShade config, so it is only
+	// done again after invalidate_screenshot_directory
+	std::filesystem::path screenshot_directory;
+	bool screenshot_directory_valid = false;
+	std::shared_ptr<const preset_warm_up_report> warm_up_report;
+	preset_switch_state preset_switch;
+	// Null unless the runtime's device can copy the back buffer asynchronously
+	readback_device *device = nullptr;
+	frame_readback readback;
+	signature_readback signatures;
 };
 
-void queue_screenshot_workload(std::filesystem::path &preset, std::filesystem::path &original_preset);
-bool process_screenshot_workload(reshade::api::effect_runtime *runtime);
-void save_screenshot(reshade::api::effect_runtime *runtime);
-void screenshot_notify_frame(uint32_t frame);
-void screenshot_notify_effects_rendered(uint32_t frame);
+// Every queue function returns the id of the new workload, or of the identical
+// one it was merged into. Each workload restores the preset it started from.
+screenshot_workload_id queue_screenshot_workload(screenshot_queue &queue, const std::filesystem::path &preset, const addon_settings &settings, screenshot_workload_priority priority = workload_priority_normal);
+screenshot_workload_id queue_burst_screenshot_workload(screenshot_queue &queue, const std::filesystem::path &preset, const addon_settings &settings, screenshot_workload_priority priority = workload_priority_normal);
+// Also builds a contact sheet of the captures unless settings.contact_sheet is off
+screenshot_workload_id queue_batch_screenshot_workload(screenshot_queue &queue, const std::vector<std::filesystem::path> &presets, const addon_settings &settings, screenshot_workload_priority priority = workload_priority_low);
+// Loads every preset once so the first switch during gameplay does not stall
+// on compiling effects, then restores the original preset
+screenshot_workload_id queue_preset_warm_up_workload(screenshot_queue &queue, const std::vector<std::filesystem::path> &presets, const addon_settings &settings, screenshot_workload_priority priority = workload_priority_low);
+// Report of the running or last warm-up, null before the first one starts
+std::shared_ptr<const preset_warm_up_report> get_preset_warm_up_report(const screenshot_queue &queue);
+// Switches preset once the running workload is done, for keybinds pressed mid-capture
+screenshot_workload_id queue_preset_switch_workload(screenshot_queue &queue, const std::filesystem::path &preset, const addon_settings &settings);
+// A pending workload is dropped, a running one skips to restoring its preset.
+// Returns false when the id is unknown or already finished.
+bool cancel_screenshot_workload(screenshot_queue &queue, screenshot_workload_id id);
+void cancel_all_screenshot_workloads(screenshot_queue &queue);
+// Running plus pending
+size_t get_screenshot_workload_count(const screenshot_queue &queue);
+// Advances the running workload and reads back finished captures, returns
+// false when there is nothing to do
+bool process_screenshot_workload(screenshot_queue &queue, addon_runtime *runtime);
+// Captures and bursts copy the back buffer through device and read it a few
+// frames later instead of stalling on runtime->capture_screenshot. Setting
+// another device or null drops the pending copies of the previous one.
+void set_screenshot_readback_device(screenshot_queue &queue, readback_device *device);
+// convert_to_png only applies to BMP, the file is re-encoded in the background.
+// Frames identical to one written this session are handled per duplicates.
+void save_screenshot(screenshot_queue &queue, addon_runtime *runtime, screenshot_format format = format_png, bool convert_to_png = false, duplicate_frame_policy duplicates = duplicate_write,
+	screenshot_write_mode write_mode = write_cached);
+// The screenshot directory is read from the ReShade config once, call when
+// the config may have changed
+void invalidate_screenshot_directory(screenshot_queue &queue);
+// Shared by every runtime, only call once the last one is destroyed
+void shutdown_screenshot_workers(bool process_terminating);
+void screenshot_notify_frame(screenshot_queue &queue, uint32_t frame);
+void screenshot_notify_effects_rendered(screenshot_queue &queue, uint32_t frame);
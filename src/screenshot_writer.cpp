@@ -0,0 +1,219 @@
+#include "screenshot_writer.hpp"
+#include "addon_log.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Freed when its thread exits, worker threads live for the whole session
+struct aligned_block {
+	uint8_t *data = nullptr;
+
+	~aligned_block()
+	{
+		if (data != nullptr)
+			::operator delete(data, std::align_val_t(SCREENSHOT_WRITE_ALIGNMENT));
+	}
+
+	uint8_t *get()
+	{
+		if (data == nullptr)
+			data = static_cast<uint8_t *>(::operator new(SCREENSHOT_WRITE_BLOCK_SIZE, std::align_val_t(SCREENSHOT_WRITE_ALIGNMENT)));
+		return data;
+	}
+};
+
+static thread_local aligned_block t_block;
+
+#ifdef _WIN32
+static bool write_all(HANDLE file, const uint8_t *data, size_t size)
+{
+	while (size > 0)
+	{
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, SCREENSHOT_WRITE_BLOCK_SIZE));
+		DWORD written = 0;
+		if (!WriteFile(file, data, chunk, &written, nullptr) || written == 0)
+			return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+// Returns false without having written anything when the volume refuses
+// unbuffered writes, so the caller can retry cached
+static bool write_direct_file(const std::filesystem::path &path, const uint8_t *data, size_t size, bool sync, bool &unsupported)
+{
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		unsupported = GetLastError() == ERROR_INVALID_PARAMETER;
+		return false;
+	}
+
+	uint8_t *block = t_block.get();
+	bool ok = true;
+	for (size_t offset = 0; ok && offset < size; offset += SCREENSHOT_WRITE_BLOCK_SIZE)
+	{
+		size_t chunk = std::min<size_t>(size - offset, SCREENSHOT_WRITE_BLOCK_SIZE);
+		std::memcpy(block, data + offset, chunk);
+		// Unbuffered writes are whole sectors, the padding is cut off below
+		size_t padded = (chunk + SCREENSHOT_WRITE_ALIGNMENT - 1) & ~static_cast<size_t>(SCREENSHOT_WRITE_ALIGNMENT - 1);
+		std::memset(block + chunk, 0, padded - chunk);
+		DWORD written = 0;
+		ok = WriteFile(file, block, static_cast<DWORD>(padded), &written, nullptr) && written == padded;
+		if (!ok && offset == 0 && GetLastError() == ERROR_INVALID_PARAMETER)
+			unsupported = true;
+	}
+	if (ok)
+	{
+		FILE_END_OF_FILE_INFO end_of_file = {};
+		end_of_file.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+		ok = SetFileInformationByHandle(file, FileEndOfFileInfo, &end_of_file, sizeof(end_of_file));
+	}
+	if (ok && sync)
+		ok = FlushFileBuffers(file);
+	CloseHandle(file);
+	return ok;
+}
+
+static bool write_cached_file(const std::filesystem::path &path, const uint8_t *data, size_t size, bool sync)
+{
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	bool ok = write_all(file, data, size);
+	if (ok && sync)
+		ok = FlushFileBuffers(file);
+	CloseHandle(file);
+	return ok;
+}
+#else
+static bool write_all(int fd, const uint8_t *data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t written = ::write(fd, data, std::min<size_t>(size, SCREENSHOT_WRITE_BLOCK_SIZE));
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		data += written;
+		size -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+static bool write_direct_file(const std::filesystem::path &path, const uint8_t *data, size_t size, bool sync, bool &unsupported)
+{
+#ifdef O_DIRECT
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if (fd < 0)
+	{
+		// e.g. tmpfs
+		unsupported = errno == EINVAL;
+		return false;
+	}
+
+	uint8_t *block = t_block.get();
+	bool ok = true;
+	for (size_t offset = 0; ok && offset < size; offset += SCREENSHOT_WRITE_BLOCK_SIZE)
+	{
+		size_t chunk = std::min<size_t>(size - offset, SCREENSHOT_WRITE_BLOCK_SIZE);
+		std::memcpy(block, data + offset, chunk);
+		size_t padded = (chunk + SCREENSHOT_WRITE_ALIGNMENT - 1) & ~static_cast<size_t>(SCREENSHOT_WRITE_ALIGNMENT - 1);
+		std::memset(block + chunk, 0, padded - chunk);
+		ok = write_all(fd, block, padded);
+		if (!ok && offset == 0 && errno == EINVAL)
+			unsupported = true;
+	}
+	if (ok)
+		ok = ftruncate(fd, static_cast<off_t>(size)) == 0;
+	if (ok && sync)
+		ok = fsync(fd) == 0;
+	::close(fd);
+	return ok;
+#else
+	unsupported = true;
+	return false;
+#endif
+}
+
+static bool write_cached_file(const std::filesystem::path &path, const uint8_t *data, size_t size, bool sync)
+{
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	bool ok = write_all(fd, data, size);
+	if (ok && sync)
+		ok = fsync(fd) == 0;
+	ok = ::close(fd) == 0 && ok;
+	return ok;
+}
+#endif
+
+bool screenshot_writer::ensure_directory(const std::filesystem::path &directory)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (directory.empty() || directories.count(directory) != 0)
+		return true;
+
+	std::error_code ec;
+	if (!std::filesystem::exists(directory, ec) && !std::filesystem::create_directories(directory, ec))
+		return false;
+	directories.insert(directory);
+	return true;
+}
+
+void screenshot_writer::forget_directory(const std::filesystem::path &directory)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	directories.erase(directory);
+}
+
+bool screenshot_writer::write(const std::filesystem::path &path, const uint8_t *data, size_t size, screenshot_write_mode mode)
+{
+	std::filesystem::path directory = path.parent_path();
+	if (!ensure_directory(directory))
+	{
+		addon_log(addon_log_level::error, "Failed to create screenshot directory");
+		return false;
+	}
+
+	bool sync = mode == write_direct_sync;
+	auto attempt = [&]() {
+		bool unsupported = false;
+		if (mode != write_cached && write_direct_file(path, data, size, sync, unsupported))
+			return true;
+		if (mode != write_cached && !unsupported)
+			return false;
+		return write_cached_file(path, data, size, sync);
+	};
+
+	bool written = attempt();
+	if (!written)
+	{
+		// The directory may have been removed since it was created, try once more
+		forget_directory(directory);
+		if (ensure_directory(directory))
+			written = attempt();
+	}
+
+	if (!written)
+		addon_log(addon_log_level::error, "Error while saving screenshot to file");
+	return written;
+}
+
+void screenshot_writer::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	directories.clear();
+}
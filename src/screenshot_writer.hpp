@@ -0,0 +1,32 @@
+#pragma once
+
+#include "addon_settings.hpp"
+
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <cstddef>
+#include <cstdint>
+
+// Size of the aligned blocks direct writes go through, one per writing thread
+#define SCREENSHOT_WRITE_BLOCK_SIZE (4 << 20)
+// Covers the sector size of every disk direct writes are expected to hit
+#define SCREENSHOT_WRITE_ALIGNMENT 4096
+
+// Writes whole files for the screenshot workers. Output directories are
+// created the first time a file goes into them instead of being checked on
+// every write. Safe to use from any thread.
+struct screenshot_writer {
+	// Replaces the file at path. Direct modes fall back to cached writes on
+	// file systems that do not support them.
+	bool write(const std::filesystem::path &path, const uint8_t *data, size_t size, screenshot_write_mode mode);
+	// Directories are checked again on the next write, e.g. when a new runtime starts
+	void reset();
+
+private:
+	bool ensure_directory(const std::filesystem::path &directory);
+	void forget_directory(const std::filesystem::path &directory);
+
+	std::set<std::filesystem::path> directories;
+	std::mutex mutex;
+};
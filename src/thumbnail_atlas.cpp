@@ -0,0 +1,179 @@
+#include "thumbnail_atlas.hpp"
+#include "addon_log.hpp"
+#include "contact_sheet.hpp"
+#include "content_hash.hpp"
+
+#include <fstream>
+#include <cstring>
+
+#define THUMBNAIL_ATLAS_MAGIC 0x41545350 // "PSTA"
+#define THUMBNAIL_ATLAS_VERSION 1
+#define THUMBNAIL_SLOT_SIZE (THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT * 3)
+// Separates the path and preset hashes so a path never hashes like a file
+#define THUMBNAIL_PATH_SEED 0x7468756d62ull
+
+struct thumbnail_atlas::header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t thumbnail_width;
+	uint32_t thumbnail_height;
+	uint32_t capacity;
+	uint32_t reserved;
+	uint64_t clock;
+};
+
+struct thumbnail_atlas::entry {
+	// 0 marks an empty entry
+	uint64_t path_hash;
+	uint64_t preset_hash;
+	uint64_t last_stored;
+};
+
+#define THUMBNAIL_ATLAS_SIZE (sizeof(thumbnail_atlas::header) + THUMBNAIL_CAPACITY * sizeof(thumbnail_atlas::entry) + THUMBNAIL_CAPACITY * THUMBNAIL_SLOT_SIZE)
+
+thumbnail_atlas g_thumbnail_atlas;
+
+uint64_t hash_preset_file(const std::filesystem::path &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return 0;
+	std::vector<char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	uint64_t hash = content_hash(reinterpret_cast<const uint8_t *>(contents.data()), contents.size());
+	return hash != 0 ? hash : 1;
+}
+
+static uint64_t hash_preset_path(const std::filesystem::path &preset)
+{
+	std::string key = preset.lexically_normal().generic_u8string();
+	uint64_t hash = content_hash(reinterpret_cast<const uint8_t *>(key.data()), key.size(), THUMBNAIL_PATH_SEED);
+	return hash != 0 ? hash : 1;
+}
+
+bool thumbnail_atlas::open(const std::filesystem::path &path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file.open(path, THUMBNAIL_ATLAS_SIZE))
+		return false;
+
+	header *atlas_header = get_header();
+	if (atlas_header->magic != THUMBNAIL_ATLAS_MAGIC || atlas_header->version != THUMBNAIL_ATLAS_VERSION ||
+		atlas_header->thumbnail_width != THUMBNAIL_WIDTH || atlas_header->thumbnail_height != THUMBNAIL_HEIGHT ||
+		atlas_header->capacity != THUMBNAIL_CAPACITY)
+	{
+		// New or foreign file, only the header and entries need clearing
+		std::memset(file.data(), 0, sizeof(header) + THUMBNAIL_CAPACITY * sizeof(entry));
+		atlas_header->magic = THUMBNAIL_ATLAS_MAGIC;
+		atlas_header->version = THUMBNAIL_ATLAS_VERSION;
+		atlas_header->thumbnail_width = THUMBNAIL_WIDTH;
+		atlas_header->thumbnail_height = THUMBNAIL_HEIGHT;
+		atlas_header->capacity = THUMBNAIL_CAPACITY;
+	}
+	changes.fetch_add(1, std::memory_order_release);
+	return true;
+}
+
+void thumbnail_atlas::close()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	file.flush();
+	file.close();
+	changes.fetch_add(1, std::memory_order_release);
+}
+
+bool thumbnail_atlas::is_open()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return file.is_open();
+}
+
+thumbnail_atlas::header *thumbnail_atlas::get_header() const
+{
+	return reinterpret_cast<header *>(file.data());
+}
+
+thumbnail_atlas::entry *thumbnail_atlas::get_entries() const
+{
+	return reinterpret_cast<entry *>(file.data() + sizeof(header));
+}
+
+uint8_t *thumbnail_atlas::get_slot(uint32_t index) const
+{
+	return file.data() + sizeof(header) + THUMBNAIL_CAPACITY * sizeof(entry) + static_cast<size_t>(index) * THUMBNAIL_SLOT_SIZE;
+}
+
+thumbnail_atlas::entry *thumbnail_atlas::find(uint64_t path_hash) const
+{
+	entry *entries = get_entries();
+	for (uint32_t i = 0; i < THUMBNAIL_CAPACITY; i++)
+		if (entries[i].path_hash == path_hash)
+			return &entries[i];
+	return nullptr;
+}
+
+void thumbnail_atlas::store(const std::filesystem::path &preset, uint64_t preset_hash, const uint8_t *pixels, uint32_t width, uint32_t height)
+{
+	if (preset_hash == 0 || width == 0 || height == 0)
+		return;
+	uint64_t path_hash = hash_preset_path(preset);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file.is_open())
+		return;
+
+	entry *target = find(path_hash);
+	if (target == nullptr)
+	{
+		entry *entries = get_entries();
+		target = &entries[0];
+		for (uint32_t i = 0; i < THUMBNAIL_CAPACITY && target->path_hash != 0; i++)
+			if (entries[i].path_hash == 0 || entries[i].last_stored < target->last_stored)
+				target = &entries[i];
+	}
+
+	// Fit the frame inside the slot, keeping its aspect ratio
+	uint32_t fit_width = THUMBNAIL_WIDTH;
+	uint32_t fit_height = static_cast<uint32_t>(static_cast<uint64_t>(height) * THUMBNAIL_WIDTH / width);
+	if (fit_height > THUMBNAIL_HEIGHT)
+	{
+		fit_height = THUMBNAIL_HEIGHT;
+		fit_width = static_cast<uint32_t>(static_cast<uint64_t>(width) * THUMBNAIL_HEIGHT / height);
+	}
+	fit_width = fit_width > 0 ? fit_width : 1;
+	fit_height = fit_height > 0 ? fit_height : 1;
+
+	uint8_t *slot = get_slot(static_cast<uint32_t>(target - get_entries()));
+	std::memset(slot, 0, THUMBNAIL_SLOT_SIZE);
+	uint32_t x = (THUMBNAIL_WIDTH - fit_width) / 2;
+	uint32_t y = (THUMBNAIL_HEIGHT - fit_height) / 2;
+	downscale_rgb_box(pixels, width, height, slot + (static_cast<size_t>(y) * THUMBNAIL_WIDTH + x) * 3, fit_width, fit_height, THUMBNAIL_WIDTH * 3);
+
+	target->path_hash = path_hash;
+	target->preset_hash = preset_hash;
+	target->last_stored = ++get_header()->clock;
+	changes.fetch_add(1, std::memory_order_release);
+}
+
+bool thumbnail_atlas::load(const std::filesystem::path &preset, uint64_t preset_hash, std::vector<uint8_t> &pixels)
+{
+	uint64_t path_hash = hash_preset_path(preset);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file.is_open())
+		return false;
+
+	entry *found = find(path_hash);
+	if (found == nullptr)
+		return false;
+	if (found->preset_hash != preset_hash)
+	{
+		// The preset was edited since its thumbnail was captured
+		*found = {};
+		changes.fetch_add(1, std::memory_order_release);
+		return false;
+	}
+
+	const uint8_t *slot = get_slot(static_cast<uint32_t>(found - get_entries()));
+	pixels.assign(slot, slot + THUMBNAIL_SLOT_SIZE);
+	return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#define THUMBNAIL_WIDTH 160
+#define THUMBNAIL_HEIGHT 90
+#define THUMBNAIL_CAPACITY 128
+
+// Content hash of a preset file, 0 when it cannot be read
+uint64_t hash_preset_file(const std::filesystem::path &path);
+
+// Fixed-size file of preset preview thumbnails, memory-mapped so only the
+// slots that are actually looked at get paged in. Entries are keyed by preset
+// path and preset content hash, an entry whose preset changed since it was
+// captured is dropped on lookup. The least recently stored entry is replaced
+// when the atlas is full. Safe to use from any thread.
+struct thumbnail_atlas {
+	// Maps the atlas file, resetting it when it is missing or from another version
+	bool open(const std::filesystem::path &path);
+	void close();
+	bool is_open();
+
+	// Downscales a packed RGB frame into the preset's slot, letterboxed to THUMBNAIL_WIDTH x THUMBNAIL_HEIGHT
+	void store(const std::filesystem::path &preset, uint64_t preset_hash, const uint8_t *pixels, uint32_t width, uint32_t height);
+	// Copies the preset's packed RGB thumbnail, false when there is none or it is stale
+	bool load(const std::filesystem::path &preset, uint64_t preset_hash, std::vector<uint8_t> &pixels);
+	// Changes whenever an entry is stored or dropped, for invalidating caches
+	uint32_t generation() const { return changes.load(std::memory_order_acquire); }
+
+private:
+	struct header;
+	struct entry;
+
+	header *get_header() const;
+	entry *get_entries() const;
+	uint8_t *get_slot(uint32_t index) const;
+	entry *find(uint64_t path_hash) const;
+
+	mapped_file file;
+	std::mutex mutex;
+	std::atomic<uint32_t> changes = 0;
+};
+
+extern thumbnail_atlas g_thumbnail_atlas;
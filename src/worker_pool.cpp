@@ -0,0 +1,98 @@
+#include "worker_pool.hpp"
+#include "addon_log.hpp"
+
+#include <exception>
+#include <sstream>
+
+worker_pool::~worker_pool()
+{
+	// Never join from a static destructor, it runs under the loader lock
+	for (auto& thread : threads)
+		thread.detach();
+}
+
+void worker_pool::start()
+{
+	if (!threads.empty()) return;
+
+	stopping = false;
+	running_threads = thread_count;
+	for (size_t i = 0; i < thread_count; ++i)
+		threads.emplace_back(&worker_pool::run, this);
+}
+
+void worker_pool::submit(std::function<void()> job)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	start();
+	slot_available.wait(lock, [this] { return jobs.size() < queue_capacity; });
+	jobs.push(std::move(job));
+	lock.unlock();
+	job_available.notify_one();
+}
+
+void worker_pool::drain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (threads.empty()) return;
+	idle.wait(lock, [this] { return jobs.empty() && active_jobs == 0; });
+}
+
+void worker_pool::shutdown(bool process_terminating)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (threads.empty()) return;
+
+	if (!process_terminating)
+	{
+		idle.wait(lock, [this] { return jobs.empty() && active_jobs == 0; });
+		stopping = true;
+		job_available.notify_all();
+		// Joining could deadlock on the loader lock when called from DllMain,
+		// so wait for every worker to leave its loop and detach it instead
+		idle.wait(lock, [this] { return running_threads == 0; });
+	}
+
+	for (auto& thread : threads)
+		thread.detach();
+	threads.clear();
+	jobs = {};
+	active_jobs = 0;
+	running_threads = 0;
+}
+
+void worker_pool::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		job_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+		if (jobs.empty()) break;
+
+		std::function<void()> job = std::move(jobs.front());
+		jobs.pop();
+		++active_jobs;
+		lock.unlock();
+		slot_available.notify_one();
+
+		try
+		{
+			job();
+		}
+		catch (const std::exception& e)
+		{
+			std::stringstream ss;
+			ss << "Background job failed: " << e.what();
+			addon_log(addon_log_level::error, ss.str().c_str());
+		}
+		job = nullptr;
+
+		lock.lock();
+		--active_jobs;
+		if (jobs.empty() && active_jobs == 0)
+			idle.notify_all();
+	}
+
+	--running_threads;
+	idle.notify_all();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <queue>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Fixed-size pool of background threads fed by a bounded job queue.
+// Threads are started on the first submit and can be restarted after shutdown.
+struct worker_pool {
+	worker_pool(size_t thread_count, size_t queue_capacity) :
+		thread_count(thread_count), queue_capacity(queue_capacity) {};
+	~worker_pool();
+
+	// Blocks the caller while the queue is full (backpressure)
+	void submit(std::function<void()> job);
+	// Blocks until the queue is empty and no job is running
+	void drain();
+	// Drains pending jobs and stops all threads. When the process is terminating
+	// the threads have already been killed by the OS, so nothing is waited on.
+	void shutdown(bool process_terminating = false);
+
+private:
+	void start();
+	void run();
+
+	size_t thread_count;
+	size_t queue_capacity;
+	std::vector<std::thread> threads;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable job_available;
+	std::condition_variable slot_available;
+	std::condition_variable idle;
+	size_t active_jobs = 0;
+	size_t running_threads = 0;
+	bool stopping = false;
+};
@@ -0,0 +1,241 @@
+#include "mock_runtime.hpp"
+#include "screenshot.hpp"
+
+#include <algorithm>
+
+void mock_runtime::schedule(uint32_t at_frame, std::function<void(mock_runtime &)> callback)
+{
+	events.emplace(at_frame, std::move(callback));
+}
+
+void mock_runtime::press_key(unsigned int keycode)
+{
+	keys_queued.insert(keycode);
+}
+
+void mock_runtime::hold_key(unsigned int keycode)
+{
+	keys_held.insert(keycode);
+}
+
+void mock_runtime::release_key(unsigned int keycode)
+{
+	keys_held.erase(keycode);
+}
+
+uint64_t mock_runtime::add_uniform(const char *effect_name, const char *variable_name, uniform_base_type base_type, uint32_t rows, uint32_t columns, uint32_t array_length)
+{
+	uniforms.push_back({ effect_name, variable_name, base_type, rows, columns, array_length, {} });
+	return uniforms.size();
+}
+
+const mock_uniform *mock_runtime::find_uniform(const char *effect_name, const char *variable_name) const
+{
+	for (auto& uniform : uniforms)
+	{
+		if (uniform.effect_name == effect_name && uniform.variable_name == variable_name)
+			return &uniform;
+	}
+	return nullptr;
+}
+
+bool mock_runtime::begin_frame()
+{
+	++frame;
+
+	auto range = events.equal_range(frame);
+	std::vector<std::function<void(mock_runtime &)>> due;
+	for (auto it = range.first; it != range.second; ++it)
+		due.push_back(std::move(it->second));
+	events.erase(range.first, range.second);
+	for (auto& callback : due)
+		callback(*this);
+
+	keys_pressed = std::move(keys_queued);
+	keys_queued.clear();
+
+	return frame >= effects_ready_frame;
+}
+
+void mock_runtime::get_screenshot_width_and_height(uint32_t *width, uint32_t *height)
+{
+	*width = this->width;
+	*height = this->height;
+}
+
+bool mock_runtime::capture_screenshot(uint8_t *pixels)
+{
+	if (fail_captures) return false;
+	++capture_count;
+	draw_frame(pixels);
+	return true;
+}
+
+void mock_runtime::draw_frame(uint8_t *pixels)
+{
+	// Every preset gets its own gradient, frames that have not settled yet
+	// are offset by a frame-dependent amount
+	uint32_t seed = static_cast<uint32_t>(std::hash<std::string>()(current_preset.u8string()));
+	uint32_t noise = 0;
+	if (frame < effects_ready_frame + settle_frames)
+		noise = frame * 53;
+
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			uint8_t *pixel = pixels + 4 * (static_cast<size_t>(y) * width + x);
+			pixel[0] = static_cast<uint8_t>(seed + x + noise);
+			pixel[1] = static_cast<uint8_t>((seed >> 8) + y + noise);
+			pixel[2] = static_cast<uint8_t>((seed >> 16) + x + y);
+			pixel[3] = 255;
+		}
+	}
+}
+
+std::filesystem::path mock_runtime::get_screenshot_directory()
+{
+	++screenshot_directory_queries;
+	return screenshot_directory;
+}
+
+std::filesystem::path mock_runtime::get_current_preset_path()
+{
+	return current_preset;
+}
+
+void mock_runtime::set_current_preset_path(const char *path_utf8)
+{
+	current_preset = std::filesystem::u8path(path_utf8);
+	preset_switches.push_back(path_utf8);
+	effects_ready_frame = frame + 1 + preset_switch_latency;
+	if (loaded_presets.insert(path_utf8).second)
+		effects_ready_frame += first_load_latency;
+}
+
+bool mock_runtime::is_key_down(unsigned int keycode)
+{
+	return keys_held.count(keycode) != 0 || keys_pressed.count(keycode) != 0;
+}
+
+bool mock_runtime::is_key_pressed(unsigned int keycode)
+{
+	return keys_pressed.count(keycode) != 0;
+}
+
+uint64_t mock_runtime::find_uniform_variable(const char *effect_name, const char *variable_name)
+{
+	const mock_uniform *uniform = find_uniform(effect_name, variable_name);
+	return uniform != nullptr ? static_cast<uint64_t>(uniform - uniforms.data()) + 1 : 0;
+}
+
+void mock_runtime::get_uniform_variable_type(uint64_t variable, uniform_base_type *base_type, uint32_t *rows, uint32_t *columns, uint32_t *array_length)
+{
+	const mock_uniform &uniform = uniforms.at(variable - 1);
+	*base_type = uniform.base_type;
+	*rows = uniform.rows;
+	*columns = uniform.columns;
+	*array_length = uniform.array_length;
+}
+
+template <typename T>
+void mock_runtime::store_uniform(uint64_t variable, const T *values, size_t count)
+{
+	mock_uniform &uniform = uniforms.at(variable - 1);
+	uniform.values.assign(values, values + count);
+}
+
+void mock_runtime::set_uniform_value_float(uint64_t variable, const float *values, size_t count)
+{
+	store_uniform(variable, values, count);
+}
+
+void mock_runtime::set_uniform_value_int(uint64_t variable, const int32_t *values, size_t count)
+{
+	store_uniform(variable, values, count);
+}
+
+void mock_runtime::set_uniform_value_uint(uint64_t variable, const uint32_t *values, size_t count)
+{
+	store_uniform(variable, values, count);
+}
+
+void mock_runtime::set_uniform_value_bool(uint64_t variable, const bool *values, size_t count)
+{
+	store_uniform(variable, values, count);
+}
+
+uint64_t mock_readback_device::create_staging(uint32_t width, uint32_t height)
+{
+	++staging_created;
+	staging[++next_staging].resize(static_cast<size_t>(width) * height * 4);
+	return next_staging;
+}
+
+void mock_readback_device::destroy_staging(uint64_t staging)
+{
+	this->staging.erase(staging);
+}
+
+uint64_t mock_readback_device::copy_back_buffer(uint64_t staging)
+{
+	if (fail_copies) return 0;
+	std::vector<uint8_t> &target = this->staging.at(staging);
+	// A back buffer of another size no longer fits
+	if (target.size() != static_cast<size_t>(runtime.width) * runtime.height * 4) return 0;
+
+	++copy_count;
+	runtime.draw_frame(target.data());
+	fences[++next_fence] = runtime.frame + gpu_latency;
+	return next_fence;
+}
+
+uint64_t mock_readback_device::get_completed_fence_value()
+{
+	uint64_t completed = 0;
+	for (auto& fence : fences)
+	{
+		if (stalled || fence.second > runtime.frame) break;
+		completed = fence.first;
+	}
+	return completed;
+}
+
+bool mock_readback_device::read_staging(uint64_t staging, uint8_t *pixels)
+{
+	++read_count;
+	const std::vector<uint8_t> &source = this->staging.at(staging);
+	std::copy(source.begin(), source.end(), pixels);
+	return true;
+}
+
+uint64_t mock_readback_device::create_row_staging(uint32_t width, uint32_t row_count)
+{
+	staging[++next_staging].resize(static_cast<size_t>(width) * row_count * 4);
+	return next_staging;
+}
+
+uint64_t mock_readback_device::copy_back_buffer_rows(uint64_t staging, const uint32_t *rows, uint32_t row_count)
+{
+	if (fail_copies) return 0;
+	std::vector<uint8_t> &target = this->staging.at(staging);
+	const size_t row_bytes = static_cast<size_t>(runtime.width) * 4;
+	if (target.size() != row_bytes * row_count) return 0;
+
+	++row_copy_count;
+	std::vector<uint8_t> frame(row_bytes * runtime.height);
+	runtime.draw_frame(frame.data());
+	for (uint32_t i = 0; i < row_count; ++i)
+		std::copy(frame.begin() + rows[i] * row_bytes, frame.begin() + (rows[i] + 1) * row_bytes, target.begin() + i * row_bytes);
+	fences[++next_fence] = runtime.frame + gpu_latency;
+	return next_fence;
+}
+
+bool run_addon_frame(mock_runtime &runtime)
+{
+	if (runtime.begin_frame())
+		screenshot_notify_effects_rendered(runtime.screenshots, runtime.addon_frame);
+	++runtime.addon_frame;
+	screenshot_notify_frame(runtime.screenshots, runtime.addon_frame);
+	return process_screenshot_workload(runtime.screenshots, &runtime);
+}
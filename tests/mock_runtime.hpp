@@ -0,0 +1,131 @@
+#pragma once
+
+#include "addon_runtime.hpp"
+#include "screenshot.hpp"
+#include "frame_readback.hpp"
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct mock_uniform {
+	std::string effect_name;
+	std::string variable_name;
+	uniform_base_type base_type;
+	uint32_t rows;
+	uint32_t columns;
+	uint32_t array_length;
+	// Last written values, converted to double
+	std::vector<double> values;
+};
+
+// Scripted stand-in for the ReShade effect runtime. Each begin_frame advances
+// one frame: scheduled events run, presses queued for the frame become
+// visible, and effects render unless a preset switch is still compiling.
+struct mock_runtime : addon_runtime {
+	uint32_t width = 64;
+	uint32_t height = 36;
+	std::filesystem::path screenshot_directory;
+	std::filesystem::path current_preset;
+	// Frames set_current_preset_path keeps the effects from rendering
+	uint32_t preset_switch_latency = 0;
+	// Added the first time each preset is loaded, like compiling new effects
+	uint32_t first_load_latency = 0;
+	// Frames after the effects render again during which captures keep changing
+	uint32_t settle_frames = 0;
+	bool fail_captures = false;
+
+	uint32_t frame = 0;
+	uint32_t capture_count = 0;
+	uint32_t screenshot_directory_queries = 0;
+	std::vector<std::string> preset_switches;
+	std::set<std::string> loaded_presets;
+	std::vector<mock_uniform> uniforms;
+
+	// Addon state the addon keeps for each runtime
+	screenshot_queue screenshots;
+	uint32_t addon_frame = 0;
+
+	// Runs callback at the start of the given frame
+	void schedule(uint32_t at_frame, std::function<void(mock_runtime &)> callback);
+	// Reports the key as pressed (and down) for the next frame only
+	void press_key(unsigned int keycode);
+	// Keeps the key down until released, e.g. for modifiers
+	void hold_key(unsigned int keycode);
+	void release_key(unsigned int keycode);
+	// Returns the uniform handle
+	uint64_t add_uniform(const char *effect_name, const char *variable_name, uniform_base_type base_type, uint32_t rows = 1, uint32_t columns = 1, uint32_t array_length = 0);
+	const mock_uniform *find_uniform(const char *effect_name, const char *variable_name) const;
+
+	// Returns true when the effects render this frame
+	bool begin_frame();
+	// Writes the pixels of the current frame without counting a capture
+	void draw_frame(uint8_t *pixels);
+
+	void get_screenshot_width_and_height(uint32_t *width, uint32_t *height);
+	bool capture_screenshot(uint8_t *pixels);
+	std::filesystem::path get_screenshot_directory();
+	std::filesystem::path get_current_preset_path();
+	void set_current_preset_path(const char *path_utf8);
+	bool is_key_down(unsigned int keycode);
+	bool is_key_pressed(unsigned int keycode);
+	uint64_t find_uniform_variable(const char *effect_name, const char *variable_name);
+	void get_uniform_variable_type(uint64_t variable, uniform_base_type *base_type, uint32_t *rows, uint32_t *columns, uint32_t *array_length);
+	void set_uniform_value_float(uint64_t variable, const float *values, size_t count);
+	void set_uniform_value_int(uint64_t variable, const int32_t *values, size_t count);
+	void set_uniform_value_uint(uint64_t variable, const uint32_t *values, size_t count);
+	void set_uniform_value_bool(uint64_t variable, const bool *values, size_t count);
+
+private:
+	template <typename T>
+	void store_uniform(uint64_t variable, const T *values, size_t count);
+
+	std::multimap<uint32_t, std::function<void(mock_runtime &)>> events;
+	std::set<unsigned int> keys_held;
+	std::set<unsigned int> keys_queued;
+	std::set<unsigned int> keys_pressed;
+	// First frame the effects of the current preset render on
+	uint32_t effects_ready_frame = 0;
+};
+
+// Fake GPU for asynchronous captures. A copy takes the frame the runtime shows
+// when it is recorded and its fence signals gpu_latency frames later.
+struct mock_readback_device : readback_device {
+	mock_runtime &runtime;
+	uint32_t gpu_latency = 2;
+	// Fences never signal, like a lost device
+	bool stalled = false;
+	bool fail_copies = false;
+
+	uint32_t copy_count = 0;
+	uint32_t read_count = 0;
+	// Copies of signature rows, counted apart from the full frame copies
+	uint32_t row_copy_count = 0;
+	// Full frame staging only, signature row staging is not counted
+	uint32_t staging_created = 0;
+
+	mock_readback_device(mock_runtime &runtime) : runtime(runtime) {};
+
+	size_t staging_count() const { return staging.size(); }
+
+	uint64_t create_staging(uint32_t width, uint32_t height);
+	void destroy_staging(uint64_t staging);
+	uint64_t copy_back_buffer(uint64_t staging);
+	uint64_t get_completed_fence_value();
+	bool read_staging(uint64_t staging, uint8_t *pixels);
+	uint64_t create_row_staging(uint32_t width, uint32_t row_count);
+	uint64_t copy_back_buffer_rows(uint64_t staging, const uint32_t *rows, uint32_t row_count);
+
+private:
+	std::map<uint64_t, std::vector<uint8_t>> staging;
+	// Fence value by the frame it signals on
+	std::map<uint64_t, uint32_t> fences;
+	uint64_t next_staging = 0;
+	uint64_t next_fence = 0;
+};
+
+// Mirrors the addon's reshade_begin_effects and reshade_overlay events for one
+// frame. Returns true while a screenshot workload is pending.
+bool run_addon_frame(mock_runtime &runtime);
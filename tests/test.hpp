@@ -0,0 +1,38 @@
+#pragma once
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+
+typedef void (*test_function)();
+
+struct test_registration {
+	test_registration(const char *name, test_function function);
+};
+
+void report_test_failure(const char *file, int line, const std::string &message);
+// Empty directory unique to the running test, removed when the test ends
+std::filesystem::path test_temp_directory();
+
+#define TEST(name) \
+	static void test_##name(); \
+	static test_registration test_registration_##name(#name, &test_##name); \
+	static void test_##name()
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) \
+			report_test_failure(__FILE__, __LINE__, #condition); \
+	} while (false)
+
+#define CHECK_EQ(a, b) \
+	do { \
+		auto check_a = (a); \
+		auto check_b = (b); \
+		if (!(check_a == check_b)) \
+		{ \
+			std::stringstream check_ss; \
+			check_ss << #a " == " #b " (" << check_a << " vs " << check_b << ")"; \
+			report_test_failure(__FILE__, __LINE__, check_ss.str()); \
+		} \
+	} while (false)
@@ -0,0 +1,175 @@
+#include "test.hpp"
+#include "comparison_archive.hpp"
+#include "png_encode.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+static std::vector<uint8_t> gradient_frame(uint32_t width, uint32_t height)
+{
+	std::vector<uint8_t> frame(static_cast<size_t>(width) * height * 3);
+	for (uint32_t y = 0; y < height; ++y)
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			uint8_t *p = &frame[(static_cast<size_t>(y) * width + x) * 3];
+			p[0] = static_cast<uint8_t>(x);
+			p[1] = static_cast<uint8_t>(y * 3);
+			p[2] = static_cast<uint8_t>(x ^ y);
+		}
+	return frame;
+}
+
+static std::filesystem::path write_archive(const comparison_archive &archive)
+{
+	std::vector<uint8_t> data;
+	CHECK(archive.serialize(data));
+	std::filesystem::path path = test_temp_directory() / ("comparison" COMPARISON_ARCHIVE_EXTENSION);
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+	return path;
+}
+
+TEST(comparison_archive_round_trips_frames)
+{
+	init_png_encode();
+	const uint32_t width = 300, height = 170;
+	std::vector<uint8_t> base = gradient_frame(width, height);
+	std::vector<uint8_t> same = base;
+	std::vector<uint8_t> tinted = base;
+	// Only a small area changes, like a preset touching the HUD
+	for (uint32_t y = 10; y < 40; ++y)
+		for (uint32_t x = 200; x < 260; ++x)
+			tinted[(static_cast<size_t>(y) * width + x) * 3 + 1] += 17;
+	std::vector<uint8_t> resized = gradient_frame(120, 90);
+
+	comparison_archive archive({ "Base.ini", "Same.ini", "Tinted.ini", "Resized.ini" });
+	CHECK(!archive.add_frame(0, base.data(), width, height));
+	CHECK(!archive.add_frame(2, tinted.data(), width, height));
+	CHECK(!archive.add_frame(3, resized.data(), 120, 90));
+	CHECK(archive.add_frame(1, same.data(), width, height));
+
+	comparison_archive_reader reader;
+	CHECK(reader.open(write_archive(archive)));
+	CHECK_EQ(reader.image_count(), 4u);
+	CHECK_EQ(reader.label(2), std::string("Tinted.ini"));
+
+	const std::vector<uint8_t> *expected[] = { &base, &same, &tinted, &resized };
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		std::vector<uint8_t> pixels;
+		uint32_t w = 0, h = 0;
+		CHECK(reader.has_image(i));
+		CHECK(reader.extract(i, pixels, w, h));
+		CHECK_EQ(w, i == 3 ? 120u : width);
+		CHECK_EQ(h, i == 3 ? 90u : height);
+		CHECK(pixels == *expected[i]);
+	}
+	reader.close();
+	shutdown_png_workers(false);
+}
+
+TEST(comparison_archive_round_trips_global_changes)
+{
+	init_png_encode();
+	const uint32_t width = 200, height = 150;
+	std::vector<uint8_t> base = gradient_frame(width, height);
+	// Every pixel changes, like a tone curve, so every tile is stored
+	std::vector<uint8_t> brighter = base;
+	for (auto &value : brighter)
+		value = static_cast<uint8_t>(value * 9 / 8);
+	std::vector<uint8_t> inverted = base;
+	for (auto &value : inverted)
+		value = static_cast<uint8_t>(255 - value);
+
+	comparison_archive archive({ "Base.ini", "Brighter.ini", "Inverted.ini" });
+	CHECK(!archive.add_frame(0, base.data(), width, height));
+	CHECK(!archive.add_frame(1, brighter.data(), width, height));
+	CHECK(archive.add_frame(2, inverted.data(), width, height));
+
+	comparison_archive_reader reader;
+	CHECK(reader.open(write_archive(archive)));
+	const std::vector<uint8_t> *expected[] = { &base, &brighter, &inverted };
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		std::vector<uint8_t> pixels;
+		uint32_t w = 0, h = 0;
+		CHECK(reader.extract(i, pixels, w, h));
+		CHECK(pixels == *expected[i]);
+	}
+	reader.close();
+	shutdown_png_workers(false);
+}
+
+TEST(comparison_archive_keeps_skipped_images)
+{
+	init_png_encode();
+	std::vector<uint8_t> frame = gradient_frame(64, 64);
+	comparison_archive archive({ "A.ini", "B.ini", "C.ini" });
+	CHECK(!archive.skip_frame(0));
+	CHECK(!archive.add_frame(1, frame.data(), 64, 64));
+	CHECK(archive.skip_frame(2));
+
+	comparison_archive_reader reader;
+	CHECK(reader.open(write_archive(archive)));
+	CHECK(!reader.has_image(0));
+	CHECK(reader.has_image(1));
+	CHECK(!reader.has_image(2));
+	std::vector<uint8_t> pixels;
+	uint32_t w, h;
+	CHECK(!reader.extract(0, pixels, w, h));
+	CHECK(reader.extract(1, pixels, w, h));
+	CHECK(pixels == frame);
+	reader.close();
+
+	// Nothing captured, nothing to write
+	comparison_archive empty({ "A.ini" });
+	CHECK(empty.skip_frame(0));
+	std::vector<uint8_t> data;
+	CHECK(!empty.serialize(data));
+	shutdown_png_workers(false);
+}
+
+TEST(comparison_archive_rejects_damaged_files)
+{
+	init_png_encode();
+	std::vector<uint8_t> frame = gradient_frame(128, 128);
+	comparison_archive archive({ "A.ini", "B.ini" });
+	archive.add_frame(0, frame.data(), 128, 128);
+	frame[5000] ^= 0xFF;
+	archive.add_frame(1, frame.data(), 128, 128);
+	std::vector<uint8_t> data;
+	CHECK(archive.serialize(data));
+	shutdown_png_workers(false);
+
+	std::filesystem::path path = test_temp_directory() / "damaged.psca";
+	auto write = [&](size_t size) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(size));
+	};
+
+	comparison_archive_reader reader;
+	write(data.size() / 2);
+	CHECK(!reader.open(path));
+	write(16);
+	CHECK(!reader.open(path));
+
+	// Bad magic
+	data[0] ^= 0xFF;
+	write(data.size());
+	CHECK(!reader.open(path));
+	data[0] ^= 0xFF;
+
+	// A damaged tile mask no longer matches the differences, extract fails
+	// instead of returning garbage. The entry of image 1 starts with its offset.
+	uint64_t delta_offset;
+	memcpy(&delta_offset, data.data() + 32 + 40, sizeof(delta_offset));
+	data[delta_offset] ^= 0xFF;
+	write(data.size());
+	CHECK(reader.open(path));
+	std::vector<uint8_t> pixels;
+	uint32_t w, h;
+	CHECK(!reader.extract(1, pixels, w, h));
+	reader.close();
+	CHECK(!reader.open(test_temp_directory() / "missing.psca"));
+}
@@ -0,0 +1,107 @@
+#include "test.hpp"
+#include "contact_sheet.hpp"
+
+#include <vector>
+
+TEST(downscale_averages_boxes)
+{
+	// 4x2 source into 2x1: each output pixel averages a 2x2 block
+	const uint8_t src[4 * 2 * 3] = {
+		0, 0, 0,      100, 10, 0,   200, 0, 0,   200, 0, 0,
+		100, 30, 0,   200, 0, 4,    200, 0, 0,   200, 0, 255,
+	};
+	uint8_t dst[2 * 3] = {};
+	downscale_rgb_box(src, 4, 2, dst, 2, 1, sizeof(dst));
+	CHECK_EQ(int(dst[0]), 100);
+	CHECK_EQ(int(dst[1]), 10);
+	CHECK_EQ(int(dst[2]), 1);
+	CHECK_EQ(int(dst[3]), 200);
+	CHECK_EQ(int(dst[5]), 64);
+
+	// Fractional ratios keep flat colors flat
+	std::vector<uint8_t> flat(97 * 61 * 3, 77);
+	std::vector<uint8_t> scaled(20 * 13 * 3, 0);
+	downscale_rgb_box(flat.data(), 97, 61, scaled.data(), 20, 13, 20 * 3);
+	for (uint8_t value : scaled)
+		CHECK_EQ(int(value), 77);
+}
+
+TEST(downscale_kernels_match_scalar)
+{
+	// Odd widths exercise the vector loops and the scalar tail, uneven ratios
+	// the weighted edge pixels
+	const uint32_t sizes[][4] = {
+		{ 5, 3, 2, 1 }, { 97, 61, 20, 13 }, { 333, 187, 41, 23 }, { 640, 360, 480, 270 }, { 1031, 17, 1030, 5 },
+	};
+	for (auto &size : sizes)
+	{
+		uint32_t src_width = size[0], src_height = size[1], dst_width = size[2], dst_height = size[3];
+		std::vector<uint8_t> src(static_cast<size_t>(src_width) * src_height * 3);
+		uint32_t state = 7;
+		for (auto &value : src)
+		{
+			state = state * 1103515245 + 12345;
+			value = static_cast<uint8_t>(state >> 16);
+		}
+
+		CHECK(set_downscale_kernel(downscale_kernel_scalar));
+		std::vector<uint8_t> expected(static_cast<size_t>(dst_width) * dst_height * 3);
+		downscale_rgb_box(src.data(), src_width, src_height, expected.data(), dst_width, dst_height, dst_width * 3);
+
+		for (auto kernel : downscale_kernels)
+		{
+			if (!set_downscale_kernel(kernel))
+				continue;
+			CHECK_EQ(get_downscale_kernel(), kernel);
+			std::vector<uint8_t> scaled(expected.size());
+			downscale_rgb_box(src.data(), src_width, src_height, scaled.data(), dst_width, dst_height, dst_width * 3);
+			CHECK(scaled == expected);
+		}
+	}
+
+	CHECK(set_downscale_kernel(downscale_kernel_scalar));
+	init_downscale();
+}
+
+TEST(contact_sheet_places_cells_and_labels)
+{
+	contact_sheet sheet({ "a", "b", "c" }, 32);
+	std::vector<uint8_t> frame(64 * 36 * 3, 200);
+	CHECK(!sheet.add_frame(0, frame.data(), 64, 36));
+	CHECK(!sheet.skip_cell(1));
+	// Index out of range resolves nothing
+	CHECK(!sheet.add_frame(7, frame.data(), 64, 36));
+	CHECK(sheet.add_frame(2, frame.data(), 64, 36));
+
+	// Two columns of 32x18 cells with a label strip under each
+	CHECK_EQ(sheet.get_width(), 88u);
+	CHECK_EQ(sheet.get_height(), 104u);
+	const std::vector<uint8_t> &pixels = sheet.get_pixels();
+	auto at = [&](uint32_t x, uint32_t y) { return pixels[(static_cast<size_t>(y) * sheet.get_width() + x) * 3]; };
+	CHECK_EQ(int(at(8 + 16, 8 + 9)), 200);
+	CHECK(at(48 + 16, 8 + 9) != 200);
+	CHECK_EQ(int(at(8 + 16, 56 + 9)), 200);
+
+	// Some label pixels are lit below the first cell
+	bool lit = false;
+	for (uint32_t y = 8 + 18; y < 56; ++y)
+		for (uint32_t x = 8; x < 40; ++x)
+			lit |= at(x, y) > 200;
+	CHECK(lit);
+}
+
+TEST(label_font_draws_punctuation)
+{
+	// Every printable character except '?' itself must not fall back to its glyph
+	const uint8_t white[3] = { 255, 255, 255 };
+	auto render = [&](char ch) {
+		std::vector<uint8_t> pixels(6 * 7 * 3, 0);
+		const char text[2] = { ch, '\0' };
+		draw_text_rgb(pixels.data(), 6, 7, 0, 0, text, 1, white);
+		return pixels;
+	};
+	const std::vector<uint8_t> question = render('?');
+	for (char ch = '!'; ch <= '~'; ++ch)
+		if (ch != '?')
+			CHECK(render(ch) != question);
+}
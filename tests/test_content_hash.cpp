@@ -0,0 +1,58 @@
+#include "test.hpp"
+#include "content_hash.hpp"
+
+#include <vector>
+
+static std::vector<uint8_t> make_hash_input(size_t size)
+{
+	std::vector<uint8_t> data(size);
+	uint32_t state = 1;
+	for (auto& byte : data)
+	{
+		state = state * 1103515245 + 12345;
+		byte = static_cast<uint8_t>(state >> 16);
+	}
+	return data;
+}
+
+TEST(content_hash_matches_scalar_reference)
+{
+	// Produced by the scalar kernel, every SIMD kernel has to agree. Sizes
+	// cover empty input, partial stripes and partial blocks.
+	struct { size_t size; uint64_t hash; } expected[] = {
+		{ 0, 0x64ed8bdfbd3e14a7ull },
+		{ 1, 0xe0275d75c002cf41ull },
+		{ 63, 0xed2f1fe3568f1cedull },
+		{ 64, 0xc2c44eff5f863995ull },
+		{ 1023, 0xb936ac0ff05fe14bull },
+		{ 1024, 0xf70ae3ec0376c9ddull },
+		{ 1025, 0x3b2f9712490bb8c8ull },
+		{ 5000, 0x3b71650fa315579cull },
+		{ 100000, 0xf4fc5e3355889257ull },
+	};
+
+	init_content_hash();
+	for (auto& entry : expected)
+	{
+		std::vector<uint8_t> data = make_hash_input(entry.size);
+		CHECK_EQ(content_hash(data.data(), data.size()), entry.hash);
+	}
+}
+
+TEST(content_hash_detects_small_changes)
+{
+	std::vector<uint8_t> data = make_hash_input(4096 + 17);
+	uint64_t hash = content_hash(data.data(), data.size());
+	CHECK(content_hash(data.data(), data.size(), 1) != hash);
+	// Trailing zeros still change the length
+	std::vector<uint8_t> zeros(100, 0);
+	CHECK(content_hash(zeros.data(), 99) != content_hash(zeros.data(), 100));
+
+	for (size_t i : { size_t(0), size_t(1000), data.size() - 1 })
+	{
+		data[i] ^= 1;
+		CHECK(content_hash(data.data(), data.size()) != hash);
+		data[i] ^= 1;
+	}
+	CHECK_EQ(content_hash(data.data(), data.size()), hash);
+}
@@ -0,0 +1,165 @@
+#include "test.hpp"
+#include "mock_runtime.hpp"
+#include "frame_readback.hpp"
+#include "frame_signature.hpp"
+
+#include <vector>
+
+static size_t frame_size(const mock_runtime &runtime)
+{
+	return static_cast<size_t>(runtime.width) * runtime.height * 4;
+}
+
+TEST(readback_completes_once_the_fence_signals)
+{
+	mock_runtime runtime;
+	mock_readback_device gpu(runtime);
+	gpu.gpu_latency = 2;
+	frame_readback readback;
+	runtime.begin_frame();
+
+	std::vector<uint8_t> pixels(frame_size(runtime));
+	int completions = 0;
+	bool result = false;
+	CHECK(readback.begin(&gpu, runtime.frame, runtime.width, runtime.height, pixels.data(), [&](bool read) {
+		++completions;
+		result = read;
+	}));
+	std::vector<uint8_t> expected(frame_size(runtime));
+	runtime.draw_frame(expected.data());
+
+	readback.poll(&gpu, runtime.frame);
+	runtime.begin_frame();
+	readback.poll(&gpu, runtime.frame);
+	CHECK_EQ(completions, 0);
+	CHECK_EQ(gpu.read_count, 0u);
+
+	runtime.begin_frame();
+	readback.poll(&gpu, runtime.frame);
+	CHECK_EQ(completions, 1);
+	CHECK(result);
+	CHECK(pixels == expected);
+	CHECK_EQ(readback.pending_count(), size_t(0));
+	CHECK_EQ(runtime.capture_count, 0u);
+}
+
+TEST(readback_reuses_staging_until_the_size_changes)
+{
+	mock_runtime runtime;
+	mock_readback_device gpu(runtime);
+	gpu.gpu_latency = 0;
+	frame_readback readback;
+	std::vector<uint8_t> pixels(frame_size(runtime));
+
+	for (int i = 0; i < 3; ++i)
+	{
+		runtime.begin_frame();
+		CHECK(readback.begin(&gpu, runtime.frame, runtime.width, runtime.height, pixels.data(), [](bool) {}));
+		readback.poll(&gpu, runtime.frame);
+	}
+	CHECK_EQ(gpu.staging_created, 1u);
+
+	runtime.width = 32;
+	pixels.resize(frame_size(runtime));
+	runtime.begin_frame();
+	CHECK(readback.begin(&gpu, runtime.frame, runtime.width, runtime.height, pixels.data(), [](bool) {}));
+	readback.poll(&gpu, runtime.frame);
+	CHECK_EQ(gpu.staging_created, 2u);
+	CHECK_EQ(gpu.staging_count(), size_t(1));
+
+	readback.release(&gpu);
+	CHECK_EQ(gpu.staging_count(), size_t(0));
+}
+
+TEST(readback_is_refused_when_every_slot_is_busy)
+{
+	mock_runtime runtime;
+	mock_readback_device gpu(runtime);
+	gpu.gpu_latency = 5;
+	frame_readback readback;
+	std::vector<std::vector<uint8_t>> pixels(FRAME_READBACK_SLOTS + 1, std::vector<uint8_t>(frame_size(runtime)));
+	runtime.begin_frame();
+
+	int completions = 0;
+	for (int i = 0; i < FRAME_READBACK_SLOTS; ++i)
+		CHECK(readback.begin(&gpu, runtime.frame, runtime.width, runtime.height, pixels[i].data(), [&](bool read) { completions += read; }));
+	CHECK(!readback.begin(&gpu, runtime.frame, runtime.width, runtime.height, pixels.back().data(), [&](bool) { ++completions; }));
+	CHECK_EQ(readback.pending_count(), size_t(FRAME_READBACK_SLOTS));
+
+	for (int i = 0; i < 5; ++i)
+	{
+		runtime.begin_frame();
+		readback.poll(&gpu, runtime.frame);
+	}
+	CHECK_EQ(completions, FRAME_READBACK_SLOTS);
+	CHECK_EQ(readback.pending_count(), size_t(0));
+}
+
+TEST(readback_fails_copies_that_never_finish)
+{
+	mock_runtime runtime;
+	mock_readback_device gpu(runtime);
+	gpu.stalled = true;
+	frame_readback readback;
+	std::vector<uint8_t> pixels(frame_size(runtime));
+	runtime.begin_frame();
+
+	int failures = 0;
+	CHECK(readback.begin(&gpu, runtime.frame, runtime.width, runtime.height, pixels.data(), [&](bool read) { failures += !read; }));
+	for (int i = 0; i < FRAME_READBACK_TIMEOUT_FRAMES; ++i)
+	{
+		runtime.begin_frame();
+		readback.poll(&gpu, runtime.frame);
+	}
+	CHECK_EQ(failures, 1);
+	CHECK_EQ(gpu.read_count, 0u);
+
+	// Released copies fail too
+	CHECK(readback.begin(&gpu, runtime.frame, runtime.width, runtime.height, pixels.data(), [&](bool read) { failures += !read; }));
+	readback.release(&gpu);
+	CHECK_EQ(failures, 2);
+
+	gpu.fail_copies = true;
+	CHECK(!readback.begin(&gpu, runtime.frame, runtime.width, runtime.height, pixels.data(), [&](bool) { ++failures; }));
+	CHECK_EQ(failures, 2);
+}
+
+TEST(signature_readback_copies_only_the_sampled_rows)
+{
+	mock_runtime runtime;
+	mock_readback_device gpu(runtime);
+	gpu.gpu_latency = 1;
+	signature_readback signatures;
+	runtime.begin_frame();
+
+	std::vector<uint32_t> signature;
+	int completions = 0;
+	CHECK(signatures.begin(&gpu, runtime.frame, runtime.width, runtime.height, [&](bool read, const uint8_t *rows) {
+		++completions;
+		if (read)
+			compute_frame_signature_from_rows(rows, runtime.width, signature);
+	}));
+	std::vector<uint8_t> frame(frame_size(runtime));
+	runtime.draw_frame(frame.data());
+	std::vector<uint32_t> expected;
+	compute_frame_signature(frame.data(), runtime.width, runtime.height, expected);
+
+	runtime.begin_frame();
+	signatures.poll(&gpu, runtime.frame);
+	CHECK_EQ(completions, 1);
+	CHECK(signature == expected);
+	CHECK_EQ(gpu.row_copy_count, 1u);
+	CHECK_EQ(gpu.copy_count, 0u);
+	CHECK_EQ(runtime.capture_count, 0u);
+
+	// Its slots are its own, every capture slot stays free
+	frame_readback readback;
+	for (int i = 0; i < SIGNATURE_READBACK_SLOTS; ++i)
+		CHECK(signatures.begin(&gpu, runtime.frame, runtime.width, runtime.height, [](bool, const uint8_t *) {}));
+	CHECK(!signatures.begin(&gpu, runtime.frame, runtime.width, runtime.height, [](bool, const uint8_t *) {}));
+	std::vector<uint8_t> pixels(frame_size(runtime));
+	CHECK(readback.begin(&gpu, runtime.frame, runtime.width, runtime.height, pixels.data(), [](bool) {}));
+	readback.release(&gpu);
+	signatures.release(&gpu);
+	CHECK_EQ(gpu.staging_count(), size_t(0));
+}
@@ -0,0 +1,64 @@
+#include "test.hpp"
+#include "frame_signature.hpp"
+
+#include <cmath>
+#include <vector>
+
+static std::vector<uint8_t> solid_rgba(uint32_t width, uint32_t height, uint8_t color, uint8_t alpha)
+{
+	std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4, color);
+	for (size_t i = 3; i < pixels.size(); i += 4)
+		pixels[i] = alpha;
+	return pixels;
+}
+
+TEST(frame_signature_measures_color_change_per_channel)
+{
+	std::vector<uint32_t> a, b;
+	std::vector<uint8_t> dark = solid_rgba(640, 360, 100, 255);
+	std::vector<uint8_t> bright = solid_rgba(640, 360, 110, 255);
+	compute_frame_signature(dark.data(), 640, 360, a);
+	compute_frame_signature(bright.data(), 640, 360, b);
+	CHECK(std::fabs(compare_frame_signatures(a, b, 640) - 10.0f) < 0.01f);
+
+	// Alpha is not part of the image
+	std::vector<uint8_t> transparent = solid_rgba(640, 360, 100, 0);
+	compute_frame_signature(transparent.data(), 640, 360, b);
+	CHECK_EQ(compare_frame_signatures(a, b, 640), 0.0f);
+}
+
+TEST(frame_signature_handles_narrow_frames)
+{
+	std::vector<uint32_t> a, b;
+	for (uint32_t width : { 1u, 7u, 31u, 33u })
+	{
+		std::vector<uint8_t> dark = solid_rgba(width, 5, 20, 255);
+		std::vector<uint8_t> bright = solid_rgba(width, 5, 24, 255);
+		compute_frame_signature(dark.data(), width, 5, a);
+		compute_frame_signature(bright.data(), width, 5, b);
+		CHECK(!a.empty());
+		CHECK(std::fabs(compare_frame_signatures(a, b, width) - 4.0f) < 0.01f);
+	}
+
+	compute_frame_signature(nullptr, 0, 0, a);
+	CHECK(std::isinf(compare_frame_signatures(a, a, 0)));
+}
+
+TEST(frame_signature_from_rows_matches_the_full_frame)
+{
+	const uint32_t width = 200, height = 120;
+	std::vector<uint8_t> frame(static_cast<size_t>(width) * height * 4);
+	for (size_t i = 0; i < frame.size(); ++i)
+		frame[i] = static_cast<uint8_t>(i * 7 + i / 811);
+
+	std::vector<uint8_t> rows;
+	for (uint32_t r = 0; r < FRAME_SIGNATURE_ROWS; ++r)
+	{
+		const uint8_t *row = frame.data() + static_cast<size_t>(frame_signature_row(r, height)) * width * 4;
+		rows.insert(rows.end(), row, row + static_cast<size_t>(width) * 4);
+	}
+	std::vector<uint32_t> full, sampled;
+	compute_frame_signature(frame.data(), width, height, full);
+	compute_frame_signature_from_rows(rows.data(), width, sampled);
+	CHECK(full == sampled);
+}
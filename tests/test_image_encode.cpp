@@ -0,0 +1,129 @@
+#include "test.hpp"
+#include "image_encode.hpp"
+
+#include <cstring>
+
+// Reference decoder following the QOI specification, RGB output only
+static bool decode_qoi_rgb(const std::vector<uint8_t> &data, std::vector<uint8_t> &out, uint32_t &width, uint32_t &height)
+{
+	if (data.size() < 22 || memcmp(data.data(), "qoif", 4) != 0) return false;
+	width = (data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
+	height = (data[8] << 24) | (data[9] << 16) | (data[10] << 8) | data[11];
+
+	uint8_t index[64][4] = {};
+	uint8_t px[4] = { 0, 0, 0, 255 };
+	size_t p = 14;
+	size_t end = data.size() - 8;
+	uint32_t run = 0;
+	out.clear();
+	for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i)
+	{
+		if (run > 0)
+		{
+			--run;
+		}
+		else if (p < end)
+		{
+			uint8_t b1 = data[p++];
+			if (b1 == 0xfe)
+			{
+				px[0] = data[p++];
+				px[1] = data[p++];
+				px[2] = data[p++];
+			}
+			else if (b1 == 0xff)
+			{
+				px[0] = data[p++];
+				px[1] = data[p++];
+				px[2] = data[p++];
+				px[3] = data[p++];
+			}
+			else if ((b1 & 0xc0) == 0x00)
+			{
+				memcpy(px, index[b1], 4);
+			}
+			else if ((b1 & 0xc0) == 0x40)
+			{
+				px[0] += ((b1 >> 4) & 3) - 2;
+				px[1] += ((b1 >> 2) & 3) - 2;
+				px[2] += (b1 & 3) - 2;
+			}
+			else if ((b1 & 0xc0) == 0x80)
+			{
+				uint8_t b2 = data[p++];
+				int vg = (b1 & 0x3f) - 32;
+				px[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+				px[1] += vg;
+				px[2] += vg - 8 + (b2 & 0x0f);
+			}
+			else
+			{
+				run = b1 & 0x3f;
+			}
+			memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+		}
+		out.insert(out.end(), px, px + 3);
+	}
+	return p == end;
+}
+
+static std::vector<uint8_t> make_test_image(uint32_t width, uint32_t height)
+{
+	// Flat areas, gradients and noise to hit every QOI op
+	std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+	uint32_t state = 12345;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			uint8_t *pixel = pixels.data() + 3 * (static_cast<size_t>(y) * width + x);
+			if (y < height / 3)
+			{
+				pixel[0] = 40; pixel[1] = 80; pixel[2] = 120;
+			}
+			else if (y < 2 * height / 3)
+			{
+				pixel[0] = static_cast<uint8_t>(x); pixel[1] = static_cast<uint8_t>(x + y); pixel[2] = static_cast<uint8_t>(x * 3);
+			}
+			else
+			{
+				state = state * 1103515245 + 12345;
+				pixel[0] = static_cast<uint8_t>(state >> 16); pixel[1] = static_cast<uint8_t>(state >> 8); pixel[2] = static_cast<uint8_t>(state >> 24);
+			}
+		}
+	}
+	return pixels;
+}
+
+TEST(qoi_round_trip)
+{
+	std::vector<uint8_t> pixels = make_test_image(257, 90);
+	std::vector<uint8_t> encoded;
+	CHECK(encode_qoi_rgb(pixels.data(), 257, 90, encoded));
+
+	std::vector<uint8_t> decoded;
+	uint32_t width = 0, height = 0;
+	CHECK(decode_qoi_rgb(encoded, decoded, width, height));
+	CHECK_EQ(width, 257u);
+	CHECK_EQ(height, 90u);
+	CHECK(decoded == pixels);
+	CHECK(encoded.size() < pixels.size());
+}
+
+TEST(bmp_round_trip)
+{
+	// Odd width needs row padding
+	std::vector<uint8_t> pixels = make_test_image(33, 7);
+	std::vector<uint8_t> encoded;
+	CHECK(encode_bmp_rgb(pixels.data(), 33, 7, encoded));
+	CHECK_EQ(encoded.size(), size_t(54 + 100 * 7));
+
+	std::vector<uint8_t> decoded;
+	uint32_t width = 0, height = 0;
+	CHECK(decode_bmp_rgb(encoded.data(), encoded.size(), decoded, width, height));
+	CHECK_EQ(width, 33u);
+	CHECK_EQ(height, 7u);
+	CHECK(decoded == pixels);
+
+	CHECK(!decode_bmp_rgb(encoded.data(), encoded.size() - 1, decoded, width, height));
+}
@@ -0,0 +1,150 @@
+#include "test.hpp"
+#include "ini_file.hpp"
+
+#include <fstream>
+#include <iterator>
+
+static void write_file(const std::filesystem::path &path, const std::string &content)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file << content;
+}
+
+static std::string read_file(const std::filesystem::path &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static preset_keybind make_keybind(const char *preset, unsigned int key, bool ctrl, keybind_action action)
+{
+	preset_keybind pkb = {};
+	pkb.preset = preset;
+	pkb.keybind[0] = key;
+	pkb.keybind[1] = ctrl;
+	pkb.action = action;
+	return pkb;
+}
+
+TEST(ini_round_trip)
+{
+	std::filesystem::path config_path = test_temp_directory() / "preset_selector.ini";
+	std::vector<preset_keybind> keybinds = {
+		make_keybind("presets/a.ini", 0x41, false, change_preset),
+		make_keybind("presets/b.ini", 0x42, true, take_screenshot),
+		make_keybind("presets/c.ini", 0, false, capture_all_presets),
+		make_keybind("presets/d.ini", 0x44, false, capture_burst),
+	};
+	addon_settings settings;
+	settings.settle_min_frames = 3;
+	settings.settle_max_frames = 45;
+	settings.settle_threshold = 1.25f;
+	settings.fast_preset_switch = true;
+	settings.capture_format = format_qoi;
+	settings.convert_bmp_to_png = true;
+	settings.burst_frame_count = 12;
+	settings.burst_memory_budget_mb = 256;
+	settings.burst_overflow = burst_wait_for_encoder;
+	settings.duplicate_frames = duplicate_hard_link;
+	settings.contact_sheet = contact_sheet_only;
+	settings.contact_sheet_cell_width = 320;
+	settings.comparison_archive = true;
+	settings.write_mode = write_direct_sync;
+	settings.warm_up_on_load = true;
+	CHECK(save_config(config_path, keybinds, settings));
+
+	std::vector<preset_keybind> loaded_keybinds;
+	addon_settings loaded_settings;
+	CHECK(load_preset_keybinds(config_path, loaded_keybinds));
+	CHECK(load_addon_settings(config_path, loaded_settings));
+
+	CHECK_EQ(loaded_keybinds.size(), keybinds.size());
+	for (size_t i = 0; i < loaded_keybinds.size() && i < keybinds.size(); ++i)
+	{
+		CHECK(loaded_keybinds[i].preset == keybinds[i].preset);
+		for (int k = 0; k < 4; ++k)
+			CHECK_EQ(loaded_keybinds[i].keybind[k], keybinds[i].keybind[k]);
+		CHECK_EQ(loaded_keybinds[i].action, keybinds[i].action);
+	}
+	CHECK_EQ(loaded_settings.settle_min_frames, 3u);
+	CHECK_EQ(loaded_settings.settle_max_frames, 45u);
+	CHECK_EQ(loaded_settings.settle_threshold, 1.25f);
+	CHECK(loaded_settings.fast_preset_switch);
+	CHECK_EQ(loaded_settings.capture_format, format_qoi);
+	CHECK(loaded_settings.convert_bmp_to_png);
+	CHECK_EQ(loaded_settings.burst_frame_count, 12u);
+	CHECK_EQ(loaded_settings.burst_memory_budget_mb, 256u);
+	CHECK_EQ(loaded_settings.burst_overflow, burst_wait_for_encoder);
+	CHECK_EQ(loaded_settings.duplicate_frames, duplicate_hard_link);
+	CHECK_EQ(loaded_settings.contact_sheet, contact_sheet_only);
+	CHECK_EQ(loaded_settings.contact_sheet_cell_width, 320u);
+	CHECK(loaded_settings.comparison_archive);
+	CHECK_EQ(loaded_settings.write_mode, write_direct_sync);
+	CHECK(loaded_settings.warm_up_on_load);
+	CHECK(!std::filesystem::exists(config_path.string() + ".tmp"));
+}
+
+TEST(ini_save_keeps_other_sections)
+{
+	std::filesystem::path config_path = test_temp_directory() / "preset_selector.ini";
+	write_file(config_path,
+		"; comment\n"
+		"[Other]\n"
+		"Key = Value\n"
+		"\n"
+		"[PresetKeybinds]\n"
+		"Preset_0=old.ini\n"
+		"Keybind_0=65,0,0,0\n"
+		"Action_0=0\n"
+		"\n"
+		"[Trailing]\n"
+		"Flag=1\n");
+
+	std::vector<preset_keybind> keybinds = { make_keybind("new.ini", 0x4E, false, change_preset) };
+	addon_settings settings;
+	CHECK(save_config(config_path, keybinds, settings));
+
+	std::string content = read_file(config_path);
+	CHECK(content.find("; comment\n[Other]\nKey = Value\n") == 0);
+	CHECK(content.find("[Trailing]\nFlag=1\n") != std::string::npos);
+	CHECK(content.find("old.ini") == std::string::npos);
+
+	std::vector<preset_keybind> loaded;
+	CHECK(load_preset_keybinds(config_path, loaded));
+	CHECK_EQ(loaded.size(), size_t(1));
+	if (!loaded.empty())
+		CHECK(loaded[0].preset == "new.ini");
+}
+
+TEST(ini_skips_malformed_entries)
+{
+	std::filesystem::path config_path = test_temp_directory() / "preset_selector.ini";
+	write_file(config_path,
+		"\xEF\xBB\xBF[PresetKeybinds]\r\n"
+		"Preset_1=second.ini\r\n"
+		"Keybind_1=1,2,3\r\n"
+		"Preset_0=first.ini\r\n"
+		"Action_0=99\r\n"
+		"garbage\r\n"
+		"Unknown_0=1\r\n"
+		"Keybind_2=65,0,0,0\r\n"
+		"[Settings]\r\n"
+		"SettleMinFrames=abc\r\n"
+		"SettleMaxFrames=12\r\n");
+
+	std::vector<preset_keybind> loaded;
+	CHECK(load_preset_keybinds(config_path, loaded));
+	CHECK_EQ(loaded.size(), size_t(2));
+	if (loaded.size() == 2)
+	{
+		CHECK(loaded[0].preset == "first.ini");
+		CHECK_EQ(loaded[0].action, change_preset);
+		CHECK(loaded[1].preset == "second.ini");
+		CHECK_EQ(loaded[1].keybind[0], 0u);
+	}
+
+	addon_settings settings;
+	CHECK(load_addon_settings(config_path, settings));
+	CHECK_EQ(settings.settle_min_frames, addon_settings().settle_min_frames);
+	CHECK_EQ(settings.settle_max_frames, 12u);
+}
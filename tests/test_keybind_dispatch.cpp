@@ -0,0 +1,79 @@
+#include "test.hpp"
+#include "mock_runtime.hpp"
+#include "keybind_dispatch.hpp"
+
+static preset_keybind make_keybind(const char *preset, unsigned int key, bool ctrl, bool shift, bool alt)
+{
+	preset_keybind pkb = {};
+	pkb.preset = preset;
+	pkb.keybind[0] = key;
+	pkb.keybind[1] = ctrl;
+	pkb.keybind[2] = shift;
+	pkb.keybind[3] = alt;
+	pkb.action = change_preset;
+	return pkb;
+}
+
+static std::vector<std::string> poll(const keybind_dispatch_index &index, mock_runtime &runtime)
+{
+	std::vector<std::string> fired;
+	runtime.begin_frame();
+	poll_keybinds(index, &runtime, [&fired](const keybind_dispatch_entry &entry) {
+		fired.push_back(entry.preset_utf8);
+	});
+	return fired;
+}
+
+TEST(keybind_dispatch_matches_modifiers_exactly)
+{
+	std::vector<preset_keybind> keybinds = {
+		make_keybind("plain.ini", 0x41, false, false, false),
+		make_keybind("ctrl.ini", 0x41, true, false, false),
+		make_keybind("ctrl_shift.ini", 0x41, true, true, false),
+		make_keybind("unbound.ini", 0, false, false, false),
+	};
+	keybind_dispatch_index index;
+	build_keybind_dispatch_index(keybinds, index);
+	CHECK_EQ(index.keycodes.size(), size_t(1));
+
+	mock_runtime runtime;
+	CHECK(poll(index, runtime).empty());
+
+	runtime.press_key(0x41);
+	std::vector<std::string> fired = poll(index, runtime);
+	CHECK_EQ(fired.size(), size_t(1));
+	CHECK(!fired.empty() && fired[0] == "plain.ini");
+
+	runtime.hold_key(0x11);
+	runtime.press_key(0x41);
+	fired = poll(index, runtime);
+	CHECK(fired.size() == 1 && fired[0] == "ctrl.ini");
+
+	runtime.hold_key(0x10);
+	runtime.press_key(0x41);
+	fired = poll(index, runtime);
+	CHECK(fired.size() == 1 && fired[0] == "ctrl_shift.ini");
+
+	// Alt is not part of any binding
+	runtime.hold_key(0x12);
+	runtime.press_key(0x41);
+	CHECK(poll(index, runtime).empty());
+}
+
+TEST(keybind_dispatch_keeps_list_order_for_shared_keys)
+{
+	std::vector<preset_keybind> keybinds = {
+		make_keybind("first.ini", 0x70, false, false, false),
+		make_keybind("other.ini", 0x71, false, false, false),
+		make_keybind("second.ini", 0x70, false, false, false),
+	};
+	keybind_dispatch_index index;
+	build_keybind_dispatch_index(keybinds, index);
+
+	mock_runtime runtime;
+	runtime.schedule(2, [](mock_runtime &rt) { rt.press_key(0x70); });
+	CHECK(poll(index, runtime).empty());
+	std::vector<std::string> fired = poll(index, runtime);
+	CHECK(fired.size() == 2 && fired[0] == "first.ini" && fired[1] == "second.ini");
+	CHECK(poll(index, runtime).empty());
+}
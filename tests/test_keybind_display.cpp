@@ -0,0 +1,60 @@
+#include "test.hpp"
+#include "keybind_display.hpp"
+
+#include <vector>
+
+static size_t g_key_names;
+
+static std::string test_key_name(const unsigned int key[4])
+{
+	++g_key_names;
+	return (key[1] ? "Ctrl + " : std::string()) + static_cast<char>(key[0]);
+}
+
+static preset_keybind make_keybind(const char *preset, unsigned int keycode)
+{
+	preset_keybind pkb = {};
+	pkb.preset = std::filesystem::u8path(preset);
+	pkb.keybind[0] = keycode;
+	pkb.keybind[1] = 1;
+	pkb.action = capture_burst;
+	return pkb;
+}
+
+TEST(keybind_display_shortens_preset_paths)
+{
+	preset_keybind pkb = make_keybind("presets/Short.ini", 'A');
+	update_keybind_display(pkb, &test_key_name);
+	CHECK(pkb.display_valid);
+	CHECK_EQ(pkb.preset_display, std::string("presets/Short.ini"));
+	CHECK_EQ(pkb.keybind_display, std::string("Ctrl + A | Capture Burst"));
+
+	// The cut lands inside the two-byte "\xc3\xa9" and moves past it
+	pkb = make_keybind("presets/some/long/folder/\xc3\xa9" "cdefghijklmnopqrstuvwxyz0.ini", 'B');
+	update_keybind_display(pkb, &test_key_name);
+	CHECK_EQ(pkb.preset_display, std::string("...cdefghijklmnopqrstuvwxyz0.ini"));
+
+	pkb = {};
+	update_keybind_display(pkb, &test_key_name);
+	CHECK_EQ(pkb.preset_display, std::string("None"));
+	CHECK(pkb.keybind_display.empty());
+}
+
+TEST(keybind_display_rebuilds_only_visible_invalid_rows)
+{
+	std::vector<preset_keybind> keybinds;
+	for (int i = 0; i < 100; ++i)
+		keybinds.push_back(make_keybind(("preset_" + std::to_string(i) + ".ini").c_str(), 'A' + i % 26));
+
+	g_key_names = 0;
+	CHECK_EQ(prepare_keybind_rows(keybinds, 10, 25, &test_key_name), size_t(15));
+	CHECK_EQ(g_key_names, size_t(15));
+	CHECK(!keybinds[9].display_valid && keybinds[10].display_valid && keybinds[24].display_valid && !keybinds[25].display_valid);
+
+	// Cached rows cost nothing on the next frame
+	CHECK_EQ(prepare_keybind_rows(keybinds, 10, 25, &test_key_name), size_t(0));
+	keybinds[12].display_valid = false;
+	CHECK_EQ(prepare_keybind_rows(keybinds, 10, 25, &test_key_name), size_t(1));
+	// Ranges past the end are clamped
+	CHECK_EQ(prepare_keybind_rows(keybinds, 95, 120, &test_key_name), size_t(5));
+}
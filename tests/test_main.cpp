@@ -0,0 +1,71 @@
+#include "test.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+struct test_case {
+	const char *name;
+	test_function function;
+};
+
+static std::vector<test_case> &get_tests()
+{
+	static std::vector<test_case> tests;
+	return tests;
+}
+
+static int g_failures;
+static std::filesystem::path g_temp_directory;
+
+test_registration::test_registration(const char *name, test_function function)
+{
+	get_tests().push_back({ name, function });
+}
+
+void report_test_failure(const char *file, int line, const std::string &message)
+{
+	fprintf(stderr, "  %s:%d: CHECK failed: %s\n", file, line, message.c_str());
+	++g_failures;
+}
+
+std::filesystem::path test_temp_directory()
+{
+	if (g_temp_directory.empty())
+	{
+		static int counter;
+		g_temp_directory = std::filesystem::temp_directory_path() / ("preset_selector_tests_" + std::to_string(++counter));
+		std::filesystem::remove_all(g_temp_directory);
+		std::filesystem::create_directories(g_temp_directory);
+	}
+	return g_temp_directory;
+}
+
+// Runs every test, or only those whose name contains the first argument
+int main(int argc, char **argv)
+{
+	const char *filter = argc > 1 ? argv[1] : "";
+	int failed_tests = 0;
+	int run_tests = 0;
+	for (auto& test : get_tests())
+	{
+		if (strstr(test.name, filter) == nullptr) continue;
+
+		int failures = g_failures;
+		printf("%s\n", test.name);
+		test.function();
+		++run_tests;
+		if (g_failures != failures)
+			++failed_tests;
+
+		if (!g_temp_directory.empty())
+		{
+			std::error_code ec;
+			std::filesystem::remove_all(g_temp_directory, ec);
+			g_temp_directory.clear();
+		}
+	}
+
+	printf("%d of %d tests passed\n", run_tests - failed_tests, run_tests);
+	return failed_tests == 0 ? 0 : 1;
+}
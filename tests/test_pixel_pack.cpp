@@ -0,0 +1,48 @@
+#include "test.hpp"
+#include "pixel_pack.hpp"
+#include "png_encode.hpp"
+
+#include <algorithm>
+#include <vector>
+
+TEST(pixel_pack_drops_alpha)
+{
+	// Every kernel the CPU has, not only the one init_pixel_pack picks
+	for (auto kernel : pixel_pack_kernels)
+	{
+		if (!set_pixel_pack_kernel(kernel))
+			continue;
+		CHECK_EQ(get_pixel_pack_kernel(), kernel);
+
+		// Odd lengths exercise the vector loops and the scalar tail
+		for (size_t pixel_count : { 1, 3, 7, 15, 33, 100, 1027 })
+		{
+			std::vector<uint8_t> pixels(pixel_count * 4);
+			for (size_t i = 0; i < pixels.size(); ++i)
+				pixels[i] = static_cast<uint8_t>(i * 7 + 3);
+			std::vector<uint8_t> expected;
+			for (size_t i = 0; i < pixel_count; ++i)
+				expected.insert(expected.end(), pixels.begin() + 4 * i, pixels.begin() + 4 * i + 3);
+
+			pack_rgba_to_rgb(pixels.data(), pixel_count);
+			pixels.resize(pixel_count * 3);
+			CHECK(pixels == expected);
+		}
+	}
+
+	CHECK(set_pixel_pack_kernel(pack_kernel_scalar));
+	init_pixel_pack();
+}
+
+TEST(png_encode_writes_png_signature)
+{
+	init_png_encode();
+
+	std::vector<uint8_t> pixels(64 * 32 * 3);
+	for (size_t i = 0; i < pixels.size(); ++i)
+		pixels[i] = static_cast<uint8_t>(i);
+	std::vector<uint8_t> encoded;
+	CHECK(encode_png_rgb(pixels.data(), 64, 32, encoded));
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	CHECK(encoded.size() > sizeof(signature) && std::equal(signature, signature + sizeof(signature), encoded.begin()));
+}
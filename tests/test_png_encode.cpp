@@ -0,0 +1,247 @@
+#include "test.hpp"
+#include "png_encode.hpp"
+#include "deflate.hpp"
+
+#include <cstring>
+#include <vector>
+
+// zlib is the reference decoder when the build found it, otherwise only the
+// container (chunk CRCs, IDAT layout) is checked
+#ifdef PRESET_SELECTOR_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static uint32_t read_be32(const uint8_t *p)
+{
+	return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+// Decodes 8-bit RGB PNGs, idat_chunks counts the IDAT chunks seen
+static bool decode_png_rgb(const std::vector<uint8_t> &data, std::vector<uint8_t> &out, uint32_t &width, uint32_t &height, size_t &idat_chunks)
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if (data.size() < 8 || memcmp(data.data(), signature, 8) != 0) return false;
+
+	std::vector<uint8_t> idat;
+	idat_chunks = 0;
+	bool ended = false;
+	for (size_t p = 8; p + 12 <= data.size() && !ended;)
+	{
+		uint32_t length = read_be32(data.data() + p);
+		if (p + 12 + length > data.size()) return false;
+		const uint8_t *type = data.data() + p + 4;
+		const uint8_t *chunk = type + 4;
+#ifdef PRESET_SELECTOR_HAVE_ZLIB
+		if (crc32(0, type, length + 4) != read_be32(chunk + length)) return false;
+#endif
+		if (memcmp(type, "IHDR", 4) == 0)
+		{
+			width = read_be32(chunk);
+			height = read_be32(chunk + 4);
+			if (chunk[8] != 8 || chunk[9] != 2) return false;
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+		{
+			idat.insert(idat.end(), chunk, chunk + length);
+			++idat_chunks;
+		}
+		else if (memcmp(type, "IEND", 4) == 0)
+		{
+			ended = true;
+		}
+		p += 12 + length;
+	}
+	if (!ended) return false;
+
+#ifdef PRESET_SELECTOR_HAVE_ZLIB
+	size_t stride = static_cast<size_t>(width) * 3;
+	std::vector<uint8_t> filtered((stride + 1) * height);
+	uLongf filtered_size = static_cast<uLongf>(filtered.size());
+	if (uncompress(filtered.data(), &filtered_size, idat.data(), static_cast<uLong>(idat.size())) != Z_OK || filtered_size != filtered.size())
+		return false;
+
+	out.assign(stride * height, 0);
+	std::vector<uint8_t> zero_row(stride, 0);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		uint8_t filter = filtered[y * (stride + 1)];
+		const uint8_t *src = filtered.data() + y * (stride + 1) + 1;
+		uint8_t *row = out.data() + y * stride;
+		const uint8_t *above = y > 0 ? row - stride : zero_row.data();
+		for (size_t i = 0; i < stride; ++i)
+		{
+			uint8_t left = i >= 3 ? row[i - 3] : 0;
+			uint8_t upper_left = i >= 3 ? above[i - 3] : 0;
+			switch (filter)
+			{
+			case 0: row[i] = src[i]; break;
+			case 1: row[i] = src[i] + left; break;
+			case 2: row[i] = src[i] + above[i]; break;
+			case 3: row[i] = src[i] + ((left + above[i]) >> 1); break;
+			case 4: row[i] = src[i] + paeth(left, above[i], upper_left); break;
+			default: return false;
+			}
+		}
+	}
+#else
+	out.clear();
+#endif
+	return true;
+}
+
+static std::vector<uint8_t> make_png_test_image(uint32_t width, uint32_t height)
+{
+	// Flat band, gradient and noise so strips see both long matches and literals
+	std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+	uint32_t state = 7;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			uint8_t *pixel = pixels.data() + 3 * (static_cast<size_t>(y) * width + x);
+			state = state * 1103515245 + 12345;
+			if (y % 64 < 16)
+			{
+				pixel[0] = 10; pixel[1] = 20; pixel[2] = 30;
+			}
+			else if (y % 64 < 40)
+			{
+				pixel[0] = static_cast<uint8_t>(x); pixel[1] = static_cast<uint8_t>(y); pixel[2] = static_cast<uint8_t>(x ^ y);
+			}
+			else
+			{
+				pixel[0] = static_cast<uint8_t>(state >> 16); pixel[1] = static_cast<uint8_t>(state >> 8); pixel[2] = static_cast<uint8_t>(state >> 24);
+			}
+		}
+	}
+	return pixels;
+}
+
+static void check_png_round_trip(const std::vector<uint8_t> &pixels, uint32_t width, uint32_t height, uint32_t threads, size_t expected_strips)
+{
+	std::vector<uint8_t> encoded;
+	CHECK(encode_png_rgb_strips(pixels.data(), width, height, encoded, threads));
+
+	std::vector<uint8_t> decoded;
+	uint32_t decoded_width = 0, decoded_height = 0;
+	size_t idat_chunks = 0;
+	CHECK(decode_png_rgb(encoded, decoded, decoded_width, decoded_height, idat_chunks));
+	CHECK_EQ(decoded_width, width);
+	CHECK_EQ(decoded_height, height);
+	// One chunk per strip plus the zlib trailer
+	CHECK_EQ(idat_chunks, expected_strips + 1);
+#ifdef PRESET_SELECTOR_HAVE_ZLIB
+	CHECK(decoded == pixels);
+#endif
+}
+
+TEST(png_strips_round_trip)
+{
+	// 1.9 MB of filtered rows is enough for 7 strips of the minimum size
+	std::vector<uint8_t> pixels = make_png_test_image(1000, 640);
+	for (uint32_t threads : { 1u, 2u, 3u, 8u })
+		check_png_round_trip(pixels, 1000, 640, threads, threads == 8 ? 7 : threads);
+	shutdown_png_workers(false);
+}
+
+TEST(png_strips_small_images)
+{
+	std::vector<uint8_t> pixels = make_png_test_image(1, 1);
+	check_png_round_trip(pixels, 1, 1, 8, 1);
+
+	// A single flat color leaves a block with one literal and one distance
+	std::vector<uint8_t> flat(300 * 2 * 3, 0x55);
+	check_png_round_trip(flat, 300, 2, 8, 1);
+
+	std::vector<uint8_t> encoded;
+	CHECK(!encode_png_rgb_strips(pixels.data(), 0, 1, encoded));
+	shutdown_png_workers(false);
+}
+
+TEST(deflate_adler32_combine_matches_single_pass)
+{
+	std::vector<uint8_t> data = make_png_test_image(200, 50);
+	uint32_t whole = deflate_adler32(1, data.data(), data.size());
+	for (size_t split : { size_t(0), size_t(1), size_t(5552), data.size() / 2, data.size() })
+	{
+		uint32_t first = deflate_adler32(1, data.data(), split);
+		uint32_t second = deflate_adler32(1, data.data() + split, data.size() - split);
+		CHECK_EQ(deflate_adler32_combine(first, second, data.size() - split), whole);
+	}
+#ifdef PRESET_SELECTOR_HAVE_ZLIB
+	CHECK_EQ(whole, static_cast<uint32_t>(adler32(1, data.data(), static_cast<uInt>(data.size()))));
+#endif
+}
+
+TEST(inflate_reads_deflate_output)
+{
+	std::vector<uint8_t> data = make_png_test_image(300, 200);
+	// Two independent chunks joined like the strip encoder does, then the whole thing
+	std::vector<uint8_t> compressed;
+	deflate_chunk(data.data(), data.size() / 3, false, compressed);
+	deflate_chunk(data.data() + data.size() / 3, data.size() - data.size() / 3, true, compressed);
+
+	std::vector<uint8_t> inflated;
+	CHECK(inflate_raw(compressed.data(), compressed.size(), inflated));
+	CHECK(inflated == data);
+
+	// Output past the limit and truncated input are refused
+	inflated.clear();
+	CHECK(!inflate_raw(compressed.data(), compressed.size(), inflated, data.size() - 1));
+	inflated.clear();
+	CHECK(!inflate_raw(compressed.data(), compressed.size() / 2, inflated));
+
+	std::vector<uint8_t> empty_stream;
+	deflate_chunk(nullptr, 0, true, empty_stream);
+	inflated.clear();
+	CHECK(inflate_raw(empty_stream.data(), empty_stream.size(), inflated));
+	CHECK(inflated.empty());
+
+#ifdef PRESET_SELECTOR_HAVE_ZLIB
+	// Stored, fixed and dynamic blocks as zlib writes them
+	for (int level : { 0, 1, 9 })
+	{
+		uLongf size = compressBound(static_cast<uLong>(data.size()));
+		std::vector<uint8_t> zlib_stream(size);
+		CHECK_EQ(compress2(zlib_stream.data(), &size, data.data(), static_cast<uLong>(data.size()), level), Z_OK);
+		inflated.clear();
+		CHECK(inflate_raw(zlib_stream.data() + 2, size - 6, inflated));
+		CHECK(inflated == data);
+	}
+	const uint8_t short_text[] = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+	uLongf size = 128;
+	std::vector<uint8_t> zlib_stream(size);
+	CHECK_EQ(compress2(zlib_stream.data(), &size, short_text, sizeof(short_text), 9), Z_OK);
+	inflated.clear();
+	CHECK(inflate_raw(zlib_stream.data() + 2, size - 6, inflated));
+	CHECK(inflated == std::vector<uint8_t>(short_text, short_text + sizeof(short_text)));
+#endif
+}
+
+TEST(png_decode_reads_encoder_output)
+{
+	init_png_encode();
+	std::vector<uint8_t> pixels = make_png_test_image(333, 120);
+	std::vector<uint8_t> encoded;
+	CHECK(encode_png_rgb(pixels.data(), 333, 120, encoded));
+
+	std::vector<uint8_t> decoded;
+	uint32_t width = 0, height = 0;
+	CHECK(decode_png_rgb(encoded.data(), encoded.size(), decoded, width, height));
+	CHECK_EQ(width, 333u);
+	CHECK_EQ(height, 120u);
+	CHECK(decoded == pixels);
+
+	// A flipped byte in the pixel data fails the checksum
+	encoded[encoded.size() / 2] ^= 0x40;
+	CHECK(!decode_png_rgb(encoded.data(), encoded.size(), decoded, width, height));
+	CHECK(!decode_png_rgb(encoded.data(), 8, decoded, width, height));
+	shutdown_png_workers(false);
+}
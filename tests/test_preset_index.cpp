@@ -0,0 +1,129 @@
+#include "test.hpp"
+#include "preset_index.hpp"
+#include "thumbnail_atlas.hpp"
+
+#include <fstream>
+
+static void write_file(const std::filesystem::path &path, const char *content)
+{
+	std::filesystem::create_directories(path.parent_path());
+	std::ofstream(path, std::ios::binary | std::ios::trunc) << content;
+}
+
+static void scan_now(preset_index &index)
+{
+	index.request_rescan();
+	index.update();
+	index.wait_for_scan();
+}
+
+static bool contains(const preset_index_snapshot &snapshot, const std::filesystem::path &path)
+{
+	for (auto& entry : snapshot)
+	{
+		if (entry.path == path)
+			return true;
+	}
+	return false;
+}
+
+TEST(preset_index_lists_presets_within_depth)
+{
+	std::filesystem::path root = test_temp_directory();
+	std::filesystem::path shallow = root / "Shallow.ini";
+	std::filesystem::path folder = root;
+	for (int i = 0; i < PRESET_INDEX_MAX_DEPTH; ++i)
+		folder /= "level_" + std::to_string(i);
+	std::filesystem::path deepest = folder / "Deepest.ini";
+	std::filesystem::path too_deep = folder / "one_more" / "TooDeep.ini";
+	write_file(shallow, "Techniques=Bloom@Bloom.fx,Tonemap@Tonemap.fx\n");
+	write_file(deepest, "Techniques=Bloom@Bloom.fx\n");
+	write_file(too_deep, "Techniques=Bloom@Bloom.fx\n");
+	write_file(root / "notes.txt", "not a preset\n");
+	write_file(root / "shot.png", "Techniques=Bloom@Bloom.fx\n");
+
+	preset_index index;
+	index.set_roots({ root });
+	index.update();
+	index.wait_for_scan();
+
+	std::shared_ptr<const preset_index_snapshot> snapshot = index.snapshot();
+	CHECK(snapshot != nullptr);
+	if (snapshot == nullptr) return;
+	CHECK_EQ(snapshot->size(), size_t(2));
+	CHECK(contains(*snapshot, shallow));
+	CHECK(contains(*snapshot, deepest));
+	CHECK(!contains(*snapshot, too_deep));
+	for (auto& entry : *snapshot)
+	{
+		if (entry.path == shallow)
+		{
+			CHECK_EQ(entry.techniques.size(), size_t(2));
+			CHECK(entry.search_key.find("shallow.ini") != std::string::npos);
+		}
+	}
+	index.shutdown(false);
+}
+
+TEST(preset_index_rescans_only_changed_files)
+{
+	std::filesystem::path root = test_temp_directory();
+	std::filesystem::path preset = root / "A.ini";
+	std::filesystem::path other = root / "B.txt";
+	write_file(preset, "Techniques=Bloom@Bloom.fx\n");
+	write_file(other, "[Not a preset]\n");
+
+	preset_index index;
+	index.set_roots({ root });
+	index.update();
+	index.wait_for_scan();
+	uint32_t generation = index.generation();
+	CHECK_EQ(index.snapshot()->size(), size_t(1));
+
+	// Nothing changed, the rejected file is not parsed again either, so no
+	// new snapshot is published
+	scan_now(index);
+	CHECK_EQ(index.generation(), generation);
+
+	// The rejected file became a preset
+	write_file(other, "Techniques=Bloom@Bloom.fx,Tonemap@Tonemap.fx\n");
+	scan_now(index);
+	CHECK(index.generation() != generation);
+	CHECK(contains(*index.snapshot(), other));
+
+	// Removed files drop out
+	generation = index.generation();
+	std::filesystem::remove(preset);
+	scan_now(index);
+	CHECK(index.generation() != generation);
+	CHECK_EQ(index.snapshot()->size(), size_t(1));
+	CHECK(!contains(*index.snapshot(), preset));
+	index.shutdown(false);
+}
+
+TEST(preset_index_finds_entries_with_their_content_hash)
+{
+	std::filesystem::path root = test_temp_directory();
+	std::filesystem::path preset = root / "Sub" / "Sharpen.ini";
+	write_file(root / "A.ini", "Techniques=Bloom@Bloom.fx\n");
+	write_file(preset, "Techniques=LumaSharpen@LumaSharpen.fx\n");
+
+	preset_index index;
+	index.set_roots({ root });
+	scan_now(index);
+	std::shared_ptr<const preset_index_snapshot> snapshot = index.snapshot();
+	const preset_index_entry *entry = find_preset_index_entry(*snapshot, preset);
+	CHECK(entry != nullptr);
+	if (entry == nullptr) return;
+	// Thumbnails are looked up with this hash instead of reading the file
+	CHECK_EQ(entry->content_hash, hash_preset_file(preset));
+	CHECK(find_preset_index_entry(*snapshot, root / "Missing.ini") == nullptr);
+
+	// An edit is hashed again by the next scan
+	write_file(preset, "Techniques=LumaSharpen@LumaSharpen.fx,Vignette@Vignette.fx\n");
+	scan_now(index);
+	snapshot = index.snapshot();
+	entry = find_preset_index_entry(*snapshot, preset);
+	CHECK(entry != nullptr && entry->content_hash == hash_preset_file(preset));
+	index.shutdown(false);
+}
@@ -0,0 +1,83 @@
+#include "test.hpp"
+#include "mock_runtime.hpp"
+#include "preset_switch.hpp"
+
+#include <fstream>
+
+static std::filesystem::path write_preset(const char *name, const std::string &content)
+{
+	std::filesystem::path path = test_temp_directory() / name;
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file << content;
+	return path;
+}
+
+TEST(preset_switch_applies_uniform_diff)
+{
+	std::filesystem::path from = write_preset("from.ini",
+		"Techniques=Tonemap@Tonemap.fx\n"
+		"[Tonemap.fx]\n"
+		"Exposure=1.000000\n"
+		"Mode=1\n"
+		"Enabled=1\n");
+	std::filesystem::path to = write_preset("to.ini",
+		"Techniques=Tonemap@Tonemap.fx\n"
+		"[Tonemap.fx]\n"
+		"Exposure=0.500000\n"
+		"Mode=3\n"
+		"Enabled=1\n");
+
+	mock_runtime runtime;
+	preset_switch_state state;
+	runtime.current_preset = from;
+	runtime.add_uniform("Tonemap.fx", "Exposure", uniform_base_type::float32);
+	runtime.add_uniform("Tonemap.fx", "Mode", uniform_base_type::int32);
+	runtime.add_uniform("Tonemap.fx", "Enabled", uniform_base_type::boolean);
+
+	CHECK(switch_preset(&runtime, state, to, to.u8string(), true));
+	CHECK(runtime.preset_switches.empty());
+	const mock_uniform *exposure = runtime.find_uniform("Tonemap.fx", "Exposure");
+	const mock_uniform *mode = runtime.find_uniform("Tonemap.fx", "Mode");
+	const mock_uniform *enabled = runtime.find_uniform("Tonemap.fx", "Enabled");
+	CHECK(exposure->values.size() == 1 && exposure->values[0] == 0.5);
+	CHECK(mode->values.size() == 1 && mode->values[0] == 3.0);
+	// Unchanged values are not written
+	CHECK(enabled->values.empty());
+
+	// Back to the preset ReShade still reports
+	CHECK(switch_preset(&runtime, state, from, from.u8string(), true));
+	CHECK(exposure->values.size() == 1 && exposure->values[0] == 1.0);
+}
+
+TEST(preset_switch_reloads_when_techniques_differ)
+{
+	std::filesystem::path from = write_preset("from.ini",
+		"Techniques=Tonemap@Tonemap.fx\n"
+		"[Tonemap.fx]\n"
+		"Exposure=1.000000\n");
+	std::filesystem::path to = write_preset("to.ini",
+		"Techniques=Bloom@Bloom.fx,Tonemap@Tonemap.fx\n"
+		"[Tonemap.fx]\n"
+		"Exposure=1.000000\n");
+
+	mock_runtime runtime;
+	preset_switch_state state;
+	runtime.current_preset = from;
+	runtime.add_uniform("Tonemap.fx", "Exposure", uniform_base_type::float32);
+
+	CHECK(!switch_preset(&runtime, state, to, to.u8string(), true));
+	CHECK_EQ(runtime.preset_switches.size(), size_t(1));
+	CHECK(runtime.current_preset == to);
+}
+
+TEST(preset_switch_reloads_without_uniform_diff)
+{
+	std::filesystem::path from = write_preset("from.ini", "Techniques=Tonemap@Tonemap.fx\n");
+	std::filesystem::path to = write_preset("to.ini", "Techniques=Tonemap@Tonemap.fx\n");
+
+	mock_runtime runtime;
+	preset_switch_state state;
+	runtime.current_preset = from;
+	CHECK(!switch_preset(&runtime, state, to, to.u8string(), false));
+	CHECK_EQ(runtime.preset_switches.size(), size_t(1));
+}
@@ -0,0 +1,41 @@
+#include "test.hpp"
+#include "profiler.hpp"
+
+#include <string>
+#include <vector>
+
+TEST(profiler_stats_group_scopes_by_name)
+{
+	// Two copies of the same text, like one literal used from two modules
+	static const char decode[] = "decode";
+	static const char decode_copy[] = "decode";
+	static const char encode[] = "encode";
+	profiler_record(encode, 0, 4000000);
+	profiler_record(decode, 0, 1000000);
+	profiler_record(decode_copy, 0, 3000000);
+	profiler_record(decode, 0, 2000000);
+	profiler_collect();
+
+	std::vector<profile_stats> stats;
+	profiler_get_stats(stats);
+	CHECK_EQ(stats.size(), size_t(2));
+	CHECK_EQ(std::string(stats[0].name), std::string("decode"));
+	CHECK_EQ(stats[0].count, 3u);
+	CHECK_EQ(stats[0].p50_ms, 2.0);
+	CHECK_EQ(stats[0].max_ms, 3.0);
+	CHECK_EQ(std::string(stats[1].name), std::string("encode"));
+	CHECK_EQ(stats[1].count, 1u);
+
+	// Nothing new was collected, the same stats come back
+	profiler_collect();
+	std::vector<profile_stats> again;
+	profiler_get_stats(again);
+	CHECK_EQ(again.size(), size_t(2));
+	CHECK_EQ(again[0].count, 3u);
+
+	profiler_record(decode_copy, 0, 5000000);
+	profiler_collect();
+	profiler_get_stats(stats);
+	CHECK_EQ(stats[0].count, 4u);
+	CHECK_EQ(stats[0].max_ms, 5.0);
+}
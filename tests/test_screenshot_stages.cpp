@@ -0,0 +1,782 @@
+#include "test.hpp"
+#include "mock_runtime.hpp"
+#include "screenshot.hpp"
+#include "image_encode.hpp"
+#include "pixel_pack.hpp"
+#include "thumbnail_atlas.hpp"
+#include "comparison_archive.hpp"
+
+#include <fstream>
+#include <iterator>
+
+// Runs frames until the queue is empty, returns the number of frames it took
+static uint32_t run_until_idle(mock_runtime &runtime, uint32_t max_frames = 1000)
+{
+	uint32_t frames = 0;
+	while (run_addon_frame(runtime) && frames < max_frames)
+		++frames;
+	return frames;
+}
+
+static mock_runtime make_runtime()
+{
+	mock_runtime runtime;
+	runtime.current_preset = "original.ini";
+	runtime.screenshot_directory = test_temp_directory();
+	invalidate_screenshot_directory(runtime.screenshots);
+	// Let the effects of the original preset render once
+	run_addon_frame(runtime);
+	return runtime;
+}
+
+TEST(screenshot_workload_switches_captures_and_restores)
+{
+	mock_runtime runtime = make_runtime();
+	runtime.preset_switch_latency = 5;
+
+	addon_settings settings;
+	std::filesystem::path preset = "target.ini";
+	queue_screenshot_workload(runtime.screenshots, preset, settings);
+	uint32_t frames = run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	CHECK_EQ(runtime.preset_switches.size(), size_t(2));
+	if (runtime.preset_switches.size() == 2)
+	{
+		CHECK(runtime.preset_switches[0] == "target.ini");
+		CHECK(runtime.preset_switches[1] == "original.ini");
+	}
+	// Without a readback device the settle stage waits instead of capturing
+	CHECK_EQ(runtime.capture_count, 1u);
+	// The switch latency has to pass before the settle stage starts
+	CHECK(frames >= runtime.preset_switch_latency + SETTLE_FIXED_WAIT_FRAMES);
+	CHECK(runtime.current_preset == "original.ini");
+}
+
+// Runs a screenshot workload with a readback device, returns the frames it took
+static uint32_t run_read_back_screenshot(const addon_settings &settings, uint32_t settle_frames, bool fail_copies = false)
+{
+	mock_runtime runtime = make_runtime();
+	runtime.settle_frames = settle_frames;
+	mock_readback_device gpu(runtime);
+	gpu.gpu_latency = 2;
+	gpu.fail_copies = fail_copies;
+	set_screenshot_readback_device(runtime.screenshots, &gpu);
+	queue_screenshot_workload(runtime.screenshots, "target.ini", settings);
+	uint32_t frames = run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+	// Settle samples never fall back to synchronous captures
+	CHECK_EQ(runtime.capture_count, fail_copies ? 1u : 0u);
+	CHECK_EQ(gpu.copy_count, fail_copies ? 0u : 1u);
+	CHECK(fail_copies || gpu.row_copy_count >= settings.settle_min_frames);
+	set_screenshot_readback_device(runtime.screenshots, nullptr);
+	CHECK_EQ(gpu.staging_count(), size_t(0));
+	return frames;
+}
+
+TEST(screenshot_settle_waits_for_stable_frames)
+{
+	addon_settings settings;
+	settings.settle_min_frames = 2;
+	settings.settle_max_frames = 60;
+
+	uint32_t stable_frames = run_read_back_screenshot(settings, 0);
+	uint32_t settling_frames = run_read_back_screenshot(settings, 10);
+	CHECK(settling_frames >= stable_frames + 8);
+	CHECK(settling_frames < stable_frames + settings.settle_max_frames);
+}
+
+TEST(screenshot_settle_gives_up_at_max_frames)
+{
+	addon_settings settings;
+	settings.settle_min_frames = 2;
+	settings.settle_max_frames = 20;
+
+	uint32_t stable_frames = run_read_back_screenshot(settings, 0);
+	uint32_t frames = run_read_back_screenshot(settings, 1000);
+	CHECK(frames >= stable_frames + 10);
+	CHECK(frames < settings.settle_max_frames + 10);
+}
+
+TEST(screenshot_settle_waits_fixed_frames_without_row_copies)
+{
+	addon_settings settings;
+	settings.settle_min_frames = 2;
+	settings.settle_max_frames = 60;
+
+	// Without a device, or one that cannot copy, the stage neither samples nor
+	// waits for the maximum
+	mock_runtime runtime = make_runtime();
+	runtime.settle_frames = 1000;
+	queue_screenshot_workload(runtime.screenshots, "target.ini", settings);
+	uint32_t frames = run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+	CHECK_EQ(runtime.capture_count, 1u);
+	CHECK(frames >= SETTLE_FIXED_WAIT_FRAMES);
+	CHECK(frames < SETTLE_FIXED_WAIT_FRAMES + 5);
+
+	uint32_t failed_frames = run_read_back_screenshot(settings, 1000, true);
+	CHECK(failed_frames < SETTLE_FIXED_WAIT_FRAMES + 5);
+}
+
+TEST(screenshot_batch_captures_every_preset_once)
+{
+	mock_runtime runtime = make_runtime();
+	runtime.preset_switch_latency = 2;
+
+	addon_settings settings;
+	std::vector<std::filesystem::path> presets = { "a.ini", "b.ini", "c.ini" };
+	queue_batch_screenshot_workload(runtime.screenshots, presets, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	std::vector<std::string> expected = { "a.ini", "b.ini", "c.ini", "original.ini" };
+	CHECK(runtime.preset_switches == expected);
+	CHECK_EQ(runtime.capture_count, 3u);
+}
+
+TEST(screenshot_capture_failure_still_restores_preset)
+{
+	mock_runtime runtime = make_runtime();
+	runtime.fail_captures = true;
+
+	addon_settings settings;
+	std::filesystem::path preset = "target.ini";
+	queue_screenshot_workload(runtime.screenshots, preset, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	CHECK(runtime.current_preset == "original.ini");
+	CHECK(std::filesystem::is_empty(test_temp_directory()));
+}
+
+TEST(screenshot_is_written_as_png)
+{
+	mock_runtime runtime = make_runtime();
+	addon_settings settings;
+	std::filesystem::path preset = "target.ini";
+	queue_screenshot_workload(runtime.screenshots, preset, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	size_t files = 0;
+	for (auto& entry : std::filesystem::directory_iterator(test_temp_directory()))
+	{
+		CHECK(entry.path().extension() == ".png");
+		CHECK(entry.file_size() > 8);
+		++files;
+	}
+	CHECK_EQ(files, size_t(1));
+}
+
+static std::vector<std::filesystem::path> list_screenshots()
+{
+	std::vector<std::filesystem::path> files;
+	for (auto& entry : std::filesystem::directory_iterator(test_temp_directory()))
+		files.push_back(entry.path());
+	return files;
+}
+
+TEST(screenshot_is_written_in_selected_format)
+{
+	for (auto format : { format_qoi, format_bmp })
+	{
+		mock_runtime runtime = make_runtime();
+		addon_settings settings;
+		settings.capture_format = format;
+		std::filesystem::path preset = "target.ini";
+		queue_screenshot_workload(runtime.screenshots, preset, settings);
+		run_until_idle(runtime);
+		shutdown_screenshot_workers(false);
+
+		std::vector<std::filesystem::path> files = list_screenshots();
+		CHECK_EQ(files.size(), size_t(1));
+		for (auto& file : files)
+		{
+			CHECK(file.extension() == (format == format_qoi ? ".qoi" : ".bmp"));
+			std::filesystem::remove(file);
+		}
+	}
+}
+
+TEST(screenshot_bmp_is_converted_to_png)
+{
+	mock_runtime runtime = make_runtime();
+	addon_settings settings;
+	settings.capture_format = format_bmp;
+	settings.convert_bmp_to_png = true;
+	std::filesystem::path preset = "target.ini";
+	queue_screenshot_workload(runtime.screenshots, preset, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	std::vector<std::filesystem::path> files = list_screenshots();
+	CHECK(files.size() == 1 && files[0].extension() == ".png");
+}
+
+TEST(burst_writes_every_frame_within_budget)
+{
+	mock_runtime runtime = make_runtime();
+	addon_settings settings;
+	settings.capture_format = format_qoi;
+	settings.burst_frame_count = 12;
+	std::filesystem::path preset = "target.ini";
+	queue_burst_screenshot_workload(runtime.screenshots, preset, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	std::vector<std::filesystem::path> files = list_screenshots();
+	CHECK_EQ(files.size(), size_t(12));
+	for (auto& file : files)
+		CHECK(file.filename().u8string().find(" burst ") != std::string::npos);
+	CHECK(runtime.current_preset == "original.ini");
+}
+
+TEST(burst_over_budget_waits_or_drops)
+{
+	for (auto policy : burst_overflow_policies)
+	{
+		mock_runtime runtime = make_runtime();
+		runtime.width = 512;
+		runtime.height = 512;
+		addon_settings settings;
+		settings.capture_format = format_bmp;
+		settings.burst_frame_count = 8;
+		// One megabyte holds a single 512x512 frame
+		settings.burst_memory_budget_mb = 1;
+		settings.burst_overflow = policy;
+		std::filesystem::path preset = "target.ini";
+		queue_burst_screenshot_workload(runtime.screenshots, preset, settings);
+		run_until_idle(runtime);
+		shutdown_screenshot_workers(false);
+
+		std::vector<std::filesystem::path> files = list_screenshots();
+		if (policy == burst_wait_for_encoder)
+			CHECK_EQ(files.size(), size_t(8));
+		else
+			CHECK(files.size() >= 1 && files.size() <= 8);
+		for (auto& file : files)
+			std::filesystem::remove(file);
+	}
+}
+
+TEST(burst_ring_takes_fewer_slots_when_memory_runs_out)
+{
+	burst_ring ring(4096, 8, 1 << 20, 16);
+	CHECK_EQ(ring.slot_count(), size_t(8));
+
+	// No allocator can satisfy these, the ring ends up without slots instead of throwing
+	const size_t huge_frame = SIZE_MAX / 4;
+	burst_ring impossible(huge_frame, 4, SIZE_MAX, 16);
+	CHECK_EQ(impossible.slot_count(), size_t(0));
+
+	// Budgets past 4 GB are neither truncated nor overflowed
+	addon_settings settings;
+	settings.burst_memory_budget_mb = 8192;
+	screenshot_burst_stage stage(settings);
+	CHECK_EQ(uint64_t(stage.budget_bytes), std::min<uint64_t>(uint64_t(8192) << 20, SIZE_MAX));
+}
+
+TEST(identical_workloads_are_merged)
+{
+	mock_runtime runtime = make_runtime();
+	runtime.preset_switch_latency = 3;
+	addon_settings settings;
+	settings.capture_format = format_qoi;
+
+	screenshot_workload_id first = queue_screenshot_workload(runtime.screenshots, "target.ini", settings);
+	CHECK_EQ(queue_screenshot_workload(runtime.screenshots, "target.ini", settings), first);
+	// Still switching, so a repeated press joins the running workload
+	run_addon_frame(runtime);
+	CHECK_EQ(queue_screenshot_workload(runtime.screenshots, "target.ini", settings), first);
+	// A different format is a different request
+	settings.capture_format = format_bmp;
+	CHECK(queue_screenshot_workload(runtime.screenshots, "target.ini", settings) != first);
+	CHECK_EQ(get_screenshot_workload_count(runtime.screenshots), size_t(2));
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	CHECK_EQ(list_screenshots().size(), size_t(2));
+	CHECK_EQ(get_screenshot_workload_count(runtime.screenshots), size_t(0));
+}
+
+TEST(workloads_run_by_priority_and_restore_their_start_preset)
+{
+	mock_runtime runtime = make_runtime();
+	addon_settings settings;
+	settings.capture_format = format_qoi;
+
+	queue_screenshot_workload(runtime.screenshots, "shot.ini", settings);
+	// Captures within the same millisecond share a file name
+	settings.capture_format = format_bmp;
+	queue_batch_screenshot_workload(runtime.screenshots, { "batch.ini" }, settings);
+	queue_preset_switch_workload(runtime.screenshots, "switched.ini", settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	// The switch runs first, so the captures after it return to its preset
+	std::vector<std::string> expected = { "switched.ini", "shot.ini", "switched.ini", "batch.ini", "switched.ini" };
+	CHECK(runtime.preset_switches == expected);
+	CHECK_EQ(list_screenshots().size(), size_t(2));
+}
+
+TEST(cancelled_workloads_restore_without_capturing)
+{
+	mock_runtime runtime = make_runtime();
+	runtime.preset_switch_latency = 5;
+	addon_settings settings;
+	settings.capture_format = format_qoi;
+
+	screenshot_workload_id running = queue_screenshot_workload(runtime.screenshots, "running.ini", settings);
+	screenshot_workload_id pending = queue_screenshot_workload(runtime.screenshots, "pending.ini", settings);
+	CHECK(cancel_screenshot_workload(runtime.screenshots, pending));
+	CHECK(!cancel_screenshot_workload(runtime.screenshots, pending));
+	run_addon_frame(runtime);
+	CHECK(cancel_screenshot_workload(runtime.screenshots, running));
+	CHECK(!cancel_screenshot_workload(runtime.screenshots, running));
+	// A fresh request after cancelling is not merged into the cancelled one
+	CHECK(queue_screenshot_workload(runtime.screenshots, "running.ini", settings) != running);
+	cancel_all_screenshot_workloads(runtime.screenshots);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	std::vector<std::string> expected = { "running.ini", "original.ini" };
+	CHECK(runtime.preset_switches == expected);
+	CHECK(runtime.current_preset == "original.ini");
+	CHECK(list_screenshots().empty());
+}
+
+TEST(captures_restore_the_preset_switched_to_by_uniform_diff)
+{
+	std::filesystem::path directory = test_temp_directory() / "presets";
+	std::filesystem::create_directories(directory);
+	auto write_preset = [&](const char *name, const char *content) {
+		std::ofstream(directory / name, std::ios::binary) << content;
+		return directory / name;
+	};
+	std::filesystem::path loaded = write_preset("loaded.ini", "Techniques=Tonemap@Tonemap.fx\n[Tonemap.fx]\nExposure=1.000000\n");
+	std::filesystem::path switched = write_preset("switched.ini", "Techniques=Tonemap@Tonemap.fx\n[Tonemap.fx]\nExposure=0.500000\n");
+	std::filesystem::path other = write_preset("other.ini", "Techniques=Bloom@Bloom.fx\n");
+
+	mock_runtime runtime = make_runtime();
+	runtime.current_preset = loaded;
+	runtime.add_uniform("Tonemap.fx", "Exposure", uniform_base_type::float32);
+	addon_settings settings;
+	settings.fast_preset_switch = true;
+	settings.capture_format = format_qoi;
+
+	// ReShade keeps reporting loaded.ini while switched.ini is live
+	queue_preset_switch_workload(runtime.screenshots, switched, settings);
+	run_until_idle(runtime);
+	CHECK(runtime.preset_switches.empty());
+	CHECK(runtime.current_preset == loaded);
+
+	queue_screenshot_workload(runtime.screenshots, other, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	std::vector<std::string> expected = { other.u8string(), switched.u8string() };
+	CHECK(runtime.preset_switches == expected);
+	CHECK(get_live_preset(&runtime, runtime.screenshots.preset_switch) == switched);
+}
+
+TEST(identical_frames_are_skipped_or_linked)
+{
+	for (auto policy : { duplicate_skip, duplicate_hard_link })
+	{
+		// A static scene makes every burst frame identical
+		mock_runtime runtime = make_runtime();
+		addon_settings settings;
+		settings.capture_format = format_qoi;
+		settings.burst_frame_count = 4;
+		settings.duplicate_frames = policy;
+		queue_burst_screenshot_workload(runtime.screenshots, "target.ini", settings);
+		run_until_idle(runtime);
+		shutdown_screenshot_workers(false);
+
+		std::vector<std::filesystem::path> files = list_screenshots();
+		if (policy == duplicate_skip)
+		{
+			CHECK_EQ(files.size(), size_t(1));
+		} else {
+			CHECK_EQ(files.size(), size_t(4));
+			for (auto& file : files)
+				CHECK_EQ(std::filesystem::hard_link_count(file), uintmax_t(4));
+		}
+		for (auto& file : files)
+			std::filesystem::remove(file);
+	}
+}
+
+TEST(batch_writes_contact_sheet)
+{
+	for (auto mode : { contact_sheet_alongside, contact_sheet_only })
+	{
+		mock_runtime runtime = make_runtime();
+		addon_settings settings;
+		settings.capture_format = format_bmp;
+		settings.contact_sheet = mode;
+		settings.contact_sheet_cell_width = 32;
+		queue_batch_screenshot_workload(runtime.screenshots, { "a.ini", "b.ini", "c.ini" }, settings);
+		run_until_idle(runtime);
+		shutdown_screenshot_workers(false);
+
+		std::vector<std::filesystem::path> files = list_screenshots();
+		size_t sheets = 0;
+		for (auto& file : files)
+		{
+			if (file.filename().u8string().find(" contact sheet.bmp") == std::string::npos)
+				continue;
+			++sheets;
+			std::ifstream stream(file, std::ios::binary);
+			std::vector<uint8_t> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+			std::vector<uint8_t> pixels;
+			uint32_t width = 0, height = 0;
+			CHECK(decode_bmp_rgb(data.data(), data.size(), pixels, width, height));
+			CHECK_EQ(width, 88u);
+			CHECK_EQ(height, 104u);
+		}
+		CHECK_EQ(sheets, size_t(1));
+		CHECK_EQ(files.size(), size_t(mode == contact_sheet_only ? 1 : 4));
+		for (auto& file : files)
+			std::filesystem::remove(file);
+	}
+}
+
+TEST(cancelled_batch_still_writes_contact_sheet)
+{
+	mock_runtime runtime = make_runtime();
+	addon_settings settings;
+	settings.capture_format = format_bmp;
+	settings.contact_sheet = contact_sheet_only;
+	settings.contact_sheet_cell_width = 32;
+	screenshot_workload_id id = queue_batch_screenshot_workload(runtime.screenshots, { "a.ini", "b.ini", "c.ini" }, settings);
+	// Cancel once the first preset is captured and the switch to the second one
+	// started, the other two cells stay blank
+	do
+		run_addon_frame(runtime);
+	while (runtime.screenshots.active_workload && runtime.screenshots.active_workload->current_stage < 3);
+	CHECK(cancel_screenshot_workload(runtime.screenshots, id));
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	std::vector<std::filesystem::path> files = list_screenshots();
+	CHECK_EQ(files.size(), size_t(1));
+	for (auto& file : files)
+	{
+		CHECK(file.filename().u8string().find(" contact sheet.bmp") != std::string::npos);
+		std::filesystem::remove(file);
+	}
+	std::vector<std::string> expected = { "a.ini", "b.ini", "original.ini" };
+	CHECK(runtime.preset_switches == expected);
+}
+
+TEST(batch_writes_comparison_archive)
+{
+	mock_runtime runtime = make_runtime();
+	addon_settings settings;
+	settings.comparison_archive = true;
+	std::vector<std::filesystem::path> presets = { "a.ini", "b.ini", "c.ini" };
+	queue_batch_screenshot_workload(runtime.screenshots, presets, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	std::vector<std::filesystem::path> files = list_screenshots();
+	CHECK_EQ(files.size(), size_t(1));
+	if (files.size() != 1) return;
+	CHECK(files[0].extension() == COMPARISON_ARCHIVE_EXTENSION);
+
+	comparison_archive_reader reader;
+	CHECK(reader.open(files[0]));
+	CHECK_EQ(reader.image_count(), 3u);
+	for (uint32_t i = 0; i < reader.image_count(); ++i)
+	{
+		std::vector<uint8_t> pixels;
+		uint32_t width = 0, height = 0;
+		CHECK(reader.extract(i, pixels, width, height));
+		CHECK_EQ(width, runtime.width);
+		CHECK_EQ(height, runtime.height);
+
+		runtime.current_preset = presets[i];
+		std::vector<uint8_t> expected(static_cast<size_t>(runtime.width) * runtime.height * 4);
+		runtime.draw_frame(expected.data());
+		pack_rgba_to_rgb(expected.data(), static_cast<size_t>(runtime.width) * runtime.height);
+		expected.resize(static_cast<size_t>(runtime.width) * runtime.height * 3);
+		CHECK(pixels == expected);
+	}
+	reader.close();
+}
+
+TEST(cancelled_batch_still_writes_comparison_archive)
+{
+	mock_runtime runtime = make_runtime();
+	addon_settings settings;
+	settings.comparison_archive = true;
+	screenshot_workload_id id = queue_batch_screenshot_workload(runtime.screenshots, { "a.ini", "b.ini", "c.ini" }, settings);
+	do
+		run_addon_frame(runtime);
+	while (runtime.screenshots.active_workload && runtime.screenshots.active_workload->current_stage < 3);
+	CHECK(cancel_screenshot_workload(runtime.screenshots, id));
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	std::vector<std::filesystem::path> files = list_screenshots();
+	CHECK_EQ(files.size(), size_t(1));
+	if (files.size() != 1) return;
+	comparison_archive_reader reader;
+	CHECK(reader.open(files[0]));
+	CHECK_EQ(reader.image_count(), 3u);
+	CHECK(reader.has_image(0));
+	CHECK(!reader.has_image(1));
+	CHECK(!reader.has_image(2));
+	reader.close();
+	std::filesystem::remove(files[0]);
+}
+
+TEST(capture_stores_preset_thumbnail)
+{
+	mock_runtime runtime = make_runtime();
+	std::filesystem::path directory = test_temp_directory() / "presets";
+	std::filesystem::create_directories(directory);
+	std::filesystem::path preset = directory / "target.ini";
+	std::ofstream(preset) << "Techniques=A";
+	runtime.screenshot_directory = test_temp_directory() / "captures";
+	CHECK(g_thumbnail_atlas.open(test_temp_directory() / "atlas.bin"));
+
+	addon_settings settings;
+	queue_screenshot_workload(runtime.screenshots, preset, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	std::vector<uint8_t> thumbnail;
+	CHECK(g_thumbnail_atlas.load(preset, hash_preset_file(preset), thumbnail));
+	// The original preset does not exist, so it gets no thumbnail
+	CHECK(!g_thumbnail_atlas.load("original.ini", 0, thumbnail));
+
+	// Editing the preset makes the thumbnail stale
+	std::ofstream(preset) << "Techniques=B";
+	CHECK(!g_thumbnail_atlas.load(preset, hash_preset_file(preset), thumbnail));
+	g_thumbnail_atlas.close();
+}
+
+TEST(thumbnail_follows_the_preset_switched_to_by_uniform_diff)
+{
+	mock_runtime runtime = make_runtime();
+	std::filesystem::path directory = test_temp_directory() / "presets";
+	std::filesystem::create_directories(directory);
+	std::filesystem::path loaded = directory / "loaded.ini";
+	std::filesystem::path target = directory / "target.ini";
+	std::ofstream(loaded) << "Techniques=Tonemap@Tonemap.fx\n[Tonemap.fx]\nExposure=1.000000\n";
+	std::ofstream(target) << "Techniques=Tonemap@Tonemap.fx\n[Tonemap.fx]\nExposure=0.500000\n";
+	runtime.current_preset = loaded;
+	runtime.add_uniform("Tonemap.fx", "Exposure", uniform_base_type::float32);
+	runtime.screenshot_directory = test_temp_directory() / "captures";
+	CHECK(g_thumbnail_atlas.open(test_temp_directory() / "atlas.bin"));
+
+	addon_settings settings;
+	settings.fast_preset_switch = true;
+	queue_screenshot_workload(runtime.screenshots, target, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	// ReShade kept reporting loaded.ini during the capture
+	CHECK(runtime.preset_switches.empty());
+	std::vector<uint8_t> thumbnail;
+	CHECK(g_thumbnail_atlas.load(target, hash_preset_file(target), thumbnail));
+	CHECK(!g_thumbnail_atlas.load(loaded, hash_preset_file(loaded), thumbnail));
+	g_thumbnail_atlas.close();
+}
+
+TEST(captures_in_the_same_millisecond_get_distinct_names)
+{
+	mock_runtime runtime = make_runtime();
+	addon_settings settings;
+	settings.capture_format = format_bmp;
+	settings.settle_min_frames = 1;
+	// Every capture of the batch lands within a few frames, the directory is
+	// only resolved once for all of them
+	std::vector<std::filesystem::path> presets;
+	for (int i = 0; i < 8; ++i)
+		presets.push_back("p" + std::to_string(i) + ".ini");
+	queue_batch_screenshot_workload(runtime.screenshots, presets, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	CHECK_EQ(list_screenshots().size(), size_t(8));
+	CHECK_EQ(runtime.screenshot_directory_queries, 1u);
+}
+
+TEST(warm_up_loads_every_preset_and_reports_latency)
+{
+	mock_runtime runtime = make_runtime();
+	runtime.preset_switch_latency = 1;
+	runtime.first_load_latency = 6;
+	addon_settings settings;
+	// Warm-up always reloads in full, even with fast switching enabled
+	settings.fast_preset_switch = true;
+	queue_preset_warm_up_workload(runtime.screenshots, { "a.ini", "b.ini" }, settings);
+	run_until_idle(runtime);
+
+	std::vector<std::string> expected = { "a.ini", "b.ini", "original.ini" };
+	CHECK(runtime.preset_switches == expected);
+	CHECK_EQ(runtime.capture_count, 0u);
+
+	std::shared_ptr<const preset_warm_up_report> report = get_preset_warm_up_report(runtime.screenshots);
+	CHECK(report != nullptr);
+	CHECK_EQ(report->preset_count, size_t(2));
+	CHECK_EQ(report->entries.size(), size_t(2));
+	uint32_t warm_up_frames = report->entries[0].frames;
+	CHECK(report->entries[0].preset == "a.ini");
+	CHECK(!report->entries[0].timed_out);
+	CHECK(warm_up_frames > runtime.first_load_latency);
+
+	// The first switch during gameplay now only pays the regular latency
+	queue_preset_switch_workload(runtime.screenshots, "a.ini", settings);
+	uint32_t switch_frames = run_until_idle(runtime);
+	CHECK(switch_frames < warm_up_frames);
+	CHECK(runtime.current_preset == "a.ini");
+}
+
+TEST(warm_up_restores_the_original_preset_in_full)
+{
+	std::filesystem::path directory = test_temp_directory() / "presets";
+	std::filesystem::create_directories(directory);
+	std::filesystem::path original = directory / "original.ini";
+	std::filesystem::path warmed = directory / "warmed.ini";
+	std::ofstream(original) << "Techniques=Tonemap@Tonemap.fx\n[Tonemap.fx]\nExposure=1.000000\n";
+	std::ofstream(warmed) << "Techniques=Tonemap@Tonemap.fx\n[Tonemap.fx]\nExposure=0.500000\n";
+
+	mock_runtime runtime = make_runtime();
+	runtime.current_preset = original;
+	runtime.add_uniform("Tonemap.fx", "Exposure", uniform_base_type::float32);
+	addon_settings settings;
+	settings.fast_preset_switch = true;
+	// Both presets share an effect setup, so a uniform diff could restore
+	queue_preset_warm_up_workload(runtime.screenshots, { warmed }, settings);
+	run_until_idle(runtime);
+
+	std::vector<std::string> expected = { warmed.u8string(), original.u8string() };
+	CHECK(runtime.preset_switches == expected);
+	CHECK(runtime.current_preset == original);
+}
+
+TEST(runtimes_run_their_workloads_independently)
+{
+	// Two swapchains, e.g. both eyes of a VR headset, rendering interleaved
+	mock_runtime left = make_runtime();
+	mock_runtime right = make_runtime();
+	left.preset_switch_latency = 1;
+	right.preset_switch_latency = 20;
+	addon_settings settings;
+	queue_screenshot_workload(left.screenshots, "left.ini", settings);
+	queue_screenshot_workload(right.screenshots, "right.ini", settings);
+	CHECK_EQ(get_screenshot_workload_count(left.screenshots), size_t(1));
+	CHECK_EQ(get_screenshot_workload_count(right.screenshots), size_t(1));
+
+	uint32_t left_frames = 0;
+	uint32_t right_frames = 0;
+	bool left_busy = true;
+	bool right_busy = true;
+	while ((left_busy || right_busy) && right_frames < 1000)
+	{
+		if (left_busy && (left_busy = run_addon_frame(left)))
+			++left_frames;
+		if (right_busy && (right_busy = run_addon_frame(right)))
+			++right_frames;
+	}
+	shutdown_screenshot_workers(false);
+
+	// The renders of one runtime must not settle the preset switch of the other
+	CHECK(left_frames < right_frames);
+	CHECK(right_frames >= right.preset_switch_latency + settings.settle_min_frames);
+	std::vector<std::string> left_expected = { "left.ini", "original.ini" };
+	std::vector<std::string> right_expected = { "right.ini", "original.ini" };
+	CHECK(left.preset_switches == left_expected);
+	CHECK(right.preset_switches == right_expected);
+	CHECK_EQ(left.capture_count, right.capture_count);
+	CHECK_EQ(list_screenshots().size(), size_t(2));
+}
+
+TEST(captures_are_read_back_without_stalling)
+{
+	mock_runtime runtime = make_runtime();
+	mock_readback_device gpu(runtime);
+	gpu.gpu_latency = 2;
+	set_screenshot_readback_device(runtime.screenshots, &gpu);
+	addon_settings settings;
+	settings.capture_format = format_bmp;
+	queue_screenshot_workload(runtime.screenshots, "target.ini", settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	// The settle stage only copies the rows it compares, nothing is captured synchronously
+	CHECK_EQ(runtime.capture_count, 0u);
+	CHECK_EQ(gpu.copy_count, 1u);
+	CHECK(gpu.row_copy_count >= settings.settle_min_frames);
+	CHECK_EQ(gpu.read_count, gpu.copy_count + gpu.row_copy_count);
+	CHECK(runtime.current_preset == "original.ini");
+
+	// The frame was copied under the target preset, not the restored one
+	std::vector<std::filesystem::path> files = list_screenshots();
+	CHECK_EQ(files.size(), size_t(1));
+	if (files.size() == 1)
+	{
+		std::ifstream file(files[0], std::ios::binary);
+		std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		std::vector<uint8_t> expected;
+		runtime.current_preset = "target.ini";
+		std::vector<uint8_t> rgba(static_cast<size_t>(runtime.width) * runtime.height * 4);
+		runtime.draw_frame(rgba.data());
+		pack_rgba_to_rgb(rgba.data(), static_cast<size_t>(runtime.width) * runtime.height);
+		CHECK(encode_screenshot_image(format_bmp, rgba.data(), runtime.width, runtime.height, expected));
+		CHECK(data == expected);
+	}
+
+	set_screenshot_readback_device(runtime.screenshots, nullptr);
+	CHECK_EQ(gpu.staging_count(), size_t(0));
+}
+
+TEST(settle_samples_leave_the_capture_slots_free)
+{
+	// Every settle sample is still in flight when the capture starts
+	mock_runtime runtime = make_runtime();
+	mock_readback_device gpu(runtime);
+	gpu.gpu_latency = SIGNATURE_READBACK_SLOTS;
+	set_screenshot_readback_device(runtime.screenshots, &gpu);
+	addon_settings settings;
+	settings.capture_format = format_qoi;
+	settings.settle_min_frames = 2;
+	std::vector<std::filesystem::path> presets = { "a.ini", "b.ini", "c.ini" };
+	queue_batch_screenshot_workload(runtime.screenshots, presets, settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	CHECK_EQ(runtime.capture_count, 0u);
+	CHECK_EQ(gpu.copy_count, 3u);
+	CHECK_EQ(list_screenshots().size(), size_t(3));
+	// Signature rows never take a full frame staging buffer
+	CHECK(gpu.staging_created <= FRAME_READBACK_SLOTS);
+	set_screenshot_readback_device(runtime.screenshots, nullptr);
+	CHECK_EQ(gpu.staging_count(), size_t(0));
+}
+
+TEST(burst_frames_are_read_back_through_the_staging_pool)
+{
+	mock_runtime runtime = make_runtime();
+	mock_readback_device gpu(runtime);
+	gpu.gpu_latency = 2;
+	set_screenshot_readback_device(runtime.screenshots, &gpu);
+	addon_settings settings;
+	settings.capture_format = format_qoi;
+	settings.burst_frame_count = 12;
+	queue_burst_screenshot_workload(runtime.screenshots, "target.ini", settings);
+	run_until_idle(runtime);
+	shutdown_screenshot_workers(false);
+
+	CHECK_EQ(list_screenshots().size(), size_t(12));
+	CHECK_EQ(runtime.capture_count, 0u);
+	CHECK_EQ(gpu.copy_count, 12u);
+	// Copies overlap by the GPU latency, the pool never grows past its slots
+	CHECK(gpu.staging_created <= FRAME_READBACK_SLOTS);
+	set_screenshot_readback_device(runtime.screenshots, nullptr);
+}
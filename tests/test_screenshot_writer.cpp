@@ -0,0 +1,50 @@
+#include "test.hpp"
+#include "screenshot_writer.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+static std::vector<uint8_t> read_file(const std::filesystem::path &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+TEST(screenshot_writer_writes_exact_contents_in_every_mode)
+{
+	screenshot_writer writer;
+	// Sizes around the alignment and block boundaries, direct writes pad and truncate
+	const size_t sizes[] = { 0, 1, SCREENSHOT_WRITE_ALIGNMENT, SCREENSHOT_WRITE_ALIGNMENT + 1, SCREENSHOT_WRITE_BLOCK_SIZE + 123 };
+	for (auto mode : screenshot_write_modes)
+	{
+		for (size_t size : sizes)
+		{
+			std::vector<uint8_t> data(size);
+			for (size_t i = 0; i < size; ++i)
+				data[i] = static_cast<uint8_t>(i * 31 + mode);
+			std::filesystem::path path = test_temp_directory() / "nested" / ("file" + std::to_string(size));
+			CHECK(writer.write(path, data.data(), data.size(), mode));
+			CHECK(read_file(path) == data);
+		}
+	}
+
+	// Writing again replaces a longer file
+	std::filesystem::path path = test_temp_directory() / "nested" / "file1";
+	const uint8_t byte = 7;
+	CHECK(writer.write(path, &byte, 0, write_direct));
+	CHECK_EQ(std::filesystem::file_size(path), uintmax_t(0));
+}
+
+TEST(screenshot_writer_recreates_removed_directory)
+{
+	screenshot_writer writer;
+	std::filesystem::path directory = test_temp_directory() / "out";
+	const uint8_t data[3] = { 1, 2, 3 };
+	CHECK(writer.write(directory / "a.bmp", data, sizeof(data), write_cached));
+
+	// The directory is remembered, a failed write checks it again
+	std::filesystem::remove_all(directory);
+	CHECK(writer.write(directory / "b.bmp", data, sizeof(data), write_cached));
+	CHECK_EQ(read_file(directory / "b.bmp").size(), size_t(3));
+}
@@ -0,0 +1,99 @@
+#include "test.hpp"
+#include "thumbnail_atlas.hpp"
+
+#include <fstream>
+#include <vector>
+
+static std::vector<uint8_t> solid_frame(uint32_t width, uint32_t height, uint8_t value)
+{
+	return std::vector<uint8_t>(static_cast<size_t>(width) * height * 3, value);
+}
+
+TEST(thumbnail_atlas_round_trips_and_letterboxes)
+{
+	thumbnail_atlas atlas;
+	CHECK(atlas.open(test_temp_directory() / "atlas.bin"));
+
+	// 4:3 into 16:9, bars on the left and right
+	std::vector<uint8_t> frame = solid_frame(400, 300, 200);
+	uint32_t generation = atlas.generation();
+	atlas.store("presets/a.ini", 11, frame.data(), 400, 300);
+	CHECK(atlas.generation() != generation);
+
+	std::vector<uint8_t> thumbnail;
+	CHECK(atlas.load("presets/./a.ini", 11, thumbnail));
+	CHECK_EQ(thumbnail.size(), size_t(THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT * 3));
+	CHECK_EQ(int(thumbnail[0]), 0);
+	CHECK_EQ(int(thumbnail[(THUMBNAIL_HEIGHT / 2 * THUMBNAIL_WIDTH + THUMBNAIL_WIDTH / 2) * 3]), 200);
+	CHECK(!atlas.load("presets/b.ini", 11, thumbnail));
+}
+
+TEST(thumbnail_atlas_drops_stale_entries)
+{
+	thumbnail_atlas atlas;
+	CHECK(atlas.open(test_temp_directory() / "atlas.bin"));
+	std::vector<uint8_t> frame = solid_frame(64, 36, 90);
+	atlas.store("a.ini", 11, frame.data(), 64, 36);
+
+	std::vector<uint8_t> thumbnail;
+	CHECK(!atlas.load("a.ini", 12, thumbnail));
+	// Dropped, so the old hash no longer matches either
+	CHECK(!atlas.load("a.ini", 11, thumbnail));
+}
+
+TEST(thumbnail_atlas_persists_across_opens)
+{
+	std::filesystem::path path = test_temp_directory() / "atlas.bin";
+	std::vector<uint8_t> frame = solid_frame(64, 36, 90);
+	{
+		thumbnail_atlas atlas;
+		CHECK(atlas.open(path));
+		atlas.store("a.ini", 11, frame.data(), 64, 36);
+		atlas.close();
+	}
+
+	thumbnail_atlas atlas;
+	CHECK(atlas.open(path));
+	std::vector<uint8_t> thumbnail;
+	CHECK(atlas.load("a.ini", 11, thumbnail));
+	CHECK_EQ(int(thumbnail[(THUMBNAIL_HEIGHT / 2 * THUMBNAIL_WIDTH + THUMBNAIL_WIDTH / 2) * 3]), 90);
+	atlas.close();
+
+	// A file from another version is reset rather than misread
+	{
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(4);
+		file.put(99);
+	}
+	CHECK(atlas.open(path));
+	CHECK(!atlas.load("a.ini", 11, thumbnail));
+}
+
+TEST(thumbnail_atlas_replaces_oldest_when_full)
+{
+	thumbnail_atlas atlas;
+	CHECK(atlas.open(test_temp_directory() / "atlas.bin"));
+	std::vector<uint8_t> frame = solid_frame(16, 9, 50);
+	for (int i = 0; i < THUMBNAIL_CAPACITY; ++i)
+		atlas.store("preset" + std::to_string(i) + ".ini", 1, frame.data(), 16, 9);
+	// Storing again refreshes an entry instead of taking a new one
+	atlas.store("preset0.ini", 1, frame.data(), 16, 9);
+	atlas.store("new.ini", 1, frame.data(), 16, 9);
+
+	std::vector<uint8_t> thumbnail;
+	CHECK(atlas.load("new.ini", 1, thumbnail));
+	CHECK(atlas.load("preset0.ini", 1, thumbnail));
+	CHECK(!atlas.load("preset1.ini", 1, thumbnail));
+	CHECK(atlas.load("preset2.ini", 1, thumbnail));
+}
+
+TEST(hash_preset_file_follows_contents)
+{
+	std::filesystem::path path = test_temp_directory() / "preset.ini";
+	CHECK_EQ(hash_preset_file(path), uint64_t(0));
+	std::ofstream(path) << "Techniques=A";
+	uint64_t first = hash_preset_file(path);
+	CHECK(first != 0);
+	std::ofstream(path) << "Techniques=B";
+	CHECK(hash_preset_file(path) != first);
+}
@@ -0,0 +1,89 @@
+#include "comparison_archive.hpp"
+#include "png_encode.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static int usage()
+{
+	fprintf(stderr,
+		"usage: preset_comparison_extract <archive> --list\n"
+		"       preset_comparison_extract <archive> <image> <output.png>\n"
+		"<image> is the number from --list or the preset name\n");
+	return 2;
+}
+
+// Matches the number first, preset names are never plain numbers
+static bool find_image(const comparison_archive_reader &reader, const char *name, uint32_t &index)
+{
+	char *end = nullptr;
+	unsigned long number = strtoul(name, &end, 10);
+	if (*name != '\0' && *end == '\0' && number < reader.image_count())
+	{
+		index = static_cast<uint32_t>(number);
+		return true;
+	}
+	for (uint32_t i = 0; i < reader.image_count(); ++i)
+	{
+		if (reader.label(i) == name)
+		{
+			index = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Rebuilds single PNGs from a comparison archive written by Capture All Presets
+int main(int argc, char **argv)
+{
+	if (argc != 3 && argc != 4)
+		return usage();
+
+	comparison_archive_reader reader;
+	if (!reader.open(std::filesystem::u8path(argv[1])))
+	{
+		fprintf(stderr, "%s is not a comparison archive\n", argv[1]);
+		return 1;
+	}
+
+	if (argc == 3)
+	{
+		if (strcmp(argv[2], "--list") != 0)
+			return usage();
+		for (uint32_t i = 0; i < reader.image_count(); ++i)
+			printf("%3u  %s%s\n", i, reader.label(i).c_str(), reader.has_image(i) ? "" : "  (not captured)");
+		return 0;
+	}
+
+	uint32_t index;
+	if (!find_image(reader, argv[2], index))
+	{
+		fprintf(stderr, "No image %s in the archive\n", argv[2]);
+		return 1;
+	}
+
+	init_png_encode();
+	std::vector<uint8_t> pixels, png;
+	uint32_t width, height;
+	bool extracted = reader.extract(index, pixels, width, height) && encode_png_rgb(pixels.data(), width, height, png);
+	shutdown_png_workers(false);
+	if (!extracted)
+	{
+		fprintf(stderr, "Failed to extract image %u\n", index);
+		return 1;
+	}
+
+	std::ofstream file(std::filesystem::u8path(argv[3]), std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char *>(png.data()), static_cast<std::streamsize>(png.size()));
+	if (!file)
+	{
+		fprintf(stderr, "Failed to write %s\n", argv[3]);
+		return 1;
+	}
+	return 0;
+}